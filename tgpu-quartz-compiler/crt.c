@@ -2,6 +2,7 @@
 
 #include "stdio.h"
 #include "stdlib.h"
+#include "string.h"
 
 #ifdef TARGET_TGPU_QUARTZ
 # include "target/tgpu_quartz_gen.c"
@@ -9,76 +10,600 @@
 # include "target/tgpu_quartz_emit.c"
 # include "target/tgpu_quartz_types.c"
 # include "target/tgpu_quartz_symtab.c"
+# include "target/tgpu_quartz_ir.c"
+# include "target/tgpu_quartz_fold.c"
+# include "target/tgpu_quartz_gvn.c"
+# include "target/tgpu_quartz_licm.c"
+# include "target/tgpu_quartz_slp.c"
+# include "target/tgpu_quartz_contract.c"
+# include "target/tgpu_quartz_strength.c"
+# include "target/tgpu_quartz_dce.c"
+# include "target/tgpu_quartz_opt.c"
+# include "target/tgpu_quartz_regalloc.c"
+# include "target/tgpu_quartz_isel.c"
 #else
 #error [Err] Invalid target;
 #endif
 
-list_t* list_new(void) {
-    list_t* new_list = (list_t*)malloc(sizeof(list_t));
-    if (!new_list) {
-        perror("malloc failed");
+// ============================================================================
+// ALLOCATION
+// ============================================================================
+
+crt_alloc_stats_t crt_alloc_stats;
+
+static void* crt_check_alloc(void* ptr, const char* what) {
+    if (!ptr) {
+        perror(what);
         exit(EXIT_FAILURE);
     }
-    new_list->len = 0;
-    new_list->last = NULL;
-    return new_list;
+    return ptr;
+}
+
+void* crt_malloc(size_t size) {
+    crt_alloc_stats.heap_allocs++;
+    crt_alloc_stats.heap_bytes += size;
+    return crt_check_alloc(malloc(size), "malloc failed");
 }
 
+void* crt_calloc(size_t count, size_t size) {
+    crt_alloc_stats.heap_allocs++;
+    crt_alloc_stats.heap_bytes += count * size;
+    return crt_check_alloc(calloc(count, size), "calloc failed");
+}
 
-list_node_t* list_new_node(void* value) {
-    list_node_t* new_node = (list_node_t*)malloc(sizeof(list_node_t));
-    if (!new_node) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
+// Growing a buffer counts the full new size as allocated
+void* crt_realloc(void* ptr, size_t size) {
+    crt_alloc_stats.heap_allocs++;
+    crt_alloc_stats.heap_bytes += size;
+    return crt_check_alloc(realloc(ptr, size), "realloc failed");
+}
+
+// ============================================================================
+// RESERVED WORDS
+// ============================================================================
+
+#include "reserved_words.h"
+
+const ReservedWord* reserved_lookup(const char* str, int len) {
+    if (len < 2) {
+        return NULL;
+    }
+
+    unsigned int h = RESERVED_HASH((unsigned int)len, (unsigned char)str[0],
+                                   (unsigned char)str[len - 2], (unsigned char)str[len - 1]);
+    int slot = reserved_slots[h];
+    if (slot == 0) {
+        return NULL;
+    }
+
+    const ReservedWord* word = &reserved_words[slot - 1];
+    if (word->length != len || memcmp(word->name, str, len) != 0) {
+        return NULL;
     }
-    new_node->data = value;
-    new_node->next = NULL;
-    return new_node;
+    return word;
 }
 
-void list_append(list_t *list, void* value) {
-    list_node_t* new_node = list_new_node(value);
-    list->len += 1;
+// ============================================================================
+// ARENA ALLOCATOR
+// ============================================================================
 
-    if (list->last == NULL) {
-        list->last = new_node;
-        return;
+static arena_block_t* arena_new_block(size_t size) {
+    arena_block_t* block = (arena_block_t*)crt_malloc(sizeof(arena_block_t) + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+arena_t* arena_new(size_t block_size) {
+    arena_t* arena = (arena_t*)crt_malloc(sizeof(arena_t));
+    arena->block_size = block_size;
+    arena->head = arena_new_block(block_size);
+    return arena;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    crt_alloc_stats.arena_allocs++;
+    crt_alloc_stats.arena_bytes += size;
+
+    arena_block_t* head = arena->head;
+    if (head->used + size <= head->size) {
+        void* ptr = head->data + head->used;
+        head->used += size;
+        return ptr;
     }
 
-    list_node_t* current = list->last;
-    while (current->next != NULL) {
-        current = current->next;
+    // Oversized requests get a dedicated block behind the current one so
+    // the remaining space of the head block is not wasted.
+    if (size > arena->block_size / 4) {
+        arena_block_t* block = arena_new_block(size);
+        block->used = size;
+        block->next = head->next;
+        head->next = block;
+        return block->data;
     }
-    current->next = new_node;
+
+    arena_block_t* block = arena_new_block(arena->block_size);
+    block->next = head;
+    arena->head = block;
+    block->used = size;
+    return block->data;
 }
 
+void* arena_calloc(arena_t* arena, size_t count, size_t size) {
+    void* ptr = arena_alloc(arena, count * size);
+    memset(ptr, 0, count * size);
+    return ptr;
+}
 
-void* list_index(list_t* list, size_t index) {
-    if (!list || index >= list->len) {
-        return NULL;
+char* arena_strndup(arena_t* arena, const char* str, size_t len) {
+    char* copy = (char*)arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arena_strdup(arena_t* arena, const char* str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+void arena_free(arena_t* arena) {
+    arena_block_t* block = arena->head;
+    while (block != NULL) {
+        arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+// ============================================================================
+// STRING INTERNING
+// ============================================================================
+
+#define INTERN_INITIAL_CAPACITY 1024
+
+// Open-addressing table of interned strings, grown at 3/4 load. The strings
+// themselves are bump-allocated from a private arena.
+static struct {
+    interned_str_t** slots;
+    size_t capacity;
+    size_t count;
+    arena_t* storage;
+} intern_table;
+
+static unsigned int intern_hash(const char* str, size_t len) {
+    unsigned int hash = 2166136261u;        // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
     }
+    return hash;
+}
 
-    list_node_t* current = list->last;
-    size_t i = 0;
+static interned_str_t* intern_header(const char* interned) {
+    return (interned_str_t*)(interned - offsetof(interned_str_t, text));
+}
 
-    while (current != NULL) {
-        if (i == index) {
-            return current->data;
+static void intern_grow(void) {
+    size_t capacity = intern_table.capacity ? intern_table.capacity * 2 : INTERN_INITIAL_CAPACITY;
+    interned_str_t** slots = (interned_str_t**)crt_calloc(capacity, sizeof(interned_str_t*));
+
+    for (size_t i = 0; i < intern_table.capacity; i++) {
+        interned_str_t* entry = intern_table.slots[i];
+        if (!entry) continue;
+        size_t slot = entry->hash & (capacity - 1);
+        while (slots[slot]) {
+            slot = (slot + 1) & (capacity - 1);
         }
-        current = current->next;
-        i++;
+        slots[slot] = entry;
     }
 
-    return NULL;
+    free(intern_table.slots);
+    intern_table.slots = slots;
+    intern_table.capacity = capacity;
 }
 
+const char* str_intern_n(const char* str, size_t len) {
+    if ((intern_table.count + 1) * 4 > intern_table.capacity * 3) {
+        intern_grow();
+    }
+    if (!intern_table.storage) {
+        intern_table.storage = arena_new(16 * 1024);
+    }
+
+    unsigned int hash = intern_hash(str, len);
+    size_t mask = intern_table.capacity - 1;
+    size_t slot = hash & mask;
 
-void list_free(list_t* list) {
-    list_node_t* current = list->last;
-    while (current != NULL) {
-        list_node_t* temp = current;
-        current = current->next;
-        free(temp);
+    interned_str_t* entry;
+    while ((entry = intern_table.slots[slot]) != NULL) {
+        if (entry->hash == hash && (size_t)entry->length == len &&
+            memcmp(entry->text, str, len) == 0) {
+            return entry->text;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    entry = (interned_str_t*)arena_alloc(intern_table.storage, sizeof(interned_str_t) + len + 1);
+    entry->hash = hash;
+    entry->length = (int)len;
+    memcpy(entry->text, str, len);
+    entry->text[len] = '\0';
+
+    intern_table.slots[slot] = entry;
+    intern_table.count++;
+    return entry->text;
+}
+
+const char* str_intern(const char* str) {
+    return str_intern_n(str, strlen(str));
+}
+
+unsigned int str_hash(const char* interned) {
+    return intern_header(interned)->hash;
+}
+
+int str_length(const char* interned) {
+    return intern_header(interned)->length;
+}
+
+void str_intern_free(void) {
+    free(intern_table.slots);
+    if (intern_table.storage) {
+        arena_free(intern_table.storage);
+    }
+    memset(&intern_table, 0, sizeof(intern_table));
+}
+
+// ============================================================================
+// FLAT AST
+// ============================================================================
+
+// Builder state. AST strings are interned, so the pool is deduplicated with
+// a pointer-keyed map from string to pool offset.
+typedef struct {
+    FlatAst* ast;
+    const char** keys;
+    uint32_t* offsets;
+    uint32_t capacity;
+    uint32_t count;
+} flat_builder_t;
+
+static void* flat_reserve(void* array, uint32_t* capacity, uint32_t needed, size_t elem_size) {
+    if (needed <= *capacity) {
+        return array;
+    }
+    uint32_t capacity_new = *capacity ? *capacity : 64;
+    while (capacity_new < needed) {
+        capacity_new *= 2;
+    }
+    array = crt_realloc(array, capacity_new * elem_size);
+    *capacity = capacity_new;
+    return array;
+}
+
+static void flat_string_map_grow(flat_builder_t* b) {
+    uint32_t capacity = b->capacity ? b->capacity * 2 : 256;
+    const char** keys = (const char**)crt_calloc(capacity, sizeof(const char*));
+    uint32_t* offsets = (uint32_t*)crt_malloc(capacity * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < b->capacity; i++) {
+        if (!b->keys[i]) continue;
+        uint32_t slot = str_hash(b->keys[i]) & (capacity - 1);
+        while (keys[slot]) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        keys[slot] = b->keys[i];
+        offsets[slot] = b->offsets[i];
+    }
+
+    free(b->keys);
+    free(b->offsets);
+    b->keys = keys;
+    b->offsets = offsets;
+    b->capacity = capacity;
+}
+
+static uint32_t flat_string(flat_builder_t* b, const char* str) {
+    if (!str) {
+        return 0;
+    }
+    if ((b->count + 1) * 4 > b->capacity * 3) {
+        flat_string_map_grow(b);
+    }
+
+    uint32_t mask = b->capacity - 1;
+    uint32_t slot = str_hash(str) & mask;
+    while (b->keys[slot]) {
+        if (b->keys[slot] == str) {
+            return b->offsets[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    FlatAst* ast = b->ast;
+    uint32_t len = (uint32_t)str_length(str);
+    uint32_t offset = ast->string_size;
+    ast->strings = (char*)flat_reserve(ast->strings, &ast->string_capacity,
+                                       offset + len + 1, sizeof(char));
+    memcpy(ast->strings + offset, str, len + 1);
+    ast->string_size += len + 1;
+
+    b->keys[slot] = str;
+    b->offsets[slot] = offset;
+    b->count++;
+    return offset;
+}
+
+// Reserve `count` consecutive list entries; returns the first one
+static uint32_t flat_list(FlatAst* ast, uint32_t count) {
+    uint32_t start = ast->list_count;
+    ast->lists = (uint32_t*)flat_reserve(ast->lists, &ast->list_capacity,
+                                         start + count, sizeof(uint32_t));
+    ast->list_count += count;
+    return start;
+}
+
+static ast_index_t flat_build_node(flat_builder_t* b, ASTNode* node);
+
+// Flatten a list of child nodes into a reserved range. Children append
+// their own lists after the range, so it stays contiguous.
+static void flat_build_children(flat_builder_t* b, FlatNode* flat, ASTNode** nodes, int count) {
+    flat->list_start = flat_list(b->ast, count);
+    flat->list_count = count;
+    for (int i = 0; i < count; i++) {
+        ast_index_t child = flat_build_node(b, nodes[i]);
+        b->ast->lists[flat->list_start + i] = child;
+    }
+}
+
+// Qualifiers followed by (type, name) pairs, or (type, name, array_size)
+// triples when `sizes` is set
+static void flat_build_strings(flat_builder_t* b, FlatNode* flat,
+                               const char** qualifiers, int qualifier_count,
+                               Parameter* pairs, int pair_count, bool sizes) {
+    int stride = sizes ? 3 : 2;
+    uint32_t count = qualifier_count + stride * pair_count;
+    uint32_t start = flat_list(b->ast, count);
+    flat->list_start = start;
+    flat->list_count = count;
+    flat->qualifier_count = qualifier_count;
+
+    for (int i = 0; i < qualifier_count; i++) {
+        uint32_t offset = flat_string(b, qualifiers[i]);
+        b->ast->lists[start++] = offset;
+    }
+    for (int i = 0; i < pair_count; i++) {
+        uint32_t type = flat_string(b, pairs[i].type);
+        uint32_t name = flat_string(b, pairs[i].name);
+        b->ast->lists[start++] = type;
+        b->ast->lists[start++] = name;
+        if (sizes) {
+            uint32_t size = flat_string(b, pairs[i].array_size);
+            b->ast->lists[start++] = size;
+        }
+    }
+}
+
+static ast_index_t flat_build_node(flat_builder_t* b, ASTNode* node) {
+    if (!node) {
+        return 0;
+    }
+
+    FlatAst* ast = b->ast;
+    ast_index_t index = ast->node_count;
+    ast->nodes = (FlatNode*)flat_reserve(ast->nodes, &ast->node_capacity,
+                                         index + 1, sizeof(FlatNode));
+    ast->node_count++;
+
+    // Children may grow the node array, so fill a local copy first
+    FlatNode flat;
+    memset(&flat, 0, sizeof(flat));
+    flat.type = (uint8_t)node->type;
+
+    switch (node->type) {
+        case AST_PROGRAM:
+            flat_build_children(b, &flat, node->data.program.declarations,
+                                node->data.program.decl_count);
+            break;
+
+        case AST_FUNCTION_DECL:
+            flat.str[0] = flat_string(b, node->data.func_decl.name);
+            flat.str[1] = flat_string(b, node->data.func_decl.return_type);
+            flat_build_strings(b, &flat, node->data.func_decl.qualifiers,
+                               node->data.func_decl.qualifier_count,
+                               node->data.func_decl.params, node->data.func_decl.param_count, false);
+            flat.child[0] = flat_build_node(b, node->data.func_decl.body);
+            break;
+
+        case AST_VARIABLE_DECL:
+            flat.str[0] = flat_string(b, node->data.var_decl.name);
+            flat.str[1] = flat_string(b, node->data.var_decl.type);
+            flat.str[2] = flat_string(b, node->data.var_decl.array_size);
+            flat.is_array = node->data.var_decl.is_array;
+            flat_build_strings(b, &flat, node->data.var_decl.qualifiers,
+                               node->data.var_decl.qualifier_count, NULL, 0, false);
+            flat.child[0] = flat_build_node(b, node->data.var_decl.initializer);
+            break;
+
+        case AST_STRUCT_DECL:
+            flat.str[0] = flat_string(b, node->data.struct_decl.name);
+            flat_build_strings(b, &flat, NULL, 0, node->data.struct_decl.fields,
+                               node->data.struct_decl.field_count, true);
+            break;
+
+        case AST_BLOCK_STMT:
+            flat_build_children(b, &flat, node->data.block_stmt.statements,
+                                node->data.block_stmt.statement_count);
+            break;
+
+        case AST_EXPRESSION_STMT:
+            flat.child[0] = flat_build_node(b, node->data.expr_stmt.expression);
+            break;
+
+        case AST_IF_STMT:
+            flat.child[0] = flat_build_node(b, node->data.if_stmt.condition);
+            flat.child[1] = flat_build_node(b, node->data.if_stmt.consequent);
+            flat.child[2] = flat_build_node(b, node->data.if_stmt.alternate);
+            break;
+
+        case AST_FOR_STMT:
+            flat.child[0] = flat_build_node(b, node->data.for_stmt.init);
+            flat.child[1] = flat_build_node(b, node->data.for_stmt.test);
+            flat.child[2] = flat_build_node(b, node->data.for_stmt.update);
+            flat.child[3] = flat_build_node(b, node->data.for_stmt.body);
+            flat.unroll = node->data.for_stmt.unroll;
+            break;
+
+        case AST_WHILE_STMT:
+            flat.child[0] = flat_build_node(b, node->data.while_stmt.test);
+            flat.child[1] = flat_build_node(b, node->data.while_stmt.body);
+            flat.unroll = node->data.while_stmt.unroll;
+            break;
+
+        case AST_RETURN_STMT:
+            flat.child[0] = flat_build_node(b, node->data.return_stmt.argument);
+            break;
+
+        case AST_BREAK_STMT:
+        case AST_CONTINUE_STMT:
+            break;
+
+        case AST_BINARY_EXPR:
+            flat.str[0] = flat_string(b, node->data.binary_expr.operator);
+            flat.child[0] = flat_build_node(b, node->data.binary_expr.left);
+            flat.child[1] = flat_build_node(b, node->data.binary_expr.right);
+            break;
+
+        case AST_UNARY_EXPR:
+            flat.str[0] = flat_string(b, node->data.unary_expr.operator);
+            flat.child[0] = flat_build_node(b, node->data.unary_expr.argument);
+            break;
+
+        case AST_CALL_EXPR:
+            flat.child[0] = flat_build_node(b, node->data.call_expr.callee);
+            flat_build_children(b, &flat, node->data.call_expr.arguments,
+                                node->data.call_expr.arg_count);
+            break;
+
+        case AST_MEMBER_EXPR:
+            flat.str[0] = flat_string(b, node->data.member_expr.property);
+            flat.child[0] = flat_build_node(b, node->data.member_expr.object);
+            break;
+
+        case AST_ARRAY_EXPR:
+            flat.child[0] = flat_build_node(b, node->data.array_expr.array);
+            flat.child[1] = flat_build_node(b, node->data.array_expr.index);
+            break;
+
+        case AST_ASSIGNMENT_EXPR:
+            flat.str[0] = flat_string(b, node->data.assign_expr.operator);
+            flat.child[0] = flat_build_node(b, node->data.assign_expr.left);
+            flat.child[1] = flat_build_node(b, node->data.assign_expr.right);
+            break;
+
+        case AST_CONSTRUCTOR_EXPR:
+            flat.str[0] = flat_string(b, node->data.constructor_expr.type_name);
+            flat_build_children(b, &flat, node->data.constructor_expr.arguments,
+                                node->data.constructor_expr.arg_count);
+            break;
+
+        case AST_IDENTIFIER:
+            flat.str[0] = flat_string(b, node->data.identifier.name);
+            break;
+
+        case AST_LITERAL:
+            flat.str[0] = flat_string(b, node->data.literal.value);
+            break;
+    }
+
+    ast->nodes[index] = flat;
+    return index;
+}
+
+void flat_ast_build(FlatAst* ast, ASTNode* root) {
+    memset(ast, 0, sizeof(FlatAst));
+
+    // Slot 0 of every array stands for "none"
+    ast->node_count = 1;
+    ast->nodes = (FlatNode*)flat_reserve(NULL, &ast->node_capacity, 1, sizeof(FlatNode));
+    memset(&ast->nodes[0], 0, sizeof(FlatNode));
+    ast->string_size = 1;
+    ast->strings = (char*)flat_reserve(NULL, &ast->string_capacity, 1, sizeof(char));
+    ast->strings[0] = '\0';
+
+    flat_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.ast = ast;
+
+    ast->root = flat_build_node(&builder, root);
+
+    free(builder.keys);
+    free(builder.offsets);
+}
+
+void flat_ast_free(FlatAst* ast) {
+    free(ast->nodes);
+    free(ast->lists);
+    free(ast->strings);
+    memset(ast, 0, sizeof(FlatAst));
+}
+
+// ============================================================================
+// LIST
+// ============================================================================
+
+#define LIST_INITIAL_CAPACITY 8
+
+list_t* list_new(void) {
+    list_t* new_list = (list_t*)crt_malloc(sizeof(list_t));
+    list_init(new_list);
+    return new_list;
+}
+
+void list_init(list_t* list) {
+    list->items = NULL;
+    list->len = 0;
+    list->capacity = 0;
+}
+
+void list_reserve(list_t* list, size_t capacity) {
+    if (capacity <= list->capacity) return;
+    list->items = (void**)crt_realloc(list->items, capacity * sizeof(void*));
+    list->capacity = capacity;
+}
+
+void list_append(list_t* list, void* value) {
+    if (list->len == list->capacity) {
+        list_reserve(list, list->capacity ? list->capacity * 2 : LIST_INITIAL_CAPACITY);
     }
+    list->items[list->len++] = value;
+}
+
+void* list_index(list_t* list, size_t index) {
+    if (!list || index >= list->len) {
+        return NULL;
+    }
+    return list->items[index];
+}
+
+// Copies the items into an exactly sized arena array
+void** list_to_arena(list_t* list, arena_t* arena) {
+    void** items = (void**)arena_alloc(arena, (list->len ? list->len : 1) * sizeof(void*));
+    if (list->len) memcpy(items, list->items, list->len * sizeof(void*));
+    return items;
+}
+
+void list_release(list_t* list) {
+    free(list->items);
+    list_init(list);
+}
+
+void list_free(list_t* list) {
+    if (!list) return;
+    free(list->items);
+    free(list);
 }
 
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 // ============================================================================
 // TOKEN DEFINITIONS
 // ============================================================================
@@ -21,16 +25,63 @@ typedef enum {
     TOK_SEMICOLON, TOK_COMMA, TOK_DOT,
     // Special
     TOK_COMMENT,
+    TOK_DIRECTIVE,          // A `#` line, up to its end
     TOK_EOF
 } TokenType;
 
+// Tokens do not own their text: `offset`/`length` slice the source buffer
 typedef struct {
     TokenType type;
-    char *value;
+    int offset;
+    int length;
     int line;
     int col;
 } Token;
 
+// ============================================================================
+// RESERVED WORDS
+// ============================================================================
+
+// Builtin type names, in the order of the target type mapping table
+typedef enum {
+    BUILTIN_VOID,
+    BUILTIN_INT,
+    BUILTIN_FLOAT,
+    BUILTIN_DOUBLE,
+    BUILTIN_BOOL,
+    BUILTIN_CHAR,
+    BUILTIN_FP16,
+    BUILTIN_BF16,
+    BUILTIN_BF32,
+    BUILTIN_VEC2,
+    BUILTIN_VEC3,
+    BUILTIN_VEC4,
+    BUILTIN_IVEC2,
+    BUILTIN_IVEC3,
+    BUILTIN_IVEC4,
+    BUILTIN_BVEC2,
+    BUILTIN_BVEC3,
+    BUILTIN_BVEC4,
+    BUILTIN_MAT2,
+    BUILTIN_MAT3,
+    BUILTIN_MAT4,
+    BUILTIN_SAMPLER2D,
+    BUILTIN_SAMPLER3D,
+    BUILTIN_SAMPLERCUBE,
+    BUILTIN_TYPE_COUNT
+} BuiltinType;
+
+typedef struct {
+    const char *name;
+    int length;
+    TokenType kind;          // TOK_KEYWORD or TOK_TYPE
+    int builtin;             // BuiltinType for TOK_TYPE, -1 for keywords
+} ReservedWord;
+
+// Classify an identifier with a single perfect-hash probe (see
+// reserved_words.h). Returns NULL for ordinary identifiers.
+const ReservedWord *reserved_lookup(const char *str, int len);
+
 // ============================================================================
 // AST NODE DEFINITIONS
 // ============================================================================
@@ -46,6 +97,8 @@ typedef enum {
     AST_FOR_STMT,
     AST_WHILE_STMT,
     AST_RETURN_STMT,
+    AST_BREAK_STMT,
+    AST_CONTINUE_STMT,
     AST_BINARY_EXPR,
     AST_UNARY_EXPR,
     AST_CALL_EXPR,
@@ -59,32 +112,36 @@ typedef enum {
 
 typedef struct ASTNode ASTNode;
 
+// All names and token strings stored in the AST are interned (see
+// str_intern), so they can be compared by pointer.
+
 typedef struct {
-    char *type;
-    char *name;
+    const char *type;
+    const char *name;
+    const char *array_size;  // Struct fields only: number or const name, NULL if not an array
 } Parameter;
 
 typedef struct {
-    char *name;
+    const char *name;
     Parameter *fields;
     int field_count;
 } StructDecl;
 
 typedef struct {
-    char **qualifiers;
+    const char **qualifiers;
     int qualifier_count;
-    char *type;
-    char *name;
+    const char *type;
+    const char *name;
     ASTNode *initializer;
     bool is_array;
-    char *array_size;  // Can be a number or expression
+    const char *array_size;  // Can be a number or expression
 } VariableDecl;
 
 typedef struct {
-    char **qualifiers;
+    const char **qualifiers;
     int qualifier_count;
-    char *return_type;
-    char *name;
+    const char *return_type;
+    const char *name;
     Parameter *params;
     int param_count;
     ASTNode *body;
@@ -101,16 +158,23 @@ typedef struct {
     ASTNode *alternate;
 } IfStmt;
 
+// Unrolling asked for by `#pragma unroll [N]` before a loop: N copies of
+// the body per iteration, 1 to keep the loop as it is
+#define UNROLL_DEFAULT 0         // No pragma: the compiler decides
+#define UNROLL_FULL    (-1)      // `#pragma unroll` without a count
+
 typedef struct {
     ASTNode *init;
     ASTNode *test;
     ASTNode *update;
     ASTNode *body;
+    int unroll;
 } ForStmt;
 
 typedef struct {
     ASTNode *test;
     ASTNode *body;
+    int unroll;
 } WhileStmt;
 
 typedef struct {
@@ -118,13 +182,13 @@ typedef struct {
 } ReturnStmt;
 
 typedef struct {
-    char *operator;
+    const char *operator;
     ASTNode *left;
     ASTNode *right;
 } BinaryExpr;
 
 typedef struct {
-    char *operator;
+    const char *operator;
     ASTNode *argument;
 } UnaryExpr;
 
@@ -136,7 +200,7 @@ typedef struct {
 
 typedef struct {
     ASTNode *object;
-    char *property;
+    const char *property;
 } MemberExpr;
 
 typedef struct {
@@ -145,21 +209,19 @@ typedef struct {
 } ArrayExpr;
 
 typedef struct {
-    char *operator;
+    const char *operator;
     ASTNode *left;
     ASTNode *right;
 } AssignmentExpr;
 
 typedef struct {
-    char *type_name;
+    const char *type_name;
     ASTNode **arguments;
     int arg_count;
 } ConstructorExpr;
 
 struct ASTNode {
     ASTNodeType type;
-    int variable_declarations;
-    int func_declarations;
 
     union {
         struct { ASTNode **declarations; int decl_count; } program;
@@ -179,11 +241,89 @@ struct ASTNode {
         ArrayExpr array_expr;
         AssignmentExpr assign_expr;
         ConstructorExpr constructor_expr;
-        struct { char *name; } identifier;
-        struct { char *value; } literal;
+        struct { const char *name; } identifier;
+        struct { const char *value; } literal;
     } data;
 };
 
+// ============================================================================
+// FLAT AST
+// ============================================================================
+
+// Alternative, pointer-free AST layout. All nodes live in one contiguous
+// array and reference their children by 32-bit index; variable-length
+// lists are ranges of a shared side array and strings are offsets into a
+// string pool. Index/offset 0 means "none". Since nothing in it is a
+// pointer, a FlatAst can be copied or serialized with plain memcpy of its
+// three arrays.
+//
+// Per node type (str[], child[], list):
+//   PROGRAM            list = declarations
+//   FUNCTION_DECL      str = {name, return_type}, child = {body},
+//                      list = qualifiers, then (type, name) string pairs
+//   VARIABLE_DECL      str = {name, type, array_size}, child = {initializer},
+//                      list = qualifiers
+//   STRUCT_DECL        str = {name}, list = (type, name, array_size) string
+//                      triples, array_size 0 for plain fields
+//   BLOCK_STMT         list = statements
+//   EXPRESSION_STMT    child = {expression}
+//   IF_STMT            child = {condition, consequent, alternate}
+//   FOR_STMT           child = {init, test, update, body}, unroll
+//   WHILE_STMT         child = {test, body}, unroll
+//   RETURN_STMT        child = {argument}
+//   BREAK_STMT         -
+//   CONTINUE_STMT      -
+//   BINARY_EXPR        str = {operator}, child = {left, right}
+//   UNARY_EXPR         str = {operator}, child = {argument}
+//   CALL_EXPR          child = {callee}, list = arguments
+//   MEMBER_EXPR        str = {property}, child = {object}
+//   ARRAY_EXPR         child = {array, index}
+//   ASSIGNMENT_EXPR    str = {operator}, child = {left, right}
+//   CONSTRUCTOR_EXPR   str = {type_name}, list = arguments
+//   IDENTIFIER         str = {name}
+//   LITERAL            str = {value}
+
+typedef uint32_t ast_index_t;
+
+typedef struct {
+    uint8_t type;               // ASTNodeType
+    uint8_t is_array;           // VARIABLE_DECL only
+    uint16_t qualifier_count;   // Leading string entries of the list
+    int32_t unroll;             // FOR_STMT and WHILE_STMT only
+    uint32_t str[3];
+    ast_index_t child[4];
+    uint32_t list_start;        // Range in FlatAst.lists
+    uint32_t list_count;
+} FlatNode;
+
+typedef struct {
+    FlatNode* nodes;            // nodes[0] is unused
+    uint32_t node_count;
+    uint32_t node_capacity;
+
+    uint32_t* lists;            // Node indices or string offsets
+    uint32_t list_count;
+    uint32_t list_capacity;
+
+    char* strings;              // NUL-terminated strings; strings[0] == '\0'
+    uint32_t string_size;
+    uint32_t string_capacity;
+
+    ast_index_t root;
+} FlatAst;
+
+// Flatten a pointer AST. Identical (interned) strings share one pool entry.
+void flat_ast_build(FlatAst* ast, ASTNode* root);
+void flat_ast_free(FlatAst* ast);
+
+static inline FlatNode* flat_node(FlatAst* ast, ast_index_t index) {
+    return index ? &ast->nodes[index] : NULL;
+}
+
+static inline const char* flat_str(FlatAst* ast, uint32_t offset) {
+    return offset ? ast->strings + offset : NULL;
+}
+
 #include <stdio.h>
 inline static void crt_warn(const char* msg) {
     printf("[Warn] %s", msg);
@@ -193,26 +333,114 @@ inline static void crt_err(const char* msg) {
     printf("[Err ] %s", msg);
 }
 
-// CompileArea
+// ============================================================================
+// ALLOCATION
+// ============================================================================
+
+// All heap memory of the compiler goes through these wrappers so allocation
+// can be accounted per compile phase (see -ftime-report). They never return
+// NULL; running out of memory is fatal.
+
+typedef struct {
+    size_t heap_allocs;      // crt_malloc/crt_calloc/crt_realloc calls
+    size_t heap_bytes;       // Bytes requested from the heap
+    size_t arena_allocs;     // arena_alloc calls
+    size_t arena_bytes;      // Bytes handed out by arenas
+} crt_alloc_stats_t;
+
+extern crt_alloc_stats_t crt_alloc_stats;
+
+void* crt_malloc(size_t size);
+void* crt_calloc(size_t count, size_t size);
+void* crt_realloc(void* ptr, size_t size);
+
+// ============================================================================
+// ARENA ALLOCATOR
+// ============================================================================
+
+// Bump allocator owning all memory of one compilation session (tokens,
+// AST nodes, strings). Individual allocations are never freed; the whole
+// arena is released at once with arena_free().
+
+// Sizes are rounded to this, and block data starts on it, so every
+// allocation is aligned to it
+#define ARENA_ALIGN 16
+
+typedef struct arena_block_s {
+    struct arena_block_s* next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];  // As malloc aligns the block
+} arena_block_t;
+
+typedef struct {
+    arena_block_t* head;
+    size_t block_size;
+} arena_t;
 
-typedef struct list_node_s {
-    void* data;
-    struct list_node_s* next;
-} list_node_t;
+arena_t* arena_new(size_t block_size);
+void* arena_alloc(arena_t* arena, size_t size);
+void* arena_calloc(arena_t* arena, size_t count, size_t size);
+char* arena_strdup(arena_t* arena, const char* str);
+char* arena_strndup(arena_t* arena, const char* str, size_t len);
+void arena_free(arena_t* arena);
 
-typedef struct{
+// ============================================================================
+// STRING INTERNING
+// ============================================================================
+
+// Every distinct string is stored exactly once, so two interned strings are
+// equal iff their pointers are equal. The hash and length are computed once
+// and kept in a header right in front of the characters. Interned strings
+// are immutable and live until str_intern_free().
+
+typedef struct {
+    unsigned int hash;
+    int length;
+    char text[];
+} interned_str_t;
+
+const char* str_intern(const char* str);
+const char* str_intern_n(const char* str, size_t len);
+unsigned int str_hash(const char* interned);
+int str_length(const char* interned);
+void str_intern_free(void);
+
+// CompileArea
+
+// Contiguous growable array of pointers: amortized O(1) append, O(1)
+// indexing. Embed it and use list_init/list_release, or heap-allocate it
+// with list_new/list_free.
+typedef struct {
+    void** items;
     size_t len;
-    struct list_node_s* last;
+    size_t capacity;
 } list_t;
 
-
 list_t* list_new(void);
-list_node_t* list_new_node(void* value);
-void list_append(list_t *list, void* value);
+void list_init(list_t* list);
+void list_reserve(list_t* list, size_t capacity);
+void list_append(list_t* list, void* value);
 void* list_index(list_t* list, size_t index);
+void** list_to_arena(list_t* list, arena_t* arena);
+void list_release(list_t* list);
 void list_free(list_t* list);
 
 //Code Gen
 
+#define GEN_TRACE   (1 << 0)   // Trace the AST walk and data allocation on stdout
+#define GEN_DUMP_IR (1 << 1)   // Print the SSA IR of every function on stdout
+
+// Contraction of a * b + c into fma; without either flag, only within one
+// source expression (-ffp-contract=on)
+#define GEN_FP_CONTRACT_OFF  (1 << 2)
+#define GEN_FP_CONTRACT_FAST (1 << 3)
+
+// Float arithmetic may be rewritten where that changes rounding
+// (-ffast-math): division by a constant multiplies by its reciprocal
+#define GEN_FAST_MATH        (1 << 4)
+
 int gen_init(int flags);
-int gen_by_ast(ASTNode *root);
\ No newline at end of file
+int gen_resolve(ASTNode *root);
+int gen_by_ast(ASTNode *root);
+int gen_emit(void);
\ No newline at end of file
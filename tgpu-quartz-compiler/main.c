@@ -2,7 +2,16 @@
  * Options:
  *   -t, --tokens    Print tokens
  *   -a, --ast       Print AST
+ *   --flat-ast      Print AST through the flat (index-based) representation
  *   -o <file>       Output to file
+ *   -ftime-report   Print per-phase time and memory usage to stderr
+ *                   (-ftime-report=json for a machine-readable form)
+ *   --trace         Trace code generation on stdout
+ *   --dump-ir       Print the SSA IR of every function on stdout
+ *   -ffp-contract=off|on|fast
+ *                   Fuse a * b + c into fma never, within an expression
+ *                   (default) or across statements
+ *   -ffast-math     Allow float rewrites that change rounding
  */
 
 #include <stdio.h>
@@ -10,6 +19,12 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
 
 #include "crt.h"
 
@@ -17,61 +32,34 @@
 // LEXER
 // ============================================================================
 
+// The lexer works directly on the (usually memory-mapped) source buffer.
+// Tokens do not own any text; they are (offset, length) slices into it.
+// Tokens are produced one at a time by lexer_next(), so nothing here grows
+// with the size of the input.
 typedef struct {
-    char *code;
+    const char *code;
     int pos;
     int line;
     int col;
     int length;
+    bool keep_comments;     // return TOK_COMMENT tokens instead of skipping them
 } Lexer;
 
-const char *keywords[] = {
-    "if", "else", "for", "while", "do", "return", "break", "continue",
-    "const", "struct",
-    "uniform", "varying", "attribute",
-    "in", "out", "inout",
-    "precision", "mediump", "highp", "lowp",
-    NULL
-};
-
-const char *types[] = {
-    "void", "int", "float", "double", "bool", "char",
-    "vec2", "vec3", "vec4", "ivec2", "ivec3", "ivec4",
-    "bvec2", "bvec3", "bvec4",
-    "mat2", "mat3", "mat4",
-    "sampler2D", "sampler3D", "samplerCube",
-    NULL
-};
-
-bool is_keyword(const char *str) {
-    for (int i = 0; keywords[i] != NULL; i++) {
-        if (strcmp(str, keywords[i]) == 0) return true;
-    }
-    return false;
+static bool word_equals(const char *str, int len, const char *word) {
+    return strncmp(str, word, len) == 0 && word[len] == '\0';
 }
 
-bool is_type(const char *str) {
-    for (int i = 0; types[i] != NULL; i++) {
-        if (strcmp(str, types[i]) == 0) return true;
-    }
-    return false;
-}
-
-Lexer *lexer_create(const char *code) {
-    Lexer *lexer = malloc(sizeof(Lexer));
-    lexer->code = strdup(code);
+Lexer *lexer_create(arena_t *arena, const char *code, int length) {
+    Lexer *lexer = arena_alloc(arena, sizeof(Lexer));
+    lexer->code = code;
     lexer->pos = 0;
     lexer->line = 1;
     lexer->col = 1;
-    lexer->length = strlen(code);
+    lexer->length = length;
+    lexer->keep_comments = false;
     return lexer;
 }
 
-void lexer_free(Lexer *lexer) {
-    free(lexer->code);
-    free(lexer);
-}
-
 char lexer_current(Lexer *lexer) {
     if (lexer->pos >= lexer->length) return '\0';
     return lexer->code[lexer->pos];
@@ -98,203 +86,164 @@ void lexer_skip_whitespace(Lexer *lexer) {
     }
 }
 
-Token *token_create(TokenType type, const char *value, int line, int col) {
-    Token *token = malloc(sizeof(Token));
-    token->type = type;
-    token->value = strdup(value);
-    token->line = line;
-    token->col = col;
+// Token text runs from `start` to the current lexer position
+Token token_create(Lexer *lexer, TokenType type, int start, int line, int col) {
+    Token token;
+    token.type = type;
+    token.offset = start;
+    token.length = lexer->pos - start;
+    token.line = line;
+    token.col = col;
     return token;
 }
 
-void token_free(Token *token) {
-    free(token->value);
-    free(token);
-}
-
-Token *lexer_read_comment(Lexer *lexer) {
+// Called with the lexer on the leading '/' of a "//" or "/*" comment
+Token lexer_read_comment(Lexer *lexer) {
     int line = lexer->line;
     int col = lexer->col;
-    char buffer[4096] = {0};
-    int idx = 0;
+    int start = lexer->pos;
     
-    if (lexer_current(lexer) == '/' && lexer_peek(lexer, 1) == '/') {
-        buffer[idx++] = '/';
-        buffer[idx++] = '/';
-        lexer_advance(lexer);
+    lexer_advance(lexer);
+    
+    if (lexer_current(lexer) == '/') {
         lexer_advance(lexer);
         
         while (lexer_current(lexer) != '\n' && lexer_current(lexer) != '\0') {
-            buffer[idx++] = lexer_current(lexer);
             lexer_advance(lexer);
         }
-        return token_create(TOK_COMMENT, buffer, line, col);
+        return token_create(lexer, TOK_COMMENT, start, line, col);
     }
     
-    if (lexer_current(lexer) == '/' && lexer_peek(lexer, 1) == '*') {
-        buffer[idx++] = '/';
-        buffer[idx++] = '*';
-        lexer_advance(lexer);
+    lexer_advance(lexer);
+    
+    while (!(lexer_current(lexer) == '*' && lexer_peek(lexer, 1) == '/') && 
+           lexer_current(lexer) != '\0') {
         lexer_advance(lexer);
-        
-        while (!(lexer_current(lexer) == '*' && lexer_peek(lexer, 1) == '/') && 
-               lexer_current(lexer) != '\0') {
-            buffer[idx++] = lexer_current(lexer);
-            lexer_advance(lexer);
-        }
-        
-        if (lexer_current(lexer) == '*') {
-            buffer[idx++] = '*';
-            buffer[idx++] = '/';
-            lexer_advance(lexer);
-            lexer_advance(lexer);
-        }
-        return token_create(TOK_COMMENT, buffer, line, col);
     }
     
-    return NULL;
+    if (lexer_current(lexer) == '*') {
+        lexer_advance(lexer);
+        lexer_advance(lexer);
+    }
+    return token_create(lexer, TOK_COMMENT, start, line, col);
 }
 
-Token *lexer_read_number(Lexer *lexer) {
+Token lexer_read_number(Lexer *lexer) {
     int line = lexer->line;
     int col = lexer->col;
-    char buffer[256] = {0};
-    int idx = 0;
+    int start = lexer->pos;
     
     while (isdigit(lexer_current(lexer)) || lexer_current(lexer) == '.') {
-        buffer[idx++] = lexer_current(lexer);
         lexer_advance(lexer);
     }
     
     if (lexer_current(lexer) == 'f' || lexer_current(lexer) == 'F') {
-        buffer[idx++] = lexer_current(lexer);
         lexer_advance(lexer);
     }
     
-    return token_create(TOK_NUMBER, buffer, line, col);
+    return token_create(lexer, TOK_NUMBER, start, line, col);
 }
 
-Token *lexer_read_identifier(Lexer *lexer) {
+Token lexer_read_identifier(Lexer *lexer) {
     int line = lexer->line;
     int col = lexer->col;
-    char buffer[256] = {0};
-    int idx = 0;
+    int start = lexer->pos;
     
     while (isalnum(lexer_current(lexer)) || lexer_current(lexer) == '_') {
-        buffer[idx++] = lexer_current(lexer);
         lexer_advance(lexer);
     }
     
-    TokenType type = TOK_IDENTIFIER;
-    if (is_keyword(buffer)) {
-        type = TOK_KEYWORD;
-    } else if (is_type(buffer)) {
-        type = TOK_TYPE;
-    }
+    const ReservedWord *word = reserved_lookup(lexer->code + start, lexer->pos - start);
+    TokenType type = word ? word->kind : TOK_IDENTIFIER;
     // Note: User-defined types (struct names) will remain as IDENTIFIER
     // and will be handled by the parser context
     
-    return token_create(type, buffer, line, col);
+    return token_create(lexer, type, start, line, col);
 }
 
-Token *lexer_read_string(Lexer *lexer) {
+Token lexer_read_string(Lexer *lexer) {
     int line = lexer->line;
     int col = lexer->col;
-    char buffer[4096] = {0};
-    int idx = 0;
+    int start = lexer->pos;
     char quote = lexer_current(lexer);
     
-    buffer[idx++] = quote;
     lexer_advance(lexer);
     
     while (lexer_current(lexer) != quote && lexer_current(lexer) != '\0') {
         if (lexer_current(lexer) == '\\') {
-            buffer[idx++] = lexer_current(lexer);
             lexer_advance(lexer);
         }
-        buffer[idx++] = lexer_current(lexer);
         lexer_advance(lexer);
     }
     
     if (lexer_current(lexer) == quote) {
-        buffer[idx++] = quote;
         lexer_advance(lexer);
     }
     
-    return token_create(TOK_STRING, buffer, line, col);
+    return token_create(lexer, TOK_STRING, start, line, col);
 }
 
-Token **lexer_tokenize(Lexer *lexer, int *token_count) {
-    Token **tokens = malloc(sizeof(Token*) * 10000);
-    int count = 0;
-    
-    while (lexer_current(lexer) != '\0') {
+// Scan the next token. Once the input is exhausted every further call
+// returns TOK_EOF.
+Token lexer_next(Lexer *lexer) {
+    while (true) {
         lexer_skip_whitespace(lexer);
         
-        if (lexer_current(lexer) == '\0') break;
-        
         char ch = lexer_current(lexer);
         int line = lexer->line;
         int col = lexer->col;
+        int start = lexer->pos;
+        
+        if (ch == '\0') {
+            return token_create(lexer, TOK_EOF, start, line, col);
+        }
         
         // Comments
         if (ch == '/' && (lexer_peek(lexer, 1) == '/' || lexer_peek(lexer, 1) == '*')) {
-            Token *comment = lexer_read_comment(lexer);
-            if (comment) tokens[count++] = comment;
+            Token comment = lexer_read_comment(lexer);
+            if (lexer->keep_comments) return comment;
             continue;
         }
         
+        // Directives run to the end of the line
+        if (ch == '#') {
+            while (lexer_current(lexer) != '\n' && lexer_current(lexer) != '\0') {
+                lexer_advance(lexer);
+            }
+            return token_create(lexer, TOK_DIRECTIVE, start, line, col);
+        }
+        
         // Numbers
         if (isdigit(ch)) {
-            tokens[count++] = lexer_read_number(lexer);
-            continue;
+            return lexer_read_number(lexer);
         }
         
         // Identifiers
         if (isalpha(ch) || ch == '_') {
-            tokens[count++] = lexer_read_identifier(lexer);
-            continue;
+            return lexer_read_identifier(lexer);
         }
         
         // Strings
         if (ch == '"' || ch == '\'') {
-            tokens[count++] = lexer_read_string(lexer);
-            continue;
+            return lexer_read_string(lexer);
         }
         
         // Single character tokens
-        if (ch == '(') {
-            tokens[count++] = token_create(TOK_LPAREN, "(", line, col);
-            lexer_advance(lexer);
-        } else if (ch == ')') {
-            tokens[count++] = token_create(TOK_RPAREN, ")", line, col);
-            lexer_advance(lexer);
-        } else if (ch == '{') {
-            tokens[count++] = token_create(TOK_LBRACE, "{", line, col);
-            lexer_advance(lexer);
-        } else if (ch == '}') {
-            tokens[count++] = token_create(TOK_RBRACE, "}", line, col);
-            lexer_advance(lexer);
-        } else if (ch == '[') {
-            tokens[count++] = token_create(TOK_LBRACKET, "[", line, col);
-            lexer_advance(lexer);
-        } else if (ch == ']') {
-            tokens[count++] = token_create(TOK_RBRACKET, "]", line, col);
-            lexer_advance(lexer);
-        } else if (ch == ';') {
-            tokens[count++] = token_create(TOK_SEMICOLON, ";", line, col);
-            lexer_advance(lexer);
-        } else if (ch == ',') {
-            tokens[count++] = token_create(TOK_COMMA, ",", line, col);
-            lexer_advance(lexer);
-        } else if (ch == '.') {
-            tokens[count++] = token_create(TOK_DOT, ".", line, col);
-            lexer_advance(lexer);
-        } else {
-            // Operators
-            char buffer[3] = {ch, '\0', '\0'};
-            lexer_advance(lexer);
-            
+        TokenType type = TOK_OPERATOR;
+        switch (ch) {
+            case '(': type = TOK_LPAREN; break;
+            case ')': type = TOK_RPAREN; break;
+            case '{': type = TOK_LBRACE; break;
+            case '}': type = TOK_RBRACE; break;
+            case '[': type = TOK_LBRACKET; break;
+            case ']': type = TOK_RBRACKET; break;
+            case ';': type = TOK_SEMICOLON; break;
+            case ',': type = TOK_COMMA; break;
+            case '.': type = TOK_DOT; break;
+        }
+        lexer_advance(lexer);
+        
+        if (type == TOK_OPERATOR) {
             // Check for two-character operators
             char next = lexer_current(lexer);
             if ((ch == '=' && next == '=') || (ch == '!' && next == '=') ||
@@ -304,60 +253,75 @@ Token **lexer_tokenize(Lexer *lexer, int *token_count) {
                 (ch == '*' && next == '=') || (ch == '/' && next == '=') ||
                 (ch == '+' && next == '+') || (ch == '-' && next == '-') ||
                 (ch == '<' && next == '<') || (ch == '>' && next == '>')) {
-                buffer[1] = next;
                 lexer_advance(lexer);
             }
-            
-            tokens[count++] = token_create(TOK_OPERATOR, buffer, line, col);
         }
+        
+        return token_create(lexer, type, start, line, col);
     }
-    
-    tokens[count++] = token_create(TOK_EOF, "", lexer->line, lexer->col);
-    *token_count = count;
-    return tokens;
 }
 
 // ============================================================================
 // PARSER
 // ============================================================================
 
+// Number of tokens the parser can look ahead; must be a power of two.
+// The grammar never needs more than the current token plus one.
+#define PARSER_LOOKAHEAD 4
+
+// The parser pulls tokens from the lexer on demand into a small ring
+// buffer. Pointers returned by parser_current()/parser_peek() are only
+// valid until the next parser_advance(); copy the Token if it has to
+// survive longer.
 typedef struct {
-    Token **tokens;
-    int pos;
-    int count;
+    arena_t *arena;
+    const char *source;
+    Lexer *lexer;
+    Token lookahead[PARSER_LOOKAHEAD];
+    int head;               // ring index of the current token
+    int buffered;           // tokens in the ring, starting at head
+    int node_count;         // AST nodes created so far
 } Parser;
 
-Parser *parser_create(Token **tokens, int count) {
-    Parser *parser = malloc(sizeof(Parser));
-    
-    // Filter out comments
-    Token **filtered = malloc(sizeof(Token*) * count);
-    int filtered_count = 0;
-    
-    for (int i = 0; i < count; i++) {
-        if (tokens[i]->type != TOK_COMMENT) {
-            filtered[filtered_count++] = tokens[i];
-        }
-    }
-    
-    parser->tokens = filtered;
-    parser->pos = 0;
-    parser->count = filtered_count;
+Parser *parser_create(arena_t *arena, const char *source, Lexer *lexer) {
+    Parser *parser = arena_alloc(arena, sizeof(Parser));
+    parser->arena = arena;
+    parser->source = source;
+    parser->lexer = lexer;
+    parser->head = 0;
+    parser->buffered = 0;
+    parser->node_count = 0;
     return parser;
 }
 
-void parser_free(Parser *parser) {
-    free(parser->tokens);
-    free(parser);
+// Compare the token text with a NUL-terminated string
+bool token_is(Parser *parser, Token *token, const char *text) {
+    return word_equals(parser->source + token->offset, token->length, text);
+}
+
+// Intern the token text (only done for text that ends up in the AST)
+const char *token_text(Parser *parser, Token *token) {
+    return str_intern_n(parser->source + token->offset, token->length);
+}
+
+// Token n positions after the current one
+Token *parser_peek(Parser *parser, int n) {
+    while (parser->buffered <= n) {
+        int slot = (parser->head + parser->buffered) & (PARSER_LOOKAHEAD - 1);
+        parser->lookahead[slot] = lexer_next(parser->lexer);
+        parser->buffered++;
+    }
+    return &parser->lookahead[(parser->head + n) & (PARSER_LOOKAHEAD - 1)];
 }
 
 Token *parser_current(Parser *parser) {
-    return parser->tokens[parser->pos];
+    return parser_peek(parser, 0);
 }
 
 void parser_advance(Parser *parser) {
-    if (parser->pos < parser->count - 1) {
-        parser->pos++;
+    if (parser_current(parser)->type != TOK_EOF) {
+        parser->head = (parser->head + 1) & (PARSER_LOOKAHEAD - 1);
+        parser->buffered--;
     }
 }
 
@@ -365,17 +329,55 @@ bool parser_match(Parser *parser, TokenType type) {
     return parser_current(parser)->type == type;
 }
 
-Token *parser_expect(Parser *parser, TokenType type) {
+bool parser_match_value(Parser *parser, TokenType type, const char *text) {
     Token *token = parser_current(parser);
-    if (token->type != type) {
+    return token->type == type && token_is(parser, token, text);
+}
+
+Token parser_expect(Parser *parser, TokenType type) {
+    Token token = *parser_current(parser);
+    if (token.type != type) {
         fprintf(stderr, "Parse error at line %d:%d: expected token type %d, got %d\n",
-                token->line, token->col, type, token->type);
+                token.line, token.col, type, token.type);
         exit(1);
     }
     parser_advance(parser);
     return token;
 }
 
+// AST nodes and their strings live in the session arena
+ASTNode *ast_new(Parser *parser, ASTNodeType type) {
+    ASTNode *node = arena_calloc(parser->arena, 1, sizeof(ASTNode));
+    node->type = type;
+    parser->node_count++;
+    return node;
+}
+
+// Child lists are collected in a list_t while parsing, then copied into the
+// arena at their final size and the list storage is released
+ASTNode **ast_list(Parser *parser, list_t *list) {
+    ASTNode **items = (ASTNode**)list_to_arena(list, parser->arena);
+    list_release(list);
+    return items;
+}
+
+Parameter *ast_params(Parser *parser, list_t *list) {
+    Parameter *params = arena_alloc(parser->arena, sizeof(Parameter) * (list->len ? list->len : 1));
+    for (size_t i = 0; i < list->len; i++) {
+        params[i] = *(Parameter*)list->items[i];
+    }
+    list_release(list);
+    return params;
+}
+
+Parameter *ast_param_new(Parser *parser, Token *type, Token *name) {
+    Parameter *param = arena_alloc(parser->arena, sizeof(Parameter));
+    param->type = token_text(parser, type);
+    param->name = token_text(parser, name);
+    param->array_size = NULL;
+    return param;
+}
+
 // Forward declarations
 ASTNode *parse_expression(Parser *parser);
 ASTNode *parse_statement(Parser *parser);
@@ -385,43 +387,40 @@ ASTNode *parse_primary(Parser *parser) {
     Token *token = parser_current(parser);
     
     if (token->type == TOK_NUMBER) {
-        ASTNode *node = malloc(sizeof(ASTNode));
-        node->type = AST_LITERAL;
-        node->data.literal.value = strdup(token->value);
+        ASTNode *node = ast_new(parser, AST_LITERAL);
+        node->data.literal.value = token_text(parser, token);
         parser_advance(parser);
         return node;
     }
     
     if (token->type == TOK_IDENTIFIER) {
-        ASTNode *node = malloc(sizeof(ASTNode));
-        node->type = AST_IDENTIFIER;
-        node->data.identifier.name = strdup(token->value);
+        ASTNode *node = ast_new(parser, AST_IDENTIFIER);
+        node->data.identifier.name = token_text(parser, token);
         parser_advance(parser);
         return node;
     }
     
     if (token->type == TOK_TYPE) {
-        char *type_name = strdup(token->value);
+        const char *type_name = token_text(parser, token);
         parser_advance(parser);
         parser_expect(parser, TOK_LPAREN);
         
-        ASTNode **args = malloc(sizeof(ASTNode*) * 100);
-        int arg_count = 0;
+        list_t args;
+        list_init(&args);
         
         while (!parser_match(parser, TOK_RPAREN)) {
-            if (arg_count > 0) {
+            if (args.len > 0) {
                 parser_expect(parser, TOK_COMMA);
             }
-            args[arg_count++] = parse_expression(parser);
+            list_append(&args, parse_expression(parser));
         }
         
         parser_expect(parser, TOK_RPAREN);
         
-        ASTNode *node = malloc(sizeof(ASTNode));
-        node->type = AST_CONSTRUCTOR_EXPR;
+        ASTNode *node = ast_new(parser, AST_CONSTRUCTOR_EXPR);
         node->data.constructor_expr.type_name = type_name;
-        node->data.constructor_expr.arguments = args;
-        node->data.constructor_expr.arg_count = arg_count;
+        node->data.constructor_expr.arg_count = (int)args.len;
+        node->data.constructor_expr.arguments = ast_list(parser, &args);
         return node;
     }
     
@@ -443,40 +442,37 @@ ASTNode *parse_postfix(Parser *parser) {
         if (parser_match(parser, TOK_LPAREN)) {
             parser_advance(parser);
             
-            ASTNode **args = malloc(sizeof(ASTNode*) * 100);
-            int arg_count = 0;
+            list_t args;
+            list_init(&args);
             
             while (!parser_match(parser, TOK_RPAREN)) {
-                if (arg_count > 0) {
+                if (args.len > 0) {
                     parser_expect(parser, TOK_COMMA);
                 }
-                args[arg_count++] = parse_expression(parser);
+                list_append(&args, parse_expression(parser));
             }
             
             parser_expect(parser, TOK_RPAREN);
             
-            ASTNode *call_node = malloc(sizeof(ASTNode));
-            call_node->type = AST_CALL_EXPR;
+            ASTNode *call_node = ast_new(parser, AST_CALL_EXPR);
             call_node->data.call_expr.callee = expr;
-            call_node->data.call_expr.arguments = args;
-            call_node->data.call_expr.arg_count = arg_count;
+            call_node->data.call_expr.arg_count = (int)args.len;
+            call_node->data.call_expr.arguments = ast_list(parser, &args);
             expr = call_node;
         } else if (parser_match(parser, TOK_DOT)) {
             parser_advance(parser);
-            Token *prop = parser_expect(parser, TOK_IDENTIFIER);
+            Token prop = parser_expect(parser, TOK_IDENTIFIER);
             
-            ASTNode *member_node = malloc(sizeof(ASTNode));
-            member_node->type = AST_MEMBER_EXPR;
+            ASTNode *member_node = ast_new(parser, AST_MEMBER_EXPR);
             member_node->data.member_expr.object = expr;
-            member_node->data.member_expr.property = strdup(prop->value);
+            member_node->data.member_expr.property = token_text(parser, &prop);
             expr = member_node;
         } else if (parser_match(parser, TOK_LBRACKET)) {
             parser_advance(parser);
             ASTNode *index = parse_expression(parser);
             parser_expect(parser, TOK_RBRACKET);
             
-            ASTNode *array_node = malloc(sizeof(ASTNode));
-            array_node->type = AST_ARRAY_EXPR;
+            ASTNode *array_node = ast_new(parser, AST_ARRAY_EXPR);
             array_node->data.array_expr.array = expr;
             array_node->data.array_expr.index = index;
             expr = array_node;
@@ -492,15 +488,14 @@ ASTNode *parse_unary(Parser *parser) {
     Token *token = parser_current(parser);
     
     if (token->type == TOK_OPERATOR) {
-        const char *op = token->value;
-        if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0 || 
-            strcmp(op, "!") == 0 || strcmp(op, "++") == 0 || strcmp(op, "--") == 0) {
+        Token op = *token;
+        if (token_is(parser, &op, "+") || token_is(parser, &op, "-") || 
+            token_is(parser, &op, "!") || token_is(parser, &op, "++") || token_is(parser, &op, "--")) {
             parser_advance(parser);
             ASTNode *arg = parse_unary(parser);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_UNARY_EXPR;
-            node->data.unary_expr.operator = strdup(op);
+            ASTNode *node = ast_new(parser, AST_UNARY_EXPR);
+            node->data.unary_expr.operator = token_text(parser, &op);
             node->data.unary_expr.argument = arg;
             return node;
         }
@@ -513,14 +508,13 @@ ASTNode *parse_multiplicative(Parser *parser) {
     ASTNode *left = parse_unary(parser);
     
     while (parser_match(parser, TOK_OPERATOR)) {
-        const char *op = parser_current(parser)->value;
-        if (strcmp(op, "*") == 0 || strcmp(op, "/") == 0 || strcmp(op, "%") == 0) {
+        Token op = *parser_current(parser);
+        if (token_is(parser, &op, "*") || token_is(parser, &op, "/") || token_is(parser, &op, "%")) {
             parser_advance(parser);
             ASTNode *right = parse_unary(parser);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_BINARY_EXPR;
-            node->data.binary_expr.operator = strdup(op);
+            ASTNode *node = ast_new(parser, AST_BINARY_EXPR);
+            node->data.binary_expr.operator = token_text(parser, &op);
             node->data.binary_expr.left = left;
             node->data.binary_expr.right = right;
             left = node;
@@ -536,14 +530,13 @@ ASTNode *parse_additive(Parser *parser) {
     ASTNode *left = parse_multiplicative(parser);
     
     while (parser_match(parser, TOK_OPERATOR)) {
-        const char *op = parser_current(parser)->value;
-        if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0) {
+        Token op = *parser_current(parser);
+        if (token_is(parser, &op, "+") || token_is(parser, &op, "-")) {
             parser_advance(parser);
             ASTNode *right = parse_multiplicative(parser);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_BINARY_EXPR;
-            node->data.binary_expr.operator = strdup(op);
+            ASTNode *node = ast_new(parser, AST_BINARY_EXPR);
+            node->data.binary_expr.operator = token_text(parser, &op);
             node->data.binary_expr.left = left;
             node->data.binary_expr.right = right;
             left = node;
@@ -559,16 +552,15 @@ ASTNode *parse_comparison(Parser *parser) {
     ASTNode *left = parse_additive(parser);
     
     while (parser_match(parser, TOK_OPERATOR)) {
-        const char *op = parser_current(parser)->value;
-        if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 ||
-            strcmp(op, "<") == 0 || strcmp(op, ">") == 0 ||
-            strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0) {
+        Token op = *parser_current(parser);
+        if (token_is(parser, &op, "==") || token_is(parser, &op, "!=") ||
+            token_is(parser, &op, "<") || token_is(parser, &op, ">") ||
+            token_is(parser, &op, "<=") || token_is(parser, &op, ">=")) {
             parser_advance(parser);
             ASTNode *right = parse_additive(parser);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_BINARY_EXPR;
-            node->data.binary_expr.operator = strdup(op);
+            ASTNode *node = ast_new(parser, AST_BINARY_EXPR);
+            node->data.binary_expr.operator = token_text(parser, &op);
             node->data.binary_expr.left = left;
             node->data.binary_expr.right = right;
             left = node;
@@ -584,14 +576,13 @@ ASTNode *parse_logical_and(Parser *parser) {
     ASTNode *left = parse_comparison(parser);
     
     while (parser_match(parser, TOK_OPERATOR)) {
-        const char *op = parser_current(parser)->value;
-        if (strcmp(op, "&&") == 0) {
+        Token op = *parser_current(parser);
+        if (token_is(parser, &op, "&&")) {
             parser_advance(parser);
             ASTNode *right = parse_comparison(parser);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_BINARY_EXPR;
-            node->data.binary_expr.operator = strdup(op);
+            ASTNode *node = ast_new(parser, AST_BINARY_EXPR);
+            node->data.binary_expr.operator = token_text(parser, &op);
             node->data.binary_expr.left = left;
             node->data.binary_expr.right = right;
             left = node;
@@ -607,14 +598,13 @@ ASTNode *parse_logical_or(Parser *parser) {
     ASTNode *left = parse_logical_and(parser);
     
     while (parser_match(parser, TOK_OPERATOR)) {
-        const char *op = parser_current(parser)->value;
-        if (strcmp(op, "||") == 0) {
+        Token op = *parser_current(parser);
+        if (token_is(parser, &op, "||")) {
             parser_advance(parser);
             ASTNode *right = parse_logical_and(parser);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_BINARY_EXPR;
-            node->data.binary_expr.operator = strdup(op);
+            ASTNode *node = ast_new(parser, AST_BINARY_EXPR);
+            node->data.binary_expr.operator = token_text(parser, &op);
             node->data.binary_expr.left = left;
             node->data.binary_expr.right = right;
             left = node;
@@ -630,15 +620,14 @@ ASTNode *parse_assignment(Parser *parser) {
     ASTNode *left = parse_logical_or(parser);
     
     if (parser_match(parser, TOK_OPERATOR)) {
-        const char *op = parser_current(parser)->value;
-        if (strcmp(op, "=") == 0 || strcmp(op, "+=") == 0 || 
-            strcmp(op, "-=") == 0 || strcmp(op, "*=") == 0 || strcmp(op, "/=") == 0) {
+        Token op = *parser_current(parser);
+        if (token_is(parser, &op, "=") || token_is(parser, &op, "+=") || 
+            token_is(parser, &op, "-=") || token_is(parser, &op, "*=") || token_is(parser, &op, "/=")) {
             parser_advance(parser);
             ASTNode *right = parse_assignment(parser);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_ASSIGNMENT_EXPR;
-            node->data.assign_expr.operator = strdup(op);
+            ASTNode *node = ast_new(parser, AST_ASSIGNMENT_EXPR);
+            node->data.assign_expr.operator = token_text(parser, &op);
             node->data.assign_expr.left = left;
             node->data.assign_expr.right = right;
             return node;
@@ -655,19 +644,18 @@ ASTNode *parse_expression(Parser *parser) {
 ASTNode *parse_block(Parser *parser) {
     parser_expect(parser, TOK_LBRACE);
     
-    ASTNode **statements = malloc(sizeof(ASTNode*) * 1000);
-    int stmt_count = 0;
+    list_t statements;
+    list_init(&statements);
     
     while (!parser_match(parser, TOK_RBRACE) && !parser_match(parser, TOK_EOF)) {
-        statements[stmt_count++] = parse_statement(parser);
+        list_append(&statements, parse_statement(parser));
     }
     
     parser_expect(parser, TOK_RBRACE);
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_BLOCK_STMT;
-    node->data.block_stmt.statements = statements;
-    node->data.block_stmt.statement_count = stmt_count;
+    ASTNode *node = ast_new(parser, AST_BLOCK_STMT);
+    node->data.block_stmt.statement_count = (int)statements.len;
+    node->data.block_stmt.statements = ast_list(parser, &statements);
     return node;
 }
 
@@ -680,14 +668,12 @@ ASTNode *parse_if_statement(Parser *parser) {
     ASTNode *consequent = parse_statement(parser);
     ASTNode *alternate = NULL;
     
-    if (parser_match(parser, TOK_KEYWORD) && 
-        strcmp(parser_current(parser)->value, "else") == 0) {
+    if (parser_match_value(parser, TOK_KEYWORD, "else")) {
         parser_advance(parser);
         alternate = parse_statement(parser);
     }
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_IF_STMT;
+    ASTNode *node = ast_new(parser, AST_IF_STMT);
     node->data.if_stmt.condition = condition;
     node->data.if_stmt.consequent = consequent;
     node->data.if_stmt.alternate = alternate;
@@ -702,17 +688,17 @@ ASTNode *parse_for_statement(Parser *parser) {
     
     // Check if init is a variable declaration
     if (parser_match(parser, TOK_TYPE) || 
-        (parser_match(parser, TOK_IDENTIFIER) && parser->pos + 1 < parser->count && 
-         parser->tokens[parser->pos + 1]->type == TOK_IDENTIFIER)) {
+        (parser_match(parser, TOK_IDENTIFIER) && 
+         parser_peek(parser, 1)->type == TOK_IDENTIFIER)) {
         
-        Token *type_token = parser_current(parser);
+        Token type_token = *parser_current(parser);
         parser_advance(parser);
         
-        Token *name_token = parser_expect(parser, TOK_IDENTIFIER);
+        Token name_token = parser_expect(parser, TOK_IDENTIFIER);
         
         ASTNode *initializer = NULL;
         bool is_array = false;
-        char *array_size = NULL;
+        const char *array_size = NULL;
         
         // Check for array
         if (parser_match(parser, TOK_LBRACKET)) {
@@ -720,28 +706,26 @@ ASTNode *parse_for_statement(Parser *parser) {
             is_array = true;
             
             if (parser_match(parser, TOK_NUMBER)) {
-                array_size = strdup(parser_current(parser)->value);
+                array_size = token_text(parser, parser_current(parser));
                 parser_advance(parser);
             } else if (parser_match(parser, TOK_IDENTIFIER)) {
-                array_size = strdup(parser_current(parser)->value);
+                array_size = token_text(parser, parser_current(parser));
                 parser_advance(parser);
             }
             
             parser_expect(parser, TOK_RBRACKET);
         }
         
-        if (parser_match(parser, TOK_OPERATOR) && 
-            strcmp(parser_current(parser)->value, "=") == 0) {
+        if (parser_match_value(parser, TOK_OPERATOR, "=")) {
             parser_advance(parser);
             initializer = parse_expression(parser);
         }
         
-        init = malloc(sizeof(ASTNode));
-        init->type = AST_VARIABLE_DECL;
+        init = ast_new(parser, AST_VARIABLE_DECL);
         init->data.var_decl.qualifiers = NULL;
         init->data.var_decl.qualifier_count = 0;
-        init->data.var_decl.type = strdup(type_token->value);
-        init->data.var_decl.name = strdup(name_token->value);
+        init->data.var_decl.type = token_text(parser, &type_token);
+        init->data.var_decl.name = token_text(parser, &name_token);
         init->data.var_decl.initializer = initializer;
         init->data.var_decl.is_array = is_array;
         init->data.var_decl.array_size = array_size;
@@ -759,8 +743,7 @@ ASTNode *parse_for_statement(Parser *parser) {
     
     ASTNode *body = parse_statement(parser);
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_FOR_STMT;
+    ASTNode *node = ast_new(parser, AST_FOR_STMT);
     node->data.for_stmt.init = init;
     node->data.for_stmt.test = test;
     node->data.for_stmt.update = update;
@@ -776,8 +759,7 @@ ASTNode *parse_while_statement(Parser *parser) {
     
     ASTNode *body = parse_statement(parser);
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_WHILE_STMT;
+    ASTNode *node = ast_new(parser, AST_WHILE_STMT);
     node->data.while_stmt.test = test;
     node->data.while_stmt.body = body;
     return node;
@@ -793,48 +775,108 @@ ASTNode *parse_return_statement(Parser *parser) {
     
     parser_expect(parser, TOK_SEMICOLON);
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_RETURN_STMT;
+    ASTNode *node = ast_new(parser, AST_RETURN_STMT);
     node->data.return_stmt.argument = argument;
     return node;
 }
 
+// Reads `#pragma unroll`, `#pragma unroll N` or `#pragma unroll(N)`.
+// Returns false for any other directive.
+static bool directive_unroll(Parser *parser, Token *directive, int *unroll) {
+    char text[64];
+    int length = directive->length < (int)sizeof(text) - 1 ? directive->length : (int)sizeof(text) - 1;
+    memcpy(text, parser->source + directive->offset, length);
+    text[length] = '\0';
+
+    int end = 0;
+    sscanf(text, "# pragma unroll%n", &end);
+    if (end == 0 || isalnum((unsigned char)text[end]) || text[end] == '_') return false;
+
+    const char *p = text + end;
+    while (isspace((unsigned char)*p) || *p == '(') p++;
+    if (!isdigit((unsigned char)*p)) {
+        *unroll = UNROLL_FULL;
+        return true;
+    }
+    long n = strtol(p, NULL, 10);
+    if (n < 1) {
+        fprintf(stderr, "Warning: line %d: ignoring #pragma unroll %ld\n", directive->line, n);
+        return false;
+    }
+    *unroll = n > 1024 ? 1024 : (int)n;
+    return true;
+}
+
+// A directive inside a function; `#pragma unroll` applies to the loop
+// after it, anything else is ignored
+ASTNode *parse_directive(Parser *parser) {
+    Token directive = *parser_current(parser);
+    parser_advance(parser);
+
+    // Nothing left in the block to apply it to
+    if (parser_match(parser, TOK_RBRACE) || parser_match(parser, TOK_EOF)) {
+        ASTNode *node = ast_new(parser, AST_EXPRESSION_STMT);
+        node->data.expr_stmt.expression = NULL;
+        return node;
+    }
+
+    int unroll;
+    if (!directive_unroll(parser, &directive, &unroll)) return parse_statement(parser);
+
+    ASTNode *stmt = parse_statement(parser);
+    if (stmt->type == AST_FOR_STMT) {
+        stmt->data.for_stmt.unroll = unroll;
+    } else if (stmt->type == AST_WHILE_STMT) {
+        stmt->data.while_stmt.unroll = unroll;
+    } else {
+        fprintf(stderr, "Warning: line %d: #pragma unroll is not followed by a loop\n", directive.line);
+    }
+    return stmt;
+}
+
 ASTNode *parse_statement(Parser *parser) {
+    if (parser_match(parser, TOK_DIRECTIVE)) {
+        return parse_directive(parser);
+    }
+
     if (parser_match(parser, TOK_KEYWORD)) {
-        const char *keyword = parser_current(parser)->value;
-        if (strcmp(keyword, "if") == 0) {
+        Token *keyword = parser_current(parser);
+        if (token_is(parser, keyword, "if")) {
             return parse_if_statement(parser);
-        } else if (strcmp(keyword, "for") == 0) {
+        } else if (token_is(parser, keyword, "for")) {
             return parse_for_statement(parser);
-        } else if (strcmp(keyword, "while") == 0) {
+        } else if (token_is(parser, keyword, "while")) {
             return parse_while_statement(parser);
-        } else if (strcmp(keyword, "return") == 0) {
+        } else if (token_is(parser, keyword, "return")) {
             return parse_return_statement(parser);
-        } else if (strcmp(keyword, "const") == 0) {
+        } else if (token_is(parser, keyword, "break") || token_is(parser, keyword, "continue")) {
+            ASTNodeType type = token_is(parser, keyword, "break") ? AST_BREAK_STMT : AST_CONTINUE_STMT;
+            parser_advance(parser);
+            parser_expect(parser, TOK_SEMICOLON);
+            return ast_new(parser, type);
+        } else if (token_is(parser, keyword, "const")) {
             // Handle const variable declaration inside function
             parser_advance(parser); // skip 'const'
             
-            Token *type_token = parser_expect(parser, TOK_TYPE);
-            Token *name_token = parser_expect(parser, TOK_IDENTIFIER);
+            Token type_token = parser_expect(parser, TOK_TYPE);
+            Token name_token = parser_expect(parser, TOK_IDENTIFIER);
             
             ASTNode *initializer = NULL;
-            if (parser_match(parser, TOK_OPERATOR) && 
-                strcmp(parser_current(parser)->value, "=") == 0) {
+            if (parser_match_value(parser, TOK_OPERATOR, "=")) {
                 parser_advance(parser);
                 initializer = parse_expression(parser);
             }
             
             parser_expect(parser, TOK_SEMICOLON);
             
-            char **qualifiers = malloc(sizeof(char*) * 1);
-            qualifiers[0] = strdup("const");
+            const char **qualifiers = arena_alloc(parser->arena, sizeof(char*) * 1);
+            qualifiers[0] = str_intern("const");
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_VARIABLE_DECL;
+            ASTNode *node = ast_new(parser, AST_VARIABLE_DECL);
             node->data.var_decl.qualifiers = qualifiers;
             node->data.var_decl.qualifier_count = 1;
-            node->data.var_decl.type = strdup(type_token->value);
-            node->data.var_decl.name = strdup(name_token->value);
+            node->data.var_decl.type = token_text(parser, &type_token);
+            node->data.var_decl.name = token_text(parser, &name_token);
             node->data.var_decl.initializer = initializer;
             return node;
         }
@@ -846,19 +888,19 @@ ASTNode *parse_statement(Parser *parser) {
     
     // Check for local variable declaration (type followed by identifier)
     if (parser_match(parser, TOK_TYPE) || 
-        (parser_match(parser, TOK_IDENTIFIER) && parser->pos + 1 < parser->count && 
-         parser->tokens[parser->pos + 1]->type == TOK_IDENTIFIER)) {
+        (parser_match(parser, TOK_IDENTIFIER) && 
+         parser_peek(parser, 1)->type == TOK_IDENTIFIER)) {
         
-        Token *type_token = parser_current(parser);
+        Token type_token = *parser_current(parser);
         parser_advance(parser);
         
         if (parser_match(parser, TOK_IDENTIFIER)) {
-            Token *name_token = parser_current(parser);
+            Token name_token = *parser_current(parser);
             parser_advance(parser);
             
             ASTNode *initializer = NULL;
             bool is_array = false;
-            char *array_size = NULL;
+            const char *array_size = NULL;
             
             // Check for array declaration
             if (parser_match(parser, TOK_LBRACKET)) {
@@ -866,10 +908,10 @@ ASTNode *parse_statement(Parser *parser) {
                 is_array = true;
                 
                 if (parser_match(parser, TOK_NUMBER)) {
-                    array_size = strdup(parser_current(parser)->value);
+                    array_size = token_text(parser, parser_current(parser));
                     parser_advance(parser);
                 } else if (parser_match(parser, TOK_IDENTIFIER)) {
-                    array_size = strdup(parser_current(parser)->value);
+                    array_size = token_text(parser, parser_current(parser));
                     parser_advance(parser);
                 }
                 
@@ -877,20 +919,18 @@ ASTNode *parse_statement(Parser *parser) {
             }
             
             // Check for initialization
-            if (parser_match(parser, TOK_OPERATOR) && 
-                strcmp(parser_current(parser)->value, "=") == 0) {
+            if (parser_match_value(parser, TOK_OPERATOR, "=")) {
                 parser_advance(parser);
                 initializer = parse_expression(parser);
             }
             
             parser_expect(parser, TOK_SEMICOLON);
             
-            ASTNode *node = malloc(sizeof(ASTNode));
-            node->type = AST_VARIABLE_DECL;
+            ASTNode *node = ast_new(parser, AST_VARIABLE_DECL);
             node->data.var_decl.qualifiers = NULL;
             node->data.var_decl.qualifier_count = 0;
-            node->data.var_decl.type = strdup(type_token->value);
-            node->data.var_decl.name = strdup(name_token->value);
+            node->data.var_decl.type = token_text(parser, &type_token);
+            node->data.var_decl.name = token_text(parser, &name_token);
             node->data.var_decl.initializer = initializer;
             node->data.var_decl.is_array = is_array;
             node->data.var_decl.array_size = array_size;
@@ -908,60 +948,56 @@ ASTNode *parse_statement(Parser *parser) {
     ASTNode *expr = parse_expression(parser);
     parser_expect(parser, TOK_SEMICOLON);
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_EXPRESSION_STMT;
+    ASTNode *node = ast_new(parser, AST_EXPRESSION_STMT);
     node->data.expr_stmt.expression = expr;
     return node;
 }
 
-ASTNode *parse_function(Parser *parser, char **qualifiers, int qual_count, 
+ASTNode *parse_function(Parser *parser, const char **qualifiers, int qual_count, 
                         const char *return_type, const char *name) {
     parser_expect(parser, TOK_LPAREN);
     
-    Parameter *params = malloc(sizeof(Parameter) * 100);
-    int param_count = 0;
+    list_t params;
+    list_init(&params);
     
     while (!parser_match(parser, TOK_RPAREN)) {
-        if (param_count > 0) {
+        if (params.len > 0) {
             parser_expect(parser, TOK_COMMA);
         }
         
         // Accept both TYPE and IDENTIFIER tokens as types (for user-defined types)
-        Token *param_type = parser_current(parser);
+        Token param_type = *parser_current(parser);
         if (!parser_match(parser, TOK_TYPE) && !parser_match(parser, TOK_IDENTIFIER)) {
             fprintf(stderr, "Error: expected type in parameter list\n");
             exit(1);
         }
         parser_advance(parser);
         
-        Token *param_name = parser_expect(parser, TOK_IDENTIFIER);
+        Token param_name = parser_expect(parser, TOK_IDENTIFIER);
         
-        params[param_count].type = strdup(param_type->value);
-        params[param_count].name = strdup(param_name->value);
-        param_count++;
+        list_append(&params, ast_param_new(parser, &param_type, &param_name));
     }
     
     parser_expect(parser, TOK_RPAREN);
     
     ASTNode *body = parse_block(parser);
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_FUNCTION_DECL;
+    ASTNode *node = ast_new(parser, AST_FUNCTION_DECL);
     node->data.func_decl.qualifiers = qualifiers;
     node->data.func_decl.qualifier_count = qual_count;
-    node->data.func_decl.return_type = strdup(return_type);
-    node->data.func_decl.name = strdup(name);
-    node->data.func_decl.params = params;
-    node->data.func_decl.param_count = param_count;
+    node->data.func_decl.return_type = return_type;
+    node->data.func_decl.name = name;
+    node->data.func_decl.param_count = (int)params.len;
+    node->data.func_decl.params = ast_params(parser, &params);
     node->data.func_decl.body = body;
     return node;
 }
 
-ASTNode *parse_variable(Parser *parser, char **qualifiers, int qual_count,
+ASTNode *parse_variable(Parser *parser, const char **qualifiers, int qual_count,
                         const char *var_type, const char *name) {
     ASTNode *initializer = NULL;
     bool is_array = false;
-    char *array_size = NULL;
+    const char *array_size = NULL;
     
     // Check for array declaration
     if (parser_match(parser, TOK_LBRACKET)) {
@@ -970,79 +1006,104 @@ ASTNode *parse_variable(Parser *parser, char **qualifiers, int qual_count,
         
         // Get array size (could be number or expression)
         if (parser_match(parser, TOK_NUMBER)) {
-            array_size = strdup(parser_current(parser)->value);
+            array_size = token_text(parser, parser_current(parser));
             parser_advance(parser);
         } else if (parser_match(parser, TOK_IDENTIFIER)) {
-            array_size = strdup(parser_current(parser)->value);
+            array_size = token_text(parser, parser_current(parser));
             parser_advance(parser);
         }
         
         parser_expect(parser, TOK_RBRACKET);
     }
     
-    if (parser_match(parser, TOK_OPERATOR) && 
-        strcmp(parser_current(parser)->value, "=") == 0) {
+    if (parser_match_value(parser, TOK_OPERATOR, "=")) {
         parser_advance(parser);
         initializer = parse_expression(parser);
     }
     
     parser_expect(parser, TOK_SEMICOLON);
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_VARIABLE_DECL;
+    ASTNode *node = ast_new(parser, AST_VARIABLE_DECL);
     node->data.var_decl.qualifiers = qualifiers;
     node->data.var_decl.qualifier_count = qual_count;
-    node->data.var_decl.type = strdup(var_type);
-    node->data.var_decl.name = strdup(name);
+    node->data.var_decl.type = var_type;
+    node->data.var_decl.name = name;
     node->data.var_decl.initializer = initializer;
     node->data.var_decl.is_array = is_array;
     node->data.var_decl.array_size = array_size;
     return node;
 }
 
+// __attribute__((name, ...)) before a declaration, such as always_inline
+// or noinline; the names are appended to `qualifiers`
+void parse_attributes(Parser *parser, list_t *qualifiers) {
+    parser_advance(parser); // skip '__attribute__'
+    parser_expect(parser, TOK_LPAREN);
+    parser_expect(parser, TOK_LPAREN);
+    bool first = true;
+    while (!parser_match(parser, TOK_RPAREN)) {
+        if (!first) parser_expect(parser, TOK_COMMA);
+        Token name = parser_expect(parser, TOK_IDENTIFIER);
+        list_append(qualifiers, (void*)token_text(parser, &name));
+        first = false;
+    }
+    parser_expect(parser, TOK_RPAREN);
+    parser_expect(parser, TOK_RPAREN);
+}
+
 ASTNode *parse_declaration(Parser *parser) {
     // Handle struct declarations
-    if (parser_match(parser, TOK_KEYWORD) &&
-        strcmp(parser_current(parser)->value, "struct") == 0) {
+    if (parser_match_value(parser, TOK_KEYWORD, "struct")) {
         parser_advance(parser); // skip 'struct'
         
-        Token *name_token = parser_expect(parser, TOK_IDENTIFIER);
+        Token name_token = parser_expect(parser, TOK_IDENTIFIER);
         parser_expect(parser, TOK_LBRACE);
         
-        Parameter *fields = malloc(sizeof(Parameter) * 100);
-        int field_count = 0;
+        list_t fields;
+        list_init(&fields);
         
         while (!parser_match(parser, TOK_RBRACE)) {
             // Accept both TYPE and IDENTIFIER (for user-defined types)
-            Token *field_type = parser_current(parser);
+            Token field_type = *parser_current(parser);
             if (!parser_match(parser, TOK_TYPE) && !parser_match(parser, TOK_IDENTIFIER)) {
                 fprintf(stderr, "Error: expected type in struct field\n");
                 exit(1);
             }
             parser_advance(parser);
             
-            Token *field_name = parser_expect(parser, TOK_IDENTIFIER);
+            Token field_name = parser_expect(parser, TOK_IDENTIFIER);
+            Parameter *field = ast_param_new(parser, &field_type, &field_name);
+            
+            // Fixed-size array field: number or const name
+            if (parser_match(parser, TOK_LBRACKET)) {
+                parser_advance(parser);
+                Token size = *parser_current(parser);
+                if (!parser_match(parser, TOK_NUMBER) && !parser_match(parser, TOK_IDENTIFIER)) {
+                    fprintf(stderr, "Error at line %d:%d: expected array size in struct field\n",
+                            size.line, size.col);
+                    exit(1);
+                }
+                parser_advance(parser);
+                field->array_size = token_text(parser, &size);
+                parser_expect(parser, TOK_RBRACKET);
+            }
             parser_expect(parser, TOK_SEMICOLON);
             
-            fields[field_count].type = strdup(field_type->value);
-            fields[field_count].name = strdup(field_name->value);
-            field_count++;
+            list_append(&fields, field);
         }
         
         parser_expect(parser, TOK_RBRACE);
         parser_expect(parser, TOK_SEMICOLON);
         
-        ASTNode *node = malloc(sizeof(ASTNode));
-        node->type = AST_STRUCT_DECL;
-        node->data.struct_decl.name = strdup(name_token->value);
-        node->data.struct_decl.fields = fields;
-        node->data.struct_decl.field_count = field_count;
+        ASTNode *node = ast_new(parser, AST_STRUCT_DECL);
+        node->data.struct_decl.name = token_text(parser, &name_token);
+        node->data.struct_decl.field_count = (int)fields.len;
+        node->data.struct_decl.fields = ast_params(parser, &fields);
         return node;
     }
     
     // Handle precision statements (GLSL specific)
-    if (parser_match(parser, TOK_KEYWORD) && 
-        strcmp(parser_current(parser)->value, "precision") == 0) {
+    if (parser_match_value(parser, TOK_KEYWORD, "precision")) {
         parser_advance(parser); // skip 'precision'
         
         if (parser_match(parser, TOK_KEYWORD)) {
@@ -1056,12 +1117,11 @@ ASTNode *parse_declaration(Parser *parser) {
         parser_expect(parser, TOK_SEMICOLON);
         
         // Return empty variable declaration for precision statements
-        ASTNode *node = malloc(sizeof(ASTNode));
-        node->type = AST_VARIABLE_DECL;
+        ASTNode *node = ast_new(parser, AST_VARIABLE_DECL);
         node->data.var_decl.qualifiers = NULL;
         node->data.var_decl.qualifier_count = 0;
-        node->data.var_decl.type = strdup("precision");
-        node->data.var_decl.name = strdup("statement");
+        node->data.var_decl.type = str_intern("precision");
+        node->data.var_decl.name = str_intern("statement");
         node->data.var_decl.initializer = NULL;
         node->data.var_decl.is_array = false;
         node->data.var_decl.array_size = NULL;
@@ -1069,15 +1129,14 @@ ASTNode *parse_declaration(Parser *parser) {
     }
     
     // Handle const declarations
-    if (parser_match(parser, TOK_KEYWORD) &&
-        strcmp(parser_current(parser)->value, "const") == 0) {
+    if (parser_match_value(parser, TOK_KEYWORD, "const")) {
         parser_advance(parser); // skip 'const'
         
-        Token *type_token = parser_expect(parser, TOK_TYPE);
-        Token *name_token = parser_expect(parser, TOK_IDENTIFIER);
+        Token type_token = parser_expect(parser, TOK_TYPE);
+        Token name_token = parser_expect(parser, TOK_IDENTIFIER);
         
         bool is_array = false;
-        char *array_size = NULL;
+        const char *array_size = NULL;
         
         // Check for array
         if (parser_match(parser, TOK_LBRACKET)) {
@@ -1085,10 +1144,10 @@ ASTNode *parse_declaration(Parser *parser) {
             is_array = true;
             
             if (parser_match(parser, TOK_NUMBER)) {
-                array_size = strdup(parser_current(parser)->value);
+                array_size = token_text(parser, parser_current(parser));
                 parser_advance(parser);
             } else if (parser_match(parser, TOK_IDENTIFIER)) {
-                array_size = strdup(parser_current(parser)->value);
+                array_size = token_text(parser, parser_current(parser));
                 parser_advance(parser);
             }
             
@@ -1099,31 +1158,32 @@ ASTNode *parse_declaration(Parser *parser) {
         ASTNode *initializer = parse_expression(parser);
         parser_expect(parser, TOK_SEMICOLON);
         
-        char **qualifiers = malloc(sizeof(char*) * 1);
-        qualifiers[0] = strdup("const");
+        const char **qualifiers = arena_alloc(parser->arena, sizeof(char*) * 1);
+        qualifiers[0] = str_intern("const");
         
-        ASTNode *node = malloc(sizeof(ASTNode));
-        node->type = AST_VARIABLE_DECL;
+        ASTNode *node = ast_new(parser, AST_VARIABLE_DECL);
         node->data.var_decl.qualifiers = qualifiers;
         node->data.var_decl.qualifier_count = 1;
-        node->data.var_decl.type = strdup(type_token->value);
-        node->data.var_decl.name = strdup(name_token->value);
+        node->data.var_decl.type = token_text(parser, &type_token);
+        node->data.var_decl.name = token_text(parser, &name_token);
         node->data.var_decl.initializer = initializer;
         node->data.var_decl.is_array = is_array;
         node->data.var_decl.array_size = array_size;
         return node;
     }
     
-    char **qualifiers = malloc(sizeof(char*) * 10);
-    int qual_count = 0;
-    
-    // Parse qualifiers
-    while (parser_match(parser, TOK_KEYWORD)) {
-        const char *kw = parser_current(parser)->value;
-        if (strcmp(kw, "uniform") == 0 || strcmp(kw, "varying") == 0 ||
-            strcmp(kw, "attribute") == 0 ||
-            strcmp(kw, "in") == 0 || strcmp(kw, "out") == 0 || strcmp(kw, "inout") == 0) {
-            qualifiers[qual_count++] = strdup(kw);
+    list_t qualifiers;
+    list_init(&qualifiers);
+    
+    // Parse qualifiers; each name in __attribute__((...)) is one too
+    while (parser_match(parser, TOK_KEYWORD) || parser_match_value(parser, TOK_IDENTIFIER, "__attribute__")) {
+        Token *kw = parser_current(parser);
+        if (kw->type == TOK_IDENTIFIER) {
+            parse_attributes(parser, &qualifiers);
+        } else if (token_is(parser, kw, "uniform") || token_is(parser, kw, "varying") ||
+            token_is(parser, kw, "attribute") ||
+            token_is(parser, kw, "in") || token_is(parser, kw, "out") || token_is(parser, kw, "inout")) {
+            list_append(&qualifiers, (void*)token_text(parser, kw));
             parser_advance(parser);
         } else {
             break;
@@ -1133,40 +1193,49 @@ ASTNode *parse_declaration(Parser *parser) {
     // Check for type (including user-defined types like struct names)
     if (!parser_match(parser, TOK_TYPE) && !parser_match(parser, TOK_IDENTIFIER)) {
         Token *tok = parser_current(parser);
-        fprintf(stderr, "Error at line %d:%d: Expected type, got '%s' (type=%s)\n",
-                tok->line, tok->col, tok->value, token_type_to_string(tok->type));
+        fprintf(stderr, "Error at line %d:%d: Expected type, got '%.*s' (type=%s)\n",
+                tok->line, tok->col, tok->length, parser->source + tok->offset,
+                token_type_to_string(tok->type));
         exit(1);
     }
     
     // Parse type (could be built-in type or user-defined type)
-    Token *type_token = parser_current(parser);
+    Token type_token = *parser_current(parser);
     parser_advance(parser);
-    const char *var_type = type_token->value;
+    const char *var_type = token_text(parser, &type_token);
     
     // Parse identifier
-    Token *name_token = parser_expect(parser, TOK_IDENTIFIER);
-    const char *name = name_token->value;
+    Token name_token = parser_expect(parser, TOK_IDENTIFIER);
+    const char *name = token_text(parser, &name_token);
+    
+    int qual_count = (int)qualifiers.len;
+    const char **quals = (const char**)list_to_arena(&qualifiers, parser->arena);
+    list_release(&qualifiers);
     
     // Check if function or variable
     if (parser_match(parser, TOK_LPAREN)) {
-        return parse_function(parser, qualifiers, qual_count, var_type, name);
+        return parse_function(parser, quals, qual_count, var_type, name);
     } else {
-        return parse_variable(parser, qualifiers, qual_count, var_type, name);
+        return parse_variable(parser, quals, qual_count, var_type, name);
     }
 }
 
 ASTNode *parse_program(Parser *parser) {
-    ASTNode **declarations = malloc(sizeof(ASTNode*) * 1000);
-    int decl_count = 0;
+    list_t declarations;
+    list_init(&declarations);
     
     while (!parser_match(parser, TOK_EOF)) {
-        declarations[decl_count++] = parse_declaration(parser);
+        // Directives between declarations (#version, ...) are ignored
+        if (parser_match(parser, TOK_DIRECTIVE)) {
+            parser_advance(parser);
+            continue;
+        }
+        list_append(&declarations, parse_declaration(parser));
     }
     
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->type = AST_PROGRAM;
-    node->data.program.declarations = declarations;
-    node->data.program.decl_count = decl_count;
+    ASTNode *node = ast_new(parser, AST_PROGRAM);
+    node->data.program.decl_count = (int)declarations.len;
+    node->data.program.declarations = ast_list(parser, &declarations);
     return node;
 }
 
@@ -1192,20 +1261,23 @@ const char *token_type_to_string(TokenType type) {
         case TOK_COMMA: return "COMMA";
         case TOK_DOT: return "DOT";
         case TOK_COMMENT: return "COMMENT";
+        case TOK_DIRECTIVE: return "DIRECTIVE";
         case TOK_EOF: return "EOF";
         default: return "UNKNOWN";
     }
 }
 
-void print_tokens(Token **tokens, int count, FILE *output) {
+// Token dump runs its own lexer pass over the source, with comments kept
+void print_tokens(arena_t *arena, const char *source, int length, FILE *output) {
+    Lexer *lexer = lexer_create(arena, source, length);
+    lexer->keep_comments = true;
+    
     fprintf(output, "=== TOKENS ===\n");
-    for (int i = 0; i < count; i++) {
-        if (tokens[i]->type == TOK_EOF) break;
-        if (tokens[i]->type == TOK_COMMENT) continue;
-        fprintf(output, "%3d:%-3d %-15s %s\n", 
-                tokens[i]->line, tokens[i]->col,
-                token_type_to_string(tokens[i]->type),
-                tokens[i]->value);
+    for (Token token = lexer_next(lexer); token.type != TOK_EOF; token = lexer_next(lexer)) {
+        fprintf(output, "%3d:%-3d %-15s %.*s\n", 
+                token.line, token.col,
+                token_type_to_string(token.type),
+                token.length, source + token.offset);
     }
     fprintf(output, "\n");
 }
@@ -1218,6 +1290,14 @@ void print_indent(int indent, FILE *output) {
     }
 }
 
+// The `#pragma unroll` of a loop, if it has one
+void print_unroll(int unroll, int indent, FILE *output) {
+    if (unroll == UNROLL_DEFAULT) return;
+    print_indent(indent, output);
+    if (unroll == UNROLL_FULL) fprintf(output, "Unroll: full\n");
+    else fprintf(output, "Unroll: %d\n", unroll);
+}
+
 void print_ast_node(ASTNode *node, int indent, FILE *output) {
     if (!node) {
         print_indent(indent, output);
@@ -1253,9 +1333,13 @@ void print_ast_node(ASTNode *node, int indent, FILE *output) {
             fprintf(output, "StructDeclaration: %s\n", node->data.struct_decl.name);
             for (int i = 0; i < node->data.struct_decl.field_count; i++) {
                 print_indent(indent + 1, output);
-                fprintf(output, "Field: %s %s\n",
+                fprintf(output, "Field: %s %s",
                         node->data.struct_decl.fields[i].type,
                         node->data.struct_decl.fields[i].name);
+                if (node->data.struct_decl.fields[i].array_size) {
+                    fprintf(output, "[%s]", node->data.struct_decl.fields[i].array_size);
+                }
+                fprintf(output, "\n");
             }
             break;
             
@@ -1304,6 +1388,7 @@ void print_ast_node(ASTNode *node, int indent, FILE *output) {
             
         case AST_FOR_STMT:
             fprintf(output, "ForStatement:\n");
+            print_unroll(node->data.for_stmt.unroll, indent + 1, output);
             print_indent(indent + 1, output);
             fprintf(output, "Init:\n");
             print_ast_node(node->data.for_stmt.init, indent + 2, output);
@@ -1320,6 +1405,7 @@ void print_ast_node(ASTNode *node, int indent, FILE *output) {
             
         case AST_WHILE_STMT:
             fprintf(output, "WhileStatement:\n");
+            print_unroll(node->data.while_stmt.unroll, indent + 1, output);
             print_indent(indent + 1, output);
             fprintf(output, "Test:\n");
             print_ast_node(node->data.while_stmt.test, indent + 2, output);
@@ -1335,6 +1421,14 @@ void print_ast_node(ASTNode *node, int indent, FILE *output) {
             }
             break;
             
+        case AST_BREAK_STMT:
+            fprintf(output, "BreakStatement\n");
+            break;
+            
+        case AST_CONTINUE_STMT:
+            fprintf(output, "ContinueStatement\n");
+            break;
+            
         case AST_BINARY_EXPR:
             fprintf(output, "BinaryExpression: %s\n", node->data.binary_expr.operator);
             print_indent(indent + 1, output);
@@ -1412,27 +1506,373 @@ void print_ast(ASTNode *ast, FILE *output) {
     print_ast_node(ast, 0, output);
 }
 
+// ============================================================================
+// FLAT AST PRINTING
+// ============================================================================
+
+// Same output as print_ast_node, produced from the index-based FlatAst
+void print_flat_node(FlatAst *ast, ast_index_t index, int indent, FILE *output) {
+    FlatNode *node = flat_node(ast, index);
+    if (!node) {
+        print_indent(indent, output);
+        fprintf(output, "NULL\n");
+        return;
+    }
+    
+    uint32_t *list = ast->lists + node->list_start;
+    
+    print_indent(indent, output);
+    
+    switch ((ASTNodeType)node->type) {
+        case AST_PROGRAM:
+        case AST_BLOCK_STMT:
+            fprintf(output, node->type == AST_PROGRAM ? "Program:\n" : "BlockStatement:\n");
+            for (uint32_t i = 0; i < node->list_count; i++) {
+                print_flat_node(ast, list[i], indent + 1, output);
+            }
+            break;
+            
+        case AST_FUNCTION_DECL:
+            fprintf(output, "FunctionDeclaration: %s %s (",
+                    flat_str(ast, node->str[1]), flat_str(ast, node->str[0]));
+            for (uint32_t i = node->qualifier_count; i < node->list_count; i += 2) {
+                if (i > node->qualifier_count) fprintf(output, ", ");
+                fprintf(output, "%s %s", flat_str(ast, list[i]), flat_str(ast, list[i + 1]));
+            }
+            fprintf(output, ")\n");
+            print_flat_node(ast, node->child[0], indent + 1, output);
+            break;
+            
+        case AST_STRUCT_DECL:
+            fprintf(output, "StructDeclaration: %s\n", flat_str(ast, node->str[0]));
+            for (uint32_t i = 0; i < node->list_count; i += 3) {
+                print_indent(indent + 1, output);
+                fprintf(output, "Field: %s %s",
+                        flat_str(ast, list[i]), flat_str(ast, list[i + 1]));
+                if (list[i + 2]) {
+                    fprintf(output, "[%s]", flat_str(ast, list[i + 2]));
+                }
+                fprintf(output, "\n");
+            }
+            break;
+            
+        case AST_VARIABLE_DECL:
+            fprintf(output, "VariableDeclaration: %s %s",
+                    flat_str(ast, node->str[1]), flat_str(ast, node->str[0]));
+            if (node->is_array) {
+                fprintf(output, "[%s]", ast->strings + node->str[2]);
+            }
+            fprintf(output, "\n");
+            if (node->child[0]) {
+                print_indent(indent + 1, output);
+                fprintf(output, "Initializer:\n");
+                print_flat_node(ast, node->child[0], indent + 2, output);
+            }
+            break;
+            
+        case AST_EXPRESSION_STMT:
+            fprintf(output, "ExpressionStatement:\n");
+            print_flat_node(ast, node->child[0], indent + 1, output);
+            break;
+            
+        case AST_IF_STMT:
+            fprintf(output, "IfStatement:\n");
+            print_indent(indent + 1, output);
+            fprintf(output, "Condition:\n");
+            print_flat_node(ast, node->child[0], indent + 2, output);
+            print_indent(indent + 1, output);
+            fprintf(output, "Consequent:\n");
+            print_flat_node(ast, node->child[1], indent + 2, output);
+            if (node->child[2]) {
+                print_indent(indent + 1, output);
+                fprintf(output, "Alternate:\n");
+                print_flat_node(ast, node->child[2], indent + 2, output);
+            }
+            break;
+            
+        case AST_FOR_STMT: {
+            static const char *labels[] = {"Init:\n", "Test:\n", "Update:\n", "Body:\n"};
+            fprintf(output, "ForStatement:\n");
+            print_unroll(node->unroll, indent + 1, output);
+            for (int i = 0; i < 4; i++) {
+                print_indent(indent + 1, output);
+                fprintf(output, "%s", labels[i]);
+                print_flat_node(ast, node->child[i], indent + 2, output);
+            }
+            break;
+        }
+            
+        case AST_WHILE_STMT:
+            fprintf(output, "WhileStatement:\n");
+            print_unroll(node->unroll, indent + 1, output);
+            print_indent(indent + 1, output);
+            fprintf(output, "Test:\n");
+            print_flat_node(ast, node->child[0], indent + 2, output);
+            print_indent(indent + 1, output);
+            fprintf(output, "Body:\n");
+            print_flat_node(ast, node->child[1], indent + 2, output);
+            break;
+            
+        case AST_RETURN_STMT:
+            fprintf(output, "ReturnStatement:\n");
+            if (node->child[0]) {
+                print_flat_node(ast, node->child[0], indent + 1, output);
+            }
+            break;
+            
+        case AST_BREAK_STMT:
+        case AST_CONTINUE_STMT:
+            fprintf(output, node->type == AST_BREAK_STMT ? "BreakStatement\n" : "ContinueStatement\n");
+            break;
+            
+        case AST_BINARY_EXPR:
+        case AST_ASSIGNMENT_EXPR:
+            fprintf(output, "%s: %s\n",
+                    node->type == AST_BINARY_EXPR ? "BinaryExpression" : "AssignmentExpression",
+                    flat_str(ast, node->str[0]));
+            print_indent(indent + 1, output);
+            fprintf(output, "Left:\n");
+            print_flat_node(ast, node->child[0], indent + 2, output);
+            print_indent(indent + 1, output);
+            fprintf(output, "Right:\n");
+            print_flat_node(ast, node->child[1], indent + 2, output);
+            break;
+            
+        case AST_UNARY_EXPR:
+            fprintf(output, "UnaryExpression: %s\n", flat_str(ast, node->str[0]));
+            print_flat_node(ast, node->child[0], indent + 1, output);
+            break;
+            
+        case AST_CALL_EXPR:
+            fprintf(output, "CallExpression:\n");
+            print_indent(indent + 1, output);
+            fprintf(output, "Callee:\n");
+            print_flat_node(ast, node->child[0], indent + 2, output);
+            print_indent(indent + 1, output);
+            fprintf(output, "Arguments:\n");
+            for (uint32_t i = 0; i < node->list_count; i++) {
+                print_flat_node(ast, list[i], indent + 2, output);
+            }
+            break;
+            
+        case AST_MEMBER_EXPR:
+            fprintf(output, "MemberExpression: .%s\n", flat_str(ast, node->str[0]));
+            print_indent(indent + 1, output);
+            fprintf(output, "Object:\n");
+            print_flat_node(ast, node->child[0], indent + 2, output);
+            break;
+            
+        case AST_ARRAY_EXPR:
+            fprintf(output, "ArrayExpression:\n");
+            print_indent(indent + 1, output);
+            fprintf(output, "Array:\n");
+            print_flat_node(ast, node->child[0], indent + 2, output);
+            print_indent(indent + 1, output);
+            fprintf(output, "Index:\n");
+            print_flat_node(ast, node->child[1], indent + 2, output);
+            break;
+            
+        case AST_CONSTRUCTOR_EXPR:
+            fprintf(output, "ConstructorExpression: %s\n", flat_str(ast, node->str[0]));
+            for (uint32_t i = 0; i < node->list_count; i++) {
+                print_flat_node(ast, list[i], indent + 1, output);
+            }
+            break;
+            
+        case AST_IDENTIFIER:
+            fprintf(output, "Identifier: %s\n", flat_str(ast, node->str[0]));
+            break;
+            
+        case AST_LITERAL:
+            fprintf(output, "Literal: %s\n", flat_str(ast, node->str[0]));
+            break;
+    }
+}
+
+void print_flat_ast(FlatAst *ast, FILE *output) {
+    fprintf(output, "\n=== ABSTRACT SYNTAX TREE ===\n");
+    print_flat_node(ast, ast->root, 0, output);
+}
+
+// ============================================================================
+// TIME REPORT
+// ============================================================================
+
+typedef enum {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_RESOLVE,
+    PHASE_CODEGEN,
+    PHASE_EMIT,
+    PHASE_COUNT
+} Phase;
+
+static const char *phase_names[PHASE_COUNT] = {
+    "lex", "parse", "resolve", "codegen", "emit"
+};
+
+typedef struct {
+    double wall_ms;
+    crt_alloc_stats_t alloc;    // Allocations made during the phase
+    long peak_rss_kb;           // Peak RSS of the process at the end of the phase
+} PhaseStats;
+
+// Lexing is measured by a dedicated tokenizer pass; the parse phase
+// includes the tokens the parser pulls on demand.
+typedef struct {
+    bool enabled;
+    bool json;
+    PhaseStats phases[PHASE_COUNT];
+    struct timespec start;
+    crt_alloc_stats_t alloc_start;
+    size_t source_bytes;
+    size_t tokens;
+    size_t nodes;
+    size_t emitted_bytes;
+} TimeReport;
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;     // Kilobytes on Linux
+}
+
+void phase_begin(TimeReport *report) {
+    if (!report->enabled) return;
+    report->alloc_start = crt_alloc_stats;
+    clock_gettime(CLOCK_MONOTONIC, &report->start);
+}
+
+void phase_end(TimeReport *report, Phase phase) {
+    if (!report->enabled) return;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    PhaseStats *stats = &report->phases[phase];
+    stats->wall_ms += (end.tv_sec - report->start.tv_sec) * 1e3 +
+                      (end.tv_nsec - report->start.tv_nsec) / 1e6;
+    stats->alloc.heap_allocs += crt_alloc_stats.heap_allocs - report->alloc_start.heap_allocs;
+    stats->alloc.heap_bytes += crt_alloc_stats.heap_bytes - report->alloc_start.heap_bytes;
+    stats->alloc.arena_allocs += crt_alloc_stats.arena_allocs - report->alloc_start.arena_allocs;
+    stats->alloc.arena_bytes += crt_alloc_stats.arena_bytes - report->alloc_start.arena_bytes;
+    stats->peak_rss_kb = peak_rss_kb();
+}
+
+static PhaseStats phase_total(TimeReport *report) {
+    PhaseStats total = {0};
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        PhaseStats *stats = &report->phases[i];
+        total.wall_ms += stats->wall_ms;
+        total.alloc.heap_allocs += stats->alloc.heap_allocs;
+        total.alloc.heap_bytes += stats->alloc.heap_bytes;
+        total.alloc.arena_allocs += stats->alloc.arena_allocs;
+        total.alloc.arena_bytes += stats->alloc.arena_bytes;
+        if (stats->peak_rss_kb > total.peak_rss_kb) total.peak_rss_kb = stats->peak_rss_kb;
+    }
+    return total;
+}
+
+static void print_phase_row(FILE *out, const char *name, PhaseStats *stats) {
+    fprintf(out, "%-10s %10.3f %12zu %12zu %12zu %12zu %10ld\n", name,
+            stats->wall_ms, stats->alloc.heap_allocs, stats->alloc.heap_bytes,
+            stats->alloc.arena_allocs, stats->alloc.arena_bytes, stats->peak_rss_kb);
+}
+
+static void print_phase_json(FILE *out, const char *name, PhaseStats *stats) {
+    fprintf(out, "{\"name\": \"%s\", \"wall_ms\": %.3f, "
+            "\"heap_allocs\": %zu, \"heap_bytes\": %zu, "
+            "\"arena_allocs\": %zu, \"arena_bytes\": %zu, \"peak_rss_kb\": %ld}",
+            name, stats->wall_ms, stats->alloc.heap_allocs, stats->alloc.heap_bytes,
+            stats->alloc.arena_allocs, stats->alloc.arena_bytes, stats->peak_rss_kb);
+}
+
+void print_time_report(TimeReport *report, FILE *out) {
+    PhaseStats total = phase_total(report);
+    
+    if (report->json) {
+        fprintf(out, "{\"source_bytes\": %zu, \"tokens\": %zu, \"ast_nodes\": %zu, "
+                "\"emitted_bytes\": %zu,\n",
+                report->source_bytes, report->tokens, report->nodes, report->emitted_bytes);
+        fprintf(out, " \"phases\": [\n");
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            fprintf(out, "  ");
+            print_phase_json(out, phase_names[i], &report->phases[i]);
+            fprintf(out, i + 1 < PHASE_COUNT ? ",\n" : "\n");
+        }
+        fprintf(out, " ],\n \"total\": ");
+        print_phase_json(out, "total", &total);
+        fprintf(out, "}\n");
+        return;
+    }
+    
+    fprintf(out, "\n=== TIME REPORT ===\n");
+    fprintf(out, "source: %zu bytes, %zu tokens, %zu AST nodes; emitted %zu bytes\n",
+            report->source_bytes, report->tokens, report->nodes, report->emitted_bytes);
+    fprintf(out, "%-10s %10s %12s %12s %12s %12s %10s\n", "phase", "wall ms",
+            "heap allocs", "heap bytes", "arena allocs", "arena bytes", "peak KB");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        print_phase_row(out, phase_names[i], &report->phases[i]);
+    }
+    print_phase_row(out, "total", &total);
+}
+
 // ============================================================================
 // MAIN
 // ============================================================================
 
-char *read_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
+// Input source. Regular files are memory-mapped read-only and lexed in
+// place; anything that cannot be mapped (pipes, empty files) is read into
+// a heap buffer instead.
+typedef struct {
+    const char *data;
+    size_t size;
+    bool mapped;
+} SourceFile;
+
+bool source_open(SourceFile *src, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, "Error: could not open file '%s'\n", filename);
-        return NULL;
+        return false;
     }
     
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            src->data = map;
+            src->size = st.st_size;
+            src->mapped = true;
+            return true;
+        }
+    }
     
-    char *buffer = malloc(size + 1);
-    fread(buffer, 1, size, file);
-    buffer[size] = '\0';
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *buffer = crt_malloc(capacity);
+    ssize_t n;
+    while ((n = read(fd, buffer + size, capacity - size)) > 0) {
+        size += n;
+        if (size == capacity) {
+            capacity *= 2;
+            buffer = crt_realloc(buffer, capacity);
+        }
+    }
+    close(fd);
     
-    fclose(file);
-    return buffer;
+    src->data = buffer;
+    src->size = size;
+    src->mapped = false;
+    return true;
+}
+
+void source_close(SourceFile *src) {
+    if (src->mapped) {
+        munmap((void *)src->data, src->size);
+    } else {
+        free((void *)src->data);
+    }
 }
 
 void print_usage(const char *program_name) {
@@ -1441,7 +1881,16 @@ void print_usage(const char *program_name) {
     printf("\nOptions:\n");
     printf("  -t, --tokens       Print tokens\n");
     printf("  -a, --ast          Print AST\n");
+    printf("  --flat-ast         Print AST through the flat (index-based) representation\n");
     printf("  -o <file>          Output to file\n");
+    printf("  -ftime-report      Print per-phase time and memory usage to stderr\n");
+    printf("  -ftime-report=json Same, as JSON\n");
+    printf("  --trace            Trace code generation on stdout\n");
+    printf("  --dump-ir          Print the SSA IR of every function on stdout\n");
+    printf("  -ffp-contract=off|on|fast\n");
+    printf("                     Fuse a * b + c into fma never, within an expression\n");
+    printf("                     (default) or across statements\n");
+    printf("  -ffast-math        Allow float rewrites that change rounding\n");
     printf("  -h, --help         Show this help message\n");
     printf("\nExample:\n");
     printf("  %s shader.glsl -t -a\n", program_name);
@@ -1456,6 +1905,9 @@ int main(int argc, char **argv) {
     
     bool show_tokens = false;
     bool show_ast = false;
+    bool flat_ast = false;
+    int gen_flags = 0;
+    TimeReport report = {0};
     char *output_file = NULL;
     char *input_file = NULL;
     
@@ -1465,6 +1917,31 @@ int main(int argc, char **argv) {
             show_tokens = true;
         } else if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--ast") == 0) {
             show_ast = true;
+        } else if (strcmp(argv[i], "--flat-ast") == 0) {
+            show_ast = true;
+            flat_ast = true;
+        } else if (strcmp(argv[i], "-ftime-report") == 0) {
+            report.enabled = true;
+        } else if (strcmp(argv[i], "-ftime-report=json") == 0) {
+            report.enabled = true;
+            report.json = true;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            gen_flags |= GEN_TRACE;
+        } else if (strcmp(argv[i], "--dump-ir") == 0) {
+            gen_flags |= GEN_DUMP_IR;
+        } else if (strncmp(argv[i], "-ffp-contract=", 14) == 0) {
+            const char *mode = argv[i] + 14;
+            gen_flags &= ~(GEN_FP_CONTRACT_OFF | GEN_FP_CONTRACT_FAST);
+            if (strcmp(mode, "off") == 0) {
+                gen_flags |= GEN_FP_CONTRACT_OFF;
+            } else if (strcmp(mode, "fast") == 0) {
+                gen_flags |= GEN_FP_CONTRACT_FAST;
+            } else if (strcmp(mode, "on") != 0) {
+                fprintf(stderr, "Error: unknown -ffp-contract mode '%s'\n", mode);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-ffast-math") == 0) {
+            gen_flags |= GEN_FAST_MATH;
         } else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 < argc) {
                 output_file = argv[++i];
@@ -1492,9 +1969,9 @@ int main(int argc, char **argv) {
         show_ast = true;
     }
     
-    // Read input file
-    char *code = read_file(input_file);
-    if (!code) {
+    // Map input file
+    SourceFile source;
+    if (!source_open(&source, input_file)) {
         return 1;
     }
     
@@ -1504,28 +1981,56 @@ int main(int argc, char **argv) {
         output = fopen(output_file, "w");
         if (!output) {
             fprintf(stderr, "Error: could not open output file '%s'\n", output_file);
-            free(code);
+            source_close(&source);
             return 1;
         }
     }
     
-    // Lexer
-    Lexer *lexer = lexer_create(code);
-    int token_count;
-    Token **tokens = lexer_tokenize(lexer, &token_count);
-    
+    // All Lexer, Parser and AST memory is owned by the session arena
+    arena_t *session = arena_new(64 * 1024);
+
     if (show_tokens) {
-        print_tokens(tokens, token_count, output);
+        print_tokens(session, source.data, source.size, output);
     }
     
-    // Parser
-    Parser *parser = parser_create(tokens, token_count);
-    ASTNode *ast = NULL;
-
-    ast = parse_program(parser);
+    report.source_bytes = source.size;
+    
+    // Standalone tokenizer pass, only to measure the lexer
+    if (report.enabled) {
+        phase_begin(&report);
+        Lexer *lexer = lexer_create(session, source.data, source.size);
+        while (lexer_next(lexer).type != TOK_EOF) {
+            report.tokens++;
+        }
+        phase_end(&report, PHASE_LEX);
+    }
+    
+    // Lexer + Parser: tokens are pulled from the lexer as the parser needs them
+    phase_begin(&report);
+    Lexer *lexer = lexer_create(session, source.data, source.size);
+    Parser *parser = parser_create(session, source.data, lexer);
+    ASTNode *ast = parse_program(parser);
+    report.nodes = parser->node_count;
+    phase_end(&report, PHASE_PARSE);
 
-    gen_init(0);
-    gen_by_ast(ast);
+    phase_begin(&report);
+    gen_init(gen_flags);
+    bool ok = gen_resolve(ast) != 0;
+    phase_end(&report, PHASE_RESOLVE);
+    
+    // Errors are reported as they are found; they only set the exit status
+    phase_begin(&report);
+    if (!gen_by_ast(ast)) ok = false;
+    phase_end(&report, PHASE_CODEGEN);
+    
+    phase_begin(&report);
+    int emitted = gen_emit();
+    report.emitted_bytes = emitted > 0 ? emitted : 0;
+    if (emitted < 0) {
+        fprintf(stderr, "Error: could not write the code and data sections\n");
+        ok = false;
+    }
+    phase_end(&report, PHASE_EMIT);
     
     // Try to parse, catch errors
     if (show_ast) {
@@ -1534,16 +2039,29 @@ int main(int argc, char **argv) {
         
         // Debug: show first few tokens that will be parsed
         fprintf(output, "First tokens to parse:\n");
-        for (int i = 0; i < parser->count && i < 10; i++) {
-            fprintf(output, "  [%d] %s: '%s'\n", i, 
-                    token_type_to_string(parser->tokens[i]->type),
-                    parser->tokens[i]->value);
+        Lexer *first = lexer_create(session, source.data, source.size);
+        for (int i = 0; i < 10; i++) {
+            Token token = lexer_next(first);
+            if (token.type == TOK_EOF) break;
+            fprintf(output, "  [%d] %s: '%.*s'\n", i, 
+                    token_type_to_string(token.type),
+                    token.length, source.data + token.offset);
         }
         fprintf(output, "\n");
         fflush(output);
         
-        
-        print_ast(ast, output);
+        if (flat_ast) {
+            FlatAst flat;
+            flat_ast_build(&flat, ast);
+            print_flat_ast(&flat, output);
+            flat_ast_free(&flat);
+        } else {
+            print_ast(ast, output);
+        }
+    }
+    
+    if (report.enabled) {
+        print_time_report(&report, stderr);
     }
     
     // Cleanup
@@ -1551,17 +2069,9 @@ int main(int argc, char **argv) {
         fclose(output);
     }
     
-    free(code);
-    lexer_free(lexer);
-    parser_free(parser);
-    
-    for (int i = 0; i < token_count; i++) {
-        token_free(tokens[i]);
-    }
-    free(tokens);
-    
-    // Note: Should also free AST nodes recursively
-    // (omitted for brevity, but should be implemented in production)
+    arena_free(session);
+    str_intern_free();
+    source_close(&source);
     
-    return 0;
+    return ok ? 0 : 1;
 }
\ No newline at end of file
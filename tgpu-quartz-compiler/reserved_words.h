@@ -0,0 +1,101 @@
+// Generated by tools/gen_reserved_words.py - do not edit.
+#pragma once
+
+#define RESERVED_HASH_SIZE 128
+#define RESERVED_HASH(len, first, pen, last) \
+    (((len) * 1 + (first) * 5 + (pen) * 16 + (last) * 19) & (RESERVED_HASH_SIZE - 1))
+
+static const ReservedWord reserved_words[] = {
+    {"if",           2, TOK_KEYWORD, -1},
+    {"else",         4, TOK_KEYWORD, -1},
+    {"for",          3, TOK_KEYWORD, -1},
+    {"while",        5, TOK_KEYWORD, -1},
+    {"do",           2, TOK_KEYWORD, -1},
+    {"return",       6, TOK_KEYWORD, -1},
+    {"break",        5, TOK_KEYWORD, -1},
+    {"continue",     8, TOK_KEYWORD, -1},
+    {"const",        5, TOK_KEYWORD, -1},
+    {"struct",       6, TOK_KEYWORD, -1},
+    {"uniform",      7, TOK_KEYWORD, -1},
+    {"varying",      7, TOK_KEYWORD, -1},
+    {"attribute",    9, TOK_KEYWORD, -1},
+    {"in",           2, TOK_KEYWORD, -1},
+    {"out",          3, TOK_KEYWORD, -1},
+    {"inout",        5, TOK_KEYWORD, -1},
+    {"precision",    9, TOK_KEYWORD, -1},
+    {"mediump",      7, TOK_KEYWORD, -1},
+    {"highp",        5, TOK_KEYWORD, -1},
+    {"lowp",         4, TOK_KEYWORD, -1},
+    {"void",         4, TOK_TYPE,   BUILTIN_VOID},
+    {"int",          3, TOK_TYPE,   BUILTIN_INT},
+    {"float",        5, TOK_TYPE,   BUILTIN_FLOAT},
+    {"double",       6, TOK_TYPE,   BUILTIN_DOUBLE},
+    {"bool",         4, TOK_TYPE,   BUILTIN_BOOL},
+    {"char",         4, TOK_TYPE,   BUILTIN_CHAR},
+    {"fp16",         4, TOK_TYPE,   BUILTIN_FP16},
+    {"bf16",         4, TOK_TYPE,   BUILTIN_BF16},
+    {"bf32",         4, TOK_TYPE,   BUILTIN_BF32},
+    {"vec2",         4, TOK_TYPE,   BUILTIN_VEC2},
+    {"vec3",         4, TOK_TYPE,   BUILTIN_VEC3},
+    {"vec4",         4, TOK_TYPE,   BUILTIN_VEC4},
+    {"ivec2",        5, TOK_TYPE,   BUILTIN_IVEC2},
+    {"ivec3",        5, TOK_TYPE,   BUILTIN_IVEC3},
+    {"ivec4",        5, TOK_TYPE,   BUILTIN_IVEC4},
+    {"bvec2",        5, TOK_TYPE,   BUILTIN_BVEC2},
+    {"bvec3",        5, TOK_TYPE,   BUILTIN_BVEC3},
+    {"bvec4",        5, TOK_TYPE,   BUILTIN_BVEC4},
+    {"mat2",         4, TOK_TYPE,   BUILTIN_MAT2},
+    {"mat3",         4, TOK_TYPE,   BUILTIN_MAT3},
+    {"mat4",         4, TOK_TYPE,   BUILTIN_MAT4},
+    {"sampler2D",    9, TOK_TYPE,   BUILTIN_SAMPLER2D},
+    {"sampler3D",    9, TOK_TYPE,   BUILTIN_SAMPLER3D},
+    {"samplerCube", 11, TOK_TYPE,   BUILTIN_SAMPLERCUBE},
+};
+
+// Hash slot -> index into reserved_words + 1 (0 = empty slot)
+static const unsigned char reserved_slots[RESERVED_HASH_SIZE] = {
+    [  0] = 28,  // bf16
+    [  4] = 43,  // sampler3D
+    [  7] = 11,  // uniform
+    [ 10] =  6,  // return
+    [ 11] = 34,  // ivec3
+    [ 12] = 22,  // int
+    [ 17] = 10,  // struct
+    [ 20] = 27,  // fp16
+    [ 23] =  4,  // while
+    [ 26] = 15,  // out
+    [ 27] = 39,  // mat2
+    [ 30] = 35,  // ivec4
+    [ 44] =  2,  // else
+    [ 45] = 13,  // attribute
+    [ 46] = 40,  // mat3
+    [ 47] = 23,  // float
+    [ 49] =  1,  // if
+    [ 56] = 30,  // vec2
+    [ 57] = 24,  // double
+    [ 64] =  9,  // const
+    [ 65] = 41,  // mat4
+    [ 70] =  8,  // continue
+    [ 72] = 18,  // mediump
+    [ 73] = 14,  // in
+    [ 75] = 31,  // vec3
+    [ 78] = 21,  // void
+    [ 83] = 17,  // precision
+    [ 84] = 29,  // bf32
+    [ 85] = 36,  // bvec2
+    [ 90] = 12,  // varying
+    [ 93] = 19,  // highp
+    [ 94] = 32,  // vec4
+    [ 96] = 20,  // lowp
+    [ 98] = 25,  // bool
+    [103] =  3,  // for
+    [104] = 37,  // bvec3
+    [105] = 44,  // samplerCube
+    [112] =  7,  // break
+    [115] =  5,  // do
+    [116] = 42,  // sampler2D
+    [120] = 33,  // ivec2
+    [121] = 26,  // char
+    [123] = 38,  // bvec4
+    [126] = 16,  // inout
+};
@@ -0,0 +1,82 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+
+// ============================================================================
+// FMA CONTRACTION
+// ============================================================================
+
+// A float add whose operand is a product used nowhere else becomes one fma,
+// rounded once instead of twice. Subtractions contract when the operand to
+// negate is a constant; negating anything else costs the instruction the
+// fma saves. A matrix product plus a matrix becomes one wmma. The vector
+// unit has no fma, so vector products stay a vmul and a vadd.
+
+// A product that may be fused into its single user
+static bool contractible(IrInsn *mul, IrInsn *user, IrFpContract mode) {
+    if (mul->op != IR_MUL || mul->use_count != 1) return false;
+    if (mul->tgq_type != user->tgq_type || mul->components != user->components) return false;
+    if (user->tgq_type != TGQ_MATRIX && user->components != 1) return false;
+    return mode == IR_FP_CONTRACT_FAST || (!mul->assigned && mul->block == user->block);
+}
+
+static bool is_scalar_const(IrInsn *v) {
+    return v->op == IR_CONST && v->components == 1;
+}
+
+// A new constant with the opposite sign
+static IrInsn *negate_const(IrFunction *fn, IrInsn *c) {
+    float f = ir_decode_float(c->tgq_type, c->imm.bits);
+    return ir_const_bits(fn, c->type, ir_encode_float(c->tgq_type, -f));
+}
+
+// Turns `insn` into args[0] * args[1] + args[2] in place and drops `mul`
+static void make_fma(IrFunction *fn, IrInsn *insn, IrInsn *mul, IrInsn *a, IrInsn *b, IrInsn *c) {
+    insn->op = IR_FMA;
+    insn->arg_count = 0;
+    ir_add_arg(fn, insn, a);
+    ir_add_arg(fn, insn, b);
+    ir_add_arg(fn, insn, c);
+    ir_insn_remove(mul);
+}
+
+static void contract(IrFunction *fn, IrInsn *insn, IrFpContract mode) {
+    IrInsn *x = insn->args[0];
+    IrInsn *y = insn->args[1];
+
+    if (insn->op == IR_ADD) {
+        if (contractible(x, insn, mode)) make_fma(fn, insn, x, x->args[0], x->args[1], y);
+        else if (contractible(y, insn, mode)) make_fma(fn, insn, y, y->args[0], y->args[1], x);
+        return;
+    }
+
+    // a * b - k = fma(a, b, -k)
+    if (contractible(x, insn, mode) && is_scalar_const(y)) {
+        make_fma(fn, insn, x, x->args[0], x->args[1], negate_const(fn, y));
+        return;
+    }
+
+    // c - k * b = fma(-k, b, c)
+    if (contractible(y, insn, mode)) {
+        IrInsn *a = y->args[0], *b = y->args[1];
+        if (is_scalar_const(b)) {
+            IrInsn *t = a;
+            a = b;
+            b = t;
+        }
+        if (is_scalar_const(a)) make_fma(fn, insn, y, negate_const(fn, a), b, x);
+    }
+}
+
+void ir_contract_function(IrFunction *fn, IrFpContract mode) {
+    if (mode == IR_FP_CONTRACT_OFF) return;
+    ir_count_uses(fn);
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            bool is_float = ir_tgq_is_float(insn->tgq_type) || insn->tgq_type == TGQ_MATRIX;
+            if ((insn->op == IR_ADD || insn->op == IR_SUB) && is_float) {
+                contract(fn, insn, mode);
+            }
+        }
+    }
+}
@@ -0,0 +1,268 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// DEAD CODE ELIMINATION
+// ============================================================================
+
+// Stores go first, then every value that nothing live uses. A store is
+// dead when it is overwritten later in its block before anything may read
+// it, or when it goes to a variable of the function's own frame that the
+// function never reads: no other function sees that frame. Stores, copies,
+// terminators and calls with effects are live; a call has effects when
+// its callee writes the data section or calls something that does.
+
+#define DCE_PENDING_STORES 16
+
+// ============================================================================
+// CALL EFFECTS
+// ============================================================================
+
+typedef enum {
+    DCE_UNKNOWN,
+    DCE_VISITING,
+    DCE_PURE,
+    DCE_EFFECTS
+} DceEffect;
+
+// Recursion is rejected, so the call graph is walked depth first; a
+// cycle that slipped through counts as having effects
+static bool dce_has_effects(IrFunction *fn, uint8_t *effects) {
+    if (effects[fn->index] == DCE_PURE) return false;
+    if (effects[fn->index] != DCE_UNKNOWN) return true;
+    if (!fn->lowered || fn->failed) {
+        effects[fn->index] = DCE_EFFECTS;
+        return true;
+    }
+
+    effects[fn->index] = DCE_VISITING;
+    bool result = false;
+    for (int b = 0; b < fn->block_count && !result; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn && !result; insn = insn->next) {
+            if ((insn->op == IR_STORE || insn->op == IR_COPY) && insn->space == IR_SPACE_GLOBAL) {
+                result = true;
+            } else if (insn->op == IR_CALL) {
+                result = dce_has_effects(insn->func, effects);
+            }
+        }
+    }
+    effects[fn->index] = result ? DCE_EFFECTS : DCE_PURE;
+    return result;
+}
+
+// A call whose result is unused can go if the callee has no effects and
+// returns in registers: aggregates are copied out of its frame afterwards
+static bool dce_call_removable(IrInsn *call, uint8_t *effects) {
+    TypeInfo *ret = call->func->return_type;
+    if (ret->base != TYPE_VOID && call->type->base == TYPE_VOID) return false;
+    return !dce_has_effects(call->func, effects);
+}
+
+// ============================================================================
+// DEAD STORES
+// ============================================================================
+
+// Whether `obj` is a named variable in the frame of `fn`
+static bool dce_own_variable(IrFunction *fn, IrInsn *obj) {
+    return obj && obj->space == IR_SPACE_LOCAL && obj->func == fn && obj->sym;
+}
+
+// A read of a variable in the function's own frame
+typedef struct {
+    IrInsn *addr;
+    int size;
+} DceRead;
+
+// Drops stores to variables of the frame whose bytes are never read. A
+// read whose variable is unknown may read any of them.
+static void dce_unread_variables(IrFunction *fn) {
+    DceRead *reads = NULL;
+    int read_count = 0, read_capacity = 0;
+
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            IrInsn *addr = NULL;
+            int size = 0;
+            if (insn->op == IR_LOAD && insn->space == IR_SPACE_LOCAL) {
+                addr = insn->args[0];
+                size = ir_tgq_size(insn->tgq_type);
+            } else if (insn->op == IR_COPY && insn->src_space == IR_SPACE_LOCAL) {
+                addr = insn->args[1];
+                size = insn->imm.size;
+            }
+            if (!addr) continue;
+
+            IrInsn *obj = ir_address_object(addr);
+            if (!obj) {
+                free(reads);
+                return;
+            }
+            if (!dce_own_variable(fn, obj)) continue;
+            if (read_count == read_capacity) {
+                read_capacity = read_capacity ? read_capacity * 2 : 8;
+                reads = crt_realloc(reads, sizeof(DceRead) * read_capacity);
+            }
+            reads[read_count].addr = addr;
+            reads[read_count].size = size;
+            read_count++;
+        }
+    }
+
+    for (int b = 0; b < fn->block_count; b++) {
+        IrInsn *next;
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = next) {
+            next = insn->next;
+            if (insn->op != IR_STORE && insn->op != IR_COPY) continue;
+            if (insn->space != IR_SPACE_LOCAL) continue;
+            if (!dce_own_variable(fn, ir_address_object(insn->args[0]))) continue;
+
+            bool is_read = false;
+            for (int i = 0; i < read_count && !is_read; i++) {
+                is_read = ir_may_alias(insn->args[0], ir_write_size(insn), reads[i].addr, reads[i].size);
+            }
+            if (!is_read) ir_insn_remove(insn);
+        }
+    }
+    free(reads);
+}
+
+// A store further down the block that nothing has read since
+typedef struct {
+    IrInsn *addr;
+    int size;
+    uint8_t space;
+} DcePending;
+
+// Walks each block backwards remembering the stores ahead; a store whose
+// bytes one of them overwrites is dead. Loads and copies forget the stores
+// they may read, calls every store another function can see.
+static void dce_overwritten_stores(IrFunction *fn) {
+    DcePending pending[DCE_PENDING_STORES];
+
+    for (int b = 0; b < fn->block_count; b++) {
+        int count = 0;
+        IrInsn *prev;
+        for (IrInsn *insn = fn->blocks[b]->last; insn; insn = prev) {
+            prev = insn->prev;
+
+            if (insn->op == IR_STORE || insn->op == IR_COPY) {
+                IrAddress a = ir_address(insn->args[0]);
+                int size = ir_write_size(insn);
+                bool dead = false;
+                for (int i = 0; i < count && !dead; i++) {
+                    IrAddress p = ir_address(pending[i].addr);
+                    dead = pending[i].space == insn->space && ir_same_base(a.base, p.base) &&
+                           p.offset <= a.offset && a.offset + size <= p.offset + pending[i].size;
+                }
+                if (dead) {
+                    ir_insn_remove(insn);
+                    continue;
+                }
+            }
+
+            // Forget what this instruction may read
+            int kept = 0;
+            for (int i = 0; i < count; i++) {
+                bool read = false;
+                if (insn->op == IR_LOAD) {
+                    read = insn->space == pending[i].space &&
+                           ir_may_alias(insn->args[0], ir_tgq_size(insn->tgq_type),
+                                        pending[i].addr, pending[i].size);
+                } else if (insn->op == IR_COPY) {
+                    read = insn->src_space == pending[i].space &&
+                           ir_may_alias(insn->args[1], insn->imm.size,
+                                        pending[i].addr, pending[i].size);
+                } else if (insn->op == IR_CALL) {
+                    read = ir_call_may_access(fn, pending[i].addr);
+                }
+                if (!read) pending[kept++] = pending[i];
+            }
+            count = kept;
+
+            // When full, the store furthest down the block is forgotten
+            if (insn->op == IR_STORE || insn->op == IR_COPY) {
+                if (count == DCE_PENDING_STORES) {
+                    memmove(&pending[0], &pending[1], sizeof(DcePending) * --count);
+                }
+                pending[count].addr = insn->args[0];
+                pending[count].size = ir_write_size(insn);
+                pending[count].space = insn->space;
+                count++;
+            }
+        }
+    }
+}
+
+// ============================================================================
+// DEAD VALUES
+// ============================================================================
+
+static bool dce_is_root(IrInsn *insn, uint8_t *effects) {
+    switch (insn->op) {
+    case IR_STORE:
+    case IR_COPY:
+    case IR_JUMP:
+    case IR_BRANCH:
+    case IR_RET:
+        return true;
+    case IR_CALL:
+        return !dce_call_removable(insn, effects);
+    default:
+        return false;
+    }
+}
+
+// Marks from the roots through arguments and removes everything unmarked
+static void dce_values(IrFunction *fn, uint8_t *effects) {
+    bool *live = crt_calloc(fn->next_value_id, sizeof(bool));
+    int count = 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) count++;
+    }
+    IrInsn **stack = crt_malloc(sizeof(IrInsn*) * (count + 1));
+    int top = 0;
+
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            if (dce_is_root(insn, effects)) {
+                live[insn->id] = true;
+                stack[top++] = insn;
+            }
+        }
+    }
+    while (top > 0) {
+        IrInsn *insn = stack[--top];
+        for (int i = 0; i < insn->arg_count; i++) {
+            IrInsn *arg = insn->args[i];
+            if (!live[arg->id]) {
+                live[arg->id] = true;
+                stack[top++] = arg;
+            }
+        }
+    }
+
+    for (int b = 0; b < fn->block_count; b++) {
+        IrInsn *next;
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = next) {
+            next = insn->next;
+            if (!live[insn->id]) ir_insn_remove(insn);
+        }
+    }
+    free(stack);
+    free(live);
+}
+
+void ir_dce_module(IrModule *m) {
+    uint8_t *effects = crt_calloc(m->func_count > 0 ? m->func_count : 1, 1);
+    for (int i = 0; i < m->func_count; i++) {
+        IrFunction *fn = m->funcs[i];
+        if (!fn->lowered || fn->failed) continue;
+        dce_overwritten_stores(fn);
+        dce_unread_variables(fn);
+        dce_values(fn, effects);
+    }
+    free(effects);
+}
@@ -29,10 +29,21 @@ enum {
 };
 
 #define TGQ_SCALAR_REGISTER_COUNT 8
-#define TGQ_VECTOR_REGISTER_COUNT 8
+#define TGQ_VECTOR_REGISTER_COUNT 4
 #define TGQ_UNIFIED_MATRIX_REGISTER_COUNT 10
 
-#define GET_REG_COUNT_BY_TYPE(REG) ((REG < TGQ_V4I32) ? TGQ_SCALAR_REGISTER_COUNT : TGQ_VECTOR_REGISTER_COUNT)
+// Control registers holding the base address of each memory space; the
+// runtime sets them up before a kernel starts
+enum {
+    TGQ_CR_DATA_BASE,     // Global data section (ld_global/st_global)
+    TGQ_CR_LOCAL_BASE,    // Thread-local memory (ld_local/st_local)
+};
+
+// Registers per file: one file per scalar type, per vector type and the
+// unified matrix file
+#define GET_REG_COUNT_BY_TYPE(REG) ((REG) < TGQ_V4I32 ? TGQ_SCALAR_REGISTER_COUNT : \
+                                    (REG) < TGQ_MATRIX ? TGQ_VECTOR_REGISTER_COUNT : \
+                                    TGQ_UNIFIED_MATRIX_REGISTER_COUNT)
 
 enum {
     TGQ_I_NOP = 0x00,
@@ -73,6 +84,30 @@ enum {
     TGQ_I_ATOMIC_SUB,
     TGQ_I_ATOMIC_ST,
 
+    // Bit moves between register widths and float format conversions
+    TGQ_I_MV8_L16,
+    TGQ_I_MV8_H16,
+    TGQ_I_MV16_L32,
+    TGQ_I_MV16_H32,
+    TGQ_I_MV32_L64,
+    TGQ_I_MV32_H64,
+    TGQ_I_MV32TO16_FP,
+    TGQ_I_MV16TO32_FP,
+    TGQ_I_MV32TO16_BF,
+    TGQ_I_MV16TO32_BF,
+
+    // Matrix unit
+    TGQ_I_MLDV,
+    TGQ_I_MSTV,
+    TGQ_I_MVZ,
+    TGQ_I_MAZ,
+    TGQ_I_MADD,
+    TGQ_I_MSUB,
+    TGQ_I_MMUL,
+    TGQ_I_MXCHG,
+    TGQ_I_MMOV,
+    TGQ_I_WMMA,
+
     TGQ_I_RET = 0b10000000,
     TGQ_I_SYNC,
 
@@ -1,3 +1,5 @@
+#include "../crt.h"
+
 #include "tgpu_quartz_emit.h"
 #include <stdlib.h>
 #include <string.h>
@@ -10,7 +12,7 @@
 #define INITIAL_CAPACITY 1024
 
 void emit_init(EmitBuffer *buf) {
-    buf->data = malloc(INITIAL_CAPACITY);
+    buf->data = crt_malloc(INITIAL_CAPACITY);
     buf->size = 0;
     buf->capacity = INITIAL_CAPACITY;
 }
@@ -29,34 +31,55 @@ void emit_reset(EmitBuffer *buf) {
 }
 
 static void emit_grow(EmitBuffer *buf, int needed) {
-    if (buf->size + needed > buf->capacity) {
-        while (buf->capacity < buf->size + needed) {
-            buf->capacity *= 2;
-        }
-        buf->data = realloc(buf->data, buf->capacity);
+    if (buf->capacity == 0) buf->capacity = INITIAL_CAPACITY;
+    while (buf->capacity < buf->size + needed) {
+        buf->capacity *= 2;
+    }
+    buf->data = crt_realloc(buf->data, buf->capacity);
+}
+
+uint8_t *emit_reserve(EmitBuffer *buf, int n) {
+    if (buf->size + n > buf->capacity) {
+        emit_grow(buf, n);
     }
+    uint8_t *p = buf->data + buf->size;
+    buf->size += n;
+    return p;
+}
+
+// Little-endian stores into reserved space. The byte-wise form is what the
+// ISA specifies; compilers fold each of these into a single store.
+static inline void put_u16(uint8_t *p, uint16_t w) {
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+}
+
+static inline void put_u32(uint8_t *p, uint32_t w) {
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+static inline void put_u64(uint8_t *p, uint64_t w) {
+    put_u32(p, (uint32_t)w);
+    put_u32(p + 4, (uint32_t)(w >> 32));
 }
 
 void emit_byte(EmitBuffer *buf, uint8_t b) {
-    emit_grow(buf, 1);
-    buf->data[buf->size++] = b;
+    *emit_reserve(buf, 1) = b;
 }
 
 void emit_u16(EmitBuffer *buf, uint16_t w) {
-    emit_byte(buf, w & 0xFF);
-    emit_byte(buf, (w >> 8) & 0xFF);
+    put_u16(emit_reserve(buf, 2), w);
 }
 
 void emit_u32(EmitBuffer *buf, uint32_t w) {
-    emit_byte(buf, w & 0xFF);
-    emit_byte(buf, (w >> 8) & 0xFF);
-    emit_byte(buf, (w >> 16) & 0xFF);
-    emit_byte(buf, (w >> 24) & 0xFF);
+    put_u32(emit_reserve(buf, 4), w);
 }
 
 void emit_u64(EmitBuffer *buf, uint64_t w) {
-    emit_u32(buf, (uint32_t)(w & 0xFFFFFFFF));
-    emit_u32(buf, (uint32_t)((w >> 32) & 0xFFFFFFFF));
+    put_u64(emit_reserve(buf, 8), w);
 }
 
 void emit_i32(EmitBuffer *buf, int32_t w) {
@@ -64,70 +87,147 @@ void emit_i32(EmitBuffer *buf, int32_t w) {
 }
 
 void emit_f32(EmitBuffer *buf, float f) {
-    union { float f; uint32_t u; } conv;
-    conv.f = f;
-    emit_u32(buf, conv.u);
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    emit_u32(buf, u);
+}
+
+void emit_bytes(EmitBuffer *buf, const void *src, int n) {
+    memcpy(emit_reserve(buf, n), src, n);
 }
 
 // ============================================================================
 // LABEL MANAGEMENT
 // ============================================================================
 
+#define LABELS_INITIAL_CAPACITY 64
+
 void labels_init(LabelManager *lm) {
     memset(lm, 0, sizeof(LabelManager));
-    lm->next_label = 0;
 }
 
-int label_create(LabelManager *lm) {
-    int id = lm->next_label++;
-    if (id < MAX_LABELS) {
-        lm->labels[id].label_id = id;
-        lm->labels[id].position = -1;  // Not yet defined
-        lm->label_count++;
+void labels_free(LabelManager *lm) {
+    free(lm->labels);
+    free(lm->relocs);
+    memset(lm, 0, sizeof(LabelManager));
+}
+
+static int label_new(LabelManager *lm, int owner) {
+    if (lm->label_count == lm->label_capacity) {
+        lm->label_capacity = lm->label_capacity ? lm->label_capacity * 2 : LABELS_INITIAL_CAPACITY;
+        lm->labels = crt_realloc(lm->labels, lm->label_capacity * sizeof(LabelDef));
     }
+    int id = lm->label_count++;
+    lm->labels[id].position = -1;  // Not yet defined
+    lm->labels[id].owner = owner;
     return id;
 }
 
+int label_create(LabelManager *lm) {
+    return label_new(lm, lm->current_function);
+}
+
+int label_create_global(LabelManager *lm) {
+    return label_new(lm, 0);
+}
+
 void label_define(LabelManager *lm, EmitBuffer *buf, int label_id) {
-    if (label_id < MAX_LABELS) {
+    if (label_id >= 0 && label_id < lm->label_count) {
         lm->labels[label_id].position = buf->size;
     }
 }
 
+static void label_add_reloc_at(LabelManager *lm, int offset, int label_id, RelocType type) {
+    if (lm->reloc_count == lm->reloc_capacity) {
+        lm->reloc_capacity = lm->reloc_capacity ? lm->reloc_capacity * 2 : LABELS_INITIAL_CAPACITY;
+        lm->relocs = crt_realloc(lm->relocs, lm->reloc_capacity * sizeof(Relocation));
+    }
+    Relocation *r = &lm->relocs[lm->reloc_count++];
+    r->offset = offset;
+    r->label_id = label_id;
+    r->type = type;
+}
+
 void label_add_reloc(LabelManager *lm, EmitBuffer *buf, int label_id, RelocType type) {
-    if (lm->reloc_count < MAX_RELOCATIONS) {
-        Relocation *r = &lm->relocs[lm->reloc_count++];
-        r->offset = buf->size;
-        r->label_id = label_id;
-        r->type = type;
+    label_add_reloc_at(lm, buf->size, label_id, type);
+}
+
+static bool reloc_apply(LabelManager *lm, EmitBuffer *buf, Relocation *r) {
+    if (r->label_id < 0 || r->label_id >= lm->label_count) {
+        fprintf(stderr, "Error: invalid label id %d\n", r->label_id);
+        return false;
+    }
+
+    int target = lm->labels[r->label_id].position;
+    if (target < 0) {
+        fprintf(stderr, "Error: undefined label %d\n", r->label_id);
+        return false;
+    }
+
+    if (r->type == RELOC_BRANCH) {
+        // Relative offset from instruction position
+        int32_t offset = target - (r->offset + 4);  // +4 for size of offset itself
+        put_u32(&buf->data[r->offset], (uint32_t)offset);
+    } else {
+        // Absolute address
+        put_u64(&buf->data[r->offset], (uint64_t)target);
     }
+    return true;
 }
 
-bool labels_resolve(LabelManager *lm, EmitBuffer *buf) {
-    for (int i = 0; i < lm->reloc_count; i++) {
-        Relocation *r = &lm->relocs[i];
+static int reloc_compare(const void *a, const void *b) {
+    const Relocation *ra = a, *rb = b;
+    return (ra->offset > rb->offset) - (ra->offset < rb->offset);
+}
 
-        if (r->label_id >= MAX_LABELS) {
-            fprintf(stderr, "Error: invalid label id %d\n", r->label_id);
-            return false;
+// Fixups are recorded in emission order, so they are normally sorted
+// already; sort only when something was appended out of order.
+static void relocs_sort(Relocation *relocs, int count) {
+    for (int i = 1; i < count; i++) {
+        if (relocs[i].offset < relocs[i - 1].offset) {
+            qsort(relocs, count, sizeof(Relocation), reloc_compare);
+            return;
         }
+    }
+}
 
-        int target = lm->labels[r->label_id].position;
-        if (target < 0) {
-            fprintf(stderr, "Error: undefined label %d\n", r->label_id);
-            return false;
+void labels_begin_function(LabelManager *lm) {
+    lm->current_function = ++lm->function_count;
+    lm->function_reloc_start = lm->reloc_count;
+}
+
+bool labels_end_function(LabelManager *lm, EmitBuffer *buf) {
+    int fn = lm->current_function;
+    int start = lm->function_reloc_start;
+    int kept = start;
+    bool ok = true;
+
+    relocs_sort(lm->relocs + start, lm->reloc_count - start);
+    for (int i = start; i < lm->reloc_count; i++) {
+        Relocation *r = &lm->relocs[i];
+        int owner = (r->label_id >= 0 && r->label_id < lm->label_count) ? lm->labels[r->label_id].owner : fn;
+        if (owner == 0) {
+            lm->relocs[kept++] = *r;   // Global target, resolved by labels_resolve
+        } else if (owner != fn) {
+            fprintf(stderr, "Error: label %d belongs to another function\n", r->label_id);
+            ok = false;
+        } else if (!reloc_apply(lm, buf, r)) {
+            ok = false;
         }
+    }
+    lm->reloc_count = kept;
+    lm->current_function = 0;
+    return ok;
+}
 
-        if (r->type == RELOC_BRANCH) {
-            // Relative offset from instruction position
-            int32_t offset = target - (r->offset + 4);  // +4 for size of offset itself
-            memcpy(&buf->data[r->offset], &offset, 4);
-        } else {
-            // Absolute address
-            uint64_t addr = target;
-            memcpy(&buf->data[r->offset], &addr, 8);
+bool labels_resolve(LabelManager *lm, EmitBuffer *buf) {
+    relocs_sort(lm->relocs, lm->reloc_count);
+    for (int i = 0; i < lm->reloc_count; i++) {
+        if (!reloc_apply(lm, buf, &lm->relocs[i])) {
+            return false;
         }
     }
+    lm->reloc_count = 0;
     return true;
 }
 
@@ -149,27 +249,52 @@ void emit_nop(EmitBuffer *buf) {
 }
 
 void emit_scalar2(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t rd, uint8_t r1) {
-    emit_byte(buf, op);
-    emit_byte(buf, type);
-    emit_byte(buf, encode_reg(type, rd));
-    emit_byte(buf, encode_reg(type, r1));
+    uint8_t *p = emit_reserve(buf, 4);
+    p[0] = op;
+    p[1] = type;
+    p[2] = encode_reg(type, rd);
+    p[3] = encode_reg(type, r1);
 }
 
 void emit_scalar3(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2) {
-    emit_byte(buf, op);
-    emit_byte(buf, type);
-    emit_byte(buf, encode_reg(type, rd));
-    emit_byte(buf, encode_reg(type, r1));
-    emit_byte(buf, encode_reg(type, r2));
+    uint8_t *p = emit_reserve(buf, 5);
+    p[0] = op;
+    p[1] = type;
+    p[2] = encode_reg(type, rd);
+    p[3] = encode_reg(type, r1);
+    p[4] = encode_reg(type, r2);
 }
 
 void emit_scalar4(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2, uint8_t r3) {
-    emit_byte(buf, op);
-    emit_byte(buf, type);
-    emit_byte(buf, encode_reg(type, rd));
-    emit_byte(buf, encode_reg(type, r1));
-    emit_byte(buf, encode_reg(type, r2));
-    emit_byte(buf, encode_reg(type, r3));
+    uint8_t *p = emit_reserve(buf, 6);
+    p[0] = op;
+    p[1] = type;
+    p[2] = encode_reg(type, rd);
+    p[3] = encode_reg(type, r1);
+    p[4] = encode_reg(type, r2);
+    p[5] = encode_reg(type, r3);
+}
+
+// ============================================================================
+// BATCHED EMISSION
+// ============================================================================
+
+// Reserves space for the whole batch once and encodes straight into it
+void emit_batch(EmitBuffer *buf, const EmitInsn *insns, int count) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += 2 + insns[i].reg_count;
+    }
+
+    uint8_t *p = emit_reserve(buf, total);
+    for (int i = 0; i < count; i++) {
+        const EmitInsn *in = &insns[i];
+        *p++ = in->op;
+        *p++ = in->type;
+        for (int r = 0; r < in->reg_count; r++) {
+            *p++ = encode_reg(in->type, in->regs[r]);
+        }
+    }
 }
 
 // ============================================================================
@@ -229,7 +354,14 @@ void emit_shr(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2)
 // ============================================================================
 
 void emit_mov(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1) {
-    emit_scalar2(buf, TGQ_I_MOV, type, rd, r1);
+    if (type != TGQ_MATRIX) {
+        emit_scalar2(buf, TGQ_I_MOV, type, rd, r1);
+        return;
+    }
+    uint8_t *p = emit_reserve(buf, 3);
+    p[0] = TGQ_I_MMOV;
+    p[1] = encode_reg(TGQ_MATRIX, rd);
+    p[2] = encode_reg(TGQ_MATRIX, r1);
 }
 
 // ============================================================================
@@ -237,105 +369,219 @@ void emit_mov(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1) {
 // ============================================================================
 
 void emit_lconst8(EmitBuffer *buf, uint8_t rd, uint8_t value) {
-    emit_byte(buf, TGQ_I_LCONST8);
-    emit_byte(buf, encode_reg(TGQ_I8, rd));
-    emit_byte(buf, value);
+    uint8_t *p = emit_reserve(buf, 3);
+    p[0] = TGQ_I_LCONST8;
+    p[1] = encode_reg(TGQ_I8, rd);
+    p[2] = value;
 }
 
 void emit_lconst16(EmitBuffer *buf, uint8_t rd, uint16_t value) {
-    emit_byte(buf, TGQ_I_LCONST16);
-    emit_byte(buf, encode_reg(TGQ_I16, rd));
-    emit_u16(buf, value);
+    uint8_t *p = emit_reserve(buf, 4);
+    p[0] = TGQ_I_LCONST16;
+    p[1] = encode_reg(TGQ_I16, rd);
+    put_u16(p + 2, value);
 }
 
 void emit_lconst32(EmitBuffer *buf, uint8_t rd, uint32_t value) {
-    emit_byte(buf, TGQ_I_LCONST32);
-    emit_byte(buf, encode_reg(TGQ_I32, rd));
-    emit_u32(buf, value);
+    uint8_t *p = emit_reserve(buf, 6);
+    p[0] = TGQ_I_LCONST32;
+    p[1] = encode_reg(TGQ_I32, rd);
+    put_u32(p + 2, value);
 }
 
 void emit_lconst64(EmitBuffer *buf, uint8_t rd, uint64_t value) {
-    emit_byte(buf, TGQ_I_LCONST64);
-    emit_byte(buf, encode_reg(TGQ_I64, rd));
-    emit_u64(buf, value);
+    uint8_t *p = emit_reserve(buf, 10);
+    p[0] = TGQ_I_LCONST64;
+    p[1] = encode_reg(TGQ_I64, rd);
+    put_u64(p + 2, value);
 }
 
 void emit_lconst_f32(EmitBuffer *buf, uint8_t rd, float value) {
-    emit_byte(buf, TGQ_I_LCONST32);
-    emit_byte(buf, encode_reg(TGQ_FP32, rd));
-    emit_f32(buf, value);
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint8_t *p = emit_reserve(buf, 6);
+    p[0] = TGQ_I_LCONST32;
+    p[1] = encode_reg(TGQ_FP32, rd);
+    put_u32(p + 2, bits);
+}
+
+void emit_lconst(EmitBuffer *buf, uint8_t type, uint8_t rd, uint64_t bits) {
+    uint8_t *p;
+    switch (type) {
+    case TGQ_I8:
+        p = emit_reserve(buf, 3);
+        p[0] = TGQ_I_LCONST8;
+        p[2] = (uint8_t)bits;
+        break;
+    case TGQ_I16:
+    case TGQ_FP16:
+    case TGQ_BF16:
+        p = emit_reserve(buf, 4);
+        p[0] = TGQ_I_LCONST16;
+        put_u16(p + 2, (uint16_t)bits);
+        break;
+    case TGQ_I64:
+        p = emit_reserve(buf, 10);
+        p[0] = TGQ_I_LCONST64;
+        put_u64(p + 2, bits);
+        break;
+    default:
+        p = emit_reserve(buf, 6);
+        p[0] = TGQ_I_LCONST32;
+        put_u32(p + 2, (uint32_t)bits);
+        break;
+    }
+    p[1] = encode_reg(type, rd);
+}
+
+// ============================================================================
+// CONVERSION
+// ============================================================================
+
+// The type byte packs both types: destination high, source low
+void emit_mv(EmitBuffer *buf, uint8_t op, uint8_t dst_type, uint8_t src_type, uint8_t rd, uint8_t r1) {
+    uint8_t *p = emit_reserve(buf, 4);
+    p[0] = op;
+    p[1] = TGQ_R_GEN8(dst_type, src_type);
+    p[2] = encode_reg(dst_type, rd);
+    p[3] = encode_reg(src_type, r1);
+}
+
+// ============================================================================
+// MATRIX INSTRUCTIONS
+// ============================================================================
+
+// Column moves carry the lane in place of a type; the vector register is
+// encoded with its own type
+void emit_mldv(EmitBuffer *buf, uint8_t lane, uint8_t rd, uint8_t vec_type, uint8_t r1) {
+    uint8_t *p = emit_reserve(buf, 4);
+    p[0] = TGQ_I_MLDV;
+    p[1] = lane;
+    p[2] = encode_reg(TGQ_MATRIX, rd);
+    p[3] = encode_reg(vec_type, r1);
+}
+
+void emit_mstv(EmitBuffer *buf, uint8_t lane, uint8_t vec_type, uint8_t rd, uint8_t r1) {
+    uint8_t *p = emit_reserve(buf, 4);
+    p[0] = TGQ_I_MSTV;
+    p[1] = lane;
+    p[2] = encode_reg(vec_type, rd);
+    p[3] = encode_reg(TGQ_MATRIX, r1);
+}
+
+void emit_maz(EmitBuffer *buf, uint8_t rd) {
+    uint8_t *p = emit_reserve(buf, 2);
+    p[0] = TGQ_I_MAZ;
+    p[1] = encode_reg(TGQ_MATRIX, rd);
+}
+
+void emit_matrix3(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2) {
+    uint8_t *p = emit_reserve(buf, 5);
+    p[0] = op;
+    p[1] = type;
+    p[2] = encode_reg(TGQ_MATRIX, rd);
+    p[3] = encode_reg(TGQ_MATRIX, r1);
+    p[4] = encode_reg(TGQ_MATRIX, r2);
+}
+
+void emit_madd(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2) {
+    emit_matrix3(buf, TGQ_I_MADD, type, rd, r1, r2);
+}
+
+void emit_msub(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2) {
+    emit_matrix3(buf, TGQ_I_MSUB, type, rd, r1, r2);
+}
+
+void emit_mmul(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2) {
+    emit_matrix3(buf, TGQ_I_MMUL, type, rd, r1, r2);
+}
+
+void emit_wmma(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2, uint8_t r3) {
+    uint8_t *p = emit_reserve(buf, 6);
+    p[0] = TGQ_I_WMMA;
+    p[1] = type;
+    p[2] = encode_reg(TGQ_MATRIX, rd);
+    p[3] = encode_reg(TGQ_MATRIX, r1);
+    p[4] = encode_reg(TGQ_MATRIX, r2);
+    p[5] = encode_reg(TGQ_MATRIX, r3);
 }
 
 // ============================================================================
 // MEMORY INSTRUCTIONS
 // ============================================================================
 
+// op, type, data register, control base register, i32 offset register
+static void emit_mem(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t r, uint8_t rbase, uint8_t roff) {
+    uint8_t *p = emit_reserve(buf, 5);
+    p[0] = op;
+    p[1] = type;
+    p[2] = encode_reg(type, r);
+    p[3] = encode_reg(TGQ_CTRL, rbase);
+    p[4] = encode_reg(TGQ_I32, roff);
+}
+
 void emit_ld_global(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff) {
-    emit_scalar3(buf, TGQ_I_LD_GLOBAL, type, rd, rbase, roff);
+    emit_mem(buf, TGQ_I_LD_GLOBAL, type, rd, rbase, roff);
 }
 
 void emit_st_global(EmitBuffer *buf, uint8_t type, uint8_t rsrc, uint8_t rbase, uint8_t roff) {
-    emit_scalar3(buf, TGQ_I_ST_GLOBAL, type, rsrc, rbase, roff);
+    emit_mem(buf, TGQ_I_ST_GLOBAL, type, rsrc, rbase, roff);
 }
 
 void emit_ld_local(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff) {
-    emit_scalar3(buf, TGQ_I_LD_LOCAL, type, rd, rbase, roff);
+    emit_mem(buf, TGQ_I_LD_LOCAL, type, rd, rbase, roff);
 }
 
 void emit_st_local(EmitBuffer *buf, uint8_t type, uint8_t rsrc, uint8_t rbase, uint8_t roff) {
-    emit_scalar3(buf, TGQ_I_ST_LOCAL, type, rsrc, rbase, roff);
+    emit_mem(buf, TGQ_I_ST_LOCAL, type, rsrc, rbase, roff);
 }
 
 // ============================================================================
 // CONTROL FLOW INSTRUCTIONS
 // ============================================================================
 
+// op + 32-bit offset placeholder, patched by labels_resolve
+static void emit_jump(EmitBuffer *buf, uint8_t op, LabelManager *lm, int label_id) {
+    uint8_t *p = emit_reserve(buf, 5);
+    p[0] = op;
+    put_u32(p + 1, 0);
+    label_add_reloc_at(lm, buf->size - 4, label_id, RELOC_BRANCH);
+}
+
+// op, type, r1, r2 + 32-bit offset placeholder
+static void emit_cond_branch(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t r1, uint8_t r2,
+                             LabelManager *lm, int label_id) {
+    uint8_t *p = emit_reserve(buf, 8);
+    p[0] = op;
+    p[1] = type;
+    p[2] = encode_reg(type, r1);
+    p[3] = encode_reg(type, r2);
+    put_u32(p + 4, 0);
+    label_add_reloc_at(lm, buf->size - 4, label_id, RELOC_BRANCH);
+}
+
 void emit_bra(EmitBuffer *buf, LabelManager *lm, int label_id) {
-    emit_byte(buf, TGQ_I_BRA);
-    label_add_reloc(lm, buf, label_id, RELOC_BRANCH);
-    emit_i32(buf, 0);  // Placeholder for offset
+    emit_jump(buf, TGQ_I_BRA, lm, label_id);
 }
 
 void emit_beq(EmitBuffer *buf, uint8_t type, uint8_t r1, uint8_t r2, LabelManager *lm, int label_id) {
-    emit_byte(buf, TGQ_I_BEQ);
-    emit_byte(buf, type);
-    emit_byte(buf, encode_reg(type, r1));
-    emit_byte(buf, encode_reg(type, r2));
-    label_add_reloc(lm, buf, label_id, RELOC_BRANCH);
-    emit_i32(buf, 0);  // Placeholder
+    emit_cond_branch(buf, TGQ_I_BEQ, type, r1, r2, lm, label_id);
 }
 
 void emit_bne(EmitBuffer *buf, uint8_t type, uint8_t r1, uint8_t r2, LabelManager *lm, int label_id) {
-    emit_byte(buf, TGQ_I_BNE);
-    emit_byte(buf, type);
-    emit_byte(buf, encode_reg(type, r1));
-    emit_byte(buf, encode_reg(type, r2));
-    label_add_reloc(lm, buf, label_id, RELOC_BRANCH);
-    emit_i32(buf, 0);
+    emit_cond_branch(buf, TGQ_I_BNE, type, r1, r2, lm, label_id);
 }
 
 void emit_blt(EmitBuffer *buf, uint8_t type, uint8_t r1, uint8_t r2, LabelManager *lm, int label_id) {
-    emit_byte(buf, TGQ_I_BLT);
-    emit_byte(buf, type);
-    emit_byte(buf, encode_reg(type, r1));
-    emit_byte(buf, encode_reg(type, r2));
-    label_add_reloc(lm, buf, label_id, RELOC_BRANCH);
-    emit_i32(buf, 0);
+    emit_cond_branch(buf, TGQ_I_BLT, type, r1, r2, lm, label_id);
 }
 
 void emit_bgt(EmitBuffer *buf, uint8_t type, uint8_t r1, uint8_t r2, LabelManager *lm, int label_id) {
-    emit_byte(buf, TGQ_I_BGT);
-    emit_byte(buf, type);
-    emit_byte(buf, encode_reg(type, r1));
-    emit_byte(buf, encode_reg(type, r2));
-    label_add_reloc(lm, buf, label_id, RELOC_BRANCH);
-    emit_i32(buf, 0);
+    emit_cond_branch(buf, TGQ_I_BGT, type, r1, r2, lm, label_id);
 }
 
 void emit_call(EmitBuffer *buf, LabelManager *lm, int label_id) {
-    emit_byte(buf, TGQ_I_CALL);
-    label_add_reloc(lm, buf, label_id, RELOC_BRANCH);
-    emit_i32(buf, 0);
+    emit_jump(buf, TGQ_I_CALL, lm, label_id);
 }
 
 void emit_ret(EmitBuffer *buf) {
@@ -352,15 +598,15 @@ void emit_sync(EmitBuffer *buf) {
 // ============================================================================
 
 void emit_atomic_add(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff) {
-    emit_scalar3(buf, TGQ_I_ATOMIC_ADD, type, rd, rbase, roff);
+    emit_mem(buf, TGQ_I_ATOMIC_ADD, type, rd, rbase, roff);
 }
 
 void emit_atomic_sub(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff) {
-    emit_scalar3(buf, TGQ_I_ATOMIC_SUB, type, rd, rbase, roff);
+    emit_mem(buf, TGQ_I_ATOMIC_SUB, type, rd, rbase, roff);
 }
 
 void emit_atomic_st(EmitBuffer *buf, uint8_t type, uint8_t rsrc, uint8_t rbase, uint8_t roff) {
-    emit_scalar3(buf, TGQ_I_ATOMIC_ST, type, rsrc, rbase, roff);
+    emit_mem(buf, TGQ_I_ATOMIC_ST, type, rsrc, rbase, roff);
 }
 
 // ============================================================================
@@ -426,6 +672,31 @@ static const char *opcode_names[] = {
     [TGQ_I_LCONST16]  = "lconst.16",
     [TGQ_I_LCONST32]  = "lconst.32",
     [TGQ_I_LCONST64]  = "lconst.64",
+    [TGQ_I_LCONST32_CTRL] = "lconst.32.ctrl",
+    [TGQ_I_LCONST64_CTRL] = "lconst.64.ctrl",
+    [TGQ_I_ATOMIC_ADD] = "atomic_add",
+    [TGQ_I_ATOMIC_SUB] = "atomic_sub",
+    [TGQ_I_ATOMIC_ST]  = "atomic_st",
+    [TGQ_I_MV8_L16]    = "mv8.l16",
+    [TGQ_I_MV8_H16]    = "mv8.h16",
+    [TGQ_I_MV16_L32]   = "mv16.l32",
+    [TGQ_I_MV16_H32]   = "mv16.h32",
+    [TGQ_I_MV32_L64]   = "mv32.l64",
+    [TGQ_I_MV32_H64]   = "mv32.h64",
+    [TGQ_I_MV32TO16_FP] = "mv32to16.fp",
+    [TGQ_I_MV16TO32_FP] = "mv16to32.fp",
+    [TGQ_I_MV32TO16_BF] = "mv32to16.bf",
+    [TGQ_I_MV16TO32_BF] = "mv16to32.bf",
+    [TGQ_I_MLDV]       = "mldv",
+    [TGQ_I_MSTV]       = "mstv",
+    [TGQ_I_MVZ]        = "mvz",
+    [TGQ_I_MAZ]        = "maz",
+    [TGQ_I_MADD]       = "madd",
+    [TGQ_I_MSUB]       = "msub",
+    [TGQ_I_MMUL]       = "mmul",
+    [TGQ_I_MXCHG]      = "mxchg",
+    [TGQ_I_MMOV]       = "mmov",
+    [TGQ_I_WMMA]       = "wmma",
 };
 
 static const char *type_names[] = {
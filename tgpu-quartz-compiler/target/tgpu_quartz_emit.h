@@ -15,13 +15,18 @@ typedef struct {
     int capacity;
 } EmitBuffer;
 
+// One register-form instruction (op, type, 2-4 registers) for emit_batch
+typedef struct {
+    uint8_t op;
+    uint8_t type;
+    uint8_t reg_count;
+    uint8_t regs[4];
+} EmitInsn;
+
 // ============================================================================
 // LABEL MANAGEMENT
 // ============================================================================
 
-#define MAX_LABELS 256
-#define MAX_RELOCATIONS 512
-
 typedef enum {
     RELOC_BRANCH,      // Relative branch offset
     RELOC_ABSOLUTE     // Absolute address
@@ -34,18 +39,25 @@ typedef struct {
 } Relocation;
 
 typedef struct {
-    int label_id;
     int position;      // Position in buffer (-1 if not defined)
+    int owner;         // Function namespace, 0 for global labels
 } LabelDef;
 
+// Label ids index `labels` directly; both arrays grow on demand. Labels
+// created between labels_begin_function and labels_end_function belong to
+// that function, and its branches to them are fixed up when it ends.
 typedef struct {
-    LabelDef labels[MAX_LABELS];
+    LabelDef *labels;
     int label_count;
+    int label_capacity;
 
-    Relocation relocs[MAX_RELOCATIONS];
+    Relocation *relocs;
     int reloc_count;
+    int reloc_capacity;
 
-    int next_label;
+    int current_function;   // Open namespace, 0 when emitting globally
+    int function_count;
+    int function_reloc_start;
 } LabelManager;
 
 // ============================================================================
@@ -66,6 +78,10 @@ void emit_init(EmitBuffer *buf);
 void emit_free(EmitBuffer *buf);
 void emit_reset(EmitBuffer *buf);
 
+// Grows the buffer once for n bytes, advances size and returns the space to
+// fill. The pointer is valid until the next emission into the same buffer.
+uint8_t *emit_reserve(EmitBuffer *buf, int n);
+
 // Raw byte emission
 void emit_byte(EmitBuffer *buf, uint8_t b);
 void emit_u16(EmitBuffer *buf, uint16_t w);
@@ -73,15 +89,25 @@ void emit_u32(EmitBuffer *buf, uint32_t w);
 void emit_u64(EmitBuffer *buf, uint64_t w);
 void emit_i32(EmitBuffer *buf, int32_t w);
 void emit_f32(EmitBuffer *buf, float f);
+void emit_bytes(EmitBuffer *buf, const void *src, int n);
 
 // ============================================================================
 // LABEL MANAGEMENT API
 // ============================================================================
 
 void labels_init(LabelManager *lm);
+void labels_free(LabelManager *lm);
 int label_create(LabelManager *lm);
+int label_create_global(LabelManager *lm);
 void label_define(LabelManager *lm, EmitBuffer *buf, int label_id);
 void label_add_reloc(LabelManager *lm, EmitBuffer *buf, int label_id, RelocType type);
+
+// Function namespaces: end resolves the function's own branches and keeps
+// only fixups that target global labels
+void labels_begin_function(LabelManager *lm);
+bool labels_end_function(LabelManager *lm, EmitBuffer *buf);
+
+// Applies all pending fixups in buffer order
 bool labels_resolve(LabelManager *lm, EmitBuffer *buf);
 
 // ============================================================================
@@ -100,6 +126,9 @@ void emit_scalar3(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t rd, uint8_t
 // Scalar 4-operand: rd = op(r1, r2, r3) - for FMA
 void emit_scalar4(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2, uint8_t r3);
 
+// Register-form instructions in one reservation
+void emit_batch(EmitBuffer *buf, const EmitInsn *insns, int count);
+
 // Arithmetic shortcuts
 void emit_add(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
 void emit_sub(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
@@ -115,7 +144,7 @@ void emit_not(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1);
 void emit_shl(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
 void emit_shr(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
 
-// Move
+// Move; mmov for the matrix file
 void emit_mov(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1);
 
 // Load constant
@@ -125,7 +154,29 @@ void emit_lconst32(EmitBuffer *buf, uint8_t rd, uint32_t value);
 void emit_lconst64(EmitBuffer *buf, uint8_t rd, uint64_t value);
 void emit_lconst_f32(EmitBuffer *buf, uint8_t rd, float value);
 
-// Memory access
+// Constant of any scalar type: bits in the encoding of `type`, sized by it
+void emit_lconst(EmitBuffer *buf, uint8_t type, uint8_t rd, uint64_t bits);
+
+// Moves across register files: rd (dst_type) = op(r1 (src_type)) for the
+// mv8/mv16/mv32 bit moves and the mv32to16/mv16to32 float conversions
+void emit_mv(EmitBuffer *buf, uint8_t op, uint8_t dst_type, uint8_t src_type, uint8_t rd, uint8_t r1);
+
+// Matrix unit. A matrix register holds a 4x4 tile of 32-bit elements whose
+// columns mldv/mstv address by lane (0-3 for x-w); `type` is the element
+// type the arithmetic works on.
+void emit_mldv(EmitBuffer *buf, uint8_t lane, uint8_t rd, uint8_t vec_type, uint8_t r1);
+void emit_mstv(EmitBuffer *buf, uint8_t lane, uint8_t vec_type, uint8_t rd, uint8_t r1);
+void emit_maz(EmitBuffer *buf, uint8_t rd);
+
+// Matrix 3-operand: rd = op(r1, r2) for madd, msub and mmul
+void emit_matrix3(EmitBuffer *buf, uint8_t op, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
+void emit_madd(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
+void emit_msub(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
+void emit_mmul(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2);
+void emit_wmma(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t r1, uint8_t r2, uint8_t r3);
+
+// Memory access: rbase is a TGQ_CTRL register (TGQ_CR_*), roff an i32
+// register holding the byte offset
 void emit_ld_global(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff);
 void emit_st_global(EmitBuffer *buf, uint8_t type, uint8_t rsrc, uint8_t rbase, uint8_t roff);
 void emit_ld_local(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff);
@@ -144,6 +195,7 @@ void emit_sync(EmitBuffer *buf);
 // Atomic
 void emit_atomic_add(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff);
 void emit_atomic_sub(EmitBuffer *buf, uint8_t type, uint8_t rd, uint8_t rbase, uint8_t roff);
+void emit_atomic_st(EmitBuffer *buf, uint8_t type, uint8_t rsrc, uint8_t rbase, uint8_t roff);
 
 // ============================================================================
 // OUTPUT
@@ -0,0 +1,374 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// CONSTANT FOLDING
+// ============================================================================
+
+// Scalar instructions whose operands are constants become constants, and
+// identities (x * 1.0, x + 0, ...) forward to their operand. SSA makes the
+// propagation through locals implicit; phis merging a single value fold
+// too, which carries constants around loops and across branches.
+//
+// Folding reproduces the target's arithmetic bit for bit. Float operands
+// of every format are exact in a float; +, -, *, / and sqrt of fp16 and
+// bf16 computed in float and rounded once more are correctly rounded, as
+// float has more than twice their precision plus two bits. An fp16/bf16
+// fma is folded only when its double result is exact. Anything the target
+// may define differently (division by zero, NaN results, out of range
+// conversions, shifts right) is left to run time.
+
+typedef struct {
+    bool is_float;
+    int64_t i;
+    float f;
+} FoldValue;
+
+static bool fold_arg(IrInsn *insn, int index, FoldValue *out) {
+    IrInsn *arg = insn->args[index];
+    if (arg->op != IR_CONST || arg->components != 1) return false;
+    out->is_float = ir_tgq_is_float(arg->tgq_type);
+    if (out->is_float) out->f = ir_decode_float(arg->tgq_type, arg->imm.bits);
+    else out->i = ir_decode_int(arg->tgq_type, arg->imm.bits);
+    return true;
+}
+
+// Rounds a float result to the format of `tgq`
+static bool fold_float_bits(uint8_t tgq, float f, uint64_t *bits) {
+    if (isnan(f)) return false;
+    *bits = ir_encode_float(tgq, f);
+    return true;
+}
+
+static int tgq_bits(uint8_t tgq) {
+    return ir_tgq_size(tgq) * 8;
+}
+
+static bool fold_float_binary(IrOp op, uint8_t t, float a, float b, uint64_t *bits) {
+    switch (op) {
+    case IR_ADD: return fold_float_bits(t, a + b, bits);
+    case IR_SUB: return fold_float_bits(t, a - b, bits);
+    case IR_MUL: return fold_float_bits(t, a * b, bits);
+    case IR_DIV: return b != 0.0f && fold_float_bits(t, a / b, bits);
+    case IR_MIN:
+    case IR_MAX:
+        // NaNs and the order of signed zeros are the hardware's business
+        if (isnan(a) || isnan(b) || (a == b && signbit(a) != signbit(b))) return false;
+        return fold_float_bits(t, (op == IR_MIN) == (a < b) ? a : b, bits);
+    default:
+        return false;
+    }
+}
+
+static bool fold_int_binary(IrOp op, uint8_t t, int64_t a, int64_t b, uint64_t *bits) {
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    int64_t min = tgq_bits(t) == 64 ? INT64_MIN : -((int64_t)1 << (tgq_bits(t) - 1));
+    int64_t r;
+    switch (op) {
+    case IR_ADD: r = (int64_t)(ua + ub); break;
+    case IR_SUB: r = (int64_t)(ua - ub); break;
+    case IR_MUL: r = (int64_t)(ua * ub); break;
+    case IR_DIV:
+        if (b == 0 || (a == min && b == -1)) return false;
+        r = a / b;
+        break;
+    case IR_REM:
+        if (b == 0 || (a == min && b == -1)) return false;
+        r = a % b;
+        break;
+    case IR_AND: r = a & b; break;
+    case IR_OR:  r = a | b; break;
+    case IR_XOR: r = a ^ b; break;
+    case IR_SHL:
+        if (b < 0 || b >= tgq_bits(t)) return false;
+        r = (int64_t)(ua << b);
+        break;
+    case IR_MIN: r = a < b ? a : b; break;
+    case IR_MAX: r = a > b ? a : b; break;
+    default:     return false;
+    }
+    *bits = ir_encode_int(t, r);
+    return true;
+}
+
+static bool fold_compare(IrCmp cmp, FoldValue a, FoldValue b) {
+    if (a.is_float) {
+        switch (cmp) {
+        case IR_CMP_EQ: return a.f == b.f;
+        case IR_CMP_NE: return a.f != b.f;
+        case IR_CMP_LT: return a.f < b.f;
+        case IR_CMP_LE: return a.f <= b.f;
+        case IR_CMP_GT: return a.f > b.f;
+        case IR_CMP_GE: return a.f >= b.f;
+        }
+    }
+    switch (cmp) {
+    case IR_CMP_EQ: return a.i == b.i;
+    case IR_CMP_NE: return a.i != b.i;
+    case IR_CMP_LT: return a.i < b.i;
+    case IR_CMP_LE: return a.i <= b.i;
+    case IR_CMP_GT: return a.i > b.i;
+    case IR_CMP_GE: return a.i >= b.i;
+    }
+    return false;
+}
+
+static bool fold_convert(uint8_t to, FoldValue v, uint64_t *bits) {
+    if (ir_tgq_is_float(to)) {
+        if (!v.is_float) {
+            // Integers past 2^24 would round twice on their way to bf16
+            if (ir_tgq_lane(to) == TGQ_BF16 && (v.i > (1 << 24) || v.i < -(1 << 24))) return false;
+            return fold_float_bits(to, (float)v.i, bits);
+        }
+        return fold_float_bits(to, v.f, bits);
+    }
+    if (!v.is_float) {
+        *bits = ir_encode_int(to, v.i);
+        return true;
+    }
+    double limit = ldexp(1.0, tgq_bits(to) - 1);
+    if (isnan(v.f) || v.f >= limit || v.f <= -limit - 1.0) return false;
+    *bits = ir_encode_int(to, (int64_t)v.f);
+    return true;
+}
+
+// Fused multiply-add rounded once. Products of fp16/bf16 operands are exact
+// in a double; the sum is checked with Knuth's two-sum and then rounded
+// from the double to the 16-bit format.
+static bool fold_fma(uint8_t t, float a, float b, float c, uint64_t *bits) {
+    if (ir_tgq_lane(t) == TGQ_FP32 || ir_tgq_lane(t) == TGQ_BF32) {
+        return fold_float_bits(t, fmaf(a, b, c), bits);
+    }
+    double p = (double)a * b;
+    double s = p + c;
+    double bv = s - p;
+    double err = (p - (s - bv)) + (c - bv);
+    if (err != 0.0 || isnan(s) || isinf(s)) return false;
+    *bits = ir_encode_float(t, s);
+    return true;
+}
+
+// Constant result of `insn`, if every operand is a constant
+static bool fold_constant(IrInsn *insn, uint64_t *bits) {
+    if (insn->components != 1 || insn->arg_count == 0 || insn->arg_count > 3) return false;
+    FoldValue v[3] = {0};
+    for (int i = 0; i < insn->arg_count; i++) {
+        if (!fold_arg(insn, i, &v[i])) return false;
+    }
+    uint8_t t = insn->tgq_type;
+
+    switch (insn->op) {
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_REM:
+    case IR_AND: case IR_OR: case IR_XOR: case IR_SHL:
+    case IR_MIN: case IR_MAX:
+        if (v[0].is_float) return fold_float_binary(insn->op, t, v[0].f, v[1].f, bits);
+        return fold_int_binary(insn->op, t, v[0].i, v[1].i, bits);
+
+    case IR_NEG:
+        if (v[0].is_float) return fold_float_bits(t, -v[0].f, bits);
+        *bits = ir_encode_int(t, (int64_t)(0 - (uint64_t)v[0].i));
+        return true;
+
+    case IR_NOT:
+        if (v[0].is_float) return false;
+        *bits = ir_encode_int(t, insn->type->base == TYPE_BOOL ? v[0].i ^ 1 : ~v[0].i);
+        return true;
+
+    case IR_SQRT:
+        return v[0].is_float && v[0].f >= 0.0f && fold_float_bits(t, sqrtf(v[0].f), bits);
+
+    case IR_FMA:
+        return v[0].is_float && fold_fma(t, v[0].f, v[1].f, v[2].f, bits);
+
+    case IR_CMP:
+        *bits = ir_encode_int(t, fold_compare(insn->imm.cmp, v[0], v[1]));
+        return true;
+
+    case IR_CONVERT:
+        return fold_convert(t, v[0], bits);
+
+    default:
+        return false;
+    }
+}
+
+static bool is_const_int(IrInsn *v, int64_t value) {
+    return v->op == IR_CONST && v->components == 1 && !ir_tgq_is_float(v->tgq_type) &&
+           ir_decode_int(v->tgq_type, v->imm.bits) == value;
+}
+
+// Float constant with exactly these bits: 1.0 or +0.0 / -0.0, which are
+// the identities that hold bit for bit
+static bool is_const_float(IrInsn *v, float value) {
+    if (v->op != IR_CONST || v->components != 1 || !ir_tgq_is_float(v->tgq_type)) return false;
+    return v->imm.bits == ir_encode_float(v->tgq_type, value);
+}
+
+// Operand `insn` reduces to without computing anything, or NULL
+static IrInsn *fold_identity(IrInsn *insn) {
+    if (insn->arg_count < 1) return NULL;
+    IrInsn *a = insn->args[0];
+    IrInsn *b = insn->arg_count > 1 ? insn->args[1] : NULL;
+
+    if (ir_tgq_is_float(insn->tgq_type)) {
+        switch (insn->op) {
+        case IR_MUL:
+            if (is_const_float(b, 1.0f)) return a;
+            if (is_const_float(a, 1.0f)) return b;
+            return NULL;
+        case IR_DIV:
+            return is_const_float(b, 1.0f) ? a : NULL;
+        case IR_ADD:
+            // x + -0.0 is x for every x, x + 0.0 is not for x = -0.0
+            if (is_const_float(b, -0.0f)) return a;
+            if (is_const_float(a, -0.0f)) return b;
+            return NULL;
+        case IR_SUB:
+            return is_const_float(b, 0.0f) ? a : NULL;
+        case IR_NEG:
+            return a->op == IR_NEG ? a->args[0] : NULL;
+        default:
+            return NULL;
+        }
+    }
+
+    switch (insn->op) {
+    case IR_ADD:
+    case IR_OR:
+    case IR_XOR:
+        if (is_const_int(b, 0)) return a;
+        if (is_const_int(a, 0)) return b;
+        return NULL;
+    case IR_SUB:
+    case IR_SHL:
+        return is_const_int(b, 0) ? a : NULL;
+    case IR_MUL:
+        if (is_const_int(b, 1)) return a;
+        if (is_const_int(a, 1)) return b;
+        if (is_const_int(b, 0)) return b;
+        if (is_const_int(a, 0)) return a;
+        return NULL;
+    case IR_DIV:
+        return is_const_int(b, 1) ? a : NULL;
+    case IR_AND:
+        if (is_const_int(b, 0)) return b;
+        if (is_const_int(a, 0)) return a;
+        return a == b ? a : NULL;
+    case IR_MIN:
+    case IR_MAX:
+        return a == b ? a : NULL;
+    case IR_NEG:
+    case IR_NOT:
+        return a->op == insn->op && a->tgq_type == insn->tgq_type ? a->args[0] : NULL;
+    default:
+        return NULL;
+    }
+}
+
+// Lane `lane` of a vector built or updated by known instructions
+static IrInsn *fold_extract(IrInsn *insn) {
+    IrInsn *vec = insn->args[0];
+    int lane = insn->imm.lane;
+    while (vec->op == IR_INSERT && vec->imm.lane != lane) vec = vec->args[0];
+
+    IrInsn *value = NULL;
+    if (vec->op == IR_INSERT) value = vec->args[1];
+    else if (vec->op == IR_VEC_BUILD && lane < vec->arg_count) value = vec->args[lane];
+    if (!value || value->tgq_type != insn->tgq_type || value->components != 1) return NULL;
+    return value;
+}
+
+// Column `lane` of a matrix assembled column by column
+static IrInsn *fold_mat_extract(IrInsn *insn) {
+    IrInsn *mat = insn->args[0];
+    while (mat->op == IR_MAT_INSERT && mat->imm.lane != insn->imm.lane) mat = mat->args[0];
+    return mat->op == IR_MAT_INSERT ? mat->args[1] : NULL;
+}
+
+// The value a phi merges, or a constant all its operands agree on
+static IrInsn *fold_phi(IrFunction *fn, IrInsn *phi) {
+    IrInsn *same = NULL;
+    bool copies = false;
+    for (int i = 0; i < phi->arg_count; i++) {
+        IrInsn *arg = phi->args[i];
+        if (arg == phi || arg == same) continue;
+        if (!same) {
+            same = arg;
+            continue;
+        }
+        copies = true;
+        if (same->op == IR_UNDEF) same = arg;
+        if (arg->op == IR_UNDEF) continue;
+        if (same->op != IR_CONST || arg->op != IR_CONST || same->type != arg->type ||
+            same->imm.bits != arg->imm.bits) {
+            return NULL;
+        }
+    }
+    if (!same || same->op == IR_UNDEF) return NULL;
+    if (!copies) return same;
+
+    // Equal constants, or a constant and undefined values, come from
+    // different blocks; a copy in the entry block dominates every use
+    if (same->op != IR_CONST) return NULL;
+    return ir_const_bits(fn, same->type, same->imm.bits);
+}
+
+static void fold_to_const(IrInsn *insn, uint64_t bits) {
+    insn->op = IR_CONST;
+    insn->arg_count = 0;
+    insn->imm.bits = bits;
+}
+
+bool ir_fold_value(IrInsn *insn) {
+    if (insn->op == IR_CONST) return true;
+    if (insn->op < IR_ADD || insn->op > IR_CONVERT) return false;
+    for (int i = 0; i < insn->arg_count; i++) {
+        if (!ir_fold_value(insn->args[i])) return false;
+    }
+    uint64_t bits;
+    if (!fold_constant(insn, &bits)) return false;
+    fold_to_const(insn, bits);
+    return true;
+}
+
+void ir_fold_function(IrFunction *fn) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 0; b < fn->block_count; b++) {
+            IrInsn *next;
+            for (IrInsn *insn = fn->blocks[b]->first; insn; insn = next) {
+                next = insn->next;
+                for (int i = 0; i < insn->arg_count; i++) {
+                    insn->args[i] = ir_resolve(insn->args[i]);
+                }
+
+                IrInsn *value = NULL;
+                uint64_t bits;
+                if (insn->op == IR_PHI) {
+                    value = fold_phi(fn, insn);
+                } else if (insn->op == IR_EXTRACT) {
+                    value = fold_extract(insn);
+                } else if (insn->op == IR_MAT_EXTRACT) {
+                    value = fold_mat_extract(insn);
+                } else if (fold_constant(insn, &bits)) {
+                    fold_to_const(insn, bits);
+                    changed = true;
+                    continue;
+                } else {
+                    value = fold_identity(insn);
+                }
+                if (value && value->tgq_type == insn->tgq_type &&
+                    value->components == insn->components) {
+                    ir_replace(insn, value);
+                    changed = true;
+                }
+            }
+        }
+    }
+    ir_resolve_args(fn);
+}
@@ -2,270 +2,199 @@
 
 #include "tgpu_quartz_emit.h"
 #include "tgpu_quartz_symtab.h"
+#include "tgpu_quartz_ir.h"
 
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
 #include <math.h>
 
 EmitBuffer g_emitBufferCode;
 EmitBuffer g_emitBufferData;
 SymbolTable *g_symtab;
-const char* g_current_block_name = "<Main>";
-
-uint8_t g_local_reg[TGQ_TYPE_TOP] = {0};
-
-int gen_reg_local(EmitBuffer *_data, uint8_t type, void* data) {
-    int offset = _data->size;
-    printf("Adding new local var to memory [BASE+%016x] (value i32=%d f32=%f)...\n\n", offset, *(uint32_t*)data, *(float*)data);
-    switch (type)
-    {
-    case TGQ_I16:
-    case TGQ_FP16:
-    case TGQ_BF16:
-        uint16_t x16 = *(uint32_t*)data;
-        emit_u16(_data, x16);
-        return offset;
-    case TGQ_I32:
-    case TGQ_FP32:
-    case TGQ_BF32:
-        uint32_t x32 = *(uint32_t*)data;
-        emit_u32(_data, x32);
-        return offset;
-    default:
-        return -1;
-    }
-}
-
-int walk_vardecl(ASTNode *node) {
-    TypeInfo* tinf = type_from_name(node->data.var_decl.type);
-    if (tinf == NULL) {
-        crt_err("Invalid type:");
-        printf("Unknown type <%s> for %s\n", node->data.var_decl.type, node->data.var_decl.name);
-        return 0;
-    }
-
-    Symbol* sym = symtab_define(
-        g_symtab,
-        node->data.var_decl.name,
-        SYM_VARIABLE,
-        tinf,
-        g_current_block_name ? STORAGE_LOCAL : STORAGE_GLOBAL
-    );
-
-    if(sym == NULL) {
-        return 0;
-    }
-
-    uint64_t default_val = 0;
-    void* vval = &default_val;
-
-    if(node->data.var_decl.initializer->type == AST_LITERAL) {
-        switch (tinf->tgq_type)
-        {
-        case TGQ_I32:
-            int xi = atoi(node->data.var_decl.initializer->data.literal.value);
-            vval = &xi;
-            break;
-        case TGQ_FP32:
-            float xf = atof(node->data.var_decl.initializer->data.literal.value);
-            vval = &xf;
-            break;
-        case TGQ_BF32:
-            float xbf32 = atof(node->data.var_decl.initializer->data.literal.value);
-            vval = &xbf32;
-            break;
-        case TGQ_I16:
-            float xi16 = atoi(node->data.var_decl.initializer->data.literal.value);
-            vval = &xi16;
-            break;
-        case TGQ_FP16:
-            uint16_t xfp16 = float32_to_fp16(atof(node->data.var_decl.initializer->data.literal.value));
-            vval = &xfp16;
-            break;
-        default:
-            break;
-        }
-    } else if (node->data.var_decl.initializer == NULL) {
-
-    }
-
-    sym->stack_offset = gen_reg_local(&g_emitBufferData, tinf->tgq_type, vval);
-    if(sym->stack_offset == -1) {
-        crt_err("Allocation failed:");
-        printf("Details: typename=\"%s\" size=%s bytes\n", node->data.var_decl.type, tinf->size);
-        exit(-1);
-    }
+IrModule *g_module;
 
-    uint8_t reg = TGQ_R_GEN8(tinf->tgq_type, 0);
-    switch (tinf->size) {
-    case 1:
-        emit_lconst8(&g_emitBufferCode, reg, (uint8_t)*(uint64_t*)vval);
-        break;
-    
-    default:
-        break;
-    }
-    return 1;
-}
+// Globals with a slot in the data section, in layout order
+static Symbol **g_data_globals;
+static int g_data_global_count;
+static int g_data_global_capacity;
 
-int walk_binexp(ASTNode *node) {
+int g_gen_flags = 0;
 
+// Debug trace of the AST walk; `output` is NULL unless GEN_TRACE is set
+static void gen_trace(FILE *output, const char *fmt, ...) {
+    if (!output) return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(output, fmt, args);
+    va_end(args);
 }
 
 void walk_ast_node(ASTNode *node, int indent, FILE *output) {
     if (!node) {
-        fprintf(output, "Empety code....\n");
+        gen_trace(output, "Empety code....\n");
         return;
     }
     
     switch (node->type) {
         case AST_PROGRAM:
-            fprintf(output, "Program:\n");
+            gen_trace(output, "Program:\n");
             for (int i = 0; i < node->data.program.decl_count; i++) {
                 walk_ast_node(node->data.program.declarations[i], indent + 1, output);
             }
             break;
             
         case AST_FUNCTION_DECL:
-            fprintf(output, "FunctionDeclaration: %s %s (",
+            gen_trace(output, "FunctionDeclaration: %s %s (",
                     node->data.func_decl.return_type,
                     node->data.func_decl.name);
             for (int i = 0; i < node->data.func_decl.param_count; i++) {
-                fprintf(output, "%s %s", 
+                gen_trace(output, "%s %s", 
                         node->data.func_decl.params[i].type,
                         node->data.func_decl.params[i].name);
-                if (i < node->data.func_decl.param_count - 1) fprintf(output, ", ");
+                if (i < node->data.func_decl.param_count - 1) gen_trace(output, ", ");
             }
-            fprintf(output, ")\n");
+            gen_trace(output, ")\n");
             walk_ast_node(node->data.func_decl.body, indent + 1, output);
             break;
             
         case AST_STRUCT_DECL:
-            fprintf(output, "StructDeclaration: %s\n", node->data.struct_decl.name);
+            gen_trace(output, "StructDeclaration: %s\n", node->data.struct_decl.name);
             for (int i = 0; i < node->data.struct_decl.field_count; i++) {
 
-                fprintf(output, "Field: %s %s\n",
+                gen_trace(output, "Field: %s %s",
                         node->data.struct_decl.fields[i].type,
                         node->data.struct_decl.fields[i].name);
+                if (node->data.struct_decl.fields[i].array_size) {
+                    gen_trace(output, "[%s]", node->data.struct_decl.fields[i].array_size);
+                }
+                gen_trace(output, "\n");
             }
             break;
             
         case AST_VARIABLE_DECL:
-            fprintf(output, "VariableDeclaration: %s %s",
+            gen_trace(output, "VariableDeclaration: %s %s",
                     node->data.var_decl.type,
                     node->data.var_decl.name);
             if (node->data.var_decl.is_array) {
-                fprintf(output, "[%s]", 
+                gen_trace(output, "[%s]", 
                         node->data.var_decl.array_size ? node->data.var_decl.array_size : "");
             }
-            fprintf(output, "\n");
+            gen_trace(output, "\n");
             if (node->data.var_decl.initializer) {
 
-                fprintf(output, "Initializer:\n");
+                gen_trace(output, "Initializer:\n");
                 walk_ast_node(node->data.var_decl.initializer, indent + 2, output);
             }
-            walk_vardecl(node);
             break;
             
         case AST_BLOCK_STMT:
-            fprintf(output, "BlockStatement:\n");
+            gen_trace(output, "BlockStatement:\n");
             for (int i = 0; i < node->data.block_stmt.statement_count; i++) {
                 walk_ast_node(node->data.block_stmt.statements[i], indent + 1, output);
             }
             break;
             
         case AST_EXPRESSION_STMT:
-            fprintf(output, "ExpressionStatement:\n");
+            gen_trace(output, "ExpressionStatement:\n");
             walk_ast_node(node->data.expr_stmt.expression, indent + 1, output);
             break;
             
         case AST_IF_STMT:
-            fprintf(output, "IfStatement:\n");
-            fprintf(output, "Condition:\n");
+            gen_trace(output, "IfStatement:\n");
+            gen_trace(output, "Condition:\n");
             walk_ast_node(node->data.if_stmt.condition, indent + 2, output);
-            fprintf(output, "Consequent:\n");
+            gen_trace(output, "Consequent:\n");
             walk_ast_node(node->data.if_stmt.consequent, indent + 2, output);
             if (node->data.if_stmt.alternate) {
 
-                fprintf(output, "Alternate:\n");
+                gen_trace(output, "Alternate:\n");
                 walk_ast_node(node->data.if_stmt.alternate, indent + 2, output);
             }
             break;
             
         case AST_FOR_STMT:
-            fprintf(output, "ForStatement:\n");
-            fprintf(output, "Init:\n");
+            gen_trace(output, "ForStatement:\n");
+            gen_trace(output, "Init:\n");
             walk_ast_node(node->data.for_stmt.init, indent + 2, output);
-            fprintf(output, "Test:\n");
+            gen_trace(output, "Test:\n");
             walk_ast_node(node->data.for_stmt.test, indent + 2, output);
-            fprintf(output, "Update:\n");
+            gen_trace(output, "Update:\n");
             walk_ast_node(node->data.for_stmt.update, indent + 2, output);
-            fprintf(output, "Body:\n");
+            gen_trace(output, "Body:\n");
             walk_ast_node(node->data.for_stmt.body, indent + 2, output);
             break;
             
         case AST_WHILE_STMT:
-            fprintf(output, "WhileStatement:\n");
-            fprintf(output, "Test:\n");
+            gen_trace(output, "WhileStatement:\n");
+            gen_trace(output, "Test:\n");
             walk_ast_node(node->data.while_stmt.test, indent + 2, output);
-            fprintf(output, "Body:\n");
+            gen_trace(output, "Body:\n");
             walk_ast_node(node->data.while_stmt.body, indent + 2, output);
             break;
             
         case AST_RETURN_STMT:
-            fprintf(output, "ReturnStatement:\n");
+            gen_trace(output, "ReturnStatement:\n");
             if (node->data.return_stmt.argument) {
                 walk_ast_node(node->data.return_stmt.argument, indent + 1, output);
             }
             break;
             
+        case AST_BREAK_STMT:
+            gen_trace(output, "BreakStatement\n");
+            break;
+
+        case AST_CONTINUE_STMT:
+            gen_trace(output, "ContinueStatement\n");
+            break;
+
         case AST_BINARY_EXPR:
-            fprintf(output, "BinaryExpression: %s\n", node->data.binary_expr.operator);
-            fprintf(output, "Left:\n");
+            gen_trace(output, "BinaryExpression: %s\n", node->data.binary_expr.operator);
+            gen_trace(output, "Left:\n");
             walk_ast_node(node->data.binary_expr.left, indent + 2, output);
-            fprintf(output, "Right:\n");
+            gen_trace(output, "Right:\n");
             walk_ast_node(node->data.binary_expr.right, indent + 2, output);
-            walk_binexp(node);
             break;
             
         case AST_UNARY_EXPR:
-            fprintf(output, "UnaryExpression: %s\n", node->data.unary_expr.operator);
+            gen_trace(output, "UnaryExpression: %s\n", node->data.unary_expr.operator);
             walk_ast_node(node->data.unary_expr.argument, indent + 1, output);
             break;
             
         case AST_CALL_EXPR:
-            fprintf(output, "CallExpression:\n");
-            fprintf(output, "Callee:\n");
+            gen_trace(output, "CallExpression:\n");
+            gen_trace(output, "Callee:\n");
             walk_ast_node(node->data.call_expr.callee, indent + 2, output);
-            fprintf(output, "Arguments:\n");
+            gen_trace(output, "Arguments:\n");
             for (int i = 0; i < node->data.call_expr.arg_count; i++) {
                 walk_ast_node(node->data.call_expr.arguments[i], indent + 2, output);
             }
             break;
             
         case AST_MEMBER_EXPR:
-            fprintf(output, "MemberExpression: .%s\n", node->data.member_expr.property);
-            fprintf(output, "Object:\n");
+            gen_trace(output, "MemberExpression: .%s\n", node->data.member_expr.property);
+            gen_trace(output, "Object:\n");
             walk_ast_node(node->data.member_expr.object, indent + 2, output);
             break;
             
         case AST_ARRAY_EXPR:
-            fprintf(output, "ArrayExpression:\n");
-            fprintf(output, "Array:\n");
+            gen_trace(output, "ArrayExpression:\n");
+            gen_trace(output, "Array:\n");
             walk_ast_node(node->data.array_expr.array, indent + 2, output);
-            fprintf(output, "Index:\n");
+            gen_trace(output, "Index:\n");
             walk_ast_node(node->data.array_expr.index, indent + 2, output);
             break;
             
         case AST_ASSIGNMENT_EXPR:
-            fprintf(output, "AssignmentExpression: %s\n", node->data.assign_expr.operator);
-            fprintf(output, "Left:\n");
+            gen_trace(output, "AssignmentExpression: %s\n", node->data.assign_expr.operator);
+            gen_trace(output, "Left:\n");
             walk_ast_node(node->data.assign_expr.left, indent + 2, output);
-            fprintf(output, "Right:\n");
+            gen_trace(output, "Right:\n");
             walk_ast_node(node->data.assign_expr.right, indent + 2, output);
             break;
             
         case AST_CONSTRUCTOR_EXPR:
-            fprintf(output, "ConstructorExpression: %s\n", 
+            gen_trace(output, "ConstructorExpression: %s\n", 
                     node->data.constructor_expr.type_name);
             for (int i = 0; i < node->data.constructor_expr.arg_count; i++) {
                 walk_ast_node(node->data.constructor_expr.arguments[i], indent + 1, output);
@@ -273,26 +202,2168 @@ void walk_ast_node(ASTNode *node, int indent, FILE *output) {
             break;
             
         case AST_IDENTIFIER:
-            fprintf(output, "Identifier: %s\n", node->data.identifier.name);
+            gen_trace(output, "Identifier: %s\n", node->data.identifier.name);
             break;
             
         case AST_LITERAL:
-            fprintf(output, "Literal: %s\n", node->data.literal.value);
+            gen_trace(output, "Literal: %s\n", node->data.literal.value);
             break;
     }
 }
 
-int gen_init(int flags) {
-    emit_init(&g_emitBufferCode);
-    emit_init(&g_emitBufferData);
-    types_init();
-    g_symtab = symtab_create();
 
-    printf("TGPU\n");
+// ============================================================================
+// CONSTANT EVALUATION
+// ============================================================================
+
+// Compile-time value of the expressions allowed in array sizes and global
+// initializers: literals, constants, arithmetic and scalar conversions.
+// Float results are rounded like the code the expression would compile
+// to: every operation to float, conversions to the target format.
+typedef struct {
+    bool is_float;
+    int64_t i;
+    double f;
+} ConstValue;
+
+// Bounds the walk through constants defined in terms of each other
+#define CONST_EVAL_MAX_DEPTH 64
+
+// Number literals are digits and dots; a dot makes them float
+static bool literal_is_float(const char *text) {
+    return strchr(text, '.') != NULL;
 }
 
-int gen_by_ast(ASTNode *root) {
-    walk_ast_node(root, 2, stdout);
+static double const_as_float(ConstValue v) {
+    return v.is_float ? v.f : (float)v.i;
+}
+
+static int64_t const_as_int(ConstValue v) {
+    return v.is_float ? (int64_t)v.f : v.i;
+}
+
+// Integer constants are ints: every result wraps to 32 bits, as in the IR
+// folder, so that initializers and array sizes agree with code
+static int64_t const_wrap(uint64_t x) {
+    return ir_decode_int(TGQ_I32, ir_encode_int(TGQ_I32, (int64_t)x));
+}
+
+// Converts `v` to the representation of scalar type `t`
+static ConstValue const_cast_to(ConstValue v, TypeInfo *t) {
+    ConstValue out = {0};
+    if (t->base == TYPE_BOOL) {
+        out.i = v.is_float ? v.f != 0.0 : v.i != 0;
+    } else if (ir_tgq_is_float(t->tgq_type)) {
+        out.is_float = true;
+        out.f = ir_decode_float(t->tgq_type, ir_encode_float(t->tgq_type, const_as_float(v)));
+    } else {
+        out.i = ir_decode_int(t->tgq_type, ir_encode_int(t->tgq_type, const_as_int(v)));
+    }
+    return out;
+}
+
+static bool const_eval_depth(ASTNode *node, ConstValue *out, int depth) {
+    if (!node || depth > CONST_EVAL_MAX_DEPTH) return false;
+
+    switch (node->type) {
+    case AST_LITERAL: {
+        const char *text = node->data.literal.value;
+        memset(out, 0, sizeof(*out));
+        out->is_float = literal_is_float(text);
+        if (out->is_float) out->f = (float)strtod(text, NULL);
+        else out->i = const_wrap((uint64_t)strtoll(text, NULL, 10));
+        return true;
+    }
+
+    case AST_IDENTIFIER: {
+        const char *name = node->data.identifier.name;
+        if (!strcmp(name, "true") || !strcmp(name, "false")) {
+            memset(out, 0, sizeof(*out));
+            out->i = name[0] == 't';
+            return true;
+        }
+        Symbol *sym = symtab_lookup(g_symtab, name);
+        if (!sym || sym->storage != STORAGE_CONST || !sym->initializer ||
+            !type_is_scalar(sym->type)) {
+            return false;
+        }
+        if (!const_eval_depth(sym->initializer, out, depth + 1)) return false;
+        *out = const_cast_to(*out, sym->type);
+        return true;
+    }
+
+    case AST_UNARY_EXPR: {
+        const char *op = node->data.unary_expr.operator;
+        if (!const_eval_depth(node->data.unary_expr.argument, out, depth + 1)) return false;
+        if (!strcmp(op, "-")) {
+            if (out->is_float) out->f = -out->f;
+            else out->i = const_wrap(-(uint64_t)out->i);
+            return true;
+        }
+        if (!strcmp(op, "!")) {
+            *out = const_cast_to(*out, TYPE_BOOL_INFO);
+            out->i = !out->i;
+            return true;
+        }
+        return !strcmp(op, "+");
+    }
+
+    case AST_BINARY_EXPR: {
+        const char *op = node->data.binary_expr.operator;
+        ConstValue a, b;
+        if (!const_eval_depth(node->data.binary_expr.left, &a, depth + 1) ||
+            !const_eval_depth(node->data.binary_expr.right, &b, depth + 1)) {
+            return false;
+        }
+        memset(out, 0, sizeof(*out));
+        if (a.is_float || b.is_float) {
+            double x = const_as_float(a), y = const_as_float(b);
+            out->is_float = true;
+            switch (op[0]) {
+            case '+': out->f = (float)(x + y); return true;
+            case '-': out->f = (float)(x - y); return true;
+            case '*': out->f = (float)(x * y); return true;
+            case '/': out->f = (float)(x / y); return true;
+            default:  return false;
+            }
+        }
+        // Like the folder, INT_MIN / -1 is left to the target
+        bool divides = b.i != 0 && !(a.i == INT32_MIN && b.i == -1);
+        switch (op[0]) {
+        case '+': out->i = const_wrap((uint64_t)a.i + (uint64_t)b.i); return true;
+        case '-': out->i = const_wrap((uint64_t)a.i - (uint64_t)b.i); return true;
+        case '*': out->i = const_wrap((uint64_t)a.i * (uint64_t)b.i); return true;
+        case '/': if (!divides) return false; out->i = a.i / b.i; return true;
+        case '%': if (!divides) return false; out->i = a.i % b.i; return true;
+        default:  return false;
+        }
+    }
+
+    case AST_CONSTRUCTOR_EXPR: {
+        TypeInfo *t = type_from_name(node->data.constructor_expr.type_name);
+        if (!t || !type_is_scalar(t) || node->data.constructor_expr.arg_count != 1) return false;
+        if (!const_eval_depth(node->data.constructor_expr.arguments[0], out, depth + 1)) return false;
+        *out = const_cast_to(*out, t);
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+static bool const_eval(ASTNode *node, ConstValue *out) {
+    return const_eval_depth(node, out, 0);
+}
+
+// Writes scalar constant `init` little-endian in the encoding of `tgq`
+static bool data_write_scalar(uint8_t *out, uint8_t tgq, bool is_bool, ASTNode *init) {
+    ConstValue v;
+    if (!const_eval(init, &v)) return false;
+
+    uint64_t bits;
+    if (is_bool) bits = v.is_float ? v.f != 0.0 : v.i != 0;
+    else if (ir_tgq_is_float(tgq)) bits = ir_encode_float(tgq, const_as_float(v));
+    else bits = ir_encode_int(tgq, const_as_int(v));
+
+    for (int b = 0; b < ir_tgq_size(tgq); b++) {
+        out[b] = (uint8_t)(bits >> (8 * b));
+    }
+    return true;
+}
+
+// Matrix constructors take one scalar for the diagonal or every element in
+// column order; columns are 16 bytes apart and the rest stays zero
+static bool data_write_matrix(uint8_t *out, TypeInfo *t, ASTNode *init) {
+    if (init->type != AST_CONSTRUCTOR_EXPR || type_from_name(init->data.constructor_expr.type_name) != t) {
+        return false;
+    }
+    int n = type_matrix_column(t)->components;
+    int count = init->data.constructor_expr.arg_count;
+    ASTNode **args = init->data.constructor_expr.arguments;
+    if (count != 1 && count != n * n) return false;
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            ASTNode *arg = count == 1 ? (i == j ? args[0] : NULL) : args[i * n + j];
+            if (arg && !data_write_scalar(out + 16 * i + 4 * j, TGQ_FP32, false, arg)) return false;
+        }
+    }
+    return true;
+}
+
+// Initial bytes of a global; scalars, and vector and matrix constructors
+// of constants
+static bool data_write_init(uint8_t *out, TypeInfo *t, ASTNode *init) {
+    if (type_is_scalar(t)) {
+        return data_write_scalar(out, t->tgq_type, t->base == TYPE_BOOL, init);
+    }
+    if (type_is_matrix(t)) return data_write_matrix(out, t, init);
+    if (!type_is_vector(t) || init->type != AST_CONSTRUCTOR_EXPR ||
+        type_from_name(init->data.constructor_expr.type_name) != t) {
+        return false;
+    }
+
+    // Vectors are stored with their lanes in the TGQ vector layout
+    uint8_t lane = ir_tgq_lane(t->tgq_type);
+    bool is_bool = type_vector_element(t)->base == TYPE_BOOL;
+    int count = init->data.constructor_expr.arg_count;
+    if (count != 1 && count != t->components) return false;
+
+    for (int c = 0; c < t->components; c++) {
+        ASTNode *arg = init->data.constructor_expr.arguments[count == 1 ? 0 : c];
+        if (!data_write_scalar(out + c * ir_tgq_size(lane), lane, is_bool, arg)) return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// RESOLUTION
+// ============================================================================
+
+// Scalars, vectors and matrices are SSA values; everything else lives in
+// memory
+static bool type_in_registers(TypeInfo *t) {
+    return t->reg_class != REGCLASS_NONE;
+}
+
+// Builtin type or a struct registered by gen_resolve
+static TypeInfo *resolve_type(const char *name) {
+    TypeInfo *t = type_from_name(name);
+    if (t) return t;
+
+    Symbol *sym = symtab_lookup(g_symtab, name);
+    if (sym && sym->kind == SYM_STRUCT) return sym->type;
+
+    crt_err("Invalid type:");
+    printf(" unknown type <%s>\n", name);
+    return NULL;
+}
+
+// Length of `name[size]`; `size` is a literal or the name of an int constant
+static int resolve_array_length(const char *size) {
+    if (size[0] >= '0' && size[0] <= '9') return atoi(size);
+
+    Symbol *sym = symtab_lookup(g_symtab, size);
+    ConstValue v;
+    if (!sym || sym->storage != STORAGE_CONST || !sym->initializer ||
+        !const_eval(sym->initializer, &v) || v.is_float) {
+        return -1;
+    }
+    return (int)v.i;
+}
+
+// Type of a declaration, as an array type for `name[size]`
+static TypeInfo *resolve_decl_type(const char *type, bool is_array,
+                                   const char *array_size, const char *name) {
+    TypeInfo *t = resolve_type(type);
+    if (!t || !is_array) return t;
+
+    int length = array_size ? resolve_array_length(array_size) : -1;
+    if (length <= 0) {
+        crt_err("Invalid array size:");
+        printf(" %s[%s]\n", name, array_size ? array_size : "");
+        return NULL;
+    }
+    return type_make_array(t, length);
+}
+
+// The resolve_* functions report their errors and return false on them
+static bool resolve_struct(ASTNode *node) {
+    int count = node->data.struct_decl.field_count;
+    StructField *fields = crt_calloc(count ? count : 1, sizeof(StructField));
+
+    for (int i = 0; i < count; i++) {
+        Parameter *f = &node->data.struct_decl.fields[i];
+        fields[i].name = f->name;
+        fields[i].type = resolve_decl_type(f->type, f->array_size != NULL, f->array_size, f->name);
+        if (!fields[i].type) {
+            free(fields);
+            return false;
+        }
+    }
+
+    TypeInfo *t = type_make_struct(node->data.struct_decl.name, fields, count);
+    symtab_register_struct(g_symtab, t->struct_info);
+    free(fields);
+    return true;
+}
+
+static bool resolve_function(ASTNode *node) {
+    TypeInfo *return_type = resolve_type(node->data.func_decl.return_type);
+    if (!return_type) return false;
+
+    int count = node->data.func_decl.param_count;
+    Symbol **params = count ? crt_malloc(sizeof(Symbol*) * count) : NULL;
+
+    // Parameters get their own scope below the global one
+    symtab_enter_scope(g_symtab);
+    for (int i = 0; i < count; i++) {
+        Parameter *p = &node->data.func_decl.params[i];
+        TypeInfo *type = resolve_type(p->type);
+        params[i] = type ? symtab_define_param(g_symtab, p->name, type) : NULL;
+        if (!params[i]) {
+            symtab_exit_scope(g_symtab);
+            free(params);
+            return false;
+        }
+    }
+    symtab_exit_scope(g_symtab);
+
+    Symbol *sym = symtab_define_function(g_symtab, node->data.func_decl.name,
+                                         return_type, params, count);
+    if (!sym) {
+        free(params);
+        return false;
+    }
+    sym->func_body = node->data.func_decl.body;
+    for (int i = 0; i < node->data.func_decl.qualifier_count; i++) {
+        const char *q = node->data.func_decl.qualifiers[i];
+        if (!strcmp(q, "always_inline")) sym->always_inline = true;
+        if (!strcmp(q, "noinline"))      sym->noinline = true;
+    }
+    return true;
+}
+
+static StorageClass resolve_storage(const char **qualifiers, int count) {
+    for (int i = 0; i < count; i++) {
+        const char *q = qualifiers[i];
+        if (!strcmp(q, "uniform"))   return STORAGE_UNIFORM;
+        if (!strcmp(q, "attribute")) return STORAGE_ATTRIBUTE;
+        if (!strcmp(q, "varying"))   return STORAGE_VARYING;
+        if (!strcmp(q, "const"))     return STORAGE_CONST;
+    }
+    return STORAGE_GLOBAL;
+}
+
+// Scalar, vector and matrix constants are folded into their uses; every
+// other global gets an aligned slot in the data section holding its
+// initializer
+static bool resolve_global(ASTNode *node) {
+    VariableDecl *decl = &node->data.var_decl;
+
+    // `precision mediump float;` is parsed as a declaration of this type
+    if (!strcmp(decl->type, "precision")) return true;
+
+    TypeInfo *type = resolve_decl_type(decl->type, decl->is_array, decl->array_size, decl->name);
+    if (!type) return false;
+
+    StorageClass storage = resolve_storage(decl->qualifiers, decl->qualifier_count);
+    Symbol *sym = symtab_define(g_symtab, decl->name, SYM_VARIABLE, type, storage);
+    if (!sym) return false;
+
+    if (storage == STORAGE_CONST && type_in_registers(type)) {
+        sym->initializer = decl->initializer;
+        if (!decl->initializer) {
+            crt_err("Invalid constant:");
+            printf(" %s has no initializer\n", decl->name);
+            return false;
+        }
+        return true;
+    }
+
+    int align = type->alignment > 0 ? type->alignment : 1;
+    int offset = (g_emitBufferData.size + align - 1) / align * align;
+    uint8_t *p = emit_reserve(&g_emitBufferData, offset + type->size - g_emitBufferData.size);
+    memset(p, 0, offset + type->size - (int)(p - g_emitBufferData.data));
+    sym->stack_offset = offset;
+
+    if (g_data_global_count == g_data_global_capacity) {
+        g_data_global_capacity = g_data_global_capacity ? g_data_global_capacity * 2 : 16;
+        g_data_globals = crt_realloc(g_data_globals, sizeof(Symbol*) * g_data_global_capacity);
+    }
+    g_data_globals[g_data_global_count++] = sym;
+
+    bool ok = true;
+    if (decl->initializer &&
+        !data_write_init(g_emitBufferData.data + offset, type, decl->initializer)) {
+        crt_err("Unsupported:");
+        printf(" initializer of global %s is not a constant\n", decl->name);
+        ok = false;
+    }
+
+    if (g_gen_flags & GEN_TRACE)
+        printf("Global %s %s at [DATA+%08x], %d bytes\n", decl->type, decl->name, offset, type->size);
+    return ok;
+}
+
+// Register struct types, function signatures and global variables of the
+// whole program in the global scope before any code is generated. Returns
+// 0 if any declaration failed; the others are still registered.
+int gen_resolve(ASTNode *root) {
+    if (!root || root->type != AST_PROGRAM) return 0;
+
+    bool ok = true;
+    for (int i = 0; i < root->data.program.decl_count; i++) {
+        ASTNode *decl = root->data.program.declarations[i];
+        switch (decl->type) {
+        case AST_STRUCT_DECL:
+            if (!resolve_struct(decl)) ok = false;
+            break;
+        case AST_FUNCTION_DECL:
+            if (!resolve_function(decl)) ok = false;
+            break;
+        case AST_VARIABLE_DECL:
+            if (!resolve_global(decl)) ok = false;
+            break;
+        default:
+            break;
+        }
+    }
+    return ok ? 1 : 0;
+}
+
+// ============================================================================
+// LOWERING
+// ============================================================================
+
+// Builds the SSA IR of every function from its AST. Scalar, vector and
+// matrix locals become SSA variables; aggregates get frame memory. Errors
+// are reported once per function, which code generation then skips.
+
+typedef struct {
+    IrBlock *break_target;
+    IrBlock *continue_target;
+} LoopTargets;
+
+// A function whose body is lowered in place of a call
+typedef struct Inline {
+    Symbol *callee;
+    TypeInfo *return_type;
+    IrBlock *exit;           // Where its returns go
+    int ret_var;             // SSA variable of a result in registers
+    int ret_offset;          // Frame slot of an aggregate result
+    struct Inline *outer;    // The call this one is inlined into, if inlined
+} Inline;
+
+typedef struct {
+    IrFunction *fn;
+    IrBlock *block;          // Where new instructions go
+    LoopTargets *loops;
+    int loop_count;
+    int loop_capacity;
+    Inline *inl;             // Innermost call being inlined, NULL outside of one
+    int outer_loops;         // Loops around that call in the callers
+} Lowering;
+
+typedef enum {
+    REF_VALUE,               // A computed value
+    REF_VAR,                 // An SSA variable
+    REF_MEM                  // Memory at `addr`
+} RefKind;
+
+// An lvalue or rvalue being lowered. Swizzles of variables and memory
+// vectors are kept as lanes until the reference is read or written.
+typedef struct {
+    RefKind kind;
+    TypeInfo *type;          // Type after the swizzle
+    TypeInfo *base_type;     // Type of the whole variable or memory
+    IrInsn *value;           // REF_VALUE
+    Symbol *sym;             // REF_VAR
+    IrInsn *addr;            // REF_MEM
+    IrSpace space;
+    bool read_only;
+    int lanes[4];
+    int lane_count;          // 0 without swizzle
+} Ref;
+
+static IrInsn *lower_expr(Lowering *lw, ASTNode *node);
+static void lower_ref(Lowering *lw, ASTNode *node, Ref *ref);
+static void lower_stmt(Lowering *lw, ASTNode *node);
+static IrInsn *lower_matrix_arith(Lowering *lw, IrOp op, const char *opname, IrInsn *a, IrInsn *b);
+static bool lower_inline(Lowering *lw, Symbol *f, IrInsn **values, Ref *refs, Ref *ref);
+
+// Reports the first error of the function and returns a placeholder value
+static IrInsn *lower_fail(Lowering *lw, TypeInfo *type, const char *fmt, ...) {
+    if (!lw->fn->failed) {
+        crt_err("Codegen:");
+        printf(" in %s: ", lw->fn->name);
+        va_list args;
+        va_start(args, fmt);
+        vprintf(fmt, args);
+        va_end(args);
+        printf("\n");
+    }
+    lw->fn->failed = true;
+    return ir_undef(lw->block, type ? type : TYPE_INT_INFO);
+}
+
+static void ref_set_value(Ref *ref, IrInsn *value) {
+    memset(ref, 0, sizeof(*ref));
+    ref->kind = REF_VALUE;
+    ref->value = value;
+    ref->type = ref->base_type = value->type;
+}
+
+static IrInsn *lower_zero(Lowering *lw, TypeInfo *t) {
+    return ir_tgq_is_float(t->tgq_type) ? ir_const_float(lw->block, t, 0.0)
+                                        : ir_const_int(lw->block, t, 0);
+}
+
+static IrInsn *lower_build(Lowering *lw, TypeInfo *vector, IrInsn **lanes) {
+    IrInsn *v = ir_insn_new(lw->block, IR_VEC_BUILD, vector);
+    for (int i = 0; i < vector->components; i++) {
+        ir_add_arg(lw->fn, v, lanes[i]);
+    }
+    return v;
+}
+
+static IrInsn *lower_splat(Lowering *lw, IrInsn *scalar, TypeInfo *vector) {
+    IrInsn *lanes[4] = {scalar, scalar, scalar, scalar};
+    return lower_build(lw, vector, lanes);
+}
+
+static IrInsn *lower_convert(Lowering *lw, IrInsn *v, TypeInfo *to) {
+    TypeInfo *from = v->type;
+    if (from == to) return v;
+    if (from->base == TYPE_DOUBLE || to->base == TYPE_DOUBLE) {
+        return lower_fail(lw, to, "double is not supported");
+    }
+
+    if (type_is_scalar(from) && type_is_scalar(to)) {
+        if (to->base == TYPE_BOOL) return ir_cmp(lw->block, IR_CMP_NE, v, lower_zero(lw, from));
+        // The target has no instruction between integers and floats;
+        // only values that fold to constants convert
+        if (ir_tgq_is_float(from->tgq_type) != ir_tgq_is_float(to->tgq_type) && !ir_fold_value(v)) {
+            return lower_fail(lw, to, "cannot convert %s to %s: the target has no integer and float conversions",
+                              type_name(from), type_name(to));
+        }
+        return ir_convert(lw->block, to, v);
+    }
+
+    if (type_is_vector(to)) {
+        TypeInfo *element = type_vector_element(to);
+        if (type_is_scalar(from)) {
+            return lower_splat(lw, lower_convert(lw, v, element), to);
+        }
+        if (type_is_vector(from) && from->components == to->components) {
+            TypeInfo *from_element = type_vector_element(from);
+            IrInsn *lanes[4];
+            for (int i = 0; i < to->components; i++) {
+                lanes[i] = lower_convert(lw, ir_extract(lw->block, from_element, v, i), element);
+            }
+            return lower_build(lw, to, lanes);
+        }
+    }
+
+    return lower_fail(lw, to, "cannot convert %s to %s", type_name(from), type_name(to));
+}
+
+static IrInsn *lower_bool(Lowering *lw, ASTNode *node) {
+    return lower_convert(lw, lower_expr(lw, node), TYPE_BOOL_INFO);
+}
+
+// Scalar or vector of `v` converted to float lanes
+static IrInsn *lower_to_float(Lowering *lw, IrInsn *v) {
+    if (ir_tgq_is_float(v->tgq_type)) return v;
+    if (type_is_vector(v->type)) {
+        return lower_convert(lw, v, type_make_vector(TYPE_FLOAT_INFO, v->type->components));
+    }
+    return lower_convert(lw, v, TYPE_FLOAT_INFO);
+}
+
+static IrInsn *lower_swizzle(Lowering *lw, IrInsn *v, const int *lanes, int count) {
+    TypeInfo *element = type_vector_element(v->type);
+    IrInsn *parts[4];
+    for (int i = 0; i < count; i++) {
+        parts[i] = ir_extract(lw->block, element, v, lanes[i]);
+    }
+    if (count == 1) return parts[0];
+    return lower_build(lw, type_make_vector(element, count), parts);
+}
+
+// Address `offset` bytes past `addr`; frame and data addresses stay
+// constant so code generation can rematerialize them
+static IrInsn *lower_offset(Lowering *lw, IrInsn *addr, int offset) {
+    if (!offset) return addr;
+    if (addr->op == IR_ADDR) {
+        return ir_addr(lw->block, addr->space, addr->func, addr->sym, addr->imm.offset + offset);
+    }
+    return ir_binary(lw->block, IR_ADD, TYPE_INT_INFO, addr,
+                     ir_const_int(lw->block, TYPE_INT_INFO, offset));
+}
+
+// Vector registers only add, subtract, multiply and divide element-wise,
+// so any other operation on a vector goes lane by lane. `b` is NULL for
+// unary operations.
+static IrInsn *lower_lanes(Lowering *lw, IrOp op, TypeInfo *t, IrInsn *a, IrInsn *b) {
+    if (!type_is_vector(t) || op == IR_ADD || op == IR_SUB || op == IR_MUL || op == IR_DIV) {
+        return b ? ir_binary(lw->block, op, t, a, b) : ir_unary(lw->block, op, t, a);
+    }
+    TypeInfo *element = type_vector_element(t);
+    IrInsn *lanes[4];
+    for (int i = 0; i < t->components; i++) {
+        IrInsn *x = ir_extract(lw->block, element, a, i);
+        lanes[i] = b ? ir_binary(lw->block, op, element, x, ir_extract(lw->block, element, b, i))
+                     : ir_unary(lw->block, op, element, x);
+    }
+    return lower_build(lw, t, lanes);
+}
+
+static IrInsn *lower_arith(Lowering *lw, IrOp op, const char *opname, IrInsn *a, IrInsn *b) {
+    if (type_is_matrix(a->type) || type_is_matrix(b->type)) {
+        return lower_matrix_arith(lw, op, opname, a, b);
+    }
+    TypeInfo *t = type_binary_result(opname, a->type, b->type);
+    if (!t || !type_in_registers(t) || t->base == TYPE_DOUBLE ||
+        (!type_is_scalar(t) && !type_is_vector(t))) {
+        return lower_fail(lw, t, "invalid operands to '%s': %s and %s",
+                          opname, type_name(a->type), type_name(b->type));
+    }
+    if ((op == IR_REM || op == IR_AND || op == IR_OR || op == IR_XOR ||
+         op == IR_SHL || op == IR_SHR) && ir_tgq_is_float(t->tgq_type)) {
+        return lower_fail(lw, t, "'%s' needs integer operands", opname);
+    }
+    a = lower_convert(lw, a, t);
+    b = lower_convert(lw, b, t);
+    return lower_lanes(lw, op, t, a, b);
+}
+
+static IrInsn *lower_compare(Lowering *lw, IrCmp cmp, IrInsn *a, IrInsn *b) {
+    TypeInfo *t = type_binary_result("+", a->type, b->type);
+    if (!t || !type_is_scalar(t) || t->base == TYPE_DOUBLE) {
+        return lower_fail(lw, TYPE_BOOL_INFO, "cannot compare %s and %s",
+                          type_name(a->type), type_name(b->type));
+    }
+    return ir_cmp(lw->block, cmp, lower_convert(lw, a, t), lower_convert(lw, b, t));
+}
+
+// ============================================================================
+// LOWERING: MATRICES
+// ============================================================================
+
+// Column i of a matrix in memory is the vector at byte 16 * i. A matrix
+// with fewer than four columns starts from a zero tile, which keeps the
+// unused columns zero; mat_insert zeroes the unused rows.
+static IrInsn *lower_matrix_base(Lowering *lw, TypeInfo *type) {
+    if (type_matrix_column(type)->components < 4) return ir_mat_zero(lw->block, type);
+    return ir_undef(lw->block, type);
+}
+
+static IrInsn *lower_matrix_load(Lowering *lw, TypeInfo *type, IrSpace space, IrInsn *addr) {
+    TypeInfo *column = type_matrix_column(type);
+    IrInsn *m = lower_matrix_base(lw, type);
+    for (int i = 0; i < column->components; i++) {
+        IrInsn *v = ir_load(lw->block, column, space, lower_offset(lw, addr, 16 * i));
+        m = ir_mat_insert(lw->block, m, v, i);
+    }
+    return m;
+}
+
+static void lower_matrix_store(Lowering *lw, IrSpace space, IrInsn *addr, IrInsn *m) {
+    TypeInfo *column = type_matrix_column(m->type);
+    for (int i = 0; i < column->components; i++) {
+        ir_store(lw->block, space, lower_offset(lw, addr, 16 * i), ir_mat_extract(lw->block, m, i));
+    }
+}
+
+// Applies `op` between every column and the scalar `k`
+static IrInsn *lower_matrix_scale(Lowering *lw, IrOp op, IrInsn *m, IrInsn *k) {
+    TypeInfo *column = type_matrix_column(m->type);
+    IrInsn *splat = lower_convert(lw, k, column);
+    IrInsn *result = lower_matrix_base(lw, m->type);
+    for (int i = 0; i < column->components; i++) {
+        IrInsn *v = ir_binary(lw->block, op, column, ir_mat_extract(lw->block, m, i), splat);
+        result = ir_mat_insert(lw->block, result, v, i);
+    }
+    return result;
+}
+
+// + and - are element-wise and * is the product on the matrix unit. A
+// vector is multiplied as column 0 of an otherwise zero tile.
+static IrInsn *lower_matrix_arith(Lowering *lw, IrOp op, const char *opname, IrInsn *a, IrInsn *b) {
+    TypeInfo *ta = a->type, *tb = b->type;
+    if (ta == tb && (op == IR_ADD || op == IR_SUB || op == IR_MUL)) {
+        return ir_binary(lw->block, op, ta, a, b);
+    }
+    if (op == IR_MUL && type_is_matrix(ta) && tb == type_matrix_column(ta)) {
+        IrInsn *tile = ir_mat_insert(lw->block, ir_mat_zero(lw->block, ta), b, 0);
+        return ir_mat_extract(lw->block, ir_binary(lw->block, IR_MUL, ta, a, tile), 0);
+    }
+    if ((op == IR_MUL || op == IR_DIV) && type_is_matrix(ta) && type_is_scalar(tb)) {
+        return lower_matrix_scale(lw, op, a, b);
+    }
+    if (op == IR_MUL && type_is_scalar(ta) && type_is_matrix(tb)) {
+        return lower_matrix_scale(lw, op, b, a);
+    }
+    TypeInfo *t = type_is_matrix(ta) ? ta : tb;
+    return lower_fail(lw, t, "invalid operands to '%s': %s and %s",
+                      opname, type_name(ta), type_name(tb));
+}
+
+// ============================================================================
+// LOWERING: REFERENCES
+// ============================================================================
+
+static IrInsn *ref_read(Lowering *lw, Ref *ref) {
+    IrInsn *v;
+    switch (ref->kind) {
+    case REF_VALUE:
+        v = ref->value;
+        break;
+    case REF_VAR:
+        v = ir_read_var(lw->block, ref->sym->ssa_var, ref->base_type, ref->sym);
+        break;
+    default:
+        if (type_is_matrix(ref->base_type)) {
+            v = lower_matrix_load(lw, ref->base_type, ref->space, ref->addr);
+            break;
+        }
+        if (!type_in_registers(ref->base_type)) {
+            return lower_fail(lw, ref->type, "%s cannot be used as a value",
+                              type_name(ref->base_type));
+        }
+        v = ir_load(lw->block, ref->base_type, ref->space, ref->addr);
+        break;
+    }
+    return ref->lane_count ? lower_swizzle(lw, v, ref->lanes, ref->lane_count) : v;
+}
+
+// `value` must already have the type of the reference
+static void ref_write(Lowering *lw, Ref *ref, IrInsn *value) {
+    if (ref->kind == REF_VALUE || ref->read_only) {
+        lower_fail(lw, NULL, "assignment to a read-only value");
+        return;
+    }
+    value->assigned = true;
+
+    // Writing a swizzle merges the lanes into the whole vector
+    if (ref->lane_count) {
+        Ref whole = *ref;
+        whole.lane_count = 0;
+        whole.type = ref->base_type;
+        IrInsn *v = ref_read(lw, &whole);
+        TypeInfo *element = type_vector_element(ref->base_type);
+        for (int i = 0; i < ref->lane_count; i++) {
+            IrInsn *lane = ref->lane_count == 1 ? value : ir_extract(lw->block, element, value, i);
+            v = ir_insert(lw->block, v, lane, ref->lanes[i]);
+        }
+        value = v;
+    }
+
+    if (ref->kind == REF_VAR) ir_write_var(lw->block, ref->sym->ssa_var, value);
+    else if (type_is_matrix(value->type)) lower_matrix_store(lw, ref->space, ref->addr, value);
+    else ir_store(lw->block, ref->space, ref->addr, value);
+}
+
+// Narrows a vector reference to `lanes` of it (indices into ref->type)
+static void ref_select_lanes(Lowering *lw, Ref *ref, const int *lanes, int count) {
+    TypeInfo *result = type_make_vector(type_vector_element(ref->type), count);
+    int base_lanes[4];
+    for (int i = 0; i < count; i++) {
+        base_lanes[i] = ref->lane_count ? ref->lanes[lanes[i]] : lanes[i];
+    }
+
+    if (ref->kind == REF_VALUE) {
+        ref_set_value(ref, lower_swizzle(lw, ref->value, base_lanes, count));
+        return;
+    }
+
+    // A single lane of a vector in memory is a scalar at its own address
+    if (ref->kind == REF_MEM && count == 1) {
+        int lane_size = ir_tgq_size(ir_tgq_lane(ref->base_type->tgq_type));
+        ref->addr = lower_offset(lw, ref->addr, base_lanes[0] * lane_size);
+        ref->type = ref->base_type = result;
+        ref->lane_count = 0;
+        return;
+    }
 
-    emit_write_file(&g_emitBufferData, ".data.hex");
-}
\ No newline at end of file
+    memcpy(ref->lanes, base_lanes, sizeof(int) * count);
+    ref->lane_count = count;
+    ref->type = result;
+}
+
+static void lower_identifier(Lowering *lw, ASTNode *node, Ref *ref) {
+    const char *name = node->data.identifier.name;
+    Symbol *sym = symtab_lookup(g_symtab, name);
+
+    if (!sym) {
+        if (!strcmp(name, "true") || !strcmp(name, "false")) {
+            ref_set_value(ref, ir_const_int(lw->block, TYPE_BOOL_INFO, name[0] == 't'));
+        } else {
+            ref_set_value(ref, lower_fail(lw, NULL, "undefined identifier '%s'", name));
+        }
+        return;
+    }
+    if (sym->kind != SYM_VARIABLE && sym->kind != SYM_PARAMETER) {
+        ref_set_value(ref, lower_fail(lw, NULL, "'%s' is not a variable", name));
+        return;
+    }
+
+    ref->type = ref->base_type = sym->type;
+    if (sym->ssa_var >= 0) {
+        ref->kind = REF_VAR;
+        ref->sym = sym;
+        return;
+    }
+    if (sym->storage == STORAGE_CONST && sym->initializer) {
+        ref_set_value(ref, lower_convert(lw, lower_expr(lw, sym->initializer), sym->type));
+        return;
+    }
+
+    ref->kind = REF_MEM;
+    if (sym->scope_level == 0) {
+        ref->space = IR_SPACE_GLOBAL;
+        ref->addr = ir_addr(lw->block, IR_SPACE_GLOBAL, NULL, sym, sym->stack_offset);
+        ref->read_only = sym->storage == STORAGE_UNIFORM || sym->storage == STORAGE_ATTRIBUTE ||
+                         sym->storage == STORAGE_CONST;
+    } else {
+        ref->space = IR_SPACE_LOCAL;
+        ref->addr = ir_addr(lw->block, IR_SPACE_LOCAL, lw->fn, sym, sym->stack_offset);
+    }
+}
+
+static void lower_member(Lowering *lw, ASTNode *node, Ref *ref) {
+    lower_ref(lw, node->data.member_expr.object, ref);
+    const char *property = node->data.member_expr.property;
+    TypeInfo *t = ref->type;
+
+    if (t->base == TYPE_STRUCT && ref->kind == REF_MEM) {
+        StructInfo *info = t->struct_info;
+        for (int i = 0; i < info->field_count; i++) {
+            if (info->fields[i].name == property) {
+                ref->addr = lower_offset(lw, ref->addr, info->fields[i].offset);
+                ref->type = ref->base_type = info->fields[i].type;
+                return;
+            }
+        }
+        ref_set_value(ref, lower_fail(lw, NULL, "%s has no field '%s'", type_name(t), property));
+        return;
+    }
+
+    if (type_is_vector(t)) {
+        SwizzleInfo *sw = swizzle_parse(property, t->components);
+        if (!sw) {
+            ref_set_value(ref, lower_fail(lw, NULL, "invalid swizzle '.%s' of %s",
+                                          property, type_name(t)));
+            return;
+        }
+        ref_select_lanes(lw, ref, sw->indices, sw->count);
+        swizzle_free(sw);
+        return;
+    }
+
+    ref_set_value(ref, lower_fail(lw, NULL, "member '.%s' of %s is not supported",
+                                  property, type_name(t)));
+}
+
+static void lower_index(Lowering *lw, ASTNode *node, Ref *ref) {
+    lower_ref(lw, node->data.array_expr.array, ref);
+    ASTNode *index_node = node->data.array_expr.index;
+    TypeInfo *t = ref->type;
+
+    if (t->base == TYPE_ARRAY && ref->kind == REF_MEM) {
+        TypeInfo *element = t->element_type;
+        IrInsn *index = lower_convert(lw, lower_expr(lw, index_node), TYPE_INT_INFO);
+        IrInsn *offset = ir_binary(lw->block, IR_MUL, TYPE_INT_INFO, index,
+                                   ir_const_int(lw->block, TYPE_INT_INFO, element->size));
+        ref->addr = ir_binary(lw->block, IR_ADD, TYPE_INT_INFO, ref->addr, offset);
+        ref->type = ref->base_type = element;
+        return;
+    }
+
+    if (type_is_vector(t)) {
+        // Constant indices select a lane like a swizzle
+        if (index_node->type == AST_LITERAL && !literal_is_float(index_node->data.literal.value)) {
+            int lane = atoi(index_node->data.literal.value);
+            if (lane >= t->components) {
+                ref_set_value(ref, lower_fail(lw, NULL, "index %d out of range for %s",
+                                              lane, type_name(t)));
+                return;
+            }
+            ref_select_lanes(lw, ref, &lane, 1);
+            return;
+        }
+        if (ref->kind == REF_MEM && !ref->lane_count) {
+            TypeInfo *element = type_vector_element(t);
+            int lane_size = ir_tgq_size(ir_tgq_lane(t->tgq_type));
+            IrInsn *index = lower_convert(lw, lower_expr(lw, index_node), TYPE_INT_INFO);
+            IrInsn *offset = ir_binary(lw->block, IR_MUL, TYPE_INT_INFO, index,
+                                       ir_const_int(lw->block, TYPE_INT_INFO, lane_size));
+            ref->addr = ir_binary(lw->block, IR_ADD, TYPE_INT_INFO, ref->addr, offset);
+            ref->type = ref->base_type = element;
+            return;
+        }
+    }
+
+    ref_set_value(ref, lower_fail(lw, NULL, "indexing %s is not supported", type_name(t)));
+}
+
+// ============================================================================
+// LOWERING: CALLS
+// ============================================================================
+
+static IrInsn *lower_dot(Lowering *lw, IrInsn *a, IrInsn *b) {
+    IrInsn *product = lower_arith(lw, IR_MUL, "*", lower_to_float(lw, a), lower_to_float(lw, b));
+    if (!type_is_vector(product->type)) return product;
+
+    TypeInfo *element = type_vector_element(product->type);
+    IrInsn *sum = ir_extract(lw->block, element, product, 0);
+    for (int i = 1; i < product->type->components; i++) {
+        sum = ir_binary(lw->block, IR_ADD, element, sum, ir_extract(lw->block, element, product, i));
+    }
+    return sum;
+}
+
+static IrInsn *lower_length(Lowering *lw, IrInsn *v) {
+    IrInsn *d = lower_dot(lw, v, v);
+    return ir_unary(lw->block, IR_SQRT, d->type, d);
+}
+
+// Builtin functions lowered inline
+static IrInsn *lower_builtin(Lowering *lw, const char *name, ASTNode **args, int argc) {
+    static const struct {
+        const char *name;
+        int argc;
+    } builtins[] = {
+        {"sqrt", 1}, {"abs", 1}, {"length", 1}, {"normalize", 1},
+        {"min", 2}, {"max", 2}, {"dot", 2}, {"distance", 2},
+        {"clamp", 3}, {"mix", 3},
+    };
+
+    int known = -1;
+    for (int i = 0; i < (int)(sizeof(builtins) / sizeof(builtins[0])); i++) {
+        if (!strcmp(name, builtins[i].name)) known = i;
+    }
+    if (known < 0) return lower_fail(lw, NULL, "undefined or unsupported function '%s'", name);
+    if (argc != builtins[known].argc) {
+        return lower_fail(lw, NULL, "%s takes %d arguments", name, builtins[known].argc);
+    }
+
+    IrInsn *v[3];
+    for (int i = 0; i < argc; i++) {
+        v[i] = lower_expr(lw, args[i]);
+    }
+
+    if (!strcmp(name, "sqrt")) {
+        IrInsn *x = lower_to_float(lw, v[0]);
+        return lower_lanes(lw, IR_SQRT, x->type, x, NULL);
+    }
+    if (!strcmp(name, "abs")) {
+        return lower_lanes(lw, IR_MAX, v[0]->type, v[0], lower_lanes(lw, IR_NEG, v[0]->type, v[0], NULL));
+    }
+    if (!strcmp(name, "length")) return lower_length(lw, v[0]);
+    if (!strcmp(name, "normalize")) {
+        IrInsn *x = lower_to_float(lw, v[0]);
+        return lower_arith(lw, IR_DIV, "/", x, lower_length(lw, x));
+    }
+    if (!strcmp(name, "min")) return lower_arith(lw, IR_MIN, "+", v[0], v[1]);
+    if (!strcmp(name, "max")) return lower_arith(lw, IR_MAX, "+", v[0], v[1]);
+    if (!strcmp(name, "dot")) return lower_dot(lw, v[0], v[1]);
+    if (!strcmp(name, "distance")) {
+        return lower_length(lw, lower_arith(lw, IR_SUB, "-", v[0], v[1]));
+    }
+    if (!strcmp(name, "clamp")) {
+        IrInsn *lo = lower_arith(lw, IR_MAX, "+", v[0], v[1]);
+        return lower_arith(lw, IR_MIN, "+", lo, v[2]);
+    }
+
+    // mix(a, b, t) = a + (b - a) * t
+    IrInsn *a = lower_to_float(lw, v[0]);
+    IrInsn *delta = lower_arith(lw, IR_SUB, "-", lower_to_float(lw, v[1]), a);
+    return lower_arith(lw, IR_ADD, "+", a, lower_arith(lw, IR_MUL, "*", delta, v[2]));
+}
+
+// Scalar, vector and matrix arguments are passed in the CALL; aggregates
+// are copied into the callee's parameter slots and aggregate results out
+// of its return slot, since frames are static. Calls worth it are inlined
+// instead, once the arguments are evaluated.
+static void lower_call(Lowering *lw, ASTNode *node, Ref *ref) {
+    CallExpr *call = &node->data.call_expr;
+    if (call->callee->type != AST_IDENTIFIER) {
+        ref_set_value(ref, lower_fail(lw, NULL, "call of a non-function"));
+        return;
+    }
+
+    const char *name = call->callee->data.identifier.name;
+    Symbol *f = symtab_lookup_function(g_symtab, name);
+    if (!f) {
+        ref_set_value(ref, lower_builtin(lw, name, call->arguments, call->arg_count));
+        return;
+    }
+    if (call->arg_count != f->param_count) {
+        ref_set_value(ref, lower_fail(lw, NULL, "%s takes %d arguments, %d given",
+                                      name, f->param_count, call->arg_count));
+        return;
+    }
+
+    IrFunction *callee = f->ir_func;
+    int count = call->arg_count;
+    IrInsn **values = crt_calloc(count ? count : 1, sizeof(IrInsn*));
+    Ref *refs = crt_calloc(count ? count : 1, sizeof(Ref));
+
+    for (int i = 0; i < count; i++) {
+        TypeInfo *p = f->params[i]->type;
+        if (type_in_registers(p)) {
+            values[i] = lower_convert(lw, lower_expr(lw, call->arguments[i]), p);
+            continue;
+        }
+        lower_ref(lw, call->arguments[i], &refs[i]);
+        if (refs[i].kind != REF_MEM || refs[i].type != p) {
+            lower_fail(lw, NULL, "argument %d of %s must be %s", i + 1, name, type_name(p));
+        }
+    }
+
+    if (lower_inline(lw, f, values, refs, ref)) {
+        free(values);
+        free(refs);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        TypeInfo *p = f->params[i]->type;
+        if (values[i] || refs[i].kind != REF_MEM) continue;
+        IrInsn *slot = ir_addr(lw->block, IR_SPACE_LOCAL, callee, f->params[i],
+                               callee->param_offsets[i]);
+        ir_copy(lw->block, IR_SPACE_LOCAL, slot, refs[i].space, refs[i].addr, p->size);
+    }
+
+    TypeInfo *ret = callee->return_type;
+    IrInsn *insn = ir_insn_new(lw->block, IR_CALL, type_in_registers(ret) ? ret : TYPE_VOID_INFO);
+    insn->func = callee;
+    for (int i = 0; i < count; i++) {
+        if (values[i]) ir_add_arg(lw->fn, insn, values[i]);
+    }
+    free(values);
+    free(refs);
+
+    if (ret->base != TYPE_VOID && !type_in_registers(ret)) {
+        int temp = ir_frame_alloc(lw->fn, ret->size, ret->alignment);
+        IrInsn *dst = ir_addr(lw->block, IR_SPACE_LOCAL, lw->fn, NULL, temp);
+        IrInsn *src = ir_addr(lw->block, IR_SPACE_LOCAL, callee, NULL, callee->ret_offset);
+        ir_copy(lw->block, IR_SPACE_LOCAL, dst, IR_SPACE_LOCAL, src, ret->size);
+        memset(ref, 0, sizeof(*ref));
+        ref->kind = REF_MEM;
+        ref->space = IR_SPACE_LOCAL;
+        ref->addr = dst;
+        ref->type = ref->base_type = ret;
+        return;
+    }
+    ref_set_value(ref, insn);
+}
+
+// ============================================================================
+// LOWERING: EXPRESSIONS
+// ============================================================================
+
+static void lower_ref(Lowering *lw, ASTNode *node, Ref *ref) {
+    memset(ref, 0, sizeof(*ref));
+    switch (node->type) {
+    case AST_IDENTIFIER:
+        lower_identifier(lw, node, ref);
+        break;
+    case AST_MEMBER_EXPR:
+        lower_member(lw, node, ref);
+        break;
+    case AST_ARRAY_EXPR:
+        lower_index(lw, node, ref);
+        break;
+    case AST_CALL_EXPR:
+        lower_call(lw, node, ref);
+        break;
+    default:
+        ref_set_value(ref, lower_expr(lw, node));
+        break;
+    }
+}
+
+// a && b, a || b: the right operand only runs when it decides the result
+static IrInsn *lower_logical(Lowering *lw, ASTNode *node, bool is_and) {
+    IrInsn *left = lower_bool(lw, node->data.binary_expr.left);
+    IrInsn *shortcut = ir_const_int(lw->block, TYPE_BOOL_INFO, !is_and);
+    IrBlock *left_end = lw->block;
+    IrBlock *rhs = ir_block_new(lw->fn);
+    IrBlock *join = ir_block_new(lw->fn);
+
+    if (is_and) ir_branch(left_end, left, rhs, join);
+    else ir_branch(left_end, left, join, rhs);
+    ir_seal_block(rhs);
+
+    lw->block = rhs;
+    IrInsn *right = lower_bool(lw, node->data.binary_expr.right);
+    ir_jump(lw->block, join);
+    ir_seal_block(join);
+
+    lw->block = join;
+    IrInsn *phi = ir_phi(join, TYPE_BOOL_INFO, NULL);
+    phi->imm.index = -1;
+    for (int i = 0; i < join->pred_count; i++) {
+        ir_add_arg(lw->fn, phi, join->preds[i] == left_end ? shortcut : right);
+    }
+    return phi;
+}
+
+static IrInsn *lower_binary(Lowering *lw, ASTNode *node) {
+    static const struct {
+        const char *op;
+        IrOp ir;
+    } arith[] = {
+        {"+", IR_ADD}, {"-", IR_SUB}, {"*", IR_MUL}, {"/", IR_DIV}, {"%", IR_REM},
+        {"&", IR_AND}, {"|", IR_OR}, {"^", IR_XOR}, {"<<", IR_SHL}, {">>", IR_SHR},
+    };
+    static const struct {
+        const char *op;
+        IrCmp cmp;
+    } compare[] = {
+        {"==", IR_CMP_EQ}, {"!=", IR_CMP_NE}, {"<", IR_CMP_LT},
+        {"<=", IR_CMP_LE}, {">", IR_CMP_GT}, {">=", IR_CMP_GE},
+    };
+
+    const char *op = node->data.binary_expr.operator;
+    if (!strcmp(op, "&&") || !strcmp(op, "||")) return lower_logical(lw, node, op[0] == '&');
+
+    IrInsn *a = lower_expr(lw, node->data.binary_expr.left);
+    IrInsn *b = lower_expr(lw, node->data.binary_expr.right);
+
+    for (int i = 0; i < (int)(sizeof(arith) / sizeof(arith[0])); i++) {
+        if (!strcmp(op, arith[i].op)) return lower_arith(lw, arith[i].ir, op, a, b);
+    }
+    for (int i = 0; i < (int)(sizeof(compare) / sizeof(compare[0])); i++) {
+        if (!strcmp(op, compare[i].op)) return lower_compare(lw, compare[i].cmp, a, b);
+    }
+    return lower_fail(lw, NULL, "unsupported operator '%s'", op);
+}
+
+static IrInsn *lower_unary(Lowering *lw, ASTNode *node) {
+    const char *op = node->data.unary_expr.operator;
+    ASTNode *arg = node->data.unary_expr.argument;
+
+    if (!strcmp(op, "!")) {
+        IrInsn *v = lower_bool(lw, arg);
+        return ir_unary(lw->block, IR_NOT, TYPE_BOOL_INFO, v);
+    }
+
+    // Prefix increment and decrement
+    if (!strcmp(op, "++") || !strcmp(op, "--")) {
+        Ref ref;
+        lower_ref(lw, arg, &ref);
+        IrInsn *v = ref_read(lw, &ref);
+        if (!type_is_scalar(v->type) || v->type->base == TYPE_BOOL) {
+            return lower_fail(lw, v->type, "'%s' needs a scalar operand", op);
+        }
+        IrInsn *one = lower_convert(lw, ir_const_int(lw->block, TYPE_INT_INFO, 1), v->type);
+        IrInsn *result = ir_binary(lw->block, op[0] == '+' ? IR_ADD : IR_SUB, v->type, v, one);
+        ref_write(lw, &ref, result);
+        return result;
+    }
+
+    IrInsn *v = lower_expr(lw, arg);
+    if (!strcmp(op, "+")) return v;
+    if (type_is_matrix(v->type)) {
+        return lower_matrix_scale(lw, IR_MUL, v, ir_const_float(lw->block, TYPE_FLOAT_INFO, -1.0));
+    }
+    if (v->type->base == TYPE_BOOL || v->type->base == TYPE_DOUBLE ||
+        (!type_is_scalar(v->type) && !type_is_vector(v->type))) {
+        return lower_fail(lw, v->type, "invalid operand to '-': %s", type_name(v->type));
+    }
+    return lower_lanes(lw, IR_NEG, v->type, v, NULL);
+}
+
+static IrInsn *lower_assign(Lowering *lw, ASTNode *node) {
+    const char *op = node->data.assign_expr.operator;
+    Ref ref;
+    lower_ref(lw, node->data.assign_expr.left, &ref);
+
+    // Aggregates are assigned as a whole by copying their memory
+    if (!type_in_registers(ref.type)) {
+        Ref src;
+        lower_ref(lw, node->data.assign_expr.right, &src);
+        if (strcmp(op, "=") || src.kind != REF_MEM || src.type != ref.type) {
+            return lower_fail(lw, TYPE_VOID_INFO, "cannot assign %s to %s",
+                              type_name(src.type), type_name(ref.type));
+        }
+        if (ref.kind != REF_MEM || ref.read_only) {
+            return lower_fail(lw, TYPE_VOID_INFO, "assignment to a read-only value");
+        }
+        ir_copy(lw->block, ref.space, ref.addr, src.space, src.addr, ref.type->size);
+        return ir_undef(lw->block, TYPE_VOID_INFO);
+    }
+
+    IrInsn *value = lower_expr(lw, node->data.assign_expr.right);
+    if (strcmp(op, "=")) {
+        // Compound assignment: "+=" applies "+"
+        static const IrOp ops[] = {['+'] = IR_ADD, ['-'] = IR_SUB, ['*'] = IR_MUL, ['/'] = IR_DIV};
+        char binop[2] = {op[0], '\0'};
+        value = lower_arith(lw, ops[(unsigned char)op[0]], binop, ref_read(lw, &ref), value);
+    }
+    value = lower_convert(lw, value, ref.type);
+    ref_write(lw, &ref, value);
+    return value;
+}
+
+// Flattens constructor arguments into scalars and keeps the first `max`.
+// Returns how many there were, or -1 after reporting an argument that is
+// neither a scalar nor a vector.
+static int lower_constructor_args(Lowering *lw, ConstructorExpr *c, IrInsn **out, int max) {
+    int count = 0;
+    for (int i = 0; i < c->arg_count; i++) {
+        IrInsn *v = lower_expr(lw, c->arguments[i]);
+        if (type_is_scalar(v->type)) {
+            if (count < max) out[count] = v;
+            count++;
+        } else if (type_is_vector(v->type)) {
+            TypeInfo *from = type_vector_element(v->type);
+            for (int l = 0; l < v->type->components; l++, count++) {
+                if (count < max) out[count] = ir_extract(lw->block, from, v, l);
+            }
+        } else {
+            lower_fail(lw, NULL, "invalid argument %s to %s()", type_name(v->type), c->type_name);
+            return -1;
+        }
+    }
+    return count;
+}
+
+// Elements come in column order; one scalar fills the diagonal
+static IrInsn *lower_matrix_constructor(Lowering *lw, ConstructorExpr *c, TypeInfo *t) {
+    TypeInfo *column = type_matrix_column(t);
+    int n = column->components;
+    IrInsn *elements[16];
+    int count = lower_constructor_args(lw, c, elements, n * n);
+    if (count < 0) return ir_undef(lw->block, t);
+    if (count != 1 && count < n * n) return lower_fail(lw, t, "too few components for %s()", c->type_name);
+
+    IrInsn *m = lower_matrix_base(lw, t);
+    IrInsn *diagonal = count == 1 ? lower_convert(lw, elements[0], TYPE_FLOAT_INFO) : NULL;
+    IrInsn *zero = diagonal ? ir_const_float(lw->block, TYPE_FLOAT_INFO, 0.0) : NULL;
+    for (int i = 0; i < n; i++) {
+        IrInsn *lanes[4];
+        for (int j = 0; j < n; j++) {
+            if (diagonal) lanes[j] = i == j ? diagonal : zero;
+            else lanes[j] = lower_convert(lw, elements[i * n + j], TYPE_FLOAT_INFO);
+        }
+        m = ir_mat_insert(lw->block, m, lower_build(lw, column, lanes), i);
+    }
+    return m;
+}
+
+static IrInsn *lower_constructor(Lowering *lw, ASTNode *node) {
+    ConstructorExpr *c = &node->data.constructor_expr;
+    TypeInfo *t = type_from_name(c->type_name);
+
+    if (t && type_is_scalar(t) && t->base != TYPE_DOUBLE) {
+        if (c->arg_count != 1) return lower_fail(lw, t, "%s() takes one argument", c->type_name);
+        IrInsn *v = lower_expr(lw, c->arguments[0]);
+        if (type_is_vector(v->type)) v = ir_extract(lw->block, type_vector_element(v->type), v, 0);
+        return lower_convert(lw, v, t);
+    }
+
+    if (t && type_is_vector(t)) {
+        // Arguments are flattened into lanes; one scalar fills every lane
+        TypeInfo *element = type_vector_element(t);
+        IrInsn *lanes[4];
+        int count = lower_constructor_args(lw, c, lanes, t->components);
+        if (count < 0) return ir_undef(lw->block, t);
+        if (count == 1) return lower_splat(lw, lower_convert(lw, lanes[0], element), t);
+        if (count < t->components) return lower_fail(lw, t, "too few components for %s()", c->type_name);
+        for (int i = 0; i < t->components; i++) {
+            lanes[i] = lower_convert(lw, lanes[i], element);
+        }
+        return lower_build(lw, t, lanes);
+    }
+
+    if (t && type_is_matrix(t)) return lower_matrix_constructor(lw, c, t);
+
+    return lower_fail(lw, t, "%s() is not supported", c->type_name);
+}
+
+static IrInsn *lower_expr(Lowering *lw, ASTNode *node) {
+    switch (node->type) {
+    case AST_LITERAL: {
+        const char *text = node->data.literal.value;
+        if (literal_is_float(text)) return ir_const_float(lw->block, TYPE_FLOAT_INFO, strtod(text, NULL));
+        return ir_const_int(lw->block, TYPE_INT_INFO, strtoll(text, NULL, 10));
+    }
+    case AST_BINARY_EXPR:
+        return lower_binary(lw, node);
+    case AST_UNARY_EXPR:
+        return lower_unary(lw, node);
+    case AST_ASSIGNMENT_EXPR:
+        return lower_assign(lw, node);
+    case AST_CONSTRUCTOR_EXPR:
+        return lower_constructor(lw, node);
+    default: {
+        Ref ref;
+        lower_ref(lw, node, &ref);
+        return ref_read(lw, &ref);
+    }
+    }
+}
+
+// ============================================================================
+// LOWERING: AST SCANS
+// ============================================================================
+
+// What a walk over the AST under a node found
+typedef struct {
+    const char *var;         // Variable whose assignments are looked for, or NULL
+    bool assigned;           // Something assigns `var`
+    int size;                // AST nodes
+    int locals;              // Declarations of scalars, vectors and matrices
+    bool want_calls;         // Collect the calls of user functions
+    Symbol **calls;          // Callees, once per call
+    int call_count;
+    int call_capacity;
+} AstScan;
+
+static bool is_identifier(ASTNode *node, const char *name) {
+    return node && node->type == AST_IDENTIFIER && !strcmp(node->data.identifier.name, name);
+}
+
+static void ast_scan(ASTNode *node, AstScan *scan) {
+    if (!node) return;
+    scan->size++;
+
+    switch (node->type) {
+    case AST_VARIABLE_DECL: {
+        TypeInfo *t = type_from_name(node->data.var_decl.type);
+        if (t && !node->data.var_decl.is_array && type_in_registers(t)) scan->locals++;
+        ast_scan(node->data.var_decl.initializer, scan);
+        break;
+    }
+    case AST_BLOCK_STMT:
+        for (int i = 0; i < node->data.block_stmt.statement_count; i++) {
+            ast_scan(node->data.block_stmt.statements[i], scan);
+        }
+        break;
+    case AST_EXPRESSION_STMT:
+        ast_scan(node->data.expr_stmt.expression, scan);
+        break;
+    case AST_IF_STMT:
+        ast_scan(node->data.if_stmt.condition, scan);
+        ast_scan(node->data.if_stmt.consequent, scan);
+        ast_scan(node->data.if_stmt.alternate, scan);
+        break;
+    case AST_FOR_STMT:
+        ast_scan(node->data.for_stmt.init, scan);
+        ast_scan(node->data.for_stmt.test, scan);
+        ast_scan(node->data.for_stmt.update, scan);
+        ast_scan(node->data.for_stmt.body, scan);
+        break;
+    case AST_WHILE_STMT:
+        ast_scan(node->data.while_stmt.test, scan);
+        ast_scan(node->data.while_stmt.body, scan);
+        break;
+    case AST_RETURN_STMT:
+        ast_scan(node->data.return_stmt.argument, scan);
+        break;
+    case AST_BINARY_EXPR:
+        ast_scan(node->data.binary_expr.left, scan);
+        ast_scan(node->data.binary_expr.right, scan);
+        break;
+    case AST_UNARY_EXPR: {
+        const char *op = node->data.unary_expr.operator;
+        if ((!strcmp(op, "++") || !strcmp(op, "--")) && scan->var &&
+            is_identifier(node->data.unary_expr.argument, scan->var)) {
+            scan->assigned = true;
+        }
+        ast_scan(node->data.unary_expr.argument, scan);
+        break;
+    }
+    case AST_CALL_EXPR: {
+        ASTNode *callee = node->data.call_expr.callee;
+        Symbol *f = callee->type == AST_IDENTIFIER
+                        ? symtab_lookup_function(g_symtab, callee->data.identifier.name) : NULL;
+        if (f && scan->want_calls) {
+            if (scan->call_count == scan->call_capacity) {
+                scan->call_capacity = scan->call_capacity ? scan->call_capacity * 2 : 8;
+                scan->calls = crt_realloc(scan->calls, sizeof(Symbol*) * scan->call_capacity);
+            }
+            scan->calls[scan->call_count++] = f;
+        }
+        ast_scan(callee, scan);
+        for (int i = 0; i < node->data.call_expr.arg_count; i++) {
+            ast_scan(node->data.call_expr.arguments[i], scan);
+        }
+        break;
+    }
+    case AST_MEMBER_EXPR:
+        ast_scan(node->data.member_expr.object, scan);
+        break;
+    case AST_ARRAY_EXPR:
+        ast_scan(node->data.array_expr.array, scan);
+        ast_scan(node->data.array_expr.index, scan);
+        break;
+    case AST_ASSIGNMENT_EXPR:
+        if (scan->var && is_identifier(node->data.assign_expr.left, scan->var)) scan->assigned = true;
+        ast_scan(node->data.assign_expr.left, scan);
+        ast_scan(node->data.assign_expr.right, scan);
+        break;
+    case AST_CONSTRUCTOR_EXPR:
+        for (int i = 0; i < node->data.constructor_expr.arg_count; i++) {
+            ast_scan(node->data.constructor_expr.arguments[i], scan);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// ============================================================================
+// LOWERING: LOOP UNROLLING
+// ============================================================================
+
+// Loops are unrolled as they are lowered: the body is lowered once per
+// copy, each copy with a continue target of its own, and SSA construction
+// and folding turn the copies of the loop variable into constants.
+//
+// A `for` loop whose init declares an int variable, whose test compares it
+// with a constant and whose update steps it by a constant runs a known
+// number of times, as long as the body never assigns it. Such a loop is
+// unrolled completely when it is short or `#pragma unroll` asks for it.
+// With `#pragma unroll N` a loop runs N copies per iteration; when the
+// count is known the leftover iterations run first and the copies need no
+// test between them, otherwise every copy is tested.
+
+#define UNROLL_MAX_COPIES 16     // Complete unrolling without a pragma
+#define UNROLL_MAX_SIZE   256    // AST nodes of all copies, without a pragma
+#define UNROLL_MAX_TRIPS  1024   // Complete unrolling with a pragma
+
+typedef struct {
+    int prologue;            // Copies before the loop, untested
+    int copies;              // Copies per iteration; 0 leaves no loop
+    bool tested;             // Every copy tests the condition, not only the first
+} LoopShape;
+
+static bool const_int(ASTNode *node, int64_t *out) {
+    ConstValue v;
+    if (!const_eval(node, &v) || v.is_float) return false;
+    *out = v.i;
+    return true;
+}
+
+// Constant step of `var` by an update `var += k`, `var -= k`,
+// `var = var + k`, `var = var - k`, `var++` or `var--`
+static bool loop_step(ASTNode *update, const char *var, int64_t *step) {
+    if (!update) return false;
+    if (update->type == AST_UNARY_EXPR) {
+        const char *op = update->data.unary_expr.operator;
+        if (!is_identifier(update->data.unary_expr.argument, var)) return false;
+        if (!strcmp(op, "++")) *step = 1;
+        else if (!strcmp(op, "--")) *step = -1;
+        else return false;
+        return true;
+    }
+    if (update->type != AST_ASSIGNMENT_EXPR || !is_identifier(update->data.assign_expr.left, var)) {
+        return false;
+    }
+
+    const char *op = update->data.assign_expr.operator;
+    ASTNode *right = update->data.assign_expr.right;
+    bool negate;
+    if (!strcmp(op, "+=") || !strcmp(op, "-=")) {
+        if (!const_int(right, step)) return false;
+        negate = op[0] == '-';
+    } else if (!strcmp(op, "=") && right->type == AST_BINARY_EXPR) {
+        const char *bop = right->data.binary_expr.operator;
+        if (strcmp(bop, "+") && strcmp(bop, "-")) return false;
+        negate = bop[0] == '-';
+        if (is_identifier(right->data.binary_expr.left, var)) {
+            if (!const_int(right->data.binary_expr.right, step)) return false;
+        } else if (!negate && is_identifier(right->data.binary_expr.right, var)) {
+            if (!const_int(right->data.binary_expr.left, step)) return false;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    if (negate) *step = -*step;
+    return *step != 0;
+}
+
+// Iterations of a counted `for` loop, or -1 if the count is not known.
+// The variable must not wrap around on the way.
+static int64_t loop_trip_count(ForStmt *s) {
+    ASTNode *init = s->init, *test = s->test;
+    if (!init || init->type != AST_VARIABLE_DECL || !test || test->type != AST_BINARY_EXPR) return -1;
+    VariableDecl *decl = &init->data.var_decl;
+    if (decl->is_array || type_from_name(decl->type) != TYPE_INT_INFO) return -1;
+
+    const char *var = decl->name;
+    const char *op = test->data.binary_expr.operator;
+    int64_t start, bound, step;
+    if (!const_int(decl->initializer, &start) || !is_identifier(test->data.binary_expr.left, var) ||
+        !const_int(test->data.binary_expr.right, &bound) || !loop_step(s->update, var, &step)) {
+        return -1;
+    }
+    if (start < INT32_MIN || start > INT32_MAX || bound < INT32_MIN || bound > INT32_MAX ||
+        step < INT32_MIN || step > INT32_MAX) {
+        return -1;
+    }
+
+    int64_t n;
+    if (!strcmp(op, "<")) {
+        if (start >= bound) return 0;
+        n = step > 0 ? (bound - start + step - 1) / step : -1;
+    } else if (!strcmp(op, "<=")) {
+        if (start > bound) return 0;
+        n = step > 0 ? (bound - start) / step + 1 : -1;
+    } else if (!strcmp(op, ">")) {
+        if (start <= bound) return 0;
+        n = step < 0 ? (start - bound - step - 1) / -step : -1;
+    } else if (!strcmp(op, ">=")) {
+        if (start < bound) return 0;
+        n = step < 0 ? (start - bound) / -step + 1 : -1;
+    } else if (!strcmp(op, "!=")) {
+        n = (bound - start) % step == 0 ? (bound - start) / step : -1;
+    } else {
+        return -1;
+    }
+
+    int64_t last = start + n * step;
+    if (n < 0 || last < INT32_MIN || last > INT32_MAX) return -1;
+    AstScan scan = { .var = var };
+    ast_scan(s->body, &scan);
+    return scan.assigned ? -1 : n;
+}
+
+// How to lay out a loop with the given pragma, trip count (-1 if unknown)
+// and body
+static LoopShape loop_shape(int unroll, int64_t trips, ASTNode *body) {
+    LoopShape shape = { 0, 1, true };
+    AstScan scan = {0};
+    ast_scan(body, &scan);
+    int size = scan.size;
+
+    // A loop that never runs keeps its body, which is still checked
+    if (unroll == 1 || trips == 0) return shape;
+    if (trips < 0) {
+        if (unroll > 1) shape.copies = unroll;
+        return shape;
+    }
+
+    bool complete;
+    if (unroll == UNROLL_FULL) complete = trips <= UNROLL_MAX_TRIPS;
+    else if (unroll > 1) complete = unroll >= trips;
+    else complete = trips <= UNROLL_MAX_COPIES && trips * (size > 0 ? size : 1) <= UNROLL_MAX_SIZE;
+
+    if (complete) {
+        shape.prologue = (int)trips;
+        shape.copies = 0;
+    } else if (unroll > 1) {
+        shape.prologue = (int)(trips % unroll);
+        shape.copies = unroll;
+        shape.tested = false;
+    }
+    return shape;
+}
+
+// ============================================================================
+// LOWERING: INLINING
+// ============================================================================
+
+// A call is inlined by lowering the callee's body from its AST in place of
+// the call: register arguments become the values of its parameters,
+// aggregate arguments are copied into slots of the caller's frame, and
+// returns jump past the body with the result. That saves the call and
+// return, the arguments and aggregate results copied through the callee's
+// frame, and the caller's values saved and restored around the call, and
+// the body is then optimized with the caller.
+//
+// Bodies about the size of the call are always inlined. Larger ones are
+// inlined up to INLINE_MAX_SIZE, twice that inside loops, as long as the
+// copies at all call sites add at most INLINE_MAX_GROWTH to the program
+// and the body holds few enough variables in registers not to crowd out
+// the caller's. always_inline and noinline attributes override that. A
+// callee is only inlined once it has lowered cleanly, which functions
+// lowered before their callers make sure of, and never into itself.
+
+#define INLINE_CALL_SIZE  32     // AST nodes of a body no bigger than its call
+#define INLINE_MAX_SIZE   128    // Larger bodies stay calls, twice that in loops
+#define INLINE_MAX_GROWTH 512    // AST nodes the copies may add to the program
+#define INLINE_MAX_VARS   8      // Parameters and locals held in registers
+
+static bool inline_worth(Lowering *lw, Symbol *f) {
+    if (f->noinline) return false;
+    if (f->always_inline) return true;
+
+    AstScan scan = {0};
+    ast_scan(f->func_body, &scan);
+    if (scan.size <= INLINE_CALL_SIZE) return true;
+
+    int vars = scan.locals;
+    for (int i = 0; i < f->param_count; i++) {
+        if (type_in_registers(f->params[i]->type)) vars++;
+    }
+    int max_size = lw->loop_count + lw->outer_loops > 0 ? INLINE_MAX_SIZE * 2 : INLINE_MAX_SIZE;
+    return vars <= INLINE_MAX_VARS && scan.size <= max_size &&
+           scan.size * (f->call_sites - 1) <= INLINE_MAX_GROWTH;
+}
+
+static bool lower_inline(Lowering *lw, Symbol *f, IrInsn **values, Ref *refs, Ref *ref) {
+    IrFunction *callee = f->ir_func;
+    if (lw->fn->failed || !callee->lowered || callee->failed || callee == lw->fn) return false;
+    for (Inline *i = lw->inl; i; i = i->outer) {
+        if (i->callee == f) return false;
+    }
+    if (!inline_worth(lw, f)) return false;
+
+    TypeInfo *ret = callee->return_type;
+    Inline inl = { f, ret, ir_block_new(lw->fn), -1, -1, lw->inl };
+    if (type_in_registers(ret)) inl.ret_var = ir_ssa_var(lw->fn);
+    else if (ret->base != TYPE_VOID) inl.ret_offset = ir_frame_alloc(lw->fn, ret->size, ret->alignment);
+
+    Scope *outer = symtab_enter_function_scope(g_symtab);
+    for (int i = 0; i < f->param_count; i++) {
+        Symbol *p = symtab_define_param(g_symtab, f->params[i]->name, f->params[i]->type);
+        if (!p) {
+            lw->fn->failed = true;
+            continue;
+        }
+        if (values[i]) {
+            p->ssa_var = ir_ssa_var(lw->fn);
+            values[i]->assigned = true;
+            ir_write_var(lw->block, p->ssa_var, values[i]);
+            continue;
+        }
+        p->stack_offset = ir_frame_alloc(lw->fn, p->type->size, p->type->alignment);
+        if (refs[i].kind != REF_MEM) continue;
+        IrInsn *slot = ir_addr(lw->block, IR_SPACE_LOCAL, lw->fn, p, p->stack_offset);
+        ir_copy(lw->block, IR_SPACE_LOCAL, slot, refs[i].space, refs[i].addr, p->type->size);
+    }
+
+    // The caller's loops are out of reach of the body, but still count as
+    // loops for what the body inlines in turn
+    Lowering body = *lw;
+    body.loops = NULL;
+    body.loop_count = body.loop_capacity = 0;
+    body.inl = &inl;
+    body.outer_loops = lw->outer_loops + lw->loop_count;
+    lower_stmt(&body, f->func_body);
+    free(body.loops);
+    symtab_exit_function_scope(g_symtab, outer);
+
+    // Falling off the end returns; the value is undefined for non-void
+    if (!ir_block_terminated(body.block)) {
+        if (inl.ret_var >= 0) ir_write_var(body.block, inl.ret_var, ir_undef(body.block, ret));
+        ir_jump(body.block, inl.exit);
+    }
+    ir_block_move_last(inl.exit);
+    ir_seal_block(inl.exit);
+    lw->block = inl.exit;
+
+    if (inl.ret_var >= 0) {
+        ref_set_value(ref, ir_read_var(lw->block, inl.ret_var, ret, NULL));
+    } else if (inl.ret_offset >= 0) {
+        memset(ref, 0, sizeof(*ref));
+        ref->kind = REF_MEM;
+        ref->space = IR_SPACE_LOCAL;
+        ref->addr = ir_addr(lw->block, IR_SPACE_LOCAL, lw->fn, NULL, inl.ret_offset);
+        ref->type = ref->base_type = ret;
+    } else {
+        ref_set_value(ref, ir_undef(lw->block, TYPE_VOID_INFO));
+    }
+    return true;
+}
+
+// ============================================================================
+// LOWERING: STATEMENTS
+// ============================================================================
+
+// Code after return, break or continue goes into a block no edge reaches;
+// it is dropped with the other unreachable blocks
+static void lower_unreachable(Lowering *lw) {
+    lw->block = ir_block_new(lw->fn);
+    ir_seal_block(lw->block);
+}
+
+static void lower_push_loop(Lowering *lw, IrBlock *break_target, IrBlock *continue_target) {
+    if (lw->loop_count == lw->loop_capacity) {
+        lw->loop_capacity = lw->loop_capacity ? lw->loop_capacity * 2 : 8;
+        lw->loops = crt_realloc(lw->loops, sizeof(LoopTargets) * lw->loop_capacity);
+    }
+    lw->loops[lw->loop_count].break_target = break_target;
+    lw->loops[lw->loop_count].continue_target = continue_target;
+    lw->loop_count++;
+}
+
+static void lower_local(Lowering *lw, ASTNode *node) {
+    VariableDecl *decl = &node->data.var_decl;
+    TypeInfo *type = resolve_decl_type(decl->type, decl->is_array, decl->array_size, decl->name);
+    Symbol *sym = type ? symtab_define(g_symtab, decl->name, SYM_VARIABLE, type, STORAGE_LOCAL) : NULL;
+    if (!sym) {
+        lw->fn->failed = true;
+        return;
+    }
+
+    if (type_in_registers(type)) {
+        sym->ssa_var = ir_ssa_var(lw->fn);
+        if (decl->initializer) {
+            IrInsn *value = lower_convert(lw, lower_expr(lw, decl->initializer), type);
+            value->assigned = true;
+            ir_write_var(lw->block, sym->ssa_var, value);
+        }
+        return;
+    }
+
+    // The function frame replaces the symbol table's stack layout
+    sym->stack_offset = ir_frame_alloc(lw->fn, type->size, type->alignment);
+    if (decl->initializer) {
+        Ref src;
+        lower_ref(lw, decl->initializer, &src);
+        if (src.kind != REF_MEM || src.type != type) {
+            lower_fail(lw, NULL, "cannot initialize %s %s with %s",
+                       type_name(type), decl->name, type_name(src.type));
+            return;
+        }
+        IrInsn *dst = ir_addr(lw->block, IR_SPACE_LOCAL, lw->fn, sym, sym->stack_offset);
+        ir_copy(lw->block, IR_SPACE_LOCAL, dst, src.space, src.addr, type->size);
+    }
+}
+
+static void lower_if(Lowering *lw, ASTNode *node) {
+    IfStmt *s = &node->data.if_stmt;
+    IrInsn *cond = lower_bool(lw, s->condition);
+    IrBlock *then_block = ir_block_new(lw->fn);
+    IrBlock *else_block = s->alternate ? ir_block_new(lw->fn) : NULL;
+    IrBlock *join = ir_block_new(lw->fn);
+
+    ir_branch(lw->block, cond, then_block, else_block ? else_block : join);
+    ir_seal_block(then_block);
+    lw->block = then_block;
+    lower_stmt(lw, s->consequent);
+    if (!ir_block_terminated(lw->block)) ir_jump(lw->block, join);
+
+    if (else_block) {
+        ir_seal_block(else_block);
+        lw->block = else_block;
+        lower_stmt(lw, s->alternate);
+        if (!ir_block_terminated(lw->block)) ir_jump(lw->block, join);
+    }
+
+    ir_seal_block(join);
+    lw->block = join;
+}
+
+// Branches to `exit` unless `test` holds
+static void lower_loop_test(Lowering *lw, ASTNode *test, IrBlock *exit) {
+    if (!test) return;
+    IrBlock *body = ir_block_new(lw->fn);
+    ir_branch(lw->block, lower_bool(lw, test), body, exit);
+    ir_seal_block(body);
+    lw->block = body;
+}
+
+// One copy of the body followed by the update; continue goes to the
+// update, which is laid out after the body so that the body falls into it
+static void lower_loop_copy(Lowering *lw, ASTNode *body, ASTNode *update, IrBlock *exit) {
+    IrBlock *next = ir_block_new(lw->fn);
+    lower_push_loop(lw, exit, next);
+    symtab_enter_scope(g_symtab);
+    lower_stmt(lw, body);
+    symtab_exit_scope(g_symtab);
+    if (!ir_block_terminated(lw->block)) ir_jump(lw->block, next);
+    lw->loop_count--;
+
+    ir_block_move_last(next);
+    ir_seal_block(next);
+    lw->block = next;
+    if (update) lower_expr(lw, update);
+}
+
+// The prologue copies, then a header testing the condition before the
+// copies of each iteration and the back edge to it. The header is sealed
+// once the back edge is known; the exit comes last in the layout.
+static void lower_loop(Lowering *lw, ASTNode *test, ASTNode *body, ASTNode *update, LoopShape shape) {
+    IrBlock *exit = ir_block_new(lw->fn);
+    for (int i = 0; i < shape.prologue; i++) {
+        lower_loop_copy(lw, body, update, exit);
+    }
+
+    if (shape.copies > 0) {
+        IrBlock *header = ir_block_new(lw->fn);
+        ir_jump(lw->block, header);
+        lw->block = header;
+        for (int i = 0; i < shape.copies; i++) {
+            if (i == 0 || shape.tested) lower_loop_test(lw, test, exit);
+            lower_loop_copy(lw, body, update, exit);
+        }
+        ir_jump(lw->block, header);
+        ir_seal_block(header);
+    } else {
+        ir_jump(lw->block, exit);
+    }
+
+    ir_block_move_last(exit);
+    ir_seal_block(exit);
+    lw->block = exit;
+}
+
+static void lower_while(Lowering *lw, ASTNode *node) {
+    WhileStmt *s = &node->data.while_stmt;
+    lower_loop(lw, s->test, s->body, NULL, loop_shape(s->unroll, -1, s->body));
+}
+
+static void lower_for(Lowering *lw, ASTNode *node) {
+    ForStmt *s = &node->data.for_stmt;
+
+    // The loop variable is scoped to the statement
+    symtab_enter_scope(g_symtab);
+    if (s->init) {
+        if (s->init->type == AST_VARIABLE_DECL) lower_local(lw, s->init);
+        else lower_stmt(lw, s->init);
+    }
+    lower_loop(lw, s->test, s->body, s->update, loop_shape(s->unroll, loop_trip_count(s), s->body));
+    symtab_exit_scope(g_symtab);
+}
+
+// An inlined body returns by setting the result and jumping past itself
+static void lower_return(Lowering *lw, ASTNode *node) {
+    Inline *inl = lw->inl;
+    TypeInfo *ret = inl ? inl->return_type : lw->fn->return_type;
+    ASTNode *arg = node->data.return_stmt.argument;
+    IrInsn *value = NULL;
+
+    if (!arg) {
+        if (ret->base != TYPE_VOID) lower_fail(lw, NULL, "missing return value");
+    } else if (ret->base == TYPE_VOID) {
+        lower_fail(lw, NULL, "return with a value in a void function");
+    } else if (type_in_registers(ret)) {
+        value = lower_convert(lw, lower_expr(lw, arg), ret);
+    } else {
+        // Aggregates are returned through the return slot of the frame
+        Ref src;
+        lower_ref(lw, arg, &src);
+        if (src.kind != REF_MEM || src.type != ret) {
+            lower_fail(lw, NULL, "cannot return %s as %s", type_name(src.type), type_name(ret));
+        } else {
+            int offset = inl ? inl->ret_offset : lw->fn->ret_offset;
+            IrInsn *dst = ir_addr(lw->block, IR_SPACE_LOCAL, lw->fn, NULL, offset);
+            ir_copy(lw->block, IR_SPACE_LOCAL, dst, src.space, src.addr, ret->size);
+        }
+    }
+
+    if (inl) {
+        if (value) {
+            value->assigned = true;
+            ir_write_var(lw->block, inl->ret_var, value);
+        }
+        ir_jump(lw->block, inl->exit);
+    } else {
+        ir_ret(lw->block, value);
+    }
+    lower_unreachable(lw);
+}
+
+static void lower_stmt(Lowering *lw, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+    case AST_VARIABLE_DECL:
+        lower_local(lw, node);
+        break;
+
+    case AST_BLOCK_STMT:
+        symtab_enter_scope(g_symtab);
+        for (int i = 0; i < node->data.block_stmt.statement_count; i++) {
+            lower_stmt(lw, node->data.block_stmt.statements[i]);
+        }
+        symtab_exit_scope(g_symtab);
+        break;
+
+    case AST_EXPRESSION_STMT:
+        if (node->data.expr_stmt.expression) lower_expr(lw, node->data.expr_stmt.expression);
+        break;
+
+    case AST_IF_STMT:
+        lower_if(lw, node);
+        break;
+
+    case AST_WHILE_STMT:
+        lower_while(lw, node);
+        break;
+
+    case AST_FOR_STMT:
+        lower_for(lw, node);
+        break;
+
+    case AST_RETURN_STMT:
+        lower_return(lw, node);
+        break;
+
+    case AST_BREAK_STMT:
+    case AST_CONTINUE_STMT:
+        if (!lw->loop_count) {
+            lower_fail(lw, NULL, "%s outside of a loop",
+                       node->type == AST_BREAK_STMT ? "break" : "continue");
+            break;
+        }
+        ir_jump(lw->block, node->type == AST_BREAK_STMT
+                               ? lw->loops[lw->loop_count - 1].break_target
+                               : lw->loops[lw->loop_count - 1].continue_target);
+        lower_unreachable(lw);
+        break;
+
+    default:
+        lower_fail(lw, NULL, "unexpected declaration in a function body");
+        break;
+    }
+}
+
+static void lower_function(Symbol *sym) {
+    IrFunction *fn = sym->ir_func;
+    Lowering lw = {0};
+    lw.fn = fn;
+    lw.block = ir_block_new(fn);
+    ir_seal_block(lw.block);
+
+    // Parameters are redefined in a scope of their own around the body
+    symtab_enter_scope(g_symtab);
+    for (int i = 0; i < sym->param_count; i++) {
+        Symbol *p = symtab_define_param(g_symtab, sym->params[i]->name, sym->params[i]->type);
+        if (!p) {
+            fn->failed = true;
+            continue;
+        }
+        if (type_in_registers(p->type)) {
+            p->ssa_var = ir_ssa_var(fn);
+            IrInsn *value = ir_insn_new(lw.block, IR_PARAM, p->type);
+            value->imm.index = i;
+            ir_write_var(lw.block, p->ssa_var, value);
+        } else {
+            p->stack_offset = fn->param_offsets[i];
+        }
+    }
+
+    lower_stmt(&lw, sym->func_body);
+
+    // Falling off the end returns; the value is undefined for non-void
+    if (!ir_block_terminated(lw.block)) {
+        if (type_in_registers(fn->return_type)) ir_ret(lw.block, ir_undef(lw.block, fn->return_type));
+        else ir_ret(lw.block, NULL);
+    }
+    symtab_exit_scope(g_symtab);
+    free(lw.loops);
+
+    ir_ssa_finish(fn);
+    ir_remove_unreachable(fn);
+    fn->lowered = true;
+}
+
+// Lowers the functions `sym` calls, then `sym`, so that its calls may be
+// inlined. `calls` holds the callees of every function by IR index; a
+// cycle is entered anywhere, and calls back into it stay calls.
+static void lower_callees_first(Symbol *sym, AstScan *calls, uint8_t *state) {
+    int index = sym->ir_func->index;
+    if (state[index]) return;
+    state[index] = 1;
+    for (int i = 0; i < calls[index].call_count; i++) {
+        lower_callees_first(calls[index].calls[i], calls, state);
+    }
+    lower_function(sym);
+}
+
+// ============================================================================
+// DEAD FUNCTIONS
+// ============================================================================
+
+// Drops helpers whose every call was inlined, so that they take no code
+// and keep no globals alive. Functions the source never calls are entry
+// points and stay, as do functions that failed, so that their errors
+// still fail the module; everything they still call or address stays too.
+static void drop_dead_functions(IrModule *m) {
+    int count = m->func_count;
+    bool *reached = crt_calloc(count > 0 ? count : 1, sizeof(bool));
+    IrFunction **stack = crt_malloc(sizeof(IrFunction*) * (count > 0 ? count : 1));
+    int top = 0;
+
+    for (int i = 0; i < count; i++) {
+        IrFunction *fn = m->funcs[i];
+        if (fn->sym->call_sites > 0 && fn->lowered && !fn->failed) continue;
+        reached[i] = true;
+        stack[top++] = fn;
+    }
+
+    // Calls, and addresses into the frame of another function
+    while (top > 0) {
+        IrFunction *fn = stack[--top];
+        for (int b = 0; b < fn->block_count; b++) {
+            for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+                if (!insn->func || reached[insn->func->index]) continue;
+                reached[insn->func->index] = true;
+                stack[top++] = insn->func;
+            }
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        IrFunction *fn = m->funcs[i];
+        if (!reached[i]) {
+            if (g_gen_flags & GEN_TRACE) printf("Function %s is inlined everywhere, dropped\n", fn->name);
+            continue;
+        }
+        fn->index = kept;
+        m->funcs[kept++] = fn;
+    }
+    m->func_count = kept;
+
+    free(stack);
+    free(reached);
+}
+
+// ============================================================================
+// DATA SECTION
+// ============================================================================
+
+// Index in g_data_globals of the global at `sym`, by its current offset
+static int data_global_index(Symbol *sym) {
+    int lo = 0, hi = g_data_global_count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (g_data_globals[mid]->stack_offset < sym->stack_offset) lo = mid + 1;
+        else if (g_data_globals[mid]->stack_offset > sym->stack_offset) hi = mid - 1;
+        else return g_data_globals[mid] == sym ? mid : -1;
+    }
+    return -1;
+}
+
+// The host writes uniforms, attributes and varyings at the offsets their
+// declarations give them, whether the kernel reads them or not
+static bool data_is_interface(Symbol *sym) {
+    return sym->storage == STORAGE_UNIFORM || sym->storage == STORAGE_ATTRIBUTE ||
+           sym->storage == STORAGE_VARYING;
+}
+
+// Drops the plain globals no generated code refers to and packs the others
+// in declaration order around the interface globals, which keep their
+// offsets. Globals that are only written stay: the data section is where a
+// kernel leaves its results. A global never moves up past the one before
+// it, so packed globals cannot reach into an interface global.
+static void data_compact(IrModule *m) {
+    int count = g_data_global_count;
+    bool *used = crt_calloc(count > 0 ? count : 1, sizeof(bool));
+    for (int i = 0; i < count; i++) {
+        used[i] = data_is_interface(g_data_globals[i]);
+    }
+    for (int f = 0; f < m->func_count; f++) {
+        IrFunction *fn = m->funcs[f];
+        if (!fn->lowered || fn->failed) continue;
+        for (int b = 0; b < fn->block_count; b++) {
+            for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+                if (insn->op != IR_ADDR || insn->space != IR_SPACE_GLOBAL || !insn->sym) continue;
+                int i = data_global_index(insn->sym);
+                if (i >= 0) used[i] = true;
+            }
+        }
+    }
+
+    int dropped = 0;
+    for (int i = 0; i < count; i++) {
+        if (!used[i]) dropped++;
+    }
+    if (dropped == 0) {
+        free(used);
+        return;
+    }
+
+    EmitBuffer data;
+    emit_init(&data);
+    int *offsets = crt_malloc(sizeof(int) * count);
+    for (int i = 0; i < count; i++) {
+        Symbol *sym = g_data_globals[i];
+        if (!used[i]) {
+            if (g_gen_flags & GEN_TRACE) printf("Global %s is unused, dropped\n", sym->name);
+            continue;
+        }
+        int align = sym->type->alignment > 0 ? sym->type->alignment : 1;
+        int offset = data_is_interface(sym) ? sym->stack_offset
+                                            : (data.size + align - 1) / align * align;
+        uint8_t *p = emit_reserve(&data, offset + sym->type->size - data.size);
+        memset(p, 0, offset - (int)(p - data.data));
+        memcpy(data.data + offset, g_emitBufferData.data + sym->stack_offset, sym->type->size);
+        offsets[i] = offset;
+        if ((g_gen_flags & GEN_TRACE) && offset != sym->stack_offset)
+            printf("Global %s moved to [DATA+%08x]\n", sym->name, offset);
+    }
+
+    // Addresses keep their distance into the global
+    for (int f = 0; f < m->func_count; f++) {
+        IrFunction *fn = m->funcs[f];
+        if (!fn->lowered || fn->failed) continue;
+        for (int b = 0; b < fn->block_count; b++) {
+            for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+                if (insn->op != IR_ADDR || insn->space != IR_SPACE_GLOBAL || !insn->sym) continue;
+                int i = data_global_index(insn->sym);
+                if (i >= 0) insn->imm.offset += offsets[i] - insn->sym->stack_offset;
+            }
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (!used[i]) continue;
+        g_data_globals[i]->stack_offset = offsets[i];
+        g_data_globals[kept++] = g_data_globals[i];
+    }
+    g_data_global_count = kept;
+
+    emit_free(&g_emitBufferData);
+    g_emitBufferData = data;
+    free(offsets);
+    free(used);
+}
+
+// ============================================================================
+// ENTRY POINTS
+// ============================================================================
+
+int gen_init(int flags) {
+    g_gen_flags = flags;
+    emit_init(&g_emitBufferCode);
+    emit_init(&g_emitBufferData);
+    g_data_global_count = 0;
+    types_init();
+    g_symtab = symtab_create();
+
+    if (flags & GEN_TRACE)
+        printf("TGPU\n");
+    return 1;
+}
+
+// Lower every function to IR, then generate code for the module
+int gen_by_ast(ASTNode *root) {
+    walk_ast_node(root, 2, (g_gen_flags & GEN_TRACE) ? stdout : NULL);
+    if (!root || root->type != AST_PROGRAM) return 0;
+
+    // Every function gets its IR shell first so calls can refer to
+    // functions defined later in the source
+    g_module = ir_module_new();
+    for (int i = 0; i < g_symtab->func_count; i++) {
+        Symbol *sym = g_symtab->functions[i];
+        sym->ir_func = ir_function_new(g_module, sym);
+    }
+
+    // Redefinitions were reported during resolution and are not lowered
+    int count = g_symtab->func_count;
+    AstScan *calls = crt_calloc(count ? count : 1, sizeof(AstScan));
+    uint8_t *state = crt_calloc(count ? count : 1, 1);
+    for (int i = 0; i < count; i++) {
+        calls[i].want_calls = true;
+        ast_scan(g_symtab->functions[i]->func_body, &calls[i]);
+        for (int j = 0; j < calls[i].call_count; j++) calls[i].calls[j]->call_sites++;
+    }
+    for (int i = 0; i < count; i++) {
+        lower_callees_first(g_symtab->functions[i], calls, state);
+    }
+    for (int i = 0; i < count; i++) free(calls[i].calls);
+    free(calls);
+    free(state);
+    ir_optimize_module(g_module, g_gen_flags);
+    drop_dead_functions(g_module);
+    data_compact(g_module);
+
+    if (g_gen_flags & GEN_DUMP_IR)
+        ir_dump_module(g_module, stdout);
+
+    return isel_module(g_module, &g_emitBufferCode) ? 1 : 0;
+}
+
+// Write the code and data sections. Returns the number of bytes generated,
+// or -1 if the output could not be written.
+int gen_emit(void) {
+    if (!emit_write_file(&g_emitBufferCode, ".code.hex")) return -1;
+    if (!emit_write_file(&g_emitBufferData, ".data.hex")) return -1;
+    return g_emitBufferCode.size + g_emitBufferData.size;
+}
@@ -0,0 +1,263 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// GLOBAL VALUE NUMBERING
+// ============================================================================
+
+// Blocks are visited in reverse postorder, so a block comes after all its
+// dominators. Each value is looked up among those seen so far by operation,
+// type, immediates and operands, operands of commutative operations in a
+// fixed order; an equal value in a dominating block replaces it. Swizzles
+// are extracts and builds, so repeated ones merge like any arithmetic.
+// Undefined values of one type are all the same value, which lets matrix
+// tiles assembled from the same columns merge.
+//
+// A load is redundant with an earlier load of the same address, or a store
+// of a value of its type there, if that one dominates it and nothing on a
+// path in between may write the bytes. Uniform, attribute and const
+// globals are never written. Calls may write the data section and the
+// frames of the functions they reach, but not the caller's frame.
+
+#define GVN_MAX_ARGS   4
+#define GVN_MAX_BLOCKS 64     // Blocks searched for writes between a load and its source
+
+typedef struct GvnEntry GvnEntry;
+
+struct GvnEntry {
+    IrInsn *insn;            // The value, or the store providing it
+    unsigned hash;
+    GvnEntry *next;
+};
+
+typedef struct {
+    IrFunction *fn;
+    GvnEntry **buckets;
+    int bucket_count;        // Power of two
+    GvnEntry *entries;
+    int entry_count;
+    bool *visited;           // By block id, while searching for writes
+    IrBlock **worklist;
+} Gvn;
+
+// ============================================================================
+// KEYS
+// ============================================================================
+
+static bool gvn_numbered(IrInsn *insn) {
+    switch (insn->op) {
+    case IR_CONST:
+    case IR_UNDEF:
+    case IR_ADDR:
+    case IR_LOAD:
+    case IR_CMP:
+    case IR_CONVERT:
+    case IR_VEC_BUILD:
+    case IR_EXTRACT:
+    case IR_INSERT:
+    case IR_MAT_ZERO:
+    case IR_MAT_INSERT:
+    case IR_MAT_EXTRACT:
+        return true;
+    default:
+        return insn->op >= IR_ADD && insn->op <= IR_FMA;
+    }
+}
+
+// Operations whose first two operands may be swapped without changing a
+// bit of the result. Float min and max are left alone: which zero or NaN
+// they return is the hardware's business.
+static bool gvn_commutative(IrInsn *insn) {
+    switch (insn->op) {
+    case IR_ADD:
+    case IR_MUL:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+    case IR_FMA:
+        return true;
+    case IR_MIN:
+    case IR_MAX:
+        return !ir_tgq_is_float(insn->tgq_type);
+    default:
+        return false;
+    }
+}
+
+// A store is looked up as the load of what it stored
+static IrOp gvn_op(IrInsn *insn) {
+    return insn->op == IR_STORE ? IR_LOAD : insn->op;
+}
+
+static TypeInfo *gvn_type(IrInsn *insn) {
+    return insn->op == IR_STORE ? insn->args[1]->type : insn->type;
+}
+
+static int gvn_args(IrInsn *insn, IrInsn **args) {
+    int count = insn->op == IR_STORE ? 1 : insn->arg_count;
+    for (int i = 0; i < count; i++) args[i] = insn->args[i];
+    if (gvn_commutative(insn) && args[0]->id > args[1]->id) {
+        IrInsn *t = args[0];
+        args[0] = args[1];
+        args[1] = t;
+    }
+    return count;
+}
+
+static unsigned gvn_hash(IrInsn *insn) {
+    IrInsn *args[GVN_MAX_ARGS];
+    int count = gvn_args(insn, args);
+    uint64_t h = (uint64_t)gvn_op(insn) * 0x9e3779b97f4a7c15ull;
+    h ^= (uint64_t)(uintptr_t)gvn_type(insn);
+    h = h * 31 + (insn->op == IR_STORE ? 0 : insn->imm.bits);
+    h = h * 31 + insn->space;
+    for (int i = 0; i < count; i++) h = h * 31 + (uint64_t)args[i]->id;
+    return (unsigned)(h ^ (h >> 32));
+}
+
+static bool gvn_equal(IrInsn *a, IrInsn *b) {
+    if (gvn_op(a) != gvn_op(b) || gvn_type(a) != gvn_type(b)) return false;
+    if (a->op != IR_STORE && b->op != IR_STORE && a->imm.bits != b->imm.bits) return false;
+    if (a->space != b->space || a->sym != b->sym || a->func != b->func) return false;
+
+    IrInsn *xa[GVN_MAX_ARGS], *xb[GVN_MAX_ARGS];
+    int count = gvn_args(a, xa);
+    if (gvn_args(b, xb) != count) return false;
+    for (int i = 0; i < count; i++) {
+        if (xa[i] != xb[i]) return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// MEMORY
+// ============================================================================
+
+// Whether instructions from `first` up to, not including, `end` may write
+// the bytes of `load`
+static bool gvn_range_writes(Gvn *g, IrInsn *first, IrInsn *end, IrInsn *load, int size) {
+    for (IrInsn *insn = first; insn != end; insn = insn->next) {
+        if (ir_insn_may_write(g->fn, insn, load->space, load->args[0], size)) return true;
+    }
+    return false;
+}
+
+// Whether something may write the bytes of `load` on a path from `source`,
+// which dominates it, to the load. The blocks that reach the load without
+// going through the source block are searched backwards; every path from
+// the source block leaves it after `source`.
+static bool gvn_written_between(Gvn *g, IrInsn *source, IrInsn *load) {
+    int size = ir_tgq_size(load->tgq_type);
+    if (ir_read_only(load->args[0])) return false;
+
+    IrBlock *from = source->block, *to = load->block;
+    if (from == to) return gvn_range_writes(g, source->next, load, load, size);
+    if (gvn_range_writes(g, to->first, load, load, size)) return true;
+    if (gvn_range_writes(g, source->next, NULL, load, size)) return true;
+
+    int top = 0, seen = 0;
+    bool written = false;
+    g->visited[from->id] = true;
+    for (int p = 0; p < to->pred_count; p++) {
+        IrBlock *pred = to->preds[p];
+        if (g->visited[pred->id]) continue;
+        g->visited[pred->id] = true;
+        g->worklist[top++] = pred;
+    }
+    while (top > 0 && !written) {
+        IrBlock *b = g->worklist[--top];
+        if (++seen > GVN_MAX_BLOCKS || gvn_range_writes(g, b->first, NULL, load, size)) {
+            written = true;
+            break;
+        }
+        for (int p = 0; p < b->pred_count; p++) {
+            IrBlock *pred = b->preds[p];
+            if (g->visited[pred->id]) continue;
+            g->visited[pred->id] = true;
+            g->worklist[top++] = pred;
+        }
+    }
+    memset(g->visited, 0, g->fn->next_block_id * sizeof(bool));
+    return written;
+}
+
+// ============================================================================
+// NUMBERING
+// ============================================================================
+
+static void gvn_insert(Gvn *g, IrInsn *insn, unsigned hash) {
+    GvnEntry *e = &g->entries[g->entry_count++];
+    e->insn = insn;
+    e->hash = hash;
+    GvnEntry **bucket = &g->buckets[hash & (g->bucket_count - 1)];
+    e->next = *bucket;
+    *bucket = e;
+}
+
+// The value `insn` computes again, or NULL
+static IrInsn *gvn_find(Gvn *g, IrInsn *insn, unsigned hash) {
+    for (GvnEntry *e = g->buckets[hash & (g->bucket_count - 1)]; e; e = e->next) {
+        IrInsn *other = e->insn;
+        if (e->hash != hash || !gvn_equal(insn, other)) continue;
+        if (other->block != insn->block && !ir_dominates(other->block, insn->block)) continue;
+        if (insn->op == IR_LOAD && gvn_written_between(g, other, insn)) continue;
+        return other->op == IR_STORE ? other->args[1] : other;
+    }
+    return NULL;
+}
+
+void ir_gvn_function(IrFunction *fn) {
+    if (fn->block_count == 0) return;
+
+    int insn_count = 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) insn_count++;
+    }
+
+    Gvn g;
+    memset(&g, 0, sizeof(g));
+    g.fn = fn;
+    g.bucket_count = 16;
+    while (g.bucket_count < insn_count * 2) g.bucket_count *= 2;
+    g.buckets = crt_calloc(g.bucket_count, sizeof(GvnEntry*));
+    g.entries = crt_malloc(sizeof(GvnEntry) * (insn_count + 1));
+    g.visited = crt_calloc(fn->next_block_id, sizeof(bool));
+    g.worklist = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+
+    IrBlock **order = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    int count = ir_reverse_postorder(fn, order);
+    ir_compute_dominators(fn);
+
+    for (int b = 0; b < count; b++) {
+        IrInsn *next;
+        for (IrInsn *insn = order[b]->first; insn; insn = next) {
+            next = insn->next;
+            for (int i = 0; i < insn->arg_count; i++) {
+                insn->args[i] = ir_resolve(insn->args[i]);
+            }
+
+            bool is_store = insn->op == IR_STORE;
+            if (!is_store && (!gvn_numbered(insn) || insn->arg_count > GVN_MAX_ARGS)) continue;
+
+            unsigned hash = gvn_hash(insn);
+            if (!is_store) {
+                IrInsn *value = gvn_find(&g, insn, hash);
+                if (value) {
+                    ir_replace(insn, value);
+                    continue;
+                }
+            }
+            gvn_insert(&g, insn, hash);
+        }
+    }
+    ir_resolve_args(fn);
+
+    free(order);
+    free(g.worklist);
+    free(g.visited);
+    free(g.entries);
+    free(g.buckets);
+}
@@ -0,0 +1,1134 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// ============================================================================
+// ALLOCATION
+// ============================================================================
+
+#define IR_ARENA_BLOCK_SIZE (64 * 1024)
+
+// Grows an arena-backed array to hold one more element. The old storage
+// stays in the arena; arrays here are small and rarely grow.
+static void *ir_grow(arena_t *arena, void *items, int count, int *capacity, size_t elem) {
+    if (count < *capacity) return items;
+    int new_capacity = *capacity ? *capacity * 2 : 4;
+    void *grown = arena_alloc(arena, new_capacity * elem);
+    if (count) memcpy(grown, items, count * elem);
+    *capacity = new_capacity;
+    return grown;
+}
+
+IrModule *ir_module_new(void) {
+    IrModule *m = crt_calloc(1, sizeof(IrModule));
+    m->arena = arena_new(IR_ARENA_BLOCK_SIZE);
+    return m;
+}
+
+void ir_module_free(IrModule *m) {
+    if (!m) return;
+    arena_free(m->arena);
+    free(m);
+}
+
+// ============================================================================
+// FUNCTIONS AND BLOCKS
+// ============================================================================
+
+int ir_frame_alloc(IrFunction *fn, int size, int alignment) {
+    if (alignment < 1) alignment = 1;
+    int offset = (fn->frame_size + alignment - 1) & ~(alignment - 1);
+    fn->frame_size = offset + size;
+    return offset;
+}
+
+IrFunction *ir_function_new(IrModule *m, Symbol *sym) {
+    IrFunction *fn = arena_calloc(m->arena, 1, sizeof(IrFunction));
+    fn->module = m;
+    fn->sym = sym;
+    fn->name = sym->name;
+    fn->return_type = sym->type->return_type;
+    fn->ret_offset = -1;
+
+    fn->param_count = sym->param_count;
+    fn->param_offsets = arena_alloc(m->arena, sizeof(int) * (sym->param_count ? sym->param_count : 1));
+    for (int i = 0; i < sym->param_count; i++) {
+        TypeInfo *t = sym->params[i]->type;
+        fn->param_offsets[i] = ir_frame_alloc(fn, t->size, t->alignment);
+    }
+    if (fn->return_type && fn->return_type->base != TYPE_VOID) {
+        fn->ret_offset = ir_frame_alloc(fn, fn->return_type->size, fn->return_type->alignment);
+    }
+
+    m->funcs = ir_grow(m->arena, m->funcs, m->func_count, &m->func_capacity, sizeof(IrFunction*));
+    fn->index = m->func_count;
+    m->funcs[m->func_count++] = fn;
+    return fn;
+}
+
+IrBlock *ir_block_new(IrFunction *fn) {
+    arena_t *arena = fn->module->arena;
+    IrBlock *b = arena_calloc(arena, 1, sizeof(IrBlock));
+    b->id = fn->next_block_id++;
+    b->func = fn;
+    b->label = -1;
+
+    fn->blocks = ir_grow(arena, fn->blocks, fn->block_count, &fn->block_capacity, sizeof(IrBlock*));
+    fn->blocks[fn->block_count++] = b;
+    return b;
+}
+
+void ir_block_move_last(IrBlock *block) {
+    IrFunction *fn = block->func;
+    for (int i = 0; i < fn->block_count; i++) {
+        if (fn->blocks[i] != block) continue;
+        memmove(&fn->blocks[i], &fn->blocks[i + 1], (fn->block_count - i - 1) * sizeof(IrBlock*));
+        fn->blocks[fn->block_count - 1] = block;
+        return;
+    }
+}
+
+static void block_add_pred(IrBlock *block, IrBlock *pred) {
+    arena_t *arena = block->func->module->arena;
+    block->preds = ir_grow(arena, block->preds, block->pred_count, &block->pred_capacity, sizeof(IrBlock*));
+    block->preds[block->pred_count++] = pred;
+}
+
+// ============================================================================
+// INSTRUCTIONS
+// ============================================================================
+
+static IrInsn *insn_alloc(IrFunction *fn, IrOp op, TypeInfo *type) {
+    IrInsn *insn = arena_calloc(fn->module->arena, 1, sizeof(IrInsn));
+    insn->op = op;
+    insn->id = fn->next_value_id++;
+    insn->type = type ? type : TYPE_VOID_INFO;
+    insn->tgq_type = insn->type->tgq_type;
+    insn->components = insn->type->components;
+    insn->reg_class = insn->type->reg_class;
+    insn->reg = -1;
+    insn->slot = -1;
+    return insn;
+}
+
+static void insn_insert_after(IrBlock *block, IrInsn *after, IrInsn *insn) {
+    insn->block = block;
+    insn->prev = after;
+    insn->next = after ? after->next : block->first;
+    if (insn->next) insn->next->prev = insn;
+    else block->last = insn;
+    if (after) after->next = insn;
+    else block->first = insn;
+}
+
+// After the leading phis
+static void insn_insert_front(IrBlock *block, IrInsn *insn) {
+    IrInsn *after = NULL;
+    for (IrInsn *i = block->first; i && i->op == IR_PHI; i = i->next) {
+        after = i;
+    }
+    insn_insert_after(block, after, insn);
+}
+
+void ir_insn_remove(IrInsn *insn) {
+    IrBlock *block = insn->block;
+    if (insn->prev) insn->prev->next = insn->next;
+    else block->first = insn->next;
+    if (insn->next) insn->next->prev = insn->prev;
+    else block->last = insn->prev;
+    insn->prev = insn->next = NULL;
+}
+
+void ir_insn_move_before(IrInsn *insn, IrInsn *pos) {
+    ir_insn_remove(insn);
+    insn_insert_after(pos->block, pos->prev, insn);
+}
+
+void ir_replace(IrInsn *insn, IrInsn *value) {
+    insn->forward = value;
+    ir_insn_remove(insn);
+}
+
+void ir_resolve_args(IrFunction *fn) {
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            for (int i = 0; i < insn->arg_count; i++) {
+                insn->args[i] = ir_resolve(insn->args[i]);
+            }
+        }
+    }
+}
+
+IrInsn *ir_insn_new(IrBlock *block, IrOp op, TypeInfo *type) {
+    IrInsn *insn = insn_alloc(block->func, op, type);
+    insn_insert_after(block, block->last, insn);
+    return insn;
+}
+
+void ir_add_arg(IrFunction *fn, IrInsn *insn, IrInsn *arg) {
+    insn->args = ir_grow(fn->module->arena, insn->args, insn->arg_count,
+                         &insn->arg_capacity, sizeof(IrInsn*));
+    insn->args[insn->arg_count++] = arg;
+}
+
+// ============================================================================
+// CONSTANT ENCODING
+// ============================================================================
+
+uint64_t ir_encode_int(uint8_t tgq, int64_t value) {
+    switch (ir_tgq_lane(tgq)) {
+    case TGQ_I8:  return (uint8_t)value;
+    case TGQ_I16: return (uint16_t)value;
+    case TGQ_I32: return (uint32_t)value;
+    case TGQ_I64: return (uint64_t)value;
+    default:      return ir_encode_float(tgq, (double)value);
+    }
+}
+
+// `value` as a float rounded to odd: toward zero, with the last bit set
+// when anything was dropped. Rounding that to nearest again for fp16 or
+// bf16, two or more bits shorter, gives the correctly rounded result,
+// where rounding to nearest twice may not.
+static float round_to_odd(double value) {
+    float f = (float)value;
+    if (isnan(value) || (double)f == value) return f;
+    if (fabs((double)f) > fabs(value)) f = nextafterf(f, 0.0f);
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    bits |= 1;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+uint64_t ir_encode_float(uint8_t tgq, double value) {
+    float f = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+
+    switch (ir_tgq_lane(tgq)) {
+    case TGQ_FP32:
+    case TGQ_BF32:
+        return bits;
+    case TGQ_FP16:
+        return float32_to_fp16(round_to_odd(value));
+    case TGQ_BF16:
+        return float32_to_bf16(round_to_odd(value));
+    case TGQ_I64: {
+        uint64_t d;
+        memcpy(&d, &value, 8);
+        return d;
+    }
+    default:
+        return ir_encode_int(tgq, (int64_t)value);
+    }
+}
+
+int64_t ir_decode_int(uint8_t tgq, uint64_t bits) {
+    switch (ir_tgq_lane(tgq)) {
+    case TGQ_I8:  return (int8_t)bits;
+    case TGQ_I16: return (int16_t)bits;
+    case TGQ_I32: return (int32_t)bits;
+    default:      return (int64_t)bits;
+    }
+}
+
+float ir_decode_float(uint8_t tgq, uint64_t bits) {
+    uint32_t word = (uint32_t)bits;
+    float f;
+    switch (ir_tgq_lane(tgq)) {
+    case TGQ_FP16: return fp16_to_float32((uint16_t)bits);
+    case TGQ_BF16: return bf16_to_float32((uint16_t)bits);
+    default:
+        memcpy(&f, &word, 4);
+        return f;
+    }
+}
+
+// ============================================================================
+// BUILDERS
+// ============================================================================
+
+IrInsn *ir_const_int(IrBlock *block, TypeInfo *type, int64_t value) {
+    IrInsn *insn = ir_insn_new(block, IR_CONST, type);
+    insn->imm.bits = ir_encode_int(insn->tgq_type, value);
+    return insn;
+}
+
+IrInsn *ir_const_float(IrBlock *block, TypeInfo *type, double value) {
+    IrInsn *insn = ir_insn_new(block, IR_CONST, type);
+    insn->imm.bits = ir_encode_float(insn->tgq_type, value);
+    return insn;
+}
+
+IrInsn *ir_const_bits(IrFunction *fn, TypeInfo *type, uint64_t bits) {
+    IrInsn *insn = insn_alloc(fn, IR_CONST, type);
+    insn->imm.bits = bits;
+    insn_insert_front(fn->blocks[0], insn);
+    return insn;
+}
+
+IrInsn *ir_undef(IrBlock *block, TypeInfo *type) {
+    return ir_insn_new(block, IR_UNDEF, type);
+}
+
+IrInsn *ir_phi(IrBlock *block, TypeInfo *type, Symbol *sym) {
+    IrInsn *phi = insn_alloc(block->func, IR_PHI, type);
+    phi->sym = sym;
+    IrInsn *after = NULL;
+    for (IrInsn *i = block->first; i && i->op == IR_PHI; i = i->next) {
+        after = i;
+    }
+    insn_insert_after(block, after, phi);
+    return phi;
+}
+
+IrInsn *ir_unary(IrBlock *block, IrOp op, TypeInfo *type, IrInsn *a) {
+    IrInsn *insn = ir_insn_new(block, op, type);
+    ir_add_arg(block->func, insn, a);
+    return insn;
+}
+
+IrInsn *ir_binary(IrBlock *block, IrOp op, TypeInfo *type, IrInsn *a, IrInsn *b) {
+    IrInsn *insn = ir_insn_new(block, op, type);
+    ir_add_arg(block->func, insn, a);
+    ir_add_arg(block->func, insn, b);
+    return insn;
+}
+
+IrInsn *ir_cmp(IrBlock *block, IrCmp cmp, IrInsn *a, IrInsn *b) {
+    IrInsn *insn = ir_binary(block, IR_CMP, TYPE_BOOL_INFO, a, b);
+    insn->imm.cmp = cmp;
+    return insn;
+}
+
+IrInsn *ir_convert(IrBlock *block, TypeInfo *type, IrInsn *a) {
+    return ir_unary(block, IR_CONVERT, type, a);
+}
+
+IrInsn *ir_extract(IrBlock *block, TypeInfo *type, IrInsn *vec, int lane) {
+    IrInsn *insn = ir_unary(block, IR_EXTRACT, type, vec);
+    insn->imm.lane = lane;
+    return insn;
+}
+
+IrInsn *ir_insert(IrBlock *block, IrInsn *vec, IrInsn *value, int lane) {
+    IrInsn *insn = ir_binary(block, IR_INSERT, vec->type, vec, value);
+    insn->imm.lane = lane;
+    return insn;
+}
+
+IrInsn *ir_mat_zero(IrBlock *block, TypeInfo *type) {
+    return ir_insn_new(block, IR_MAT_ZERO, type);
+}
+
+IrInsn *ir_mat_insert(IrBlock *block, IrInsn *mat, IrInsn *column, int index) {
+    IrInsn *insn = ir_binary(block, IR_MAT_INSERT, mat->type, mat, column);
+    insn->imm.lane = index;
+    return insn;
+}
+
+IrInsn *ir_mat_extract(IrBlock *block, IrInsn *mat, int index) {
+    IrInsn *insn = ir_unary(block, IR_MAT_EXTRACT, type_matrix_column(mat->type), mat);
+    insn->imm.lane = index;
+    return insn;
+}
+
+IrInsn *ir_addr(IrBlock *block, IrSpace space, IrFunction *frame, Symbol *sym, int offset) {
+    IrInsn *insn = ir_insn_new(block, IR_ADDR, TYPE_INT_INFO);
+    insn->space = space;
+    insn->func = space == IR_SPACE_LOCAL ? frame : NULL;
+    insn->sym = sym;
+    insn->imm.offset = offset;
+    return insn;
+}
+
+IrInsn *ir_load(IrBlock *block, TypeInfo *type, IrSpace space, IrInsn *addr) {
+    IrInsn *insn = ir_unary(block, IR_LOAD, type, addr);
+    insn->space = space;
+    return insn;
+}
+
+IrInsn *ir_store(IrBlock *block, IrSpace space, IrInsn *addr, IrInsn *value) {
+    IrInsn *insn = ir_binary(block, IR_STORE, TYPE_VOID_INFO, addr, value);
+    insn->space = space;
+    return insn;
+}
+
+IrInsn *ir_copy(IrBlock *block, IrSpace dst_space, IrInsn *dst,
+                IrSpace src_space, IrInsn *src, int size) {
+    IrInsn *insn = ir_binary(block, IR_COPY, TYPE_VOID_INFO, dst, src);
+    insn->space = dst_space;
+    insn->src_space = src_space;
+    insn->imm.size = size;
+    return insn;
+}
+
+void ir_jump(IrBlock *block, IrBlock *target) {
+    ir_insn_new(block, IR_JUMP, TYPE_VOID_INFO);
+    block->succs[0] = target;
+    block->succ_count = 1;
+    block_add_pred(target, block);
+}
+
+void ir_branch(IrBlock *block, IrInsn *cond, IrBlock *if_true, IrBlock *if_false) {
+    ir_unary(block, IR_BRANCH, TYPE_VOID_INFO, cond);
+    block->succs[0] = if_true;
+    block->succs[1] = if_false;
+    block->succ_count = 2;
+    block_add_pred(if_true, block);
+    block_add_pred(if_false, block);
+}
+
+void ir_ret(IrBlock *block, IrInsn *value) {
+    IrInsn *insn = ir_insn_new(block, IR_RET, TYPE_VOID_INFO);
+    if (value) ir_add_arg(block->func, insn, value);
+}
+
+// ============================================================================
+// SSA CONSTRUCTION
+// ============================================================================
+
+// Open-addressing table keyed by (variable, block)
+typedef struct IrDef {
+    IrBlock *block;          // NULL for an empty slot
+    int var;
+    IrInsn *value;
+} IrDef;
+
+#define IR_DEFS_INITIAL_CAPACITY 64
+
+static unsigned int def_hash(int var, IrBlock *block) {
+    return ((unsigned int)var * 2654435761u) ^ ((unsigned int)block->id * 40503u);
+}
+
+static IrDef *def_find(IrFunction *fn, int var, IrBlock *block) {
+    unsigned int mask = fn->def_capacity - 1;
+    unsigned int i = def_hash(var, block) & mask;
+    while (fn->defs[i].block) {
+        if (fn->defs[i].block == block && fn->defs[i].var == var) {
+            return &fn->defs[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return &fn->defs[i];
+}
+
+static void defs_grow(IrFunction *fn) {
+    IrDef *old = fn->defs;
+    int old_capacity = fn->def_capacity;
+
+    fn->def_capacity = old_capacity ? old_capacity * 2 : IR_DEFS_INITIAL_CAPACITY;
+    fn->defs = crt_calloc(fn->def_capacity, sizeof(IrDef));
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i].block) {
+            *def_find(fn, old[i].var, old[i].block) = old[i];
+        }
+    }
+    free(old);
+}
+
+int ir_ssa_var(IrFunction *fn) {
+    return fn->var_count++;
+}
+
+void ir_write_var(IrBlock *block, int var, IrInsn *value) {
+    IrFunction *fn = block->func;
+    if ((fn->def_count + 1) * 4 > fn->def_capacity * 3) {
+        defs_grow(fn);
+    }
+    IrDef *d = def_find(fn, var, block);
+    if (!d->block) {
+        d->block = block;
+        d->var = var;
+        fn->def_count++;
+    }
+    d->value = value;
+}
+
+// Undefined values are placed at the start of the entry block, which
+// dominates every use
+static IrInsn *entry_undef(IrFunction *fn, TypeInfo *type) {
+    IrInsn *undef = insn_alloc(fn, IR_UNDEF, type);
+    insn_insert_front(fn->blocks[0], undef);
+    return undef;
+}
+
+// A phi is trivial if it merges only itself and one other value
+static IrInsn *phi_trivial_value(IrInsn *phi) {
+    IrInsn *same = NULL;
+    for (int i = 0; i < phi->arg_count; i++) {
+        IrInsn *arg = ir_resolve(phi->args[i]);
+        if (arg == same || arg == phi) continue;
+        if (same) return NULL;
+        same = arg;
+    }
+    return same ? same : phi;
+}
+
+static IrInsn *try_remove_trivial_phi(IrInsn *phi) {
+    IrInsn *same = phi_trivial_value(phi);
+    if (!same) return phi;
+    if (same == phi) {
+        same = entry_undef(phi->block->func, phi->type);
+    }
+    ir_replace(phi, same);
+    return same;
+}
+
+static IrInsn *read_var_recursive(IrBlock *block, int var, TypeInfo *type, Symbol *sym);
+
+static IrInsn *add_phi_operands(IrInsn *phi) {
+    IrBlock *block = phi->block;
+    for (int i = 0; i < block->pred_count; i++) {
+        IrInsn *v = ir_read_var(block->preds[i], phi->imm.index, phi->type, phi->sym);
+        ir_add_arg(block->func, phi, v);
+    }
+    return try_remove_trivial_phi(phi);
+}
+
+IrInsn *ir_read_var(IrBlock *block, int var, TypeInfo *type, Symbol *sym) {
+    IrFunction *fn = block->func;
+    if (fn->def_capacity) {
+        IrDef *d = def_find(fn, var, block);
+        if (d->block) return ir_resolve(d->value);
+    }
+    return read_var_recursive(block, var, type, sym);
+}
+
+static IrInsn *read_var_recursive(IrBlock *block, int var, TypeInfo *type, Symbol *sym) {
+    IrFunction *fn = block->func;
+    IrInsn *value;
+
+    if (!block->sealed) {
+        // Operands are filled in when the block is sealed
+        value = ir_phi(block, type, sym);
+        value->imm.index = var;
+        block->incomplete = ir_grow(fn->module->arena, block->incomplete, block->incomplete_count,
+                                    &block->incomplete_capacity, sizeof(IrInsn*));
+        block->incomplete[block->incomplete_count++] = value;
+    } else if (block->pred_count == 0) {
+        value = entry_undef(fn, type);
+    } else if (block->pred_count == 1) {
+        value = ir_read_var(block->preds[0], var, type, sym);
+    } else {
+        // Break cycles with an operandless phi first
+        IrInsn *phi = ir_phi(block, type, sym);
+        phi->imm.index = var;
+        ir_write_var(block, var, phi);
+        value = add_phi_operands(phi);
+    }
+    ir_write_var(block, var, value);
+    return value;
+}
+
+void ir_seal_block(IrBlock *block) {
+    if (block->sealed) return;
+    block->sealed = true;
+    for (int i = 0; i < block->incomplete_count; i++) {
+        add_phi_operands(block->incomplete[i]);
+    }
+    block->incomplete_count = 0;
+}
+
+// Phis whose operands were forwarded after they were built may have become
+// trivial; iterate until none is left, then point every argument at its
+// final value
+static void ssa_cleanup(IrFunction *fn) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 0; b < fn->block_count; b++) {
+            IrInsn *next;
+            for (IrInsn *phi = fn->blocks[b]->first; phi && phi->op == IR_PHI; phi = next) {
+                next = phi->next;
+                if (phi_trivial_value(phi)) {
+                    try_remove_trivial_phi(phi);
+                    changed = true;
+                }
+            }
+        }
+    }
+    ir_resolve_args(fn);
+}
+
+void ir_ssa_finish(IrFunction *fn) {
+    ssa_cleanup(fn);
+
+    free(fn->defs);
+    fn->defs = NULL;
+    fn->def_capacity = 0;
+    fn->def_count = 0;
+}
+
+// ============================================================================
+// CFG UTILITIES
+// ============================================================================
+
+static void block_remove_pred(IrBlock *block, int index) {
+    for (IrInsn *phi = block->first; phi && phi->op == IR_PHI; phi = phi->next) {
+        memmove(&phi->args[index], &phi->args[index + 1],
+                (phi->arg_count - index - 1) * sizeof(IrInsn*));
+        phi->arg_count--;
+    }
+    memmove(&block->preds[index], &block->preds[index + 1],
+            (block->pred_count - index - 1) * sizeof(IrBlock*));
+    block->pred_count--;
+}
+
+void ir_remove_unreachable(IrFunction *fn) {
+    if (fn->block_count == 0) return;
+
+    bool *reachable = crt_calloc(fn->next_block_id, sizeof(bool));
+    IrBlock **stack = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    int top = 0;
+
+    reachable[fn->blocks[0]->id] = true;
+    stack[top++] = fn->blocks[0];
+    while (top > 0) {
+        IrBlock *b = stack[--top];
+        for (int i = 0; i < b->succ_count; i++) {
+            IrBlock *s = b->succs[i];
+            if (!reachable[s->id]) {
+                reachable[s->id] = true;
+                stack[top++] = s;
+            }
+        }
+    }
+
+    int kept = 0;
+    bool removed = false;
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *b = fn->blocks[i];
+        if (reachable[b->id]) {
+            fn->blocks[kept++] = b;
+            continue;
+        }
+        removed = true;
+        for (int s = 0; s < b->succ_count; s++) {
+            IrBlock *succ = b->succs[s];
+            for (int p = 0; p < succ->pred_count; p++) {
+                if (succ->preds[p] == b) {
+                    block_remove_pred(succ, p);
+                    break;
+                }
+            }
+        }
+    }
+    fn->block_count = kept;
+
+    free(stack);
+    free(reachable);
+
+    if (removed) ssa_cleanup(fn);
+}
+
+bool ir_fold_branches(IrFunction *fn) {
+    bool changed = false;
+    for (int b = 0; b < fn->block_count; b++) {
+        IrBlock *block = fn->blocks[b];
+        IrInsn *br = block->last;
+        if (!br || br->op != IR_BRANCH || br->args[0]->op != IR_CONST) continue;
+
+        int taken = br->args[0]->imm.bits ? 0 : 1;
+        IrBlock *dead = block->succs[1 - taken];
+        for (int p = 0; p < dead->pred_count; p++) {
+            if (dead->preds[p] == block) {
+                block_remove_pred(dead, p);
+                break;
+            }
+        }
+        br->op = IR_JUMP;
+        br->arg_count = 0;
+        block->succs[0] = block->succs[taken];
+        block->succ_count = 1;
+        changed = true;
+    }
+    if (changed) ir_remove_unreachable(fn);
+    return changed;
+}
+
+void ir_split_critical_edges(IrFunction *fn) {
+    int count = fn->block_count;
+    for (int b = 0; b < count; b++) {
+        IrBlock *block = fn->blocks[b];
+        if (block->succ_count < 2) continue;
+
+        for (int s = 0; s < block->succ_count; s++) {
+            IrBlock *succ = block->succs[s];
+            if (succ->pred_count < 2) continue;
+
+            IrBlock *split = ir_block_new(fn);
+            split->sealed = true;
+            ir_insn_new(split, IR_JUMP, TYPE_VOID_INFO);
+            split->succs[0] = succ;
+            split->succ_count = 1;
+            block_add_pred(split, block);
+
+            // Take over the edge in place so phi operands stay aligned
+            for (int p = 0; p < succ->pred_count; p++) {
+                if (succ->preds[p] == block) {
+                    succ->preds[p] = split;
+                    break;
+                }
+            }
+            block->succs[s] = split;
+        }
+    }
+}
+
+void ir_count_uses(IrFunction *fn) {
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            insn->use_count = 0;
+        }
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            for (int i = 0; i < insn->arg_count; i++) {
+                insn->args[i]->use_count++;
+            }
+        }
+    }
+}
+
+int ir_reverse_postorder(IrFunction *fn, IrBlock **order) {
+    if (fn->block_count == 0) return 0;
+
+    bool *visited = crt_calloc(fn->next_block_id, sizeof(bool));
+    IrBlock **stack = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    int *next_succ = crt_malloc(sizeof(int) * fn->block_count);
+    int top = 0, count = fn->block_count;
+
+    // Blocks are stored from the back as they finish
+    int pos = count;
+    visited[fn->blocks[0]->id] = true;
+    stack[top] = fn->blocks[0];
+    next_succ[top++] = 0;
+    while (top > 0) {
+        IrBlock *b = stack[top - 1];
+        if (next_succ[top - 1] < b->succ_count) {
+            IrBlock *s = b->succs[next_succ[top - 1]++];
+            if (!visited[s->id]) {
+                visited[s->id] = true;
+                stack[top] = s;
+                next_succ[top++] = 0;
+            }
+            continue;
+        }
+        order[--pos] = b;
+        top--;
+    }
+    free(next_succ);
+    free(stack);
+    free(visited);
+
+    memmove(order, order + pos, sizeof(IrBlock*) * (count - pos));
+    return count - pos;
+}
+
+void ir_compute_dominators(IrFunction *fn) {
+    for (int b = 0; b < fn->block_count; b++) {
+        fn->blocks[b]->idom = NULL;
+        fn->blocks[b]->dom_depth = 0;
+    }
+    if (fn->block_count == 0) return;
+
+    IrBlock **order = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    int count = ir_reverse_postorder(fn, order);
+    int *rpo = crt_malloc(sizeof(int) * fn->next_block_id);
+    for (int i = 0; i < fn->next_block_id; i++) rpo[i] = -1;
+    for (int i = 0; i < count; i++) rpo[order[i]->id] = i;
+
+    // The entry is its own idom while iterating
+    IrBlock *entry = order[0];
+    entry->idom = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < count; i++) {
+            IrBlock *b = order[i];
+            IrBlock *idom = NULL;
+            for (int p = 0; p < b->pred_count; p++) {
+                IrBlock *x = b->preds[p];
+                if (rpo[x->id] < 0 || !x->idom) continue;
+                if (!idom) {
+                    idom = x;
+                    continue;
+                }
+                IrBlock *y = idom;
+                while (x != y) {
+                    while (rpo[x->id] > rpo[y->id]) x = x->idom;
+                    while (rpo[y->id] > rpo[x->id]) y = y->idom;
+                }
+                idom = x;
+            }
+            if (idom != b->idom) {
+                b->idom = idom;
+                changed = true;
+            }
+        }
+    }
+    entry->idom = NULL;
+    for (int i = 1; i < count; i++) order[i]->dom_depth = order[i]->idom->dom_depth + 1;
+
+    free(rpo);
+    free(order);
+}
+
+bool ir_dominates(IrBlock *a, IrBlock *b) {
+    while (b && b->dom_depth > a->dom_depth) b = b->idom;
+    return b == a;
+}
+
+static IrLoop *loop_of_header(IrFunction *fn, IrLoop **loops, int *count, int *capacity,
+                              IrBlock *header) {
+    for (int i = 0; i < *count; i++) {
+        if ((*loops)[i].header == header) return &(*loops)[i];
+    }
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4;
+        *loops = crt_realloc(*loops, sizeof(IrLoop) * *capacity);
+    }
+    IrLoop *loop = &(*loops)[(*count)++];
+    memset(loop, 0, sizeof(IrLoop));
+    loop->header = header;
+    loop->blocks = crt_calloc(fn->next_block_id, sizeof(bool));
+    loop->blocks[header->id] = true;
+    loop->block_count = 1;
+    return loop;
+}
+
+// Adds the blocks that reach `latch` without going through the header
+static void loop_add_latch(IrLoop *loop, IrBlock *latch, IrBlock **worklist) {
+    int top = 0;
+    if (!loop->blocks[latch->id]) {
+        loop->blocks[latch->id] = true;
+        loop->block_count++;
+        worklist[top++] = latch;
+    }
+    while (top > 0) {
+        IrBlock *b = worklist[--top];
+        for (int p = 0; p < b->pred_count; p++) {
+            IrBlock *pred = b->preds[p];
+            if (loop->blocks[pred->id]) continue;
+            loop->blocks[pred->id] = true;
+            loop->block_count++;
+            worklist[top++] = pred;
+        }
+    }
+}
+
+static int loop_compare_size(const void *a, const void *b) {
+    return ((const IrLoop*)a)->block_count - ((const IrLoop*)b)->block_count;
+}
+
+static void loop_describe(IrLoop *loop, IrBlock **order, int order_count) {
+    loop->exiting = crt_malloc(sizeof(IrBlock*) * loop->block_count);
+    for (int b = 0; b < order_count; b++) {
+        IrBlock *block = order[b];
+        if (!loop->blocks[block->id]) continue;
+        for (IrInsn *insn = block->first; insn; insn = insn->next) {
+            if (insn->op == IR_CALL) loop->has_call = true;
+        }
+        for (int s = 0; s < block->succ_count; s++) {
+            if (!loop->blocks[block->succs[s]->id]) {
+                loop->exiting[loop->exiting_count++] = block;
+                break;
+            }
+        }
+    }
+
+    IrBlock *preheader = NULL;
+    for (int p = 0; p < loop->header->pred_count; p++) {
+        IrBlock *pred = loop->header->preds[p];
+        if (loop->blocks[pred->id]) continue;
+        if (preheader && preheader != pred) return;
+        preheader = pred;
+    }
+    if (preheader && preheader->succ_count == 1) loop->preheader = preheader;
+}
+
+int ir_find_loops(IrFunction *fn, IrLoop **loops) {
+    *loops = NULL;
+    if (fn->block_count == 0) return 0;
+
+    IrBlock **order = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    IrBlock **worklist = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    int order_count = ir_reverse_postorder(fn, order);
+    int count = 0, capacity = 0;
+    for (int i = 0; i < order_count; i++) {
+        IrBlock *b = order[i];
+        for (int s = 0; s < b->succ_count; s++) {
+            IrBlock *header = b->succs[s];
+            if (!ir_dominates(header, b)) continue;
+            loop_add_latch(loop_of_header(fn, loops, &count, &capacity, header), b, worklist);
+        }
+    }
+
+    // Inner loops have fewer blocks than the loops around them
+    if (count > 1) qsort(*loops, count, sizeof(IrLoop), loop_compare_size);
+    for (int i = 0; i < count; i++) loop_describe(&(*loops)[i], order, order_count);
+    free(worklist);
+    free(order);
+    return count;
+}
+
+void ir_free_loops(IrLoop *loops, int count) {
+    for (int i = 0; i < count; i++) {
+        free(loops[i].exiting);
+        free(loops[i].blocks);
+    }
+    free(loops);
+}
+
+// ============================================================================
+// ADDRESSES
+// ============================================================================
+
+IrAddress ir_address(IrInsn *addr) {
+    IrAddress a = { addr, 0 };
+    while (a.base->op == IR_ADD) {
+        IrInsn *x = a.base->args[0], *y = a.base->args[1];
+        if (x->op == IR_CONST) {
+            IrInsn *t = x;
+            x = y;
+            y = t;
+        }
+        if (y->op != IR_CONST) break;
+        a.offset += (int)ir_decode_int(y->tgq_type, y->imm.bits);
+        a.base = x;
+    }
+    if (a.base->op == IR_ADDR) a.offset += a.base->imm.offset;
+    return a;
+}
+
+bool ir_same_base(IrInsn *a, IrInsn *b) {
+    if (a == b) return true;
+    return a->op == IR_ADDR && b->op == IR_ADDR && a->space == b->space && a->func == b->func;
+}
+
+IrInsn *ir_address_object(IrInsn *addr) {
+    while (addr->op == IR_ADD) addr = addr->args[0];
+    return addr->op == IR_ADDR ? addr : NULL;
+}
+
+bool ir_read_only(IrInsn *addr) {
+    IrInsn *obj = ir_address_object(addr);
+    if (!obj || obj->space != IR_SPACE_GLOBAL || !obj->sym) return false;
+    StorageClass storage = obj->sym->storage;
+    return storage == STORAGE_UNIFORM || storage == STORAGE_ATTRIBUTE || storage == STORAGE_CONST;
+}
+
+bool ir_may_alias(IrInsn *x, int x_size, IrInsn *y, int y_size) {
+    IrAddress a = ir_address(x), b = ir_address(y);
+    if (ir_same_base(a.base, b.base)) {
+        return a.offset < b.offset + y_size && b.offset < a.offset + x_size;
+    }
+    IrInsn *ox = ir_address_object(x), *oy = ir_address_object(y);
+    if (!ox || !oy) return true;
+    if (ox->space != oy->space) return false;
+    return ox->func != oy->func || !ox->sym || !oy->sym || ox->sym == oy->sym;
+}
+
+int ir_write_size(IrInsn *insn) {
+    return insn->op == IR_COPY ? insn->imm.size : ir_tgq_size(insn->args[1]->tgq_type);
+}
+
+bool ir_call_may_access(IrFunction *fn, IrInsn *addr) {
+    IrInsn *obj = ir_address_object(addr);
+    return !obj || obj->space != IR_SPACE_LOCAL || obj->func != fn;
+}
+
+bool ir_insn_may_write(IrFunction *fn, IrInsn *insn, IrSpace space, IrInsn *addr, int size) {
+    switch (insn->op) {
+    case IR_STORE:
+    case IR_COPY:
+        return insn->space == space && ir_may_alias(insn->args[0], ir_write_size(insn), addr, size);
+    case IR_CALL:
+        return ir_call_may_access(fn, addr);
+    default:
+        return false;
+    }
+}
+
+// ============================================================================
+// DEBUG OUTPUT
+// ============================================================================
+
+static const char *ir_op_names[IR_OP_COUNT] = {
+    [IR_CONST]     = "const",
+    [IR_UNDEF]     = "undef",
+    [IR_PARAM]     = "param",
+    [IR_PHI]       = "phi",
+    [IR_ADD]       = "add",
+    [IR_SUB]       = "sub",
+    [IR_MUL]       = "mul",
+    [IR_DIV]       = "div",
+    [IR_REM]       = "rem",
+    [IR_NEG]       = "neg",
+    [IR_NOT]       = "not",
+    [IR_AND]       = "and",
+    [IR_OR]        = "or",
+    [IR_XOR]       = "xor",
+    [IR_SHL]       = "shl",
+    [IR_SHR]       = "shr",
+    [IR_MIN]       = "min",
+    [IR_MAX]       = "max",
+    [IR_SQRT]      = "sqrt",
+    [IR_FMA]       = "fma",
+    [IR_CMP]       = "cmp",
+    [IR_CONVERT]   = "convert",
+    [IR_VEC_BUILD] = "vec_build",
+    [IR_EXTRACT]   = "extract",
+    [IR_INSERT]    = "insert",
+    [IR_MAT_ZERO]    = "mat_zero",
+    [IR_MAT_INSERT]  = "mat_insert",
+    [IR_MAT_EXTRACT] = "mat_extract",
+    [IR_ADDR]      = "addr",
+    [IR_LOAD]      = "load",
+    [IR_STORE]     = "store",
+    [IR_COPY]      = "copy",
+    [IR_CALL]      = "call",
+    [IR_JUMP]      = "jump",
+    [IR_BRANCH]    = "branch",
+    [IR_RET]       = "ret",
+};
+
+static const char *ir_tgq_names[TGQ_TYPE_TOP] = {
+    [TGQ_I8]     = "i8",
+    [TGQ_I16]    = "i16",
+    [TGQ_I32]    = "i32",
+    [TGQ_I64]    = "i64",
+    [TGQ_FP16]   = "fp16",
+    [TGQ_FP32]   = "fp32",
+    [TGQ_BF16]   = "bf16",
+    [TGQ_BF32]   = "bf32",
+    [TGQ_V4I32]  = "v4i32",
+    [TGQ_V4FP16] = "v4fp16",
+    [TGQ_V4FP32] = "v4fp32",
+    [TGQ_V4BF16] = "v4bf16",
+    [TGQ_V4BF32] = "v4bf32",
+    [TGQ_MATRIX] = "matrix",
+};
+
+static const char *ir_cmp_names[] = {"eq", "ne", "lt", "le", "gt", "ge"};
+
+const char *ir_op_name(IrOp op) {
+    return op < IR_OP_COUNT && ir_op_names[op] ? ir_op_names[op] : "???";
+}
+
+static void dump_const(IrInsn *insn, FILE *out) {
+    switch (insn->tgq_type) {
+    case TGQ_FP32:
+    case TGQ_BF32: {
+        float f;
+        uint32_t bits = (uint32_t)insn->imm.bits;
+        memcpy(&f, &bits, 4);
+        fprintf(out, " %g", f);
+        break;
+    }
+    case TGQ_FP16:
+    case TGQ_BF16:
+        fprintf(out, " 0x%04x", (unsigned)insn->imm.bits);
+        break;
+    default:
+        fprintf(out, " %lld", (long long)insn->imm.bits);
+        break;
+    }
+}
+
+static void dump_insn(IrInsn *insn, FILE *out) {
+    fprintf(out, "    ");
+    if (insn->type->base != TYPE_VOID) {
+        const char *t = insn->tgq_type < TGQ_TYPE_TOP && ir_tgq_names[insn->tgq_type]
+                        ? ir_tgq_names[insn->tgq_type] : "?";
+        fprintf(out, "%%%d:%s", insn->id, t);
+        if (insn->reg_class == REGCLASS_VECTOR) fprintf(out, "x%d", insn->components);
+        fprintf(out, " = ");
+    }
+    fprintf(out, "%s", ir_op_name(insn->op));
+
+    switch (insn->op) {
+    case IR_CONST:
+        dump_const(insn, out);
+        break;
+    case IR_PARAM:
+        fprintf(out, " %d", insn->imm.index);
+        break;
+    case IR_CMP:
+        fprintf(out, ".%s", ir_cmp_names[insn->imm.cmp]);
+        break;
+    case IR_ADDR:
+        fprintf(out, " %s", insn->space == IR_SPACE_GLOBAL ? "global" : "local");
+        if (insn->sym) fprintf(out, " @%s", insn->sym->name);
+        if (insn->func) fprintf(out, " [%s]", insn->func->name);
+        fprintf(out, " +%d", insn->imm.offset);
+        break;
+    case IR_LOAD:
+    case IR_STORE:
+        fprintf(out, ".%s", insn->space == IR_SPACE_GLOBAL ? "global" : "local");
+        break;
+    case IR_COPY:
+        fprintf(out, ".%s.%s %d",
+                insn->space == IR_SPACE_GLOBAL ? "global" : "local",
+                insn->src_space == IR_SPACE_GLOBAL ? "global" : "local",
+                insn->imm.size);
+        break;
+    case IR_CALL:
+        fprintf(out, " %s", insn->func->name);
+        break;
+    default:
+        break;
+    }
+
+    for (int i = 0; i < insn->arg_count; i++) {
+        fprintf(out, "%s%%%d", i ? ", " : " ", insn->args[i]->id);
+        if (insn->op == IR_PHI) {
+            fprintf(out, " [b%d]", insn->block->preds[i]->id);
+        }
+    }
+    if (insn->op == IR_EXTRACT || insn->op == IR_INSERT) {
+        fprintf(out, ", lane %d", insn->imm.lane);
+    } else if (insn->op == IR_MAT_INSERT || insn->op == IR_MAT_EXTRACT) {
+        fprintf(out, ", column %d", insn->imm.lane);
+    }
+
+    IrBlock *b = insn->block;
+    if (insn->op == IR_JUMP) {
+        fprintf(out, " b%d", b->succs[0]->id);
+    } else if (insn->op == IR_BRANCH) {
+        fprintf(out, ", b%d, b%d", b->succs[0]->id, b->succs[1]->id);
+    }
+    fprintf(out, "\n");
+}
+
+void ir_dump_function(IrFunction *fn, FILE *out) {
+    fprintf(out, "function %s (frame %d bytes)%s\n", fn->name, fn->frame_size,
+            fn->failed ? " [failed]" : "");
+    for (int b = 0; b < fn->block_count; b++) {
+        IrBlock *block = fn->blocks[b];
+        fprintf(out, "  b%d:", block->id);
+        if (block->pred_count) {
+            fprintf(out, " ; preds");
+            for (int p = 0; p < block->pred_count; p++) {
+                fprintf(out, " b%d", block->preds[p]->id);
+            }
+        }
+        fprintf(out, "\n");
+        for (IrInsn *insn = block->first; insn; insn = insn->next) {
+            dump_insn(insn, out);
+        }
+    }
+}
+
+void ir_dump_module(IrModule *m, FILE *out) {
+    for (int i = 0; i < m->func_count; i++) {
+        if (!m->funcs[i]->lowered) continue;
+        ir_dump_function(m->funcs[i], out);
+        fprintf(out, "\n");
+    }
+}
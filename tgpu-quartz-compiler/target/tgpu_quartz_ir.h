@@ -0,0 +1,533 @@
+#pragma once
+
+#include "../crt.h"
+#include "tgpu_quartz_types.h"
+#include "tgpu_quartz_symtab.h"
+#include "tgpu_quartz_emit.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// ============================================================================
+// SSA INTERMEDIATE REPRESENTATION
+// ============================================================================
+
+// Functions are lists of basic blocks; blocks are doubly linked lists of
+// instructions ending in exactly one terminator (JUMP, BRANCH or RET). An
+// instruction is also the SSA value it defines. Values carry their TGQL
+// type plus the target type and register class it maps to.
+//
+// Scalars, vectors and matrices are SSA values. Structs and arrays live in
+// memory and are accessed through LOAD/STORE/COPY on i32 byte addresses in
+// one of two spaces: the global data section or local memory, where every
+// function has a statically placed frame (there is no call stack, so
+// recursion is rejected).
+//
+// A matN value is a tile of the matrix file with its N columns and rows in
+// the top left corner and zeros elsewhere. It enters and leaves the tile a
+// column vector at a time; ADD and SUB are element-wise on it, MUL and FMA
+// are matrix products.
+//
+// All IR memory comes from the module arena and is released at once.
+
+typedef struct IrInsn IrInsn;
+typedef struct IrBlock IrBlock;
+typedef struct IrFunction IrFunction;
+typedef struct IrModule IrModule;
+
+typedef enum {
+    // Values
+    IR_CONST,        // imm.bits
+    IR_UNDEF,
+    IR_PARAM,        // imm.index; scalar/vector/matrix parameter on entry
+    IR_PHI,          // One argument per predecessor, in pred order
+
+    // Arithmetic, element-wise on vectors
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_REM,          // Integer only
+    IR_NEG,
+    IR_NOT,          // Bitwise complement; logical not of a bool
+    IR_AND,
+    IR_OR,
+    IR_XOR,
+    IR_SHL,
+    IR_SHR,
+    IR_MIN,
+    IR_MAX,
+    IR_SQRT,
+    IR_FMA,          // args[0] * args[1] + args[2]
+
+    IR_CMP,          // imm.cmp, scalar operands, bool result
+    IR_CONVERT,      // Scalar to another scalar type
+
+    // Vectors
+    IR_VEC_BUILD,    // One scalar per component
+    IR_EXTRACT,      // args = {vector}, imm.lane
+    IR_INSERT,       // args = {vector, scalar}, imm.lane
+
+    // Matrices
+    IR_MAT_ZERO,
+    IR_MAT_INSERT,   // args = {matrix, column vector}, imm.lane: column
+    IR_MAT_EXTRACT,  // args = {matrix}, imm.lane: column
+
+    // Memory
+    IR_ADDR,         // Address of imm.offset in `space` (sym: the variable, if any)
+    IR_LOAD,         // args = {address}
+    IR_STORE,        // args = {address, value}
+    IR_COPY,         // args = {dst address, src address}, imm.size bytes
+
+    IR_CALL,         // func: callee, one argument per scalar/vector/matrix parameter
+
+    // Terminators
+    IR_JUMP,         // succs[0]
+    IR_BRANCH,       // args = {bool}, succs[0] if true, succs[1] if false
+    IR_RET,          // Optional args = {value}
+
+    IR_OP_COUNT
+} IrOp;
+
+typedef enum {
+    IR_CMP_EQ,
+    IR_CMP_NE,
+    IR_CMP_LT,
+    IR_CMP_LE,
+    IR_CMP_GT,
+    IR_CMP_GE
+} IrCmp;
+
+typedef enum {
+    IR_SPACE_GLOBAL,    // Data section, ld_global/st_global
+    IR_SPACE_LOCAL      // Function frames, ld_local/st_local
+} IrSpace;
+
+struct IrInsn {
+    IrOp op;
+    int id;                  // Value number, unique within the function
+
+    // Type of the value; TYPE_VOID_INFO if the instruction defines none
+    TypeInfo *type;
+    uint8_t tgq_type;        // TGQ_* of the value
+    uint8_t components;      // 1 for scalars
+    RegisterClass reg_class;
+
+    IrInsn **args;
+    int arg_count;
+    int arg_capacity;
+
+    union {
+        uint64_t bits;       // IR_CONST: value in the encoding of tgq_type
+        int cmp;             // IR_CMP: IrCmp
+        int lane;            // IR_EXTRACT, IR_INSERT, IR_MAT_INSERT, IR_MAT_EXTRACT
+        int offset;          // IR_ADDR: byte offset in the space or frame
+        int size;            // IR_COPY: bytes
+        int index;           // IR_PARAM: parameter index; IR_PHI: SSA variable
+    } imm;
+    uint8_t space;           // IrSpace of IR_ADDR/IR_LOAD/IR_STORE, destination of IR_COPY
+    uint8_t src_space;       // IR_COPY: IrSpace of the source
+    Symbol *sym;             // IR_ADDR: variable; IR_PHI: variable it merges
+    IrFunction *func;        // IR_CALL: callee; IR_ADDR in local space: frame owner
+
+    IrBlock *block;
+    IrInsn *prev;
+    IrInsn *next;
+
+    // Set when the value was replaced (trivial phis); see ir_resolve
+    IrInsn *forward;
+
+    int use_count;           // Filled by ir_count_uses
+    bool assigned;           // Assigned to a source variable: ends an expression
+
+    // Code generation
+    int reg;                 // Allocated register of the value's file, -1 if in memory
+    int slot;                // Frame offset of the value in memory, -1 if none
+    IrInsn **saves;          // IR_CALL: values kept in registers across the call
+    int save_count;
+};
+
+struct IrBlock {
+    int id;
+    IrFunction *func;
+    IrInsn *first;
+    IrInsn *last;
+
+    IrBlock **preds;
+    int pred_count;
+    int pred_capacity;
+    IrBlock *succs[2];
+    int succ_count;
+
+    // SSA construction: no more predecessors will be added once sealed;
+    // phis created before that are completed when the block is sealed
+    bool sealed;
+    IrInsn **incomplete;
+    int incomplete_count;
+    int incomplete_capacity;
+
+    // Dominator tree, filled by ir_compute_dominators
+    IrBlock *idom;           // NULL for the entry and unreachable blocks
+    int dom_depth;
+
+    int label;               // Code generation
+};
+
+struct IrFunction {
+    IrModule *module;
+    int index;               // Position in module->funcs
+    Symbol *sym;
+    const char *name;
+    TypeInfo *return_type;
+
+    IrBlock **blocks;        // Layout order; blocks[0] is the entry
+    int block_count;
+    int block_capacity;
+    int next_block_id;
+    int next_value_id;
+
+    // Frame layout: parameters, return slot, then memory-resident locals.
+    // Offsets are relative to frame_base, which code generation assigns.
+    int *param_offsets;
+    int param_count;
+    int ret_offset;          // -1 for void
+    int frame_size;
+    int frame_base;
+
+    // SSA construction: current definition per (variable, block)
+    struct IrDef *defs;
+    int def_capacity;
+    int def_count;
+    int var_count;
+
+    bool failed;             // Lowering hit an error; no code is generated
+    bool lowered;            // Body has been lowered
+
+    // Code generation
+    int label;               // Entry label
+    int scratch;             // Frame offset of the selector's scratch area
+};
+
+struct IrModule {
+    arena_t *arena;
+    IrFunction **funcs;
+    int func_count;
+    int func_capacity;
+};
+
+// ============================================================================
+// TARGET TYPES
+// ============================================================================
+
+// Bytes of one value of a TGQ_* type in memory
+static inline int ir_tgq_size(uint8_t tgq) {
+    switch (tgq) {
+    case TGQ_I8:     return 1;
+    case TGQ_I16:
+    case TGQ_FP16:
+    case TGQ_BF16:   return 2;
+    case TGQ_I64:    return 8;
+    case TGQ_V4FP16:
+    case TGQ_V4BF16: return 8;
+    case TGQ_V4I32:
+    case TGQ_V4FP32:
+    case TGQ_V4BF32: return 16;
+    case TGQ_MATRIX: return 64;
+    default:         return 4;
+    }
+}
+
+// Lane type of a TGQ_V4* type; scalars are their own lane
+static inline uint8_t ir_tgq_lane(uint8_t tgq) {
+    switch (tgq) {
+    case TGQ_V4I32:  return TGQ_I32;
+    case TGQ_V4FP16: return TGQ_FP16;
+    case TGQ_V4FP32: return TGQ_FP32;
+    case TGQ_V4BF16: return TGQ_BF16;
+    case TGQ_V4BF32: return TGQ_BF32;
+    default:         return tgq;
+    }
+}
+
+static inline bool ir_tgq_is_float(uint8_t tgq) {
+    tgq = ir_tgq_lane(tgq);
+    return tgq == TGQ_FP16 || tgq == TGQ_FP32 || tgq == TGQ_BF16 || tgq == TGQ_BF32;
+}
+
+// Constant bits of a value in the encoding of a scalar TGQ_* type; floats
+// are rounded once, straight from the double
+uint64_t ir_encode_int(uint8_t tgq, int64_t value);
+uint64_t ir_encode_float(uint8_t tgq, double value);
+
+// Value of constant bits; integers are sign-extended, floats of every
+// format are exact in a float
+int64_t ir_decode_int(uint8_t tgq, uint64_t bits);
+float ir_decode_float(uint8_t tgq, uint64_t bits);
+
+// ============================================================================
+// CONSTRUCTION API
+// ============================================================================
+
+IrModule *ir_module_new(void);
+void ir_module_free(IrModule *m);
+
+// Creates the function and lays out parameters and the return slot
+IrFunction *ir_function_new(IrModule *m, Symbol *sym);
+
+// Reserves `size` bytes in the frame for a memory-resident local
+int ir_frame_alloc(IrFunction *fn, int size, int alignment);
+
+IrBlock *ir_block_new(IrFunction *fn);
+
+// Moves `block` to the end of the layout order
+void ir_block_move_last(IrBlock *block);
+
+// Instructions are appended to the end of `block`
+IrInsn *ir_insn_new(IrBlock *block, IrOp op, TypeInfo *type);
+void ir_add_arg(IrFunction *fn, IrInsn *insn, IrInsn *arg);
+
+IrInsn *ir_const_int(IrBlock *block, TypeInfo *type, int64_t value);
+IrInsn *ir_const_float(IrBlock *block, TypeInfo *type, double value);
+IrInsn *ir_undef(IrBlock *block, TypeInfo *type);
+// Constant at the start of the entry block, where it dominates every use
+IrInsn *ir_const_bits(IrFunction *fn, TypeInfo *type, uint64_t bits);
+IrInsn *ir_phi(IrBlock *block, TypeInfo *type, Symbol *sym);
+IrInsn *ir_unary(IrBlock *block, IrOp op, TypeInfo *type, IrInsn *a);
+IrInsn *ir_binary(IrBlock *block, IrOp op, TypeInfo *type, IrInsn *a, IrInsn *b);
+IrInsn *ir_cmp(IrBlock *block, IrCmp cmp, IrInsn *a, IrInsn *b);
+IrInsn *ir_convert(IrBlock *block, TypeInfo *type, IrInsn *a);
+IrInsn *ir_extract(IrBlock *block, TypeInfo *type, IrInsn *vec, int lane);
+IrInsn *ir_insert(IrBlock *block, IrInsn *vec, IrInsn *value, int lane);
+IrInsn *ir_mat_zero(IrBlock *block, TypeInfo *type);
+IrInsn *ir_mat_insert(IrBlock *block, IrInsn *mat, IrInsn *column, int index);
+IrInsn *ir_mat_extract(IrBlock *block, IrInsn *mat, int index);
+IrInsn *ir_addr(IrBlock *block, IrSpace space, IrFunction *frame, Symbol *sym, int offset);
+IrInsn *ir_load(IrBlock *block, TypeInfo *type, IrSpace space, IrInsn *addr);
+IrInsn *ir_store(IrBlock *block, IrSpace space, IrInsn *addr, IrInsn *value);
+IrInsn *ir_copy(IrBlock *block, IrSpace dst_space, IrInsn *dst,
+                IrSpace src_space, IrInsn *src, int size);
+
+// Terminators also record the CFG edges
+void ir_jump(IrBlock *block, IrBlock *target);
+void ir_branch(IrBlock *block, IrInsn *cond, IrBlock *if_true, IrBlock *if_false);
+void ir_ret(IrBlock *block, IrInsn *value);
+
+static inline bool ir_is_terminator(IrInsn *insn) {
+    return insn && (insn->op == IR_JUMP || insn->op == IR_BRANCH || insn->op == IR_RET);
+}
+
+static inline bool ir_block_terminated(IrBlock *block) {
+    return ir_is_terminator(block->last);
+}
+
+// Follows replacement forwarding
+static inline IrInsn *ir_resolve(IrInsn *v) {
+    while (v->forward) v = v->forward;
+    return v;
+}
+
+void ir_insn_remove(IrInsn *insn);
+
+// Moves `insn` right before `pos`, possibly into another block; passes
+// build instructions at the end of a block and move them into place
+void ir_insn_move_before(IrInsn *insn, IrInsn *pos);
+
+// Removes `insn` and forwards its uses to `value`; arguments are rewritten
+// lazily through ir_resolve, or all at once by ir_resolve_args
+void ir_replace(IrInsn *insn, IrInsn *value);
+void ir_resolve_args(IrFunction *fn);
+
+// ============================================================================
+// SSA CONSTRUCTION
+// ============================================================================
+
+// On-the-fly SSA construction (Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form"). Variables are numbered
+// with ir_ssa_var; blocks are sealed once all their predecessors are known.
+
+int ir_ssa_var(IrFunction *fn);
+void ir_write_var(IrBlock *block, int var, IrInsn *value);
+IrInsn *ir_read_var(IrBlock *block, int var, TypeInfo *type, Symbol *sym);
+void ir_seal_block(IrBlock *block);
+
+// Removes phis that turned out trivial and rewrites all arguments past
+// forwarded values. Every block must be sealed.
+void ir_ssa_finish(IrFunction *fn);
+
+// ============================================================================
+// CFG UTILITIES
+// ============================================================================
+
+// Drops blocks not reachable from the entry and their phi arguments
+void ir_remove_unreachable(IrFunction *fn);
+
+// Turns branches on constants into jumps and drops the blocks no longer
+// reachable. Returns whether anything changed.
+bool ir_fold_branches(IrFunction *fn);
+
+// Inserts an empty block on every edge from a block with several
+// successors to a block with several predecessors
+void ir_split_critical_edges(IrFunction *fn);
+
+void ir_count_uses(IrFunction *fn);
+
+// Stores the blocks reachable from the entry in reverse postorder, where
+// every block comes after its dominators; `order` has room for all blocks.
+// Returns the number stored.
+int ir_reverse_postorder(IrFunction *fn, IrBlock **order);
+
+// Sets `idom` and `dom_depth` of every block (Cooper, Harvey and Kennedy,
+// "A Simple, Fast Dominance Algorithm")
+void ir_compute_dominators(IrFunction *fn);
+
+// Whether every path from the entry to `b` goes through `a`; needs
+// ir_compute_dominators
+bool ir_dominates(IrBlock *a, IrBlock *b);
+
+// A natural loop: a header and the blocks that reach one of its back edges
+// without going through it
+typedef struct {
+    IrBlock *header;
+    IrBlock *preheader;      // Single block outside entering the header and
+                             // jumping nowhere else, NULL if there is none
+    bool *blocks;            // By block id
+    int block_count;
+    IrBlock **exiting;       // Blocks with a successor outside the loop
+    int exiting_count;
+    bool has_call;
+} IrLoop;
+
+// Finds the loops of the blocks reachable from the entry, innermost first,
+// and returns how many; needs ir_compute_dominators. Each block of a loop
+// is in the loops around it too.
+int ir_find_loops(IrFunction *fn, IrLoop **loops);
+void ir_free_loops(IrLoop *loops, int count);
+
+// ============================================================================
+// ADDRESSES
+// ============================================================================
+
+// An address as a base plus constant bytes. IR_ADDR bases fold their own
+// offset in, so addresses of one space and frame compare by offset alone.
+typedef struct {
+    IrInsn *base;
+    int offset;
+} IrAddress;
+
+IrAddress ir_address(IrInsn *addr);
+bool ir_same_base(IrInsn *a, IrInsn *b);
+
+// The IR_ADDR of the variable an address points into, NULL if unknown;
+// indexing stays within the variable
+IrInsn *ir_address_object(IrInsn *addr);
+
+// Whether the address points into a uniform, attribute or const global,
+// which no code writes
+bool ir_read_only(IrInsn *addr);
+
+// Whether `x_size` bytes at `x` and `y_size` bytes at `y` of one space may
+// overlap
+bool ir_may_alias(IrInsn *x, int x_size, IrInsn *y, int y_size);
+
+// Bytes a store or copy writes
+int ir_write_size(IrInsn *insn);
+
+// Whether a call made from `fn` may read or write the bytes at `addr`:
+// anything but fn's own frame, which no other function touches
+bool ir_call_may_access(IrFunction *fn, IrInsn *addr);
+
+// Whether `insn` of `fn` may write `size` bytes at `addr` in `space`: a
+// store or copy that may overlap them, or a call that may reach them
+bool ir_insn_may_write(IrFunction *fn, IrInsn *insn, IrSpace space, IrInsn *addr, int size);
+
+// ============================================================================
+// OPTIMIZATION
+// ============================================================================
+
+// Folds constant scalar arithmetic bit-exactly, forwards identities such
+// as x * 1.0 and merges phis of a single value
+void ir_fold_function(IrFunction *fn);
+
+// Folds `insn` and the arithmetic it is computed from in place; true when
+// it is a constant then
+bool ir_fold_value(IrInsn *insn);
+
+// Merges values computed again where an equal one dominates them, and
+// loads of bytes a dominating load or store already has in a register
+void ir_gvn_function(IrFunction *fn);
+
+// Moves values computed the same way on every iteration of a loop, loads
+// of bytes the loop never writes among them, to the block entering it
+void ir_licm_function(IrFunction *fn);
+
+typedef enum {
+    IR_FP_CONTRACT_OFF,
+    IR_FP_CONTRACT_ON,       // Within one source expression
+    IR_FP_CONTRACT_FAST      // Wherever a product has a single use
+} IrFpContract;
+
+// Packs isomorphic scalar fp32 operations on adjacent vector lanes or
+// adjacent floats in memory into vector operations
+void ir_slp_function(IrFunction *fn);
+
+// Fuses float a * b + c, and a * b - c or c - a * b with a constant to
+// negate, into fma
+void ir_contract_function(IrFunction *fn, IrFpContract mode);
+
+// Turns integer multiplies, and divisions of values that are not negative,
+// by powers of two into shifts, float divisions by constants into
+// multiplies where the result stays the same or `fast_math` allows, and
+// multiples of loop induction variables into variables of their own
+void ir_strength_function(IrFunction *fn, bool fast_math);
+
+// Removes values nothing uses, calls without effects whose result is
+// unused, and stores nothing reads: overwritten further down the block or
+// to a variable of the function's frame it never reads
+void ir_dce_module(IrModule *m);
+
+// Runs the optimization passes over every function that lowered cleanly;
+// `flags` are the GEN_* options
+void ir_optimize_module(IrModule *m, int flags);
+
+// ============================================================================
+// DEBUG OUTPUT
+// ============================================================================
+
+const char *ir_op_name(IrOp op);
+void ir_dump_function(IrFunction *fn, FILE *out);
+void ir_dump_module(IrModule *m, FILE *out);
+
+// ============================================================================
+// CODE GENERATION
+// ============================================================================
+
+// Register conventions: the two highest registers of every file are
+// scratch for operands that live in memory or are rematerialized, and i32
+// r5 holds frame slot addresses. The remaining registers are allocated.
+#define IR_SCRATCH_REGS 2
+#define IR_SLOT_REG     5
+
+static inline int ir_scratch_reg(uint8_t tgq, int n) {
+    return GET_REG_COUNT_BY_TYPE(tgq) - IR_SCRATCH_REGS + n;
+}
+
+static inline int ir_allocatable_regs(uint8_t tgq) {
+    if (tgq == TGQ_I32) return IR_SLOT_REG;
+    return GET_REG_COUNT_BY_TYPE(tgq) - IR_SCRATCH_REGS;
+}
+
+// Values that need a register or memory; constants and addresses are
+// rematerialized where they are used
+static inline bool ir_is_allocated(IrInsn *insn) {
+    if (insn->type->base == TYPE_VOID) return false;
+    return insn->op != IR_CONST && insn->op != IR_ADDR && insn->op != IR_UNDEF;
+}
+
+// Linear-scan register allocation over live intervals. Sets `reg` of every
+// allocated value (-1 when spilled) and `saves` of every call. Critical
+// edges must be split.
+void regalloc_function(IrFunction *fn);
+
+// Lowers every successfully built function to `code`. Returns false if a
+// function could not be generated (the error has been reported).
+bool isel_module(IrModule *m, EmitBuffer *code);
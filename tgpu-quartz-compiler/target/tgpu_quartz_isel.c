@@ -0,0 +1,887 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// INSTRUCTION SELECTION
+// ============================================================================
+
+// Values live in the registers chosen by regalloc_function; the rest have
+// a slot in their function's frame and pass through the scratch registers
+// of their file (see IR_SCRATCH_REGS). Constants and addresses are
+// rematerialized at every use. An instruction that needs more scratch
+// registers of one file than there are borrows an allocated register for
+// its duration and restores it afterwards.
+//
+// Frames are placed one after another in local memory at frame_base. A
+// call stores the arguments into the callee's parameter slots and reads
+// the result from its return slot; it saves the caller's live registers
+// to their slots around it, since every function uses the same files.
+
+// Per function scratch memory: vector lanes, then borrowed registers,
+// each with room for a matrix, then a slot for conversions through memory
+#define ISEL_LANES_OFFSET    0
+#define ISEL_BORROW_OFFSET   16
+#define ISEL_BORROW_SIZE     64
+#define ISEL_MAX_BORROWS     2
+#define ISEL_CONVERT_OFFSET  (ISEL_BORROW_OFFSET + ISEL_BORROW_SIZE * ISEL_MAX_BORROWS)
+#define ISEL_SCRATCH_SIZE    (ISEL_CONVERT_OFFSET + 8)
+
+// Element type of the matrix arithmetic: TGQL matrices are float
+#define ISEL_MATRIX_ELEMENT  TGQ_FP32
+
+typedef struct {
+    IrModule *module;
+    EmitBuffer *code;
+    LabelManager labels;
+    IrFunction *fn;          // Function being emitted
+    bool *visiting;          // Call graph walk, by function index
+    bool *visited;
+
+    // Instruction being emitted
+    IrInsn *insn;
+    uint8_t scratch_used[TGQ_TYPE_TOP];
+    uint8_t borrow_type[ISEL_MAX_BORROWS];
+    uint8_t borrow_reg[ISEL_MAX_BORROWS];
+    int borrow_count;
+    bool failed;             // The function cannot be generated
+} Isel;
+
+// Reports the first error of the function; emission goes on to its end
+static void isel_fail(Isel *s, const char *fmt, ...) {
+    if (!s->failed) {
+        crt_err("Codegen:");
+        printf(" in %s: ", s->fn->name);
+        va_list args;
+        va_start(args, fmt);
+        vprintf(fmt, args);
+        va_end(args);
+        printf("\n");
+    }
+    s->failed = true;
+}
+
+static uint8_t mem_base(IrSpace space) {
+    return space == IR_SPACE_GLOBAL ? TGQ_CR_DATA_BASE : TGQ_CR_LOCAL_BASE;
+}
+
+static void emit_ld(EmitBuffer *code, IrSpace space, uint8_t type, uint8_t rd, uint8_t roff) {
+    if (space == IR_SPACE_GLOBAL) emit_ld_global(code, type, rd, mem_base(space), roff);
+    else emit_ld_local(code, type, rd, mem_base(space), roff);
+}
+
+static void emit_st(EmitBuffer *code, IrSpace space, uint8_t type, uint8_t rs, uint8_t roff) {
+    if (space == IR_SPACE_GLOBAL) emit_st_global(code, type, rs, mem_base(space), roff);
+    else emit_st_local(code, type, rs, mem_base(space), roff);
+}
+
+// ============================================================================
+// FRAME LAYOUT
+// ============================================================================
+
+static void value_slot(IrFunction *fn, IrInsn *v) {
+    if (v->slot >= 0) return;
+    if (v->op == IR_PARAM) {
+        v->slot = fn->param_offsets[v->imm.index];
+    } else {
+        int size = ir_tgq_size(v->tgq_type);
+        v->slot = ir_frame_alloc(fn, size, size < 16 ? size : 16);
+    }
+}
+
+// Spilled values and values saved around calls get a slot
+static void isel_layout(IrFunction *fn) {
+    ir_split_critical_edges(fn);
+    regalloc_function(fn);
+
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            if (ir_is_allocated(insn) && (insn->reg < 0 || insn->op == IR_PARAM)) value_slot(fn, insn);
+            if (insn->op != IR_CALL) continue;
+            for (int i = 0; i < insn->save_count; i++) value_slot(fn, insn->saves[i]);
+        }
+    }
+    fn->scratch = ir_frame_alloc(fn, ISEL_SCRATCH_SIZE, 16);
+}
+
+// Functions that cannot be generated: lowering failed, they recurse (frames
+// are static) or they call such a function
+static bool isel_check_calls(Isel *s, IrFunction *fn) {
+    if (s->visited[fn->index]) return !fn->failed;
+    if (s->visiting[fn->index]) {
+        crt_err("Codegen:");
+        printf(" in %s: recursion is not supported\n", fn->name);
+        fn->failed = true;
+        return false;
+    }
+    s->visiting[fn->index] = true;
+
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            if (insn->op != IR_CALL) continue;
+            if (!isel_check_calls(s, insn->func) && !fn->failed) {
+                crt_err("Codegen:");
+                printf(" in %s: calls %s, which cannot be generated\n", fn->name, insn->func->name);
+                fn->failed = true;
+            }
+        }
+    }
+
+    s->visiting[fn->index] = false;
+    s->visited[fn->index] = true;
+    return !fn->failed;
+}
+
+// ============================================================================
+// OPERANDS
+// ============================================================================
+
+// Absolute local memory address of a value's slot
+static int slot_addr(IrInsn *v) {
+    return v->block->func->frame_base + v->slot;
+}
+
+static int scratch_addr(Isel *s, int offset) {
+    return s->fn->frame_base + s->fn->scratch + offset;
+}
+
+// Matrices have no loads and stores of their own: they move a column at a
+// time through the first vector scratch register, which holds operands
+// only after the matrix ones have been read and before results are written
+static void load_slot(Isel *s, uint8_t type, uint8_t reg, int addr) {
+    if (type == TGQ_MATRIX) {
+        uint8_t column = ir_scratch_reg(TGQ_V4FP32, 0);
+        for (int i = 0; i < 4; i++) {
+            load_slot(s, TGQ_V4FP32, column, addr + 16 * i);
+            emit_mldv(s->code, i, reg, TGQ_V4FP32, column);
+        }
+        return;
+    }
+    emit_lconst32(s->code, IR_SLOT_REG, (uint32_t)addr);
+    emit_ld_local(s->code, type, reg, TGQ_CR_LOCAL_BASE, IR_SLOT_REG);
+}
+
+static void store_slot(Isel *s, uint8_t type, uint8_t reg, int addr) {
+    if (type == TGQ_MATRIX) {
+        uint8_t column = ir_scratch_reg(TGQ_V4FP32, 0);
+        for (int i = 0; i < 4; i++) {
+            emit_mstv(s->code, i, TGQ_V4FP32, column, reg);
+            store_slot(s, TGQ_V4FP32, column, addr + 16 * i);
+        }
+        return;
+    }
+    emit_lconst32(s->code, IR_SLOT_REG, (uint32_t)addr);
+    emit_st_local(s->code, type, reg, TGQ_CR_LOCAL_BASE, IR_SLOT_REG);
+}
+
+static bool insn_uses_reg(IrInsn *insn, uint8_t type, int reg) {
+    if (insn->reg == reg && insn->tgq_type == type) return true;
+    for (int i = 0; i < insn->arg_count; i++) {
+        IrInsn *arg = insn->args[i];
+        if (arg->reg == reg && arg->tgq_type == type) return true;
+    }
+    return false;
+}
+
+static bool is_borrowed(Isel *s, uint8_t type, int reg) {
+    for (int i = 0; i < s->borrow_count; i++) {
+        if (s->borrow_type[i] == type && s->borrow_reg[i] == reg) return true;
+    }
+    return false;
+}
+
+// Next free scratch register of `type` for the current instruction. Past
+// the reserved ones, an allocated register the instruction does not touch
+// and that is not lent out already is saved and lent out.
+static uint8_t scratch(Isel *s, uint8_t type) {
+    int n = s->scratch_used[type]++;
+    if (n < IR_SCRATCH_REGS) return ir_scratch_reg(type, n);
+
+    int reg = 0;
+    while (reg < ir_allocatable_regs(type) &&
+           (insn_uses_reg(s->insn, type, reg) || is_borrowed(s, type, reg))) {
+        reg++;
+    }
+    if (reg == ir_allocatable_regs(type) || s->borrow_count == ISEL_MAX_BORROWS) {
+        isel_fail(s, "no register left for a temporary of %s", ir_op_name(s->insn->op));
+        return ir_scratch_reg(type, 0);
+    }
+    int b = s->borrow_count++;
+    s->borrow_type[b] = type;
+    s->borrow_reg[b] = reg;
+    store_slot(s, type, reg, scratch_addr(s, ISEL_BORROW_OFFSET + ISEL_BORROW_SIZE * b));
+    return reg;
+}
+
+static void scratch_release(Isel *s) {
+    for (int b = s->borrow_count - 1; b >= 0; b--) {
+        load_slot(s, s->borrow_type[b], s->borrow_reg[b],
+                  scratch_addr(s, ISEL_BORROW_OFFSET + ISEL_BORROW_SIZE * b));
+    }
+    s->borrow_count = 0;
+    memset(s->scratch_used, 0, sizeof(s->scratch_used));
+}
+
+// Materializes a value that has no register into `reg`
+static void rematerialize(Isel *s, IrInsn *v, uint8_t reg) {
+    switch (v->op) {
+    case IR_CONST:
+        emit_lconst(s->code, v->tgq_type, reg, v->imm.bits);
+        break;
+    case IR_ADDR: {
+        int addr = v->imm.offset;
+        if (v->space == IR_SPACE_LOCAL) addr += v->func->frame_base;
+        emit_lconst32(s->code, reg, (uint32_t)addr);
+        break;
+    }
+    case IR_UNDEF:
+        break;
+    default:
+        load_slot(s, v->tgq_type, reg, slot_addr(v));
+        break;
+    }
+}
+
+// Register holding `v`
+static uint8_t use(Isel *s, IrInsn *v) {
+    if (v->reg >= 0) return v->reg;
+    uint8_t reg = scratch(s, v->tgq_type);
+    rematerialize(s, v, reg);
+    return reg;
+}
+
+// ============================================================================
+// CONVERSIONS
+// ============================================================================
+
+// The target has no instruction between integers and floats; lowering
+// only lets constants through, which folding converts. Integers narrow
+// by keeping low halves (mv32.l64, mv16.l32, mv8.l16). Floats convert
+// through fp32: mv32to16/mv16to32 for fp16 and bf16, and bf32, which has
+// the bits of an fp32, through memory.
+
+static void convert(Isel *s, uint8_t to, uint8_t from, uint8_t rd, uint8_t r1);
+
+static void convert_narrow(Isel *s, uint8_t to, uint8_t from, uint8_t rd, uint8_t r1) {
+    static const uint8_t low_half[] = {
+        [TGQ_I16] = TGQ_I_MV8_L16, [TGQ_I32] = TGQ_I_MV16_L32, [TGQ_I64] = TGQ_I_MV32_L64,
+    };
+    while (from != to) {
+        uint8_t half = from - 1;
+        uint8_t reg = half == to ? rd : scratch(s, half);
+        emit_mv(s->code, low_half[from], half, from, reg, r1);
+        from = half;
+        r1 = reg;
+    }
+}
+
+// There is no widening move: the value is stored over a zeroed slot and
+// read back wide, then sign-extended as (x ^ m) - m with m its sign bit
+static void convert_widen(Isel *s, uint8_t to, uint8_t from, uint8_t rd, uint8_t r1) {
+    int addr = scratch_addr(s, ISEL_CONVERT_OFFSET);
+    emit_lconst(s->code, to, rd, 0);
+    store_slot(s, to, rd, addr);
+    store_slot(s, from, r1, addr);
+    load_slot(s, to, rd, addr);
+
+    uint8_t mask = scratch(s, to);
+    if (mask == rd) mask = scratch(s, to);
+    emit_lconst(s->code, to, mask, (uint64_t)1 << (ir_tgq_size(from) * 8 - 1));
+    emit_xor(s->code, to, rd, rd, mask);
+    emit_sub(s->code, to, rd, rd, mask);
+}
+
+static void convert_float(Isel *s, uint8_t to, uint8_t from, uint8_t rd, uint8_t r1) {
+    if (to != TGQ_FP32 && from != TGQ_FP32) {
+        uint8_t wide = scratch(s, TGQ_FP32);
+        convert(s, TGQ_FP32, from, wide, r1);
+        convert(s, to, TGQ_FP32, rd, wide);
+    } else if (from == TGQ_FP16) {
+        emit_mv(s->code, TGQ_I_MV16TO32_FP, to, from, rd, r1);
+    } else if (from == TGQ_BF16) {
+        emit_mv(s->code, TGQ_I_MV16TO32_BF, to, from, rd, r1);
+    } else if (to == TGQ_FP16) {
+        emit_mv(s->code, TGQ_I_MV32TO16_FP, to, from, rd, r1);
+    } else if (to == TGQ_BF16) {
+        emit_mv(s->code, TGQ_I_MV32TO16_BF, to, from, rd, r1);
+    } else {
+        store_slot(s, from, r1, scratch_addr(s, ISEL_CONVERT_OFFSET));
+        load_slot(s, to, rd, scratch_addr(s, ISEL_CONVERT_OFFSET));
+    }
+}
+
+// rd (to) = r1 (from)
+static void convert(Isel *s, uint8_t to, uint8_t from, uint8_t rd, uint8_t r1) {
+    if (to == from) {
+        if (rd != r1) emit_mov(s->code, to, rd, r1);
+    } else if (ir_tgq_is_float(to) != ir_tgq_is_float(from)) {
+        isel_fail(s, "the target has no conversion between integers and floats");
+    } else if (ir_tgq_is_float(to)) {
+        convert_float(s, to, from, rd, r1);
+    } else if (to < from) {
+        convert_narrow(s, to, from, rd, r1);
+    } else {
+        convert_widen(s, to, from, rd, r1);
+    }
+}
+
+// `v` converted to `type`
+static uint8_t use_as(Isel *s, IrInsn *v, uint8_t type) {
+    uint8_t reg = use(s, v);
+    if (v->tgq_type == type) return reg;
+    uint8_t converted = scratch(s, type);
+    convert(s, type, v->tgq_type, converted, reg);
+    return converted;
+}
+
+// Register the result is computed into. A spilled result goes through the
+// first scratch register, which operands may still occupy: the final
+// write of an instruction comes after its last operand read.
+static uint8_t dest(IrInsn *insn) {
+    return insn->reg >= 0 ? insn->reg : ir_scratch_reg(insn->tgq_type, 0);
+}
+
+static void def(Isel *s, IrInsn *insn, uint8_t reg) {
+    if (insn->reg < 0) store_slot(s, insn->tgq_type, reg, slot_addr(insn));
+}
+
+// ============================================================================
+// INSTRUCTIONS
+// ============================================================================
+
+static const uint8_t isel_binary_ops[IR_OP_COUNT] = {
+    [IR_ADD] = TGQ_I_ADD,
+    [IR_SUB] = TGQ_I_SUB,
+    [IR_MUL] = TGQ_I_MUL,
+    [IR_DIV] = TGQ_I_DIV,
+    [IR_AND] = TGQ_I_AND,
+    [IR_OR]  = TGQ_I_OR,
+    [IR_XOR] = TGQ_I_XOR,
+    [IR_SHL] = TGQ_I_SHL,
+    [IR_SHR] = TGQ_I_SHR,
+    [IR_MIN] = TGQ_I_MIN,
+    [IR_MAX] = TGQ_I_MAX,
+};
+
+static const uint8_t isel_matrix_ops[IR_OP_COUNT] = {
+    [IR_ADD] = TGQ_I_MADD,
+    [IR_SUB] = TGQ_I_MSUB,
+    [IR_MUL] = TGQ_I_MMUL,
+};
+
+// Comparisons materialize 1 or 0 through branches
+static void isel_cmp(Isel *s, IrInsn *insn) {
+    uint8_t t = insn->args[0]->tgq_type;
+    int is_true = label_create(&s->labels);
+    int done = label_create(&s->labels);
+
+    uint8_t a = use(s, insn->args[0]);
+    uint8_t b = use(s, insn->args[1]);
+    switch (insn->imm.cmp) {
+    case IR_CMP_EQ: emit_beq(s->code, t, a, b, &s->labels, is_true); break;
+    case IR_CMP_NE: emit_bne(s->code, t, a, b, &s->labels, is_true); break;
+    case IR_CMP_LT: emit_blt(s->code, t, a, b, &s->labels, is_true); break;
+    case IR_CMP_GT: emit_bgt(s->code, t, a, b, &s->labels, is_true); break;
+    case IR_CMP_LE:
+        emit_blt(s->code, t, a, b, &s->labels, is_true);
+        emit_beq(s->code, t, a, b, &s->labels, is_true);
+        break;
+    case IR_CMP_GE:
+        emit_bgt(s->code, t, a, b, &s->labels, is_true);
+        emit_beq(s->code, t, a, b, &s->labels, is_true);
+        break;
+    }
+    uint8_t rd = dest(insn);
+    emit_lconst8(s->code, rd, 0);
+    emit_bra(s->code, &s->labels, done);
+    label_define(&s->labels, s->code, is_true);
+    emit_lconst8(s->code, rd, 1);
+    label_define(&s->labels, s->code, done);
+    def(s, insn, rd);
+}
+
+// Vectors are assembled and taken apart in memory, a lane at a time: in
+// the slot of a spilled vector, otherwise in the scratch area
+static int lane_size(IrInsn *vec) {
+    return ir_tgq_size(ir_tgq_lane(vec->tgq_type));
+}
+
+static int vector_memory(Isel *s, IrInsn *vec) {
+    return vec->reg >= 0 ? scratch_addr(s, ISEL_LANES_OFFSET) : slot_addr(vec);
+}
+
+// A scratch register of float type `type` with only the sign bit set
+static uint8_t sign_mask(Isel *s, uint8_t type) {
+    uint8_t mask = scratch(s, type);
+    emit_lconst(s->code, type, mask, (uint64_t)1 << (ir_tgq_size(type) * 8 - 1));
+    return mask;
+}
+
+static void isel_vec_build(Isel *s, IrInsn *insn) {
+    uint8_t lane = ir_tgq_lane(insn->tgq_type);
+    int base = vector_memory(s, insn);
+    for (int i = 0; i < insn->arg_count; i++) {
+        store_slot(s, lane, use_as(s, insn->args[i], lane), base + i * lane_size(insn));
+        memset(s->scratch_used, 0, sizeof(s->scratch_used));
+    }
+    if (insn->reg >= 0) load_slot(s, insn->tgq_type, insn->reg, base);
+}
+
+static void isel_extract(Isel *s, IrInsn *insn) {
+    IrInsn *vec = insn->args[0];
+    if (vec->op == IR_UNDEF) return;
+    uint8_t lane = ir_tgq_lane(vec->tgq_type);
+    int base = vector_memory(s, vec);
+    if (vec->reg >= 0) store_slot(s, vec->tgq_type, vec->reg, base);
+
+    uint8_t rd = dest(insn);
+    uint8_t reg = lane == insn->tgq_type ? rd : scratch(s, lane);
+    load_slot(s, lane, reg, base + insn->imm.lane * lane_size(vec));
+    convert(s, insn->tgq_type, lane, rd, reg);
+    def(s, insn, rd);
+}
+
+static void isel_insert(Isel *s, IrInsn *insn) {
+    IrInsn *vec = insn->args[0];
+    uint8_t lane = ir_tgq_lane(insn->tgq_type);
+    int base = vector_memory(s, insn);
+    if (vec->op != IR_UNDEF) store_slot(s, insn->tgq_type, use(s, vec), base);
+    store_slot(s, lane, use_as(s, insn->args[1], lane), base + insn->imm.lane * lane_size(insn));
+    if (insn->reg >= 0) load_slot(s, insn->tgq_type, insn->reg, base);
+}
+
+// A column shorter than four lanes has its other rows zeroed on the way
+// in, in the scratch area
+static void isel_mat_insert(Isel *s, IrInsn *insn) {
+    IrInsn *mat = insn->args[0];
+    IrInsn *vec = insn->args[1];
+    uint8_t rd = dest(insn);
+    if (mat->op != IR_UNDEF) {
+        uint8_t m = use(s, mat);
+        if (m != rd) emit_mov(s->code, TGQ_MATRIX, rd, m);
+    }
+
+    uint8_t v = use(s, vec);
+    if (vec->components < 4) {
+        int base = scratch_addr(s, ISEL_LANES_OFFSET);
+        uint8_t zero = scratch(s, TGQ_FP32);
+        store_slot(s, vec->tgq_type, v, base);
+        emit_lconst(s->code, TGQ_FP32, zero, 0);
+        for (int i = vec->components; i < 4; i++) {
+            store_slot(s, TGQ_FP32, zero, base + 4 * i);
+        }
+        v = scratch(s, vec->tgq_type);
+        load_slot(s, vec->tgq_type, v, base);
+    }
+    emit_mldv(s->code, insn->imm.lane, rd, vec->tgq_type, v);
+    def(s, insn, rd);
+}
+
+// Eight byte chunks through i64, then i16 and i8 ones. The addresses are
+// copied into the i32 scratch registers and advanced by the slot register.
+static void copy_address(Isel *s, IrInsn *v, uint8_t reg) {
+    if (v->reg >= 0) emit_mov(s->code, TGQ_I32, reg, v->reg);
+    else rematerialize(s, v, reg);
+}
+
+static void isel_copy(Isel *s, IrInsn *insn) {
+    static const uint8_t chunk_types[] = { TGQ_I64, TGQ_I16, TGQ_I8 };
+    uint8_t dst = ir_scratch_reg(TGQ_I32, 0);
+    uint8_t src = ir_scratch_reg(TGQ_I32, 1);
+    copy_address(s, insn->args[0], dst);
+    copy_address(s, insn->args[1], src);
+
+    int left = insn->imm.size;
+    for (int c = 0; c < 3; c++) {
+        uint8_t type = chunk_types[c];
+        uint8_t data = ir_scratch_reg(type, 0);
+        int step = ir_tgq_size(type);
+        if (left < step) continue;
+        emit_lconst32(s->code, IR_SLOT_REG, step);
+        while (left >= step) {
+            emit_ld(s->code, insn->src_space, type, data, src);
+            emit_st(s->code, insn->space, type, data, dst);
+            left -= step;
+            if (!left) break;
+            emit_add(s->code, TGQ_I32, src, src, IR_SLOT_REG);
+            emit_add(s->code, TGQ_I32, dst, dst, IR_SLOT_REG);
+        }
+    }
+}
+
+// Arguments go to the callee's parameter slots in parameter order
+static void isel_call(Isel *s, IrInsn *insn) {
+    IrFunction *callee = insn->func;
+    Symbol *sym = callee->sym;
+    int arg = 0;
+    for (int i = 0; i < callee->param_count && arg < insn->arg_count; i++) {
+        TypeInfo *t = sym->params[i]->type;
+        if (t->reg_class == REGCLASS_NONE) continue;
+        IrInsn *v = insn->args[arg++];
+        store_slot(s, v->tgq_type, use(s, v), callee->frame_base + callee->param_offsets[i]);
+        memset(s->scratch_used, 0, sizeof(s->scratch_used));
+    }
+
+    for (int i = 0; i < insn->save_count; i++) {
+        IrInsn *v = insn->saves[i];
+        if (v->reg >= 0) store_slot(s, v->tgq_type, v->reg, slot_addr(v));
+    }
+    emit_call(s->code, &s->labels, callee->label);
+    for (int i = 0; i < insn->save_count; i++) {
+        IrInsn *v = insn->saves[i];
+        if (v->reg >= 0) load_slot(s, v->tgq_type, v->reg, slot_addr(v));
+    }
+
+    if (ir_is_allocated(insn)) {
+        uint8_t rd = dest(insn);
+        load_slot(s, insn->tgq_type, rd, callee->frame_base + callee->ret_offset);
+        def(s, insn, rd);
+    }
+}
+
+// ============================================================================
+// PHI COPIES
+// ============================================================================
+
+// The phis of a block take their operands for an edge all at once, so the
+// copies at the end of the predecessor form a parallel move. A copy is
+// emitted once no other pending copy still reads its destination; a cycle
+// is broken by parking one value in the second scratch register of its
+// file.
+
+typedef struct {
+    IrInsn *dst;
+    IrInsn *src;
+    int parked;              // Register the source was moved to, -1 if none
+} PhiCopy;
+
+// Identifies where a value lives: 0 for rematerialized values
+static int location(IrInsn *v) {
+    if (!ir_is_allocated(v)) return 0;
+    if (v->reg >= 0) return 1 + v->tgq_type * 16 + v->reg;
+    return 1 + TGQ_TYPE_TOP * 16 + v->block->func->frame_base + v->slot;
+}
+
+static void phi_copy(Isel *s, PhiCopy *c) {
+    IrInsn *dst = c->dst;
+    uint8_t t = dst->tgq_type;
+    if (c->parked < 0 && location(c->src) == location(dst)) return;
+
+    uint8_t reg;
+    if (c->parked >= 0) {
+        reg = c->parked;
+    } else if (c->src->reg >= 0) {
+        reg = c->src->reg;
+    } else {
+        reg = dest(dst);
+        rematerialize(s, c->src, reg);
+    }
+    if (dst->reg >= 0 && dst->reg != reg) emit_mov(s->code, t, dst->reg, reg);
+    if (dst->reg < 0) store_slot(s, t, reg, slot_addr(dst));
+}
+
+static void isel_phi_copies(Isel *s, IrBlock *block, IrBlock *succ) {
+    int pred = 0;
+    while (succ->preds[pred] != block) pred++;
+
+    int count = 0;
+    for (IrInsn *phi = succ->first; phi && phi->op == IR_PHI; phi = phi->next) count++;
+    if (!count) return;
+
+    PhiCopy *copies = crt_malloc(sizeof(PhiCopy) * count);
+    int pending = 0;
+    for (IrInsn *phi = succ->first; phi && phi->op == IR_PHI; phi = phi->next) {
+        IrInsn *src = phi->args[pred];
+        if (src == phi || src->op == IR_UNDEF) continue;
+        copies[pending++] = (PhiCopy){ phi, src, -1 };
+    }
+
+    while (pending) {
+        bool progress = false;
+        for (int i = 0; i < pending; i++) {
+            int loc = location(copies[i].dst);
+            bool blocked = false;
+            for (int j = 0; j < pending && !blocked; j++) {
+                blocked = j != i && copies[j].parked < 0 && location(copies[j].src) == loc;
+            }
+            if (blocked) continue;
+            phi_copy(s, &copies[i]);
+            copies[i--] = copies[--pending];
+            progress = true;
+        }
+        if (progress) continue;
+
+        // Every destination is still read: park the first one's value
+        IrInsn *dst = copies[0].dst;
+        uint8_t park = ir_scratch_reg(dst->tgq_type, 1);
+        if (dst->reg >= 0) emit_mov(s->code, dst->tgq_type, park, dst->reg);
+        else load_slot(s, dst->tgq_type, park, slot_addr(dst));
+        int loc = location(dst);
+        for (int j = 0; j < pending; j++) {
+            if (copies[j].parked < 0 && location(copies[j].src) == loc) copies[j].parked = park;
+        }
+    }
+    free(copies);
+}
+
+// ============================================================================
+// SELECTION
+// ============================================================================
+
+// Branches to the next block in layout order fall through
+static void isel_goto(Isel *s, IrBlock *to, int layout) {
+    int next = layout + 1;
+    if (next < s->fn->block_count && s->fn->blocks[next] == to) return;
+    emit_bra(s->code, &s->labels, to->label);
+}
+
+static void isel_insn(Isel *s, IrInsn *insn, int layout) {
+    IrBlock *block = insn->block;
+    uint8_t t = insn->tgq_type;
+    uint8_t rd, a, b, c;
+
+    switch (insn->op) {
+    case IR_CONST:
+    case IR_UNDEF:
+    case IR_PHI:
+    case IR_ADDR:
+        break;
+
+    case IR_PARAM:
+        if (insn->reg >= 0) load_slot(s, t, insn->reg, slot_addr(insn));
+        break;
+
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+    case IR_AND: case IR_OR: case IR_XOR: case IR_SHL: case IR_SHR:
+    case IR_MIN: case IR_MAX:
+        a = use(s, insn->args[0]);
+        b = use(s, insn->args[1]);
+        rd = dest(insn);
+        if (t == TGQ_MATRIX) emit_matrix3(s->code, isel_matrix_ops[insn->op], ISEL_MATRIX_ELEMENT, rd, a, b);
+        else emit_scalar3(s->code, isel_binary_ops[insn->op], t, rd, a, b);
+        def(s, insn, rd);
+        break;
+
+    case IR_REM:
+        // a - (a / b) * b
+        a = use(s, insn->args[0]);
+        b = use(s, insn->args[1]);
+        c = scratch(s, t);
+        emit_div(s->code, t, c, a, b);
+        emit_mul(s->code, t, c, c, b);
+        rd = dest(insn);
+        emit_sub(s->code, t, rd, a, c);
+        def(s, insn, rd);
+        break;
+
+    case IR_NEG:
+        a = use(s, insn->args[0]);
+        if (ir_tgq_is_float(t)) {
+            // Flipping the sign bit negates zeros and NaNs too, as folding does
+            c = sign_mask(s, t);
+            rd = dest(insn);
+            emit_xor(s->code, t, rd, a, c);
+        } else {
+            c = scratch(s, t);
+            emit_xor(s->code, t, c, c, c);
+            rd = dest(insn);
+            emit_sub(s->code, t, rd, c, a);
+        }
+        def(s, insn, rd);
+        break;
+
+    case IR_NOT:
+        a = use(s, insn->args[0]);
+        rd = dest(insn);
+        if (insn->type->base == TYPE_BOOL) {
+            c = scratch(s, t);
+            emit_lconst8(s->code, c, 1);
+            emit_xor(s->code, t, rd, a, c);
+        } else {
+            emit_not(s->code, t, rd, a);
+        }
+        def(s, insn, rd);
+        break;
+
+    case IR_SQRT:
+        a = use(s, insn->args[0]);
+        rd = dest(insn);
+        emit_scalar2(s->code, TGQ_I_SQRT, t, rd, a);
+        def(s, insn, rd);
+        break;
+
+    case IR_FMA:
+        a = use(s, insn->args[0]);
+        b = use(s, insn->args[1]);
+        c = use(s, insn->args[2]);
+        rd = dest(insn);
+        if (t == TGQ_MATRIX) emit_wmma(s->code, ISEL_MATRIX_ELEMENT, rd, a, b, c);
+        else emit_fma(s->code, t, rd, a, b, c);
+        def(s, insn, rd);
+        break;
+
+    case IR_CMP:
+        isel_cmp(s, insn);
+        break;
+
+    case IR_CONVERT:
+        a = use(s, insn->args[0]);
+        rd = dest(insn);
+        convert(s, t, insn->args[0]->tgq_type, rd, a);
+        def(s, insn, rd);
+        break;
+
+    case IR_VEC_BUILD:
+        isel_vec_build(s, insn);
+        break;
+
+    case IR_EXTRACT:
+        isel_extract(s, insn);
+        break;
+
+    case IR_INSERT:
+        isel_insert(s, insn);
+        break;
+
+    case IR_MAT_ZERO:
+        rd = dest(insn);
+        emit_maz(s->code, rd);
+        def(s, insn, rd);
+        break;
+
+    case IR_MAT_INSERT:
+        isel_mat_insert(s, insn);
+        break;
+
+    case IR_MAT_EXTRACT:
+        if (insn->args[0]->op == IR_UNDEF) break;
+        a = use(s, insn->args[0]);
+        rd = dest(insn);
+        emit_mstv(s->code, insn->imm.lane, t, rd, a);
+        def(s, insn, rd);
+        break;
+
+    case IR_LOAD:
+        a = use(s, insn->args[0]);
+        rd = dest(insn);
+        emit_ld(s->code, insn->space, t, rd, a);
+        def(s, insn, rd);
+        break;
+
+    case IR_STORE:
+        a = use(s, insn->args[0]);
+        b = use(s, insn->args[1]);
+        emit_st(s->code, insn->space, insn->args[1]->tgq_type, b, a);
+        break;
+
+    case IR_COPY:
+        isel_copy(s, insn);
+        break;
+
+    case IR_CALL:
+        isel_call(s, insn);
+        break;
+
+    case IR_JUMP:
+        isel_phi_copies(s, block, block->succs[0]);
+        isel_goto(s, block->succs[0], layout);
+        break;
+
+    case IR_BRANCH:
+        // Critical edges are split, so neither successor has phis
+        a = use(s, insn->args[0]);
+        c = scratch(s, TGQ_I8);
+        emit_lconst8(s->code, c, 0);
+        emit_bne(s->code, TGQ_I8, a, c, &s->labels, block->succs[0]->label);
+        isel_goto(s, block->succs[1], layout);
+        break;
+
+    case IR_RET:
+        if (insn->arg_count) {
+            IrInsn *v = insn->args[0];
+            store_slot(s, v->tgq_type, use(s, v), s->fn->frame_base + s->fn->ret_offset);
+        }
+        emit_ret(s->code);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static bool isel_function(Isel *s, IrFunction *fn) {
+    s->fn = fn;
+    s->failed = false;
+    labels_begin_function(&s->labels);
+    label_define(&s->labels, s->code, fn->label);
+
+    for (int b = 0; b < fn->block_count; b++) {
+        fn->blocks[b]->label = label_create(&s->labels);
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        IrBlock *block = fn->blocks[b];
+        label_define(&s->labels, s->code, block->label);
+        for (IrInsn *insn = block->first; insn; insn = insn->next) {
+            s->insn = insn;
+            isel_insn(s, insn, b);
+            scratch_release(s);
+        }
+    }
+    bool ok = labels_end_function(&s->labels, s->code);
+    return ok && !s->failed;
+}
+
+// ============================================================================
+// MODULE
+// ============================================================================
+
+bool isel_module(IrModule *m, EmitBuffer *code) {
+    Isel s = {0};
+    s.module = m;
+    s.code = code;
+    s.visiting = crt_calloc(m->func_count ? m->func_count : 1, sizeof(bool));
+    s.visited = crt_calloc(m->func_count ? m->func_count : 1, sizeof(bool));
+    labels_init(&s.labels);
+
+    for (int i = 0; i < m->func_count; i++) {
+        IrFunction *fn = m->funcs[i];
+        if (!fn->lowered) fn->failed = true;
+    }
+    for (int i = 0; i < m->func_count; i++) {
+        isel_check_calls(&s, m->funcs[i]);
+    }
+
+    // Every frame gets its own place in local memory
+    int frame_top = 0;
+    for (int i = 0; i < m->func_count; i++) {
+        IrFunction *fn = m->funcs[i];
+        if (!fn->failed) isel_layout(fn);
+        fn->frame_base = frame_top;
+        frame_top = (frame_top + fn->frame_size + 15) & ~15;
+        fn->label = label_create_global(&s.labels);
+    }
+
+    // main comes first so execution starts at offset 0
+    bool ok = true;
+    const char *entry = str_intern("main");
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < m->func_count; i++) {
+            IrFunction *fn = m->funcs[i];
+            if ((fn->name == entry) != (pass == 0)) continue;
+            if (fn->failed) {
+                ok = false;
+                continue;
+            }
+            if (!isel_function(&s, fn)) ok = false;
+        }
+    }
+    if (!labels_resolve(&s.labels, code)) ok = false;
+
+    labels_free(&s.labels);
+    free(s.visiting);
+    free(s.visited);
+    return ok;
+}
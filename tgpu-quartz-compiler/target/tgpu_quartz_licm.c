@@ -0,0 +1,145 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// LOOP-INVARIANT CODE MOTION
+// ============================================================================
+
+// A loop is a header and the blocks that reach one of its back edges
+// without going through it. Values of the loop whose operands all come
+// from outside it are computed once in the preheader, the single block
+// that enters the header from outside and jumps nowhere else. Inner loops
+// go first, so what leaves them can leave the loops around them too.
+//
+// Loads move when nothing in the loop may write their bytes: uniform,
+// attribute and const globals never change, stores and copies are checked
+// for overlap, and calls may write anything outside the function's own
+// frame. Arithmetic runs whether or not the loop would have reached it.
+// A load of a computed address or an integer division only moves from
+// blocks that run before the loop is left, however it is left, so that it
+// ran at least once anyway. Matrix tiles stay in the loop: too few of them
+// fit to hold one across it. A loop that makes calls only gives up its
+// constants and addresses: every value held across a call is saved and
+// restored around it, which costs as much as computing it again.
+
+typedef struct {
+    IrFunction *fn;
+    IrBlock **order;         // Reachable blocks in reverse postorder
+    int order_count;
+    IrInsn **writes;         // Stores, copies and calls of the current loop
+    int write_count;
+    int write_capacity;
+} Licm;
+
+// ============================================================================
+// MOTION
+// ============================================================================
+
+// Whether `block` runs before the loop is left, however it is left
+static bool licm_always_runs(IrLoop *loop, IrBlock *block) {
+    if (loop->exiting_count == 0) return block == loop->header;
+    for (int i = 0; i < loop->exiting_count; i++) {
+        if (!ir_dominates(block, loop->exiting[i])) return false;
+    }
+    return true;
+}
+
+static bool licm_movable(IrInsn *insn) {
+    if (insn->tgq_type == TGQ_MATRIX) return false;
+    switch (insn->op) {
+    case IR_CONST:
+    case IR_ADDR:
+    case IR_CMP:
+    case IR_CONVERT:
+    case IR_VEC_BUILD:
+    case IR_EXTRACT:
+    case IR_INSERT:
+    case IR_LOAD:
+        return true;
+    default:
+        return insn->op >= IR_ADD && insn->op <= IR_FMA;
+    }
+}
+
+// Whether the value may only be computed where the loop computed it: a
+// load may read outside its variable, and an integer division may divide
+// by zero
+static bool licm_needs_guard(IrInsn *insn) {
+    if (insn->op == IR_LOAD) return ir_address(insn->args[0]).base->op != IR_ADDR;
+    return (insn->op == IR_DIV || insn->op == IR_REM) && !ir_tgq_is_float(insn->tgq_type);
+}
+
+// Whether something in the loop may write the bytes `load` reads
+static bool licm_written(Licm *l, IrInsn *load) {
+    if (ir_read_only(load->args[0])) return false;
+
+    IrInsn *addr = load->args[0];
+    int size = ir_tgq_size(load->tgq_type);
+    for (int i = 0; i < l->write_count; i++) {
+        if (ir_insn_may_write(l->fn, l->writes[i], load->space, addr, size)) return true;
+    }
+    return false;
+}
+
+static void licm_hoist(Licm *l, IrLoop *loop) {
+    IrBlock *preheader = loop->preheader;
+    if (!preheader) return;
+
+    l->write_count = 0;
+    for (int b = 0; b < l->order_count; b++) {
+        IrBlock *block = l->order[b];
+        if (!loop->blocks[block->id]) continue;
+        for (IrInsn *insn = block->first; insn; insn = insn->next) {
+            if (insn->op != IR_STORE && insn->op != IR_COPY && insn->op != IR_CALL) continue;
+            if (l->write_count == l->write_capacity) {
+                l->write_capacity = l->write_capacity ? l->write_capacity * 2 : 16;
+                l->writes = crt_realloc(l->writes, sizeof(IrInsn*) * l->write_capacity);
+            }
+            l->writes[l->write_count++] = insn;
+        }
+    }
+
+    // Operands come before their users in reverse postorder, and a moved
+    // value is in the preheader by the time its users are looked at
+    for (int b = 0; b < l->order_count; b++) {
+        IrBlock *block = l->order[b];
+        if (!loop->blocks[block->id]) continue;
+        bool always = licm_always_runs(loop, block);
+
+        IrInsn *next;
+        for (IrInsn *insn = block->first; insn; insn = next) {
+            next = insn->next;
+            if (!licm_movable(insn) || (loop->has_call && ir_is_allocated(insn))) continue;
+
+            bool invariant = true;
+            for (int i = 0; i < insn->arg_count && invariant; i++) {
+                invariant = !loop->blocks[insn->args[i]->block->id];
+            }
+            if (!invariant || (!always && licm_needs_guard(insn))) continue;
+            if (insn->op == IR_LOAD && licm_written(l, insn)) continue;
+            ir_insn_move_before(insn, preheader->last);
+        }
+    }
+}
+
+void ir_licm_function(IrFunction *fn) {
+    if (fn->block_count == 0) return;
+
+    Licm l;
+    memset(&l, 0, sizeof(l));
+    l.fn = fn;
+    l.order = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    l.order_count = ir_reverse_postorder(fn, l.order);
+    ir_compute_dominators(fn);
+
+    IrLoop *loops;
+    int loop_count = ir_find_loops(fn, &loops);
+    for (int i = 0; i < loop_count; i++) licm_hoist(&l, &loops[i]);
+
+    ir_free_loops(loops, loop_count);
+    free(l.writes);
+    free(l.order);
+}
@@ -0,0 +1,30 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+
+// ============================================================================
+// PASS PIPELINE
+// ============================================================================
+
+static IrFpContract opt_fp_contract(int flags) {
+    if (flags & GEN_FP_CONTRACT_OFF) return IR_FP_CONTRACT_OFF;
+    if (flags & GEN_FP_CONTRACT_FAST) return IR_FP_CONTRACT_FAST;
+    return IR_FP_CONTRACT_ON;
+}
+
+void ir_optimize_module(IrModule *m, int flags) {
+    for (int i = 0; i < m->func_count; i++) {
+        IrFunction *fn = m->funcs[i];
+        if (!fn->lowered || fn->failed) continue;
+        ir_fold_function(fn);
+        while (ir_fold_branches(fn)) ir_fold_function(fn);
+        ir_gvn_function(fn);
+        ir_fold_function(fn);
+        ir_licm_function(fn);
+        ir_slp_function(fn);
+        ir_contract_function(fn, opt_fp_contract(flags));
+        ir_strength_function(fn, (flags & GEN_FAST_MATH) != 0);
+        ir_fold_function(fn);
+    }
+    ir_dce_module(m);
+}
@@ -0,0 +1,323 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// REGISTER ALLOCATION
+// ============================================================================
+
+// Linear scan (Poletto and Sarkar) over one live interval per value.
+// Instructions are numbered in block layout order, two positions apart;
+// a block ends one position after its last instruction. Liveness across
+// blocks comes from the usual backward dataflow, which stretches the
+// interval of a value live into or out of a block to the block's bounds.
+//
+// A phi is read at the end of each predecessor and written there by the
+// edge's parallel copy, so its interval covers those points as well.
+// Values that do not get a register live in a frame slot for their whole
+// lifetime; isel reloads them into scratch registers at every use.
+//
+// Each register file (one per tgq type) is allocated independently. A
+// call clobbers every register, so the values live across it are recorded
+// on the call and saved around it by the caller.
+
+typedef struct {
+    IrFunction *fn;
+    IrInsn **values;         // By value id, allocated values only
+    int value_count;         // fn->next_value_id
+    int words;               // Words per live set
+    uint64_t *live_in;       // Per block layout index
+    uint64_t *live_out;
+    int *layout;             // Block id -> layout index
+    int *block_start;        // By layout index
+    int *block_end;
+    int *start;              // Interval bounds, by value id
+    int *end;
+    IrInsn **calls;          // Calls in layout order and their positions
+    int *call_pos;
+    int call_count;
+} RegAlloc;
+
+static inline void set_add(uint64_t *set, int id) {
+    set[id >> 6] |= (uint64_t)1 << (id & 63);
+}
+
+static inline void set_remove(uint64_t *set, int id) {
+    set[id >> 6] &= ~((uint64_t)1 << (id & 63));
+}
+
+static int pred_index(IrBlock *block, IrBlock *pred) {
+    for (int i = 0; i < block->pred_count; i++) {
+        if (block->preds[i] == pred) return i;
+    }
+    return -1;
+}
+
+// ============================================================================
+// LIVENESS
+// ============================================================================
+
+static void regalloc_number(RegAlloc *ra) {
+    IrFunction *fn = ra->fn;
+    int pos = 0;
+    for (int b = 0; b < fn->block_count; b++) {
+        IrBlock *block = fn->blocks[b];
+        ra->layout[block->id] = b;
+        ra->block_start[b] = pos;
+        for (IrInsn *insn = block->first; insn; insn = insn->next) {
+            if (ir_is_allocated(insn)) {
+                ra->values[insn->id] = insn;
+                ra->start[insn->id] = pos;
+                ra->end[insn->id] = pos;
+            }
+            if (insn->op == IR_CALL) {
+                ra->calls[ra->call_count] = insn;
+                ra->call_pos[ra->call_count++] = pos;
+            }
+            pos += 2;
+        }
+        ra->block_end[b] = pos - 1;
+    }
+}
+
+// live_out(B) = phi operands B passes on, plus live_in of its successors
+// live_in(B)  = uses before a definition in B, plus live_out(B) minus defs
+static void regalloc_liveness(RegAlloc *ra) {
+    IrFunction *fn = ra->fn;
+    int words = ra->words;
+    uint64_t *in = crt_malloc(sizeof(uint64_t) * words);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = fn->block_count - 1; b >= 0; b--) {
+            IrBlock *block = fn->blocks[b];
+            uint64_t *out = ra->live_out + (size_t)b * words;
+            memset(out, 0, sizeof(uint64_t) * words);
+
+            for (int s = 0; s < block->succ_count; s++) {
+                IrBlock *succ = block->succs[s];
+                uint64_t *succ_in = ra->live_in + (size_t)ra->layout[succ->id] * words;
+                for (int w = 0; w < words; w++) out[w] |= succ_in[w];
+
+                int pred = pred_index(succ, block);
+                for (IrInsn *phi = succ->first; phi && phi->op == IR_PHI; phi = phi->next) {
+                    IrInsn *arg = phi->args[pred];
+                    if (ra->values[arg->id] == arg) set_add(out, arg->id);
+                }
+            }
+
+            memcpy(in, out, sizeof(uint64_t) * words);
+            for (IrInsn *insn = block->last; insn; insn = insn->prev) {
+                if (ir_is_allocated(insn)) set_remove(in, insn->id);
+                if (insn->op == IR_PHI) continue;
+                for (int i = 0; i < insn->arg_count; i++) {
+                    IrInsn *arg = insn->args[i];
+                    if (ra->values[arg->id] == arg) set_add(in, arg->id);
+                }
+            }
+
+            uint64_t *live_in = ra->live_in + (size_t)b * words;
+            if (memcmp(in, live_in, sizeof(uint64_t) * words)) {
+                memcpy(live_in, in, sizeof(uint64_t) * words);
+                changed = true;
+            }
+        }
+    }
+    free(in);
+}
+
+static void extend(RegAlloc *ra, int id, int pos) {
+    if (pos < ra->start[id]) ra->start[id] = pos;
+    if (pos > ra->end[id]) ra->end[id] = pos;
+}
+
+static void regalloc_intervals(RegAlloc *ra) {
+    IrFunction *fn = ra->fn;
+    for (int b = 0; b < fn->block_count; b++) {
+        IrBlock *block = fn->blocks[b];
+        uint64_t *in = ra->live_in + (size_t)b * ra->words;
+        uint64_t *out = ra->live_out + (size_t)b * ra->words;
+        for (int w = 0; w < ra->words; w++) {
+            for (uint64_t bits = in[w] | out[w]; bits; bits &= bits - 1) {
+                int id = w * 64 + __builtin_ctzll(bits);
+                if (in[w] & (bits & -bits)) extend(ra, id, ra->block_start[b]);
+                if (out[w] & (bits & -bits)) extend(ra, id, ra->block_end[b]);
+            }
+        }
+
+        int pos = ra->block_start[b];
+        for (IrInsn *insn = block->first; insn; insn = insn->next, pos += 2) {
+            if (insn->op == IR_PHI) {
+                for (int i = 0; i < block->pred_count; i++) {
+                    int pred_end = ra->block_end[ra->layout[block->preds[i]->id]];
+                    if (ra->values[insn->id] == insn) extend(ra, insn->id, pred_end);
+                    IrInsn *arg = insn->args[i];
+                    if (ra->values[arg->id] == arg) extend(ra, arg->id, pred_end);
+                }
+                continue;
+            }
+            for (int i = 0; i < insn->arg_count; i++) {
+                IrInsn *arg = insn->args[i];
+                if (ra->values[arg->id] == arg) extend(ra, arg->id, pos);
+            }
+        }
+    }
+}
+
+// ============================================================================
+// LINEAR SCAN
+// ============================================================================
+
+static RegAlloc *g_sort_ra;
+
+static int compare_start(const void *a, const void *b) {
+    IrInsn *x = *(IrInsn *const *)a;
+    IrInsn *y = *(IrInsn *const *)b;
+    int sx = g_sort_ra->start[x->id], sy = g_sort_ra->start[y->id];
+    if (sx != sy) return sx < sy ? -1 : 1;
+    return x->id - y->id;
+}
+
+// Active intervals are kept sorted by increasing end
+static void active_insert(RegAlloc *ra, IrInsn **active, int *count, IrInsn *v) {
+    int i = *count;
+    while (i > 0 && ra->end[active[i - 1]->id] > ra->end[v->id]) {
+        active[i] = active[i - 1];
+        i--;
+    }
+    active[i] = v;
+    (*count)++;
+}
+
+// Frees the registers of intervals that end at or before `pos`; a value
+// read for the last time by an instruction can share its register with
+// the result
+static void active_expire(RegAlloc *ra, IrInsn **active, int *count, uint32_t *free_regs, int pos) {
+    int kept = 0;
+    for (int i = 0; i < *count; i++) {
+        IrInsn *v = active[i];
+        if (ra->end[v->id] <= pos) free_regs[v->tgq_type] |= 1u << v->reg;
+        else active[kept++] = v;
+    }
+    *count = kept;
+}
+
+// Values in registers across the call at `pos`
+static void record_saves(RegAlloc *ra, IrInsn *call, int pos, IrInsn **active, int count) {
+    int saves = 0;
+    for (int i = 0; i < count; i++) {
+        if (ra->end[active[i]->id] > pos) saves++;
+    }
+    call->save_count = 0;
+    call->saves = saves ? arena_alloc(ra->fn->module->arena, sizeof(IrInsn *) * saves) : NULL;
+    for (int i = 0; i < count; i++) {
+        if (ra->end[active[i]->id] > pos) call->saves[call->save_count++] = active[i];
+    }
+}
+
+static void regalloc_scan(RegAlloc *ra) {
+    int count = 0;
+    IrInsn **sorted = crt_malloc(sizeof(IrInsn *) * (ra->value_count ? ra->value_count : 1));
+    for (int id = 0; id < ra->value_count; id++) {
+        if (ra->values[id]) sorted[count++] = ra->values[id];
+    }
+    g_sort_ra = ra;
+    qsort(sorted, count, sizeof(IrInsn *), compare_start);
+
+    uint32_t free_regs[TGQ_TYPE_TOP];
+    for (int t = 0; t < TGQ_TYPE_TOP; t++) {
+        free_regs[t] = (1u << ir_allocatable_regs(t)) - 1;
+    }
+
+    IrInsn **active = crt_malloc(sizeof(IrInsn *) * (count ? count : 1));
+    int active_count = 0;
+    int next_call = 0;
+
+    for (int i = 0; i <= count; i++) {
+        IrInsn *v = i < count ? sorted[i] : NULL;
+        int start = v ? ra->start[v->id] : INT32_MAX;
+
+        // A call's own result starts at the call, after the snapshot
+        while (next_call < ra->call_count && ra->call_pos[next_call] <= start) {
+            int pos = ra->call_pos[next_call];
+            active_expire(ra, active, &active_count, free_regs, pos);
+            record_saves(ra, ra->calls[next_call++], pos, active, active_count);
+        }
+        if (!v) break;
+
+        active_expire(ra, active, &active_count, free_regs, start);
+        uint8_t t = v->tgq_type;
+        if (free_regs[t]) {
+            v->reg = __builtin_ctz(free_regs[t]);
+            free_regs[t] &= free_regs[t] - 1;
+            active_insert(ra, active, &active_count, v);
+            continue;
+        }
+
+        // Spill whichever of v and the active intervals of its file ends last
+        int victim = -1;
+        for (int a = active_count - 1; a >= 0; a--) {
+            if (active[a]->tgq_type == t) {
+                victim = a;
+                break;
+            }
+        }
+        if (victim >= 0 && ra->end[active[victim]->id] > ra->end[v->id]) {
+            IrInsn *spilled = active[victim];
+            v->reg = spilled->reg;
+            spilled->reg = -1;
+            memmove(active + victim, active + victim + 1, sizeof(IrInsn *) * (active_count - victim - 1));
+            active_count--;
+            active_insert(ra, active, &active_count, v);
+        } else {
+            v->reg = -1;
+        }
+    }
+
+    free(active);
+    free(sorted);
+}
+
+// ============================================================================
+// ENTRY POINT
+// ============================================================================
+
+void regalloc_function(IrFunction *fn) {
+    RegAlloc ra = {0};
+    ra.fn = fn;
+    ra.value_count = fn->next_value_id;
+    ra.words = (ra.value_count + 63) / 64;
+    if (!ra.words) ra.words = 1;
+
+    int n = ra.value_count ? ra.value_count : 1;
+    int blocks = fn->block_count ? fn->block_count : 1;
+    ra.values = crt_calloc(n, sizeof(IrInsn *));
+    ra.start = crt_malloc(sizeof(int) * n);
+    ra.end = crt_malloc(sizeof(int) * n);
+    ra.layout = crt_malloc(sizeof(int) * (fn->next_block_id ? fn->next_block_id : 1));
+    ra.block_start = crt_malloc(sizeof(int) * blocks);
+    ra.block_end = crt_malloc(sizeof(int) * blocks);
+    ra.live_in = crt_calloc((size_t)blocks * ra.words, sizeof(uint64_t));
+    ra.live_out = crt_calloc((size_t)blocks * ra.words, sizeof(uint64_t));
+    ra.calls = crt_malloc(sizeof(IrInsn *) * n);
+    ra.call_pos = crt_malloc(sizeof(int) * n);
+
+    regalloc_number(&ra);
+    regalloc_liveness(&ra);
+    regalloc_intervals(&ra);
+    regalloc_scan(&ra);
+
+    free(ra.values);
+    free(ra.start);
+    free(ra.end);
+    free(ra.layout);
+    free(ra.block_start);
+    free(ra.block_end);
+    free(ra.live_in);
+    free(ra.live_out);
+    free(ra.calls);
+    free(ra.call_pos);
+}
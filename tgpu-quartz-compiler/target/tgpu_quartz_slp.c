@@ -0,0 +1,389 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// SLP VECTORIZATION
+// ============================================================================
+
+// Superword-level parallelism (Larsen and Amarasinghe): scalar float
+// operations on the lanes of a vector are packed into one vector
+// operation. Packs are seeded where lanes come together: a vec_build, an
+// insert chain writing every lane, four stores to adjacent floats. From a
+// seed the lanes are followed while they are isomorphic:
+//   - the same arithmetic in every lane, each value used only there, for
+//     the add, sub, mul and div of the vector unit
+//   - lane i extracted from lane i of one vector: that vector
+//   - loads from adjacent addresses: one vector load
+// and anything else is gathered with a vec_build.
+//
+// A tree is rewritten when it is estimated to save instructions. isel
+// takes vectors apart in memory, so an insert costs about three
+// instructions, an extract two and a gather one per lane plus a load.
+
+#define SLP_LANE_SIZE   4     // Lanes of the language's vectors are fp32
+#define SLP_VECTOR_SIZE 16
+#define SLP_MAX_DEPTH   8
+
+#define SLP_INSERT_COST  3
+#define SLP_EXTRACT_COST 2
+
+typedef struct {
+    IrFunction *fn;
+    IrInsn *root;            // Packs are inserted right before it
+    TypeInfo *type;          // Vector type of every pack
+    int lanes;
+    bool emit;               // false while estimating
+    int gain;
+    bool vectorized;         // Some pack is more than a gather
+
+    // Scalars whose only use was packed; removed once the root is
+    IrInsn **dead;
+    int dead_count;
+    int dead_capacity;
+} Slp;
+
+// ============================================================================
+// MEMORY
+// ============================================================================
+
+// Whether `insn` may write the `size` bytes at `addr`; with `reads`, also
+// whether it may read them
+static bool slp_touches(IrInsn *insn, IrInsn *addr, int size, bool reads) {
+    switch (insn->op) {
+    case IR_STORE:
+        return ir_may_alias(insn->args[0], ir_tgq_size(insn->args[1]->tgq_type), addr, size);
+    case IR_LOAD:
+        return reads && ir_may_alias(insn->args[0], ir_tgq_size(insn->tgq_type), addr, size);
+    case IR_CALL:
+    case IR_COPY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// ============================================================================
+// PACKING
+// ============================================================================
+
+static void slp_kill(Slp *s, IrInsn *insn) {
+    if (!s->emit) return;
+    if (s->dead_count == s->dead_capacity) {
+        s->dead_capacity = s->dead_capacity ? s->dead_capacity * 2 : 16;
+        s->dead = crt_realloc(s->dead, sizeof(IrInsn *) * s->dead_capacity);
+    }
+    s->dead[s->dead_count++] = insn;
+}
+
+static IrInsn *slp_place(Slp *s, IrInsn *insn) {
+    ir_insn_move_before(insn, s->root);
+    return insn;
+}
+
+// The vector whose lane i every lane i extracts. A wider one serves as an
+// operand, but the root itself must keep its type.
+static IrInsn *slp_source_vector(Slp *s, IrInsn **lanes, int depth) {
+    if (lanes[0]->op != IR_EXTRACT) return NULL;
+    IrInsn *vec = lanes[0]->args[0];
+    if (vec->tgq_type != s->type->tgq_type || vec->components < s->lanes) return NULL;
+    if (depth == 0 && vec->type != s->type) return NULL;
+    for (int i = 0; i < s->lanes; i++) {
+        if (lanes[i]->op != IR_EXTRACT || lanes[i]->args[0] != vec || lanes[i]->imm.lane != i) {
+            return NULL;
+        }
+    }
+    return vec;
+}
+
+static bool slp_isomorphic(Slp *s, IrInsn **lanes) {
+    switch (lanes[0]->op) {
+    case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+        break;
+    default:
+        return false;
+    }
+    for (int i = 0; i < s->lanes; i++) {
+        if (lanes[i]->op != lanes[0]->op || lanes[i]->tgq_type != TGQ_FP32 ||
+            lanes[i]->use_count != 1 || lanes[i]->block != s->root->block) {
+            return false;
+        }
+        for (int j = 0; j < i; j++) {
+            if (lanes[j] == lanes[i]) return false;
+        }
+    }
+    return true;
+}
+
+// Loads of consecutive floats before the root with nothing in between that
+// may store to them. Loading a vector reads 16 bytes, which must stay in
+// the variable when fewer lanes are used.
+static bool slp_adjacent_loads(Slp *s, IrInsn **lanes) {
+    IrInsn *first = lanes[0];
+    if (first->op != IR_LOAD) return false;
+    IrAddress a = ir_address(first->args[0]);
+    for (int i = 0; i < s->lanes; i++) {
+        IrInsn *l = lanes[i];
+        if (l->op != IR_LOAD || l->tgq_type != TGQ_FP32 || l->space != first->space ||
+            l->block != s->root->block) {
+            return false;
+        }
+        IrAddress b = ir_address(l->args[0]);
+        if (!ir_same_base(a.base, b.base) || b.offset != a.offset + i * SLP_LANE_SIZE) return false;
+    }
+
+    if (s->lanes * SLP_LANE_SIZE < SLP_VECTOR_SIZE) {
+        Symbol *sym = a.base->op == IR_ADDR ? a.base->sym : NULL;
+        if (!sym || a.offset + SLP_VECTOR_SIZE > sym->stack_offset + sym->type->size) return false;
+    }
+
+    int found = 0;
+    for (IrInsn *insn = s->root->prev; insn; insn = insn->prev) {
+        bool lane = false;
+        for (int i = 0; i < s->lanes; i++) {
+            if (lanes[i] == insn) lane = true;
+        }
+        if (lane && ++found == s->lanes) return true;
+        if (!lane && slp_touches(insn, first->args[0], SLP_VECTOR_SIZE, false)) return false;
+    }
+    return false;
+}
+
+// Vector of `lanes`, or NULL while estimating
+static IrInsn *slp_pack(Slp *s, IrInsn **lanes, int depth) {
+    IrBlock *block = s->root->block;
+    int n = s->lanes;
+
+    IrInsn *vec = slp_source_vector(s, lanes, depth);
+    if (vec) {
+        for (int i = 0; i < n; i++) {
+            if (lanes[i]->use_count != 1) continue;
+            s->gain += SLP_EXTRACT_COST;
+            slp_kill(s, lanes[i]);
+        }
+        s->vectorized = true;
+        return vec;
+    }
+
+    if (slp_adjacent_loads(s, lanes)) {
+        s->gain--;
+        for (int i = 0; i < n; i++) {
+            if (lanes[i]->use_count != 1) continue;
+            s->gain++;
+            slp_kill(s, lanes[i]);
+        }
+        s->vectorized = true;
+        if (!s->emit) return NULL;
+        return slp_place(s, ir_load(block, s->type, lanes[0]->space, lanes[0]->args[0]));
+    }
+
+    if (depth < SLP_MAX_DEPTH && slp_isomorphic(s, lanes)) {
+        IrInsn *packed = NULL;
+        if (s->emit) packed = ir_insn_new(block, lanes[0]->op, s->type);
+        for (int a = 0; a < lanes[0]->arg_count; a++) {
+            IrInsn *operands[4];
+            for (int i = 0; i < n; i++) {
+                operands[i] = lanes[i]->args[a];
+            }
+            IrInsn *v = slp_pack(s, operands, depth + 1);
+            if (packed) ir_add_arg(s->fn, packed, v);
+        }
+        s->gain += n - 1;
+        s->vectorized = true;
+        for (int i = 0; i < n; i++) {
+            if (packed && lanes[i]->assigned) packed->assigned = true;
+            slp_kill(s, lanes[i]);
+        }
+        return packed ? slp_place(s, packed) : NULL;
+    }
+
+    s->gain -= n + 1;
+    if (!s->emit) return NULL;
+    IrInsn *gather = ir_insn_new(block, IR_VEC_BUILD, s->type);
+    for (int i = 0; i < n; i++) {
+        ir_add_arg(s->fn, gather, lanes[i]);
+    }
+    return slp_place(s, gather);
+}
+
+// Packs `lanes` at `root` if that pays off: `root_gain` is what the seed
+// itself saves. Returns the vector, with the packed scalars left in s->dead.
+static IrInsn *slp_try(Slp *s, IrInsn *root, TypeInfo *type, IrInsn **lanes, int root_gain) {
+    s->root = root;
+    s->type = type;
+    s->lanes = type->components;
+    s->emit = false;
+    s->gain = root_gain;
+    s->vectorized = false;
+    s->dead_count = 0;
+    slp_pack(s, lanes, 0);
+    if (!s->vectorized || s->gain <= 0) return NULL;
+
+    s->emit = true;
+    return slp_pack(s, lanes, 0);
+}
+
+static void slp_finish(Slp *s) {
+    for (int i = 0; i < s->dead_count; i++) {
+        ir_insn_remove(s->dead[i]);
+    }
+    ir_resolve_args(s->fn);
+    ir_count_uses(s->fn);
+}
+
+// ============================================================================
+// SEEDS
+// ============================================================================
+
+// Lanes of an insert chain ending at `root`, if it writes every lane
+static bool slp_insert_lanes(IrInsn *root, IrInsn **lanes, int *gain) {
+    memset(lanes, 0, sizeof(IrInsn *) * 4);
+    int covered = 0;
+    *gain = 0;
+    for (IrInsn *v = root; v->op == IR_INSERT; v = v->args[0]) {
+        if (v != root && v->use_count != 1) break;
+        *gain += SLP_INSERT_COST;
+        if (!lanes[v->imm.lane]) {
+            lanes[v->imm.lane] = v->args[1];
+            covered++;
+        }
+    }
+    return covered == root->components;
+}
+
+static void slp_vector_seed(Slp *s, IrInsn *root) {
+    IrInsn *lanes[4];
+    int gain;
+    if (root->op == IR_VEC_BUILD) {
+        if (root->arg_count != root->components) return;
+        memcpy(lanes, root->args, sizeof(IrInsn *) * root->arg_count);
+        gain = root->arg_count + 1;
+    } else if (!slp_insert_lanes(root, lanes, &gain)) {
+        return;
+    }
+
+    IrInsn *vec = slp_try(s, root, root->type, lanes, gain);
+    if (!vec) return;
+    for (IrInsn *v = root->args[0]; root->op == IR_INSERT && v->op == IR_INSERT &&
+                                    v->use_count == 1; v = v->args[0]) {
+        slp_kill(s, v);
+    }
+    ir_replace(root, vec);
+    slp_finish(s);
+}
+
+// Four scalar float stores that fill one vector
+static void slp_store_seeds(Slp *s, IrBlock *block) {
+    int count = 0, capacity = 0;
+    IrInsn **stores = NULL;
+    for (IrInsn *insn = block->first; insn; insn = insn->next) {
+        if (insn->op != IR_STORE || insn->args[1]->tgq_type != TGQ_FP32) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            stores = crt_realloc(stores, sizeof(IrInsn *) * capacity);
+        }
+        stores[count++] = insn;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!stores[i]) continue;
+        IrAddress a = ir_address(stores[i]->args[0]);
+        int group[4] = { i, -1, -1, -1 };
+        int found = 1;
+        for (int j = 0; j < count && found < 4; j++) {
+            if (!stores[j] || j == i || stores[j]->space != stores[i]->space) continue;
+            IrAddress b = ir_address(stores[j]->args[0]);
+            int lane = (b.offset - a.offset) / SLP_LANE_SIZE;
+            if (!ir_same_base(a.base, b.base) || b.offset - a.offset != lane * SLP_LANE_SIZE ||
+                lane < 1 || lane > 3 || group[lane] >= 0) {
+                continue;
+            }
+            group[lane] = j;
+            found++;
+        }
+        if (found < 4) continue;
+
+        // The stores all move down to the last one: nothing in between may
+        // read or write what an earlier one of them stored
+        int first = group[0], last = group[0];
+        for (int l = 1; l < 4; l++) {
+            if (group[l] < first) first = group[l];
+            if (group[l] > last) last = group[l];
+        }
+        IrInsn *moved[4];
+        int moved_count = 0;
+        bool blocked = false;
+        for (IrInsn *insn = stores[first]; insn != stores[last] && !blocked; insn = insn->next) {
+            bool member = false;
+            for (int l = 0; l < 4; l++) {
+                if (stores[group[l]] == insn) member = true;
+            }
+            if (member) {
+                moved[moved_count++] = insn;
+                continue;
+            }
+            for (int m = 0; m < moved_count && !blocked; m++) {
+                blocked = slp_touches(insn, moved[m]->args[0], SLP_LANE_SIZE, true);
+            }
+        }
+        if (blocked) continue;
+
+        IrInsn *lanes[4];
+        for (int l = 0; l < 4; l++) {
+            lanes[l] = stores[group[l]]->args[1];
+        }
+        IrInsn *root = stores[last];
+        IrInsn *vec = slp_try(s, root, TYPE_VEC4_INFO, lanes, 3);
+        if (!vec) continue;
+
+        slp_place(s, ir_store(block, root->space, stores[i]->args[0], vec));
+        for (int l = 0; l < 4; l++) {
+            slp_kill(s, stores[group[l]]);
+            stores[group[l]] = NULL;
+        }
+        slp_finish(s);
+    }
+    free(stores);
+}
+
+void ir_slp_function(IrFunction *fn) {
+    Slp s = { .fn = fn };
+    ir_count_uses(fn);
+
+    // Outermost inserts of chains are those no other insert builds on
+    int n = fn->next_value_id;
+    bool *inner = crt_calloc(n ? n : 1, sizeof(bool));
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            if (insn->op == IR_INSERT) inner[insn->args[0]->id] = true;
+        }
+    }
+
+    int count = 0, capacity = 0;
+    IrInsn **seeds = NULL;
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            bool seed = (insn->op == IR_VEC_BUILD || (insn->op == IR_INSERT && !inner[insn->id])) &&
+                        insn->tgq_type == TGQ_V4FP32;
+            if (!seed) continue;
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                seeds = crt_realloc(seeds, sizeof(IrInsn *) * capacity);
+            }
+            seeds[count++] = insn;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        slp_vector_seed(&s, seeds[i]);
+    }
+    for (int b = 0; b < fn->block_count; b++) {
+        slp_store_seeds(&s, fn->blocks[b]);
+    }
+
+    free(seeds);
+    free(inner);
+    free(s.dead);
+}
@@ -0,0 +1,466 @@
+#include "../crt.h"
+
+#include "tgpu_quartz_ir.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// STRENGTH REDUCTION
+// ============================================================================
+
+// Integer multiplies by a power of two become shifts left. Divisions and
+// remainders by one become a shift right and a mask, but only for
+// dividends known not to be negative: how a shift right treats the sign
+// bit is the target's business, as in folding. A float division by a
+// constant multiplies by its reciprocal when that is exact and normal, so
+// the result is the same bit for bit, or under -ffast-math whenever the
+// reciprocal is finite.
+//
+// In a loop, an integer a * i + b of an induction variable i, with `a`
+// constant and `b` computed outside the loop, gets a phi of its own that
+// starts at a * init + b and steps by a * step next to i. Array indexing
+// base + i * stride becomes a pointer bumped once per iteration. That add
+// pays off for values computed on every iteration that take a multiply,
+// or a shift and more, and only while i32 registers are left over by the
+// values the loop keeps live across its back edge: a spilled variable is
+// stored and reloaded on every iteration. Temporaries of the body are not
+// counted, as the value a variable replaces held one of its own for the
+// product, and a temporary spilled for a moment costs less than the
+// multiply. Only innermost loops get them, since a variable of an outer
+// loop is held through all of its inner ones, and loops that make calls
+// keep theirs, for the reason LICM leaves their invariants in place.
+
+#define SR_MAX_DEPTH 8       // Operands followed to prove a value not negative
+
+static bool sr_is_int(IrInsn *v) {
+    return v->components == 1 && (v->tgq_type == TGQ_I32 || v->tgq_type == TGQ_I64);
+}
+
+static bool sr_int_const(IrInsn *v, int64_t *value) {
+    if (v->op != IR_CONST || v->components != 1 || ir_tgq_is_float(v->tgq_type)) return false;
+    *value = ir_decode_int(v->tgq_type, v->imm.bits);
+    return true;
+}
+
+// k if `v` is the constant 2^k with k >= 1, else -1
+static int sr_log2(IrInsn *v) {
+    int64_t c;
+    if (!sr_int_const(v, &c) || c < 2 || (c & (c - 1))) return -1;
+    int k = 0;
+    while (((int64_t)1 << k) != c) k++;
+    return k;
+}
+
+// ============================================================================
+// SIGNS
+// ============================================================================
+
+static bool sr_non_negative(IrInsn *v, int depth);
+
+// A phi counting up by one from a value that is not negative while it
+// stays below a bound, so that it never wraps around: the header branches
+// to the body on phi < bound, and the increment comes after the body
+// starts, where phi + 1 is at most the bound
+static bool sr_counts_up(IrInsn *phi, int depth) {
+    IrBlock *header = phi->block;
+    IrInsn *branch = header->last;
+    if (phi->arg_count != 2 || !branch || branch->op != IR_BRANCH) return false;
+
+    IrInsn *cond = branch->args[0];
+    IrBlock *body = header->succs[0];
+    if (cond->op != IR_CMP || cond->imm.cmp != IR_CMP_LT || cond->args[0] != phi) return false;
+    if (body == header || body->pred_count != 1) return false;
+
+    for (int i = 0; i < 2; i++) {
+        IrInsn *next = phi->args[i], *start = phi->args[1 - i];
+        int64_t one;
+        if (next->op != IR_ADD || next->args[0] != phi || !sr_int_const(next->args[1], &one) || one != 1) {
+            continue;
+        }
+        if (ir_dominates(body, next->block) && sr_non_negative(start, depth + 1)) return true;
+    }
+    return false;
+}
+
+static bool sr_non_negative(IrInsn *v, int depth) {
+    if (depth > SR_MAX_DEPTH) return false;
+    int64_t c;
+    switch (v->op) {
+    case IR_CONST:
+        return sr_int_const(v, &c) && c >= 0;
+    case IR_AND:
+        return sr_non_negative(v->args[0], depth + 1) || sr_non_negative(v->args[1], depth + 1);
+    case IR_DIV:
+    case IR_REM:
+        return sr_int_const(v->args[1], &c) && c > 0 && sr_non_negative(v->args[0], depth + 1);
+    case IR_PHI:
+        return sr_counts_up(v, depth);
+    default:
+        return false;
+    }
+}
+
+// ============================================================================
+// POWERS OF TWO AND RECIPROCALS
+// ============================================================================
+
+// The constant `bits` of `type`, reusing one from the run of constants at
+// the front of the entry block, where ir_const_bits puts them, so that a
+// value the pass needs again and again is there once
+static IrInsn *sr_const(IrFunction *fn, TypeInfo *type, uint64_t bits) {
+    for (IrInsn *k = fn->blocks[0]->first; k && k->op == IR_CONST; k = k->next) {
+        if (k->type == type && k->imm.bits == bits) return k;
+    }
+    return ir_const_bits(fn, type, bits);
+}
+
+// Turns `insn` into a binary `op` with a constant second operand
+static void sr_rewrite(IrFunction *fn, IrInsn *insn, IrOp op, IrInsn *a, int64_t c) {
+    IrInsn *k = sr_const(fn, insn->type, ir_encode_int(insn->tgq_type, c));
+    insn->op = op;
+    insn->arg_count = 0;
+    ir_add_arg(fn, insn, a);
+    ir_add_arg(fn, insn, k);
+}
+
+static void sr_power_of_two(IrFunction *fn, IrInsn *insn) {
+    IrInsn *a = insn->args[0], *b = insn->args[1];
+    int k;
+    switch (insn->op) {
+    case IR_MUL:
+        if ((k = sr_log2(b)) >= 0) sr_rewrite(fn, insn, IR_SHL, a, k);
+        else if ((k = sr_log2(a)) >= 0) sr_rewrite(fn, insn, IR_SHL, b, k);
+        break;
+    case IR_DIV:
+        if ((k = sr_log2(b)) >= 0 && sr_non_negative(a, 0)) sr_rewrite(fn, insn, IR_SHR, a, k);
+        break;
+    case IR_REM:
+        if ((k = sr_log2(b)) >= 0 && sr_non_negative(a, 0)) {
+            sr_rewrite(fn, insn, IR_AND, a, ((int64_t)1 << k) - 1);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Bits of 1 / c in the format of the constant `c`, if dividing by `c` may
+// become multiplying by that
+static bool sr_reciprocal(IrInsn *c, bool fast_math, uint64_t *bits) {
+    if (c->op != IR_CONST || c->components != 1) return false;
+    float f = ir_decode_float(c->tgq_type, c->imm.bits);
+    if (f == 0.0f || !isfinite(f)) return false;
+
+    double r = 1.0 / f;
+    *bits = ir_encode_float(c->tgq_type, r);
+    float rounded = ir_decode_float(c->tgq_type, *bits);
+    if (rounded == 0.0f || !isfinite(rounded)) return false;
+    if (fast_math) return true;
+    double min_normal = ir_tgq_lane(c->tgq_type) == TGQ_FP16 ? 0x1p-14 : 0x1p-126;
+    return rounded == r && fabs(r) >= min_normal;
+}
+
+static void sr_float_division(IrFunction *fn, IrInsn *insn, bool fast_math) {
+    IrInsn *divisor = insn->args[1];
+    IrInsn *inverse;
+    uint64_t bits;
+
+    if (divisor->components == 1) {
+        if (!sr_reciprocal(divisor, fast_math, &bits)) return;
+        inverse = sr_const(fn, divisor->type, bits);
+    } else {
+        // A vector of constants, as scalars are splatted
+        if (divisor->op != IR_VEC_BUILD) return;
+        IrInsn *lanes[4];
+        for (int i = 0; i < divisor->arg_count; i++) {
+            IrInsn *lane = divisor->args[i];
+            if (!sr_reciprocal(lane, fast_math, &bits)) return;
+            lanes[i] = sr_const(fn, lane->type, bits);
+        }
+        inverse = ir_insn_new(insn->block, IR_VEC_BUILD, divisor->type);
+        for (int i = 0; i < divisor->arg_count; i++) ir_add_arg(fn, inverse, lanes[i]);
+        ir_insn_move_before(inverse, insn);
+    }
+    insn->op = IR_MUL;
+    insn->args[1] = inverse;
+}
+
+// ============================================================================
+// INDUCTION VARIABLES
+// ============================================================================
+
+// A value of the loop as scale * iv + something computed outside it
+typedef struct {
+    IrInsn *iv;              // Basic induction variable, NULL if not affine
+    uint64_t scale;
+    bool multiplies;         // Takes a multiply or shift to compute
+    int cost;                // Instructions it takes, a multiply counting twice
+    bool root;               // Something other than such a value uses it
+
+    // The part from outside as base + offset when that is all it is, so
+    // that values apart by a constant share a variable
+    bool linear;
+    IrInsn *base;            // NULL for none
+    uint64_t offset;
+} SrAffine;
+
+// A variable added to the loop
+typedef struct {
+    IrInsn *var;
+    SrAffine *value;
+} SrVar;
+
+typedef struct {
+    IrFunction *fn;
+    IrBlock **order;         // Reachable blocks in reverse postorder
+    int order_count;
+    SrAffine *affine;        // By value id, for the values of the loop
+    int value_count;         // Values there were when the loop was looked at
+} Sr;
+
+// Whether `phi` of the header starts from outside the loop and adds a
+// constant on the back edge
+static bool sr_basic_iv(IrLoop *loop, IrInsn *phi) {
+    IrBlock *header = loop->header;
+    if (phi->op != IR_PHI || !sr_is_int(phi) || header->pred_count != 2) return false;
+
+    int64_t step;
+    for (int i = 0; i < 2; i++) {
+        IrInsn *next = phi->args[i];
+        if (!loop->blocks[header->preds[i]->id] || loop->blocks[phi->args[1 - i]->block->id]) continue;
+        if (next->op == IR_ADD && next->args[0] == phi && sr_int_const(next->args[1], &step)) return true;
+    }
+    return false;
+}
+
+// i32 registers the loop keeps busy across its back edge: its phis and
+// the values from outside it uses
+static int sr_busy_registers(Sr *s, IrLoop *loop) {
+    bool *seen = crt_calloc(s->value_count, sizeof(bool));
+    int count = 0;
+    for (int b = 0; b < s->order_count; b++) {
+        IrBlock *block = s->order[b];
+        if (!loop->blocks[block->id]) continue;
+        for (IrInsn *insn = block->first; insn; insn = insn->next) {
+            if (block == loop->header && insn->op == IR_PHI && insn->tgq_type == TGQ_I32) count++;
+            for (int i = 0; i < insn->arg_count; i++) {
+                IrInsn *arg = insn->args[i];
+                if (arg->tgq_type != TGQ_I32 || !ir_is_allocated(arg) || seen[arg->id]) continue;
+                if (loop->blocks[arg->block->id]) continue;
+                seen[arg->id] = true;
+                count++;
+            }
+        }
+    }
+    free(seen);
+    return count;
+}
+
+static bool sr_invariant(IrLoop *loop, IrInsn *v) {
+    return !loop->blocks[v->block->id];
+}
+
+static void sr_classify(Sr *s, IrLoop *loop, IrInsn *insn) {
+    SrAffine *out = &s->affine[insn->id];
+    memset(out, 0, sizeof(SrAffine));
+    if (!sr_is_int(insn) || insn->arg_count != 2) return;
+
+    IrInsn *x = insn->args[0], *y = insn->args[1];
+    SrAffine *ax = &s->affine[x->id], *ay = &s->affine[y->id];
+    int64_t c;
+    switch (insn->op) {
+    case IR_ADD:
+        if (ax->iv && sr_invariant(loop, y)) {
+            *out = *ax;
+        } else if (ay->iv && sr_invariant(loop, x)) {
+            *out = *ay;
+            y = x;
+        } else {
+            return;
+        }
+        if (sr_int_const(y, &c)) out->offset += (uint64_t)c;
+        else if (!out->base) out->base = y;
+        else out->linear = false;
+        break;
+    case IR_SUB:
+        if (!ax->iv || !sr_invariant(loop, y)) return;
+        *out = *ax;
+        if (sr_int_const(y, &c)) out->offset -= (uint64_t)c;
+        else out->linear = false;
+        break;
+    case IR_MUL:
+        if (ax->iv && sr_int_const(y, &c)) {
+            *out = *ax;
+        } else if (ay->iv && sr_int_const(x, &c)) {
+            *out = *ay;
+        } else {
+            return;
+        }
+        out->scale *= (uint64_t)c;
+        out->offset *= (uint64_t)c;
+        out->linear &= !out->base;
+        out->multiplies = true;
+        break;
+    case IR_SHL:
+        if (!ax->iv || !sr_int_const(y, &c) || c < 0 || c >= 64) return;
+        *out = *ax;
+        out->scale <<= c;
+        out->offset <<= c;
+        out->linear &= !out->base;
+        out->multiplies = true;
+        break;
+    default:
+        return;
+    }
+    out->root = false;
+    out->cost += insn->op == IR_MUL ? 2 : 1;
+    if (out->iv && out->iv->tgq_type != insn->tgq_type) out->iv = NULL;
+}
+
+// Computes `v` at the preheader, where its induction variable is `start`
+static IrInsn *sr_start(Sr *s, IrLoop *loop, IrInsn *v, IrInsn *iv, IrInsn *start, IrInsn *pos) {
+    if (v == iv) return start;
+    if (sr_invariant(loop, v)) return v;
+
+    IrInsn *a = sr_start(s, loop, v->args[0], iv, start, pos);
+    IrInsn *b = sr_start(s, loop, v->args[1], iv, start, pos);
+    IrInsn *copy = ir_binary(pos->block, v->op, v->type, a, b);
+    ir_insn_move_before(copy, pos);
+    return copy;
+}
+
+static void sr_loop(Sr *s, IrLoop *loop) {
+    if (!loop->preheader || loop->has_call) return;
+    IrBlock *header = loop->header;
+    int pre = header->preds[0] == loop->preheader ? 0 : 1;
+
+    // Phis first: values of the loop come after their operands in reverse
+    // postorder, except through phis
+    bool any = false;
+    for (IrInsn *phi = header->first; phi && phi->op == IR_PHI; phi = phi->next) {
+        if (!sr_basic_iv(loop, phi)) continue;
+        SrAffine *a = &s->affine[phi->id];
+        a->iv = phi;
+        a->scale = 1;
+        a->linear = true;
+        any = true;
+    }
+    if (!any) return;
+
+    for (int b = 0; b < s->order_count; b++) {
+        IrBlock *block = s->order[b];
+        if (!loop->blocks[block->id]) continue;
+        for (IrInsn *insn = block->first; insn; insn = insn->next) {
+            if (insn->op != IR_PHI) sr_classify(s, loop, insn);
+        }
+    }
+
+    // A value is replaced where something besides its own kind uses it
+    for (int b = 0; b < s->fn->block_count; b++) {
+        for (IrInsn *insn = s->fn->blocks[b]->first; insn; insn = insn->next) {
+            SrAffine *self = loop->blocks[insn->block->id] ? &s->affine[insn->id] : NULL;
+            for (int i = 0; i < insn->arg_count; i++) {
+                SrAffine *arg = &s->affine[insn->args[i]->id];
+                if (!arg->iv || !loop->blocks[insn->args[i]->block->id]) continue;
+                if (!self || self->iv != arg->iv || insn->op == IR_PHI) arg->root = true;
+            }
+        }
+    }
+
+    // A value apart by a constant from a variable added before is that
+    // plus the constant. Otherwise values computed on some iterations only
+    // would now cost an add on all.
+    IrBlock *latch = header->preds[1 - pre];
+    int room = ir_allocatable_regs(TGQ_I32) - sr_busy_registers(s, loop);
+    SrVar *vars = crt_malloc(sizeof(SrVar) * (room > 0 ? room : 1));
+    int var_count = 0;
+    for (int b = 0; b < s->order_count; b++) {
+        IrBlock *block = s->order[b];
+        if (!loop->blocks[block->id]) continue;
+        IrInsn *next;
+        for (IrInsn *insn = block->first; insn; insn = next) {
+            next = insn->next;
+            if (insn->op == IR_PHI || insn->id >= s->value_count) continue;
+            SrAffine *a = &s->affine[insn->id];
+            if (!a->iv || !a->multiplies || a->cost < 2 || !a->root) continue;
+
+            SrVar *same = NULL;
+            for (int i = 0; i < var_count && !same && a->linear; i++) {
+                SrAffine *v = vars[i].value;
+                if (v->linear && v->iv == a->iv && v->scale == a->scale && v->base == a->base) same = &vars[i];
+            }
+            if (same) {
+                IrInsn *value = same->var;
+                if (a->offset != same->value->offset) {
+                    IrInsn *k = sr_const(s->fn, insn->type,
+                                         ir_encode_int(insn->tgq_type, (int64_t)(a->offset - same->value->offset)));
+                    value = ir_binary(block, IR_ADD, insn->type, same->var, k);
+                    ir_insn_move_before(value, insn);
+                }
+                ir_replace(insn, value);
+                continue;
+            }
+            if (var_count >= room || !ir_dominates(block, latch)) continue;
+
+            IrInsn *iv = a->iv;
+            IrInsn *iv_next = iv->args[1 - pre];
+            int64_t step;
+            sr_int_const(iv_next->args[1], &step);
+
+            IrInsn *start = sr_start(s, loop, insn, iv, iv->args[pre], loop->preheader->last);
+            IrInsn *var = ir_phi(header, insn->type, NULL);
+            IrInsn *bump = sr_const(s->fn, insn->type,
+                                    ir_encode_int(insn->tgq_type, (int64_t)(a->scale * (uint64_t)step)));
+            IrInsn *var_next = ir_binary(iv_next->block, IR_ADD, insn->type, var, bump);
+            ir_insn_move_before(var_next, iv_next->next);
+            for (int p = 0; p < 2; p++) ir_add_arg(s->fn, var, p == pre ? start : var_next);
+
+            ir_replace(insn, var);
+            vars[var_count].var = var;
+            vars[var_count].value = a;
+            var_count++;
+        }
+    }
+    free(vars);
+    ir_resolve_args(s->fn);
+}
+
+// ============================================================================
+// PASS
+// ============================================================================
+
+void ir_strength_function(IrFunction *fn, bool fast_math) {
+    if (fn->block_count == 0) return;
+    ir_compute_dominators(fn);
+
+    for (int b = 0; b < fn->block_count; b++) {
+        for (IrInsn *insn = fn->blocks[b]->first; insn; insn = insn->next) {
+            if (insn->arg_count != 2) continue;
+            if (sr_is_int(insn)) sr_power_of_two(fn, insn);
+            else if (insn->op == IR_DIV && ir_tgq_is_float(insn->tgq_type)) sr_float_division(fn, insn, fast_math);
+        }
+    }
+
+    Sr s;
+    memset(&s, 0, sizeof(s));
+    s.fn = fn;
+    s.order = crt_malloc(sizeof(IrBlock*) * fn->block_count);
+    s.order_count = ir_reverse_postorder(fn, s.order);
+
+    IrLoop *loops;
+    int loop_count = ir_find_loops(fn, &loops);
+    for (int i = 0; i < loop_count; i++) {
+        bool innermost = true;
+        for (int j = 0; j < loop_count && innermost; j++) {
+            innermost = j == i || !loops[i].blocks[loops[j].header->id];
+        }
+        if (!innermost) continue;
+        s.value_count = fn->next_value_id;
+        s.affine = crt_calloc(s.value_count, sizeof(SrAffine));
+        sr_loop(&s, &loops[i]);
+        free(s.affine);
+    }
+    ir_free_loops(loops, loop_count);
+    free(s.order);
+}
@@ -1,39 +1,28 @@
+#include "../crt.h"
+
 #include "tgpu_quartz_symtab.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-// ============================================================================
-// HASH FUNCTION
-// ============================================================================
-
-static unsigned int hash_string(const char *str) {
-    unsigned int hash = 5381;
-    int c;
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash % SYMTAB_HASH_SIZE;
-}
-
 // ============================================================================
 // SCOPE MANAGEMENT
 // ============================================================================
 
+// Symbol and child storage is allocated on first use, so an empty block
+// scope costs just the Scope itself.
 static Scope *scope_create(Scope *parent, int level) {
-    Scope *s = calloc(1, sizeof(Scope));
+    Scope *s = crt_calloc(1, sizeof(Scope));
     s->parent = parent;
     s->scope_level = level;
-    s->child_capacity = 4;
-    s->children = malloc(sizeof(Scope*) * s->child_capacity);
     s->stack_offset = parent ? parent->stack_offset : 0;
     return s;
 }
 
 static void scope_add_child(Scope *parent, Scope *child) {
     if (parent->child_count >= parent->child_capacity) {
-        parent->child_capacity *= 2;
-        parent->children = realloc(parent->children,
+        parent->child_capacity = parent->child_capacity ? parent->child_capacity * 2 : 4;
+        parent->children = crt_realloc(parent->children,
                                    sizeof(Scope*) * parent->child_capacity);
     }
     parent->children[parent->child_count++] = child;
@@ -43,16 +32,14 @@ static void scope_destroy(Scope *s) {
     if (!s) return;
 
     // Free symbols
-    for (int i = 0; i < SYMTAB_HASH_SIZE; i++) {
-        Symbol *sym = s->buckets[i];
-        while (sym) {
-            Symbol *next = sym->next;
-            free(sym->name);
+    for (int i = 0; i < s->capacity; i++) {
+        Symbol *sym = s->slots[i];
+        if (sym) {
             if (sym->params) free(sym->params);
             free(sym);
-            sym = next;
         }
     }
+    free(s->slots);
 
     // Free children
     for (int i = 0; i < s->child_count; i++) {
@@ -62,21 +49,77 @@ static void scope_destroy(Scope *s) {
     free(s);
 }
 
+// ============================================================================
+// SCOPE HASH TABLE
+// ============================================================================
+
+// Each scope is an open-addressing table with linear probing. Names are
+// interned, so the probe start comes from the precomputed hash and entries
+// are matched by pointer.
+
+static Symbol *scope_find(Scope *s, const char *name) {
+    if (s->capacity == 0) return NULL;
+
+    unsigned int mask = s->capacity - 1;
+    unsigned int i = str_hash(name) & mask;
+    Symbol *sym;
+    while ((sym = s->slots[i]) != NULL) {
+        if (sym->name == name) {
+            return sym;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void scope_place(Symbol **slots, int capacity, Symbol *sym) {
+    unsigned int mask = capacity - 1;
+    unsigned int i = str_hash(sym->name) & mask;
+    while (slots[i]) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = sym;
+}
+
+static void scope_grow(Scope *s) {
+    int capacity = s->capacity ? s->capacity * 2 : SCOPE_INITIAL_CAPACITY;
+    Symbol **slots = crt_calloc(capacity, sizeof(Symbol*));
+
+    for (int i = 0; i < s->capacity; i++) {
+        if (s->slots[i]) {
+            scope_place(slots, capacity, s->slots[i]);
+        }
+    }
+
+    free(s->slots);
+    s->slots = slots;
+    s->capacity = capacity;
+}
+
+static void scope_insert(Scope *s, Symbol *sym) {
+    // Keep the load factor at or below 3/4
+    if ((s->symbol_count + 1) * 4 > s->capacity * 3) {
+        scope_grow(s);
+    }
+    scope_place(s->slots, s->capacity, sym);
+    s->symbol_count++;
+}
+
 // ============================================================================
 // SYMBOL TABLE CREATION
 // ============================================================================
 
 SymbolTable *symtab_create(void) {
-    SymbolTable *st = calloc(1, sizeof(SymbolTable));
+    SymbolTable *st = crt_calloc(1, sizeof(SymbolTable));
     st->global = scope_create(NULL, 0);
     st->current = st->global;
     st->scope_depth = 0;
 
     st->struct_capacity = 16;
-    st->structs = malloc(sizeof(StructInfo*) * st->struct_capacity);
+    st->structs = crt_malloc(sizeof(StructInfo*) * st->struct_capacity);
 
     st->func_capacity = 32;
-    st->functions = malloc(sizeof(Symbol*) * st->func_capacity);
+    st->functions = crt_malloc(sizeof(Symbol*) * st->func_capacity);
 
     return st;
 }
@@ -107,6 +150,19 @@ void symtab_exit_scope(SymbolTable *st) {
     }
 }
 
+Scope *symtab_enter_function_scope(SymbolTable *st) {
+    Scope *outer = st->current;
+    st->current = st->global;
+    st->scope_depth = 0;
+    symtab_enter_scope(st);
+    return outer;
+}
+
+void symtab_exit_function_scope(SymbolTable *st, Scope *outer) {
+    st->current = outer;
+    st->scope_depth = outer->scope_level;
+}
+
 int symtab_scope_depth(SymbolTable *st) {
     return st->scope_depth;
 }
@@ -117,24 +173,18 @@ int symtab_scope_depth(SymbolTable *st) {
 
 static Symbol *symbol_create(const char *name, SymbolKind kind,
                              TypeInfo *type, StorageClass storage, int level) {
-    Symbol *sym = calloc(1, sizeof(Symbol));
-    sym->name = strdup(name);
+    Symbol *sym = crt_calloc(1, sizeof(Symbol));
+    sym->name = name;
     sym->kind = kind;
     sym->type = type;
     sym->storage = storage;
     sym->scope_level = level;
     sym->reg_index = -1;
     sym->stack_offset = -1;
+    sym->ssa_var = -1;
     return sym;
 }
 
-static void scope_insert(Scope *s, Symbol *sym) {
-    unsigned int h = hash_string(sym->name);
-    sym->next = s->buckets[h];
-    s->buckets[h] = sym;
-    s->symbol_count++;
-}
-
 Symbol *symtab_define(SymbolTable *st, const char *name, SymbolKind kind,
                       TypeInfo *type, StorageClass storage) {
     // Check for duplicate in current scope
@@ -163,7 +213,7 @@ Symbol *symtab_define_function(SymbolTable *st, const char *name,
                                TypeInfo *return_type, Symbol **params, int param_count) {
     TypeInfo **param_types = NULL;
     if (param_count > 0) {
-        param_types = malloc(sizeof(TypeInfo*) * param_count);
+        param_types = crt_malloc(sizeof(TypeInfo*) * param_count);
         for (int i = 0; i < param_count; i++) {
             param_types[i] = params[i]->type;
         }
@@ -180,7 +230,7 @@ Symbol *symtab_define_function(SymbolTable *st, const char *name,
         // Register function
         if (st->func_count >= st->func_capacity) {
             st->func_capacity *= 2;
-            st->functions = realloc(st->functions, sizeof(Symbol*) * st->func_capacity);
+            st->functions = crt_realloc(st->functions, sizeof(Symbol*) * st->func_capacity);
         }
         st->functions[st->func_count++] = sym;
     }
@@ -193,43 +243,24 @@ Symbol *symtab_define_function(SymbolTable *st, const char *name,
 // ============================================================================
 
 Symbol *symtab_lookup_local(SymbolTable *st, const char *name) {
-    unsigned int h = hash_string(name);
-    Symbol *sym = st->current->buckets[h];
-    while (sym) {
-        if (strcmp(sym->name, name) == 0) {
-            return sym;
-        }
-        sym = sym->next;
-    }
-    return NULL;
+    return scope_find(st->current, name);
 }
 
 Symbol *symtab_lookup(SymbolTable *st, const char *name) {
-    unsigned int h = hash_string(name);
-
     // Search from current scope up to global
-    Scope *s = st->current;
-    while (s) {
-        Symbol *sym = s->buckets[h];
-        while (sym) {
-            if (strcmp(sym->name, name) == 0) {
-                return sym;
-            }
-            sym = sym->next;
+    for (Scope *s = st->current; s; s = s->parent) {
+        Symbol *sym = scope_find(s, name);
+        if (sym) {
+            return sym;
         }
-        s = s->parent;
     }
 
     return NULL;
 }
 
 Symbol *symtab_lookup_function(SymbolTable *st, const char *name) {
-    for (int i = 0; i < st->func_count; i++) {
-        if (strcmp(st->functions[i]->name, name) == 0) {
-            return st->functions[i];
-        }
-    }
-    return NULL;
+    Symbol *sym = scope_find(st->global, name);
+    return sym && sym->kind == SYM_FUNCTION ? sym : NULL;
 }
 
 // ============================================================================
@@ -239,22 +270,22 @@ Symbol *symtab_lookup_function(SymbolTable *st, const char *name) {
 void symtab_register_struct(SymbolTable *st, StructInfo *info) {
     if (st->struct_count >= st->struct_capacity) {
         st->struct_capacity *= 2;
-        st->structs = realloc(st->structs, sizeof(StructInfo*) * st->struct_capacity);
+        st->structs = crt_realloc(st->structs, sizeof(StructInfo*) * st->struct_capacity);
     }
     st->structs[st->struct_count++] = info;
 
-    // Also add to symbol table as a type
+    // Also add to symbol table as a type; the symbol remembers the
+    // registered StructInfo so symtab_find_struct is a hash lookup
     TypeInfo *struct_type = type_make_struct(info->name, info->fields, info->field_count);
-    symtab_define(st, info->name, SYM_STRUCT, struct_type, STORAGE_GLOBAL);
+    Symbol *sym = symtab_define(st, info->name, SYM_STRUCT, struct_type, STORAGE_GLOBAL);
+    if (sym) {
+        sym->struct_info = info;
+    }
 }
 
 StructInfo *symtab_find_struct(SymbolTable *st, const char *name) {
-    for (int i = 0; i < st->struct_count; i++) {
-        if (strcmp(st->structs[i]->name, name) == 0) {
-            return st->structs[i];
-        }
-    }
-    return NULL;
+    Symbol *sym = scope_find(st->global, name);
+    return sym && sym->kind == SYM_STRUCT ? sym->struct_info : NULL;
 }
 
 // ============================================================================
@@ -303,9 +334,9 @@ static const char *symbol_kind_name(SymbolKind k) {
 }
 
 static void dump_scope(Scope *s, FILE *out, int indent) {
-    for (int i = 0; i < SYMTAB_HASH_SIZE; i++) {
-        Symbol *sym = s->buckets[i];
-        while (sym) {
+    for (int i = 0; i < s->capacity; i++) {
+        Symbol *sym = s->slots[i];
+        if (sym) {
             fprintf(out, "%*s%s '%s' : %s %s",
                     indent, "",
                     symbol_kind_name(sym->kind),
@@ -320,8 +351,6 @@ static void dump_scope(Scope *s, FILE *out, int indent) {
                 fprintf(out, " stack=%d", sym->stack_offset);
             }
             fprintf(out, "\n");
-
-            sym = sym->next;
         }
     }
 
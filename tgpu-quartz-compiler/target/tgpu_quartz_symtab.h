@@ -40,7 +40,7 @@ typedef struct Symbol Symbol;
 typedef struct Scope Scope;
 
 struct Symbol {
-    char *name;
+    const char *name;        // Interned
     SymbolKind kind;
     TypeInfo *type;
     StorageClass storage;
@@ -55,27 +55,35 @@ struct Symbol {
     // Code generation info
     int reg_index;           // Assigned register (-1 if in memory)
     RegisterClass reg_class; // Which register file
-    int stack_offset;        // Offset in local memory
+    int stack_offset;        // Offset in local memory (data section for globals)
     int stack_type;
+    int ssa_var;             // SSA variable of a register-resident local, -1 if in memory
+    struct ASTNode *initializer;  // Compile-time constants: initializer expression
 
     // For functions
     struct ASTNode *func_body;    // Function body AST (forward decl)
     Symbol **params;              // Parameter symbols
     int param_count;
     int local_count;              // Number of local variables
+    struct IrFunction *ir_func;   // IR of the function, created by the lowering
+    int call_sites;               // Calls of it in the program
+    bool always_inline;           // __attribute__((always_inline))
+    bool noinline;                // __attribute__((noinline))
 
-    // Hash chain
-    Symbol *next;
+    // For structs
+    StructInfo *struct_info;      // Info passed to symtab_register_struct
 };
 
 // ============================================================================
 // SCOPE STRUCTURE
 // ============================================================================
 
-#define SYMTAB_HASH_SIZE 64
+// Slots allocated on the first insert; always a power of two
+#define SCOPE_INITIAL_CAPACITY 4
 
 struct Scope {
-    Symbol *buckets[SYMTAB_HASH_SIZE];
+    Symbol **slots;          // Open-addressing table, NULL while empty
+    int capacity;
     int symbol_count;
     int scope_level;
 
@@ -112,6 +120,9 @@ typedef struct {
 // SYMBOL TABLE API
 // ============================================================================
 
+// All names passed to the symbol table must be interned (str_intern); names
+// taken from the AST already are. Lookups compare names by pointer.
+
 // Create/destroy
 SymbolTable *symtab_create(void);
 void symtab_destroy(SymbolTable *st);
@@ -121,6 +132,12 @@ void symtab_enter_scope(SymbolTable *st);
 void symtab_exit_scope(SymbolTable *st);
 int symtab_scope_depth(SymbolTable *st);
 
+// A scope right below the global one, whatever the current scope, for a
+// function body lowered inside another function; returns the scope to go
+// back to with symtab_exit_function_scope
+Scope *symtab_enter_function_scope(SymbolTable *st);
+void symtab_exit_function_scope(SymbolTable *st, Scope *outer);
+
 // Symbol definition
 Symbol *symtab_define(SymbolTable *st, const char *name, SymbolKind kind,
                       TypeInfo *type, StorageClass storage);
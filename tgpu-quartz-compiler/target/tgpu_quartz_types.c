@@ -1,3 +1,5 @@
+#include "../crt.h"
+
 #include "tgpu_quartz_types.h"
 #include <stdlib.h>
 #include <string.h>
@@ -35,65 +37,167 @@ typedef struct {
     RegisterClass reg_class;
 } TypeMapping;
 
-static TypeMapping type_mappings[] = {
+// Indexed by BuiltinType; the lexer's reserved word table resolves a type
+// name to its slot here.
+static TypeMapping type_mappings[BUILTIN_TYPE_COUNT] = {
     // Scalars
-    {"void",       TYPE_VOID,   0,           0,  0, REGCLASS_NONE},
-    {"bool",       TYPE_BOOL,   TGQ_I8,      1,  1, REGCLASS_SCALAR_I8},
-    {"int",        TYPE_INT,    TGQ_I32,     4,  1, REGCLASS_SCALAR_I32},
-    {"float",      TYPE_FLOAT,  TGQ_FP32,    4,  1, REGCLASS_SCALAR_FP32},
-    {"double",     TYPE_DOUBLE, TGQ_I64,     8,  1, REGCLASS_SCALAR_I64},
-    {"char",       TYPE_CHAR,   TGQ_I8,      1,  1, REGCLASS_SCALAR_I8},
-    {"fp16",       TYPE_FLOAT,  TGQ_FP16,    2,  1, REGCLASS_SCALAR_FP16},
-    {"bf16",       TYPE_FLOAT,  TGQ_BF16,    2,  1, REGCLASS_SCALAR_BF16},
+    [BUILTIN_VOID]   = {"void",       TYPE_VOID,   0,           0,  0, REGCLASS_NONE},
+    [BUILTIN_BOOL]   = {"bool",       TYPE_BOOL,   TGQ_I8,      1,  1, REGCLASS_SCALAR_I8},
+    [BUILTIN_INT]    = {"int",        TYPE_INT,    TGQ_I32,     4,  1, REGCLASS_SCALAR_I32},
+    [BUILTIN_FLOAT]  = {"float",      TYPE_FLOAT,  TGQ_FP32,    4,  1, REGCLASS_SCALAR_FP32},
+    [BUILTIN_DOUBLE] = {"double",     TYPE_DOUBLE, TGQ_I64,     8,  1, REGCLASS_SCALAR_I64},
+    [BUILTIN_CHAR]   = {"char",       TYPE_CHAR,   TGQ_I8,      1,  1, REGCLASS_SCALAR_I8},
+    [BUILTIN_FP16]   = {"fp16",       TYPE_FLOAT,  TGQ_FP16,    2,  1, REGCLASS_SCALAR_FP16},
+    [BUILTIN_BF16]   = {"bf16",       TYPE_FLOAT,  TGQ_BF16,    2,  1, REGCLASS_SCALAR_BF16},
+    [BUILTIN_BF32]   = {"bf32",       TYPE_FLOAT,  TGQ_BF32,    4,  1, REGCLASS_SCALAR_BF32},
 
     // Float vectors
-    {"vec2",       TYPE_VEC2,   TGQ_V4FP32,   16,  2, REGCLASS_VECTOR},
-    {"vec3",       TYPE_VEC3,   TGQ_V4FP32,   16,  3, REGCLASS_VECTOR},
-    {"vec4",       TYPE_VEC4,   TGQ_V4FP32,   16,  4, REGCLASS_VECTOR},
+    [BUILTIN_VEC2]   = {"vec2",       TYPE_VEC2,   TGQ_V4FP32,   16,  2, REGCLASS_VECTOR},
+    [BUILTIN_VEC3]   = {"vec3",       TYPE_VEC3,   TGQ_V4FP32,   16,  3, REGCLASS_VECTOR},
+    [BUILTIN_VEC4]   = {"vec4",       TYPE_VEC4,   TGQ_V4FP32,   16,  4, REGCLASS_VECTOR},
 
     // Int vectors
-    {"ivec2",      TYPE_IVEC2,  TGQ_V4I32,       16,  2, REGCLASS_VECTOR},
-    {"ivec3",      TYPE_IVEC3,  TGQ_V4I32,       16,  3, REGCLASS_VECTOR},
-    {"ivec4",      TYPE_IVEC4,  TGQ_V4I32,       16,  4, REGCLASS_VECTOR},
+    [BUILTIN_IVEC2]  = {"ivec2",      TYPE_IVEC2,  TGQ_V4I32,       16,  2, REGCLASS_VECTOR},
+    [BUILTIN_IVEC3]  = {"ivec3",      TYPE_IVEC3,  TGQ_V4I32,       16,  3, REGCLASS_VECTOR},
+    [BUILTIN_IVEC4]  = {"ivec4",      TYPE_IVEC4,  TGQ_V4I32,       16,  4, REGCLASS_VECTOR},
 
     // Bool vectors
-    {"bvec2",      TYPE_BVEC2,  TGQ_V4I32,    16,  2, REGCLASS_VECTOR},
-    {"bvec3",      TYPE_BVEC3,  TGQ_V4I32,    16,  3, REGCLASS_VECTOR},
-    {"bvec4",      TYPE_BVEC4,  TGQ_V4I32,    16,  4, REGCLASS_VECTOR},
+    [BUILTIN_BVEC2]  = {"bvec2",      TYPE_BVEC2,  TGQ_V4I32,    16,  2, REGCLASS_VECTOR},
+    [BUILTIN_BVEC3]  = {"bvec3",      TYPE_BVEC3,  TGQ_V4I32,    16,  3, REGCLASS_VECTOR},
+    [BUILTIN_BVEC4]  = {"bvec4",      TYPE_BVEC4,  TGQ_V4I32,    16,  4, REGCLASS_VECTOR},
 
-    // Matrices
-    {"mat2",       TYPE_MAT2,   TGQ_FP32,   16,  4, REGCLASS_MATRIX},
-    {"mat3",       TYPE_MAT3,   TGQ_FP32,   36,  9, REGCLASS_MATRIX},
-    {"mat4",       TYPE_MAT4,   TGQ_FP32,   64, 16, REGCLASS_MATRIX},
+    // Matrices: tiles of the matrix file, stored column by column with every
+    // column padded to 16 bytes so that it is a single vector load
+    [BUILTIN_MAT2]   = {"mat2",       TYPE_MAT2,   TGQ_MATRIX, 32,  4, REGCLASS_MATRIX},
+    [BUILTIN_MAT3]   = {"mat3",       TYPE_MAT3,   TGQ_MATRIX, 48,  9, REGCLASS_MATRIX},
+    [BUILTIN_MAT4]   = {"mat4",       TYPE_MAT4,   TGQ_MATRIX, 64, 16, REGCLASS_MATRIX},
 
     // Samplers
-    {"sampler2D",  TYPE_SAMPLER2D,   TGQ_I64, 8, 1, REGCLASS_SCALAR_I64},
-    {"sampler3D",  TYPE_SAMPLER3D,   TGQ_I64, 8, 1, REGCLASS_SCALAR_I64},
-    {"samplerCube",TYPE_SAMPLERCUBE, TGQ_I64, 8, 1, REGCLASS_SCALAR_I64},
-
-    {NULL, 0, 0, 0, 0, 0}
+    [BUILTIN_SAMPLER2D]   = {"sampler2D",  TYPE_SAMPLER2D,   TGQ_I64, 8, 1, REGCLASS_SCALAR_I64},
+    [BUILTIN_SAMPLER3D]   = {"sampler3D",  TYPE_SAMPLER3D,   TGQ_I64, 8, 1, REGCLASS_SCALAR_I64},
+    [BUILTIN_SAMPLERCUBE] = {"samplerCube",TYPE_SAMPLERCUBE, TGQ_I64, 8, 1, REGCLASS_SCALAR_I64},
 };
 
 // ============================================================================
-// TYPE CREATION
+// CANONICAL TYPES
 // ============================================================================
 
+// Every type exists exactly once, so types can be compared by pointer.
+// Builtin types live in a static table indexed by BuiltinType; derived
+// (array, struct, function) types are hash-consed into derived_types and
+// allocated from type_arena. Nothing here is freed before types_cleanup().
+
+static TypeInfo builtin_types[BUILTIN_TYPE_COUNT];
+
+#define DERIVED_TYPES_INITIAL_CAPACITY 64
+
+static struct {
+    TypeInfo **slots;
+    int capacity;
+    int count;
+} derived_types;
+
+static arena_t *type_arena = NULL;
+
 static TypeInfo *type_alloc(void) {
-    TypeInfo *t = calloc(1, sizeof(TypeInfo));
-    return t;
+    return arena_calloc(type_arena, 1, sizeof(TypeInfo));
 }
 
-static TypeInfo *type_create_basic(BaseType base, uint8_t tgq, int size,
-                                    int components, RegisterClass rc) {
-    TypeInfo *t = type_alloc();
-    t->base = base;
-    t->tgq_type = tgq;
-    t->size = size;
-    t->alignment = size > 4 ? 4 : size;
-    t->components = components;
-    t->reg_class = rc;
-    t->array_length = -1;
-    return t;
+static unsigned int hash_combine(unsigned int h, uintptr_t v) {
+    return (h ^ (unsigned int)(v ^ (v >> 32))) * 16777619u;
+}
+
+// Hash of the structural key of a derived type. Structs are nominal, so
+// only their (interned) name takes part.
+static unsigned int derived_hash(TypeInfo *t) {
+    unsigned int h = hash_combine(2166136261u, t->base);
+    switch (t->base) {
+        case TYPE_ARRAY:
+            h = hash_combine(h, (uintptr_t)t->element_type);
+            return hash_combine(h, (uintptr_t)t->array_length);
+        case TYPE_STRUCT:
+            return hash_combine(h, str_hash(t->struct_name));
+        case TYPE_FUNCTION:
+            h = hash_combine(h, (uintptr_t)t->return_type);
+            for (int i = 0; i < t->param_count; i++) {
+                h = hash_combine(h, (uintptr_t)t->param_types[i]);
+            }
+            return h;
+        default:
+            return h;
+    }
+}
+
+// Components of derived types are canonical already, so a shallow
+// comparison is enough
+static bool derived_equal(TypeInfo *a, TypeInfo *b) {
+    if (a->base != b->base) return false;
+
+    switch (a->base) {
+        case TYPE_ARRAY:
+            return a->element_type == b->element_type &&
+                   a->array_length == b->array_length;
+        case TYPE_STRUCT:
+            return a->struct_name == b->struct_name;
+        case TYPE_FUNCTION:
+            if (a->return_type != b->return_type) return false;
+            if (a->param_count != b->param_count) return false;
+            for (int i = 0; i < a->param_count; i++) {
+                if (a->param_types[i] != b->param_types[i]) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void derived_place(TypeInfo **slots, int capacity, TypeInfo *t) {
+    unsigned int mask = capacity - 1;
+    unsigned int i = derived_hash(t) & mask;
+    while (slots[i]) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = t;
+}
+
+static void derived_grow(void) {
+    int capacity = derived_types.capacity ? derived_types.capacity * 2
+                                          : DERIVED_TYPES_INITIAL_CAPACITY;
+    TypeInfo **slots = crt_calloc(capacity, sizeof(TypeInfo*));
+
+    for (int i = 0; i < derived_types.capacity; i++) {
+        if (derived_types.slots[i]) {
+            derived_place(slots, capacity, derived_types.slots[i]);
+        }
+    }
+
+    free(derived_types.slots);
+    derived_types.slots = slots;
+    derived_types.capacity = capacity;
+}
+
+// Find the canonical type structurally equal to `key`; NULL if none yet
+static TypeInfo *derived_find(TypeInfo *key) {
+    if (derived_types.capacity == 0) return NULL;
+
+    unsigned int mask = derived_types.capacity - 1;
+    unsigned int i = derived_hash(key) & mask;
+    TypeInfo *t;
+    while ((t = derived_types.slots[i]) != NULL) {
+        if (derived_equal(t, key)) {
+            return t;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void derived_insert(TypeInfo *t) {
+    if ((derived_types.count + 1) * 4 > derived_types.capacity * 3) {
+        derived_grow();
+    }
+    derived_place(derived_types.slots, derived_types.capacity, t);
+    derived_types.count++;
 }
 
 // ============================================================================
@@ -101,37 +205,43 @@ static TypeInfo *type_create_basic(BaseType base, uint8_t tgq, int size,
 // ============================================================================
 
 void types_init(void) {
-    // Create predefined types
-    TYPE_VOID_INFO  = type_create_basic(TYPE_VOID,  0,         0,  0, REGCLASS_NONE);
-    TYPE_BOOL_INFO  = type_create_basic(TYPE_BOOL,  TGQ_I8,    1,  1, REGCLASS_SCALAR_I8);
-    TYPE_INT_INFO   = type_create_basic(TYPE_INT,   TGQ_I32,   4,  1, REGCLASS_SCALAR_I32);
-    TYPE_FLOAT_INFO = type_create_basic(TYPE_FLOAT, TGQ_FP32,  4,  1, REGCLASS_SCALAR_FP32);
-    TYPE_FP16_INFO = type_create_basic(TYPE_FLOAT, TGQ_FP16,  2,  1, REGCLASS_SCALAR_FP16);
-    TYPE_VEC2_INFO  = type_create_basic(TYPE_VEC2,  TGQ_V4FP32,  16,  2, REGCLASS_VECTOR);
-    TYPE_VEC3_INFO  = type_create_basic(TYPE_VEC3,  TGQ_V4FP32, 16,  3, REGCLASS_VECTOR);
-    TYPE_VEC4_INFO  = type_create_basic(TYPE_VEC4,  TGQ_V4FP32, 16, 4, REGCLASS_VECTOR);
-    TYPE_IVEC2_INFO = type_create_basic(TYPE_IVEC2, TGQ_V4I32,   16,  2, REGCLASS_VECTOR);
-    TYPE_IVEC3_INFO = type_create_basic(TYPE_IVEC3, TGQ_V4I32,  16,  3, REGCLASS_VECTOR);
-    TYPE_IVEC4_INFO = type_create_basic(TYPE_IVEC4, TGQ_V4I32, 16, 4, REGCLASS_VECTOR);
-    TYPE_MAT2_INFO  = type_create_basic(TYPE_MAT2,  TGQ_FP32, 16,  4, REGCLASS_MATRIX);
-    TYPE_MAT3_INFO  = type_create_basic(TYPE_MAT3,  TGQ_FP32, 36,  9, REGCLASS_MATRIX);
-    TYPE_MAT4_INFO  = type_create_basic(TYPE_MAT4,  TGQ_FP32, 64, 16, REGCLASS_MATRIX);
+    type_arena = arena_new(16 * 1024);
+
+    for (int i = 0; i < BUILTIN_TYPE_COUNT; i++) {
+        TypeMapping *m = &type_mappings[i];
+        TypeInfo *t = &builtin_types[i];
+        t->base = m->base;
+        t->tgq_type = m->tgq_type;
+        t->size = m->size;
+        t->alignment = m->size > 4 ? 4 : m->size;
+        t->components = m->components;
+        t->reg_class = m->reg_class;
+        t->array_length = -1;
+    }
+
+    TYPE_VOID_INFO  = &builtin_types[BUILTIN_VOID];
+    TYPE_BOOL_INFO  = &builtin_types[BUILTIN_BOOL];
+    TYPE_INT_INFO   = &builtin_types[BUILTIN_INT];
+    TYPE_FLOAT_INFO = &builtin_types[BUILTIN_FLOAT];
+    TYPE_FP16_INFO  = &builtin_types[BUILTIN_FP16];
+    TYPE_VEC2_INFO  = &builtin_types[BUILTIN_VEC2];
+    TYPE_VEC3_INFO  = &builtin_types[BUILTIN_VEC3];
+    TYPE_VEC4_INFO  = &builtin_types[BUILTIN_VEC4];
+    TYPE_IVEC2_INFO = &builtin_types[BUILTIN_IVEC2];
+    TYPE_IVEC3_INFO = &builtin_types[BUILTIN_IVEC3];
+    TYPE_IVEC4_INFO = &builtin_types[BUILTIN_IVEC4];
+    TYPE_MAT2_INFO  = &builtin_types[BUILTIN_MAT2];
+    TYPE_MAT3_INFO  = &builtin_types[BUILTIN_MAT3];
+    TYPE_MAT4_INFO  = &builtin_types[BUILTIN_MAT4];
 }
 
 void types_cleanup(void) {
-    free(TYPE_VOID_INFO);
-    free(TYPE_BOOL_INFO);
-    free(TYPE_INT_INFO);
-    free(TYPE_FLOAT_INFO);
-    free(TYPE_VEC2_INFO);
-    free(TYPE_VEC3_INFO);
-    free(TYPE_VEC4_INFO);
-    free(TYPE_IVEC2_INFO);
-    free(TYPE_IVEC3_INFO);
-    free(TYPE_IVEC4_INFO);
-    free(TYPE_MAT2_INFO);
-    free(TYPE_MAT3_INFO);
-    free(TYPE_MAT4_INFO);
+    free(derived_types.slots);
+    memset(&derived_types, 0, sizeof(derived_types));
+    if (type_arena) {
+        arena_free(type_arena);
+        type_arena = NULL;
+    }
 }
 
 // ============================================================================
@@ -141,14 +251,10 @@ void types_cleanup(void) {
 TypeInfo *type_from_name(const char *name) {
     if (!name) return NULL;
 
-    for (int i = 0; type_mappings[i].name != NULL; i++) {
-        if (strcmp(name, type_mappings[i].name) == 0) {
-            TypeMapping *m = &type_mappings[i];
-            return type_create_basic(m->base, m->tgq_type, m->size,
-                                     m->components, m->reg_class);
-        }
-    }
-    return NULL;
+    const ReservedWord *word = reserved_lookup(name, strlen(name));
+    if (!word || word->kind != TOK_TYPE) return NULL;
+
+    return &builtin_types[word->builtin];
 }
 
 // ============================================================================
@@ -156,7 +262,15 @@ TypeInfo *type_from_name(const char *name) {
 // ============================================================================
 
 TypeInfo *type_make_array(TypeInfo *element, int length) {
-    TypeInfo *t = type_alloc();
+    TypeInfo key = {0};
+    key.base = TYPE_ARRAY;
+    key.element_type = element;
+    key.array_length = length;
+
+    TypeInfo *t = derived_find(&key);
+    if (t) return t;
+
+    t = type_alloc();
     t->base = TYPE_ARRAY;
     t->element_type = element;
     t->array_length = length;
@@ -164,23 +278,71 @@ TypeInfo *type_make_array(TypeInfo *element, int length) {
     t->alignment = element->alignment;
     t->components = length;
     t->reg_class = REGCLASS_NONE; // Arrays go to memory
+    derived_insert(t);
     return t;
 }
 
+TypeInfo *type_make_vector(TypeInfo *element, int components) {
+    if (components == 1) return element;
+    if (components < 2 || components > 4) return NULL;
+
+    if (element == TYPE_FLOAT_INFO) return &builtin_types[BUILTIN_VEC2 + components - 2];
+    if (element == TYPE_INT_INFO)   return &builtin_types[BUILTIN_IVEC2 + components - 2];
+    if (element == TYPE_BOOL_INFO)  return &builtin_types[BUILTIN_BVEC2 + components - 2];
+    return NULL;
+}
+
+TypeInfo *type_vector_element(TypeInfo *vector) {
+    switch (vector->base) {
+        case TYPE_VEC2:
+        case TYPE_VEC3:
+        case TYPE_VEC4:
+            return TYPE_FLOAT_INFO;
+        case TYPE_IVEC2:
+        case TYPE_IVEC3:
+        case TYPE_IVEC4:
+            return TYPE_INT_INFO;
+        case TYPE_BVEC2:
+        case TYPE_BVEC3:
+        case TYPE_BVEC4:
+            return TYPE_BOOL_INFO;
+        default:
+            return NULL;
+    }
+}
+
+TypeInfo *type_matrix_column(TypeInfo *matrix) {
+    switch (matrix->base) {
+        case TYPE_MAT2: return TYPE_VEC2_INFO;
+        case TYPE_MAT3: return TYPE_VEC3_INFO;
+        case TYPE_MAT4: return TYPE_VEC4_INFO;
+        default:        return NULL;
+    }
+}
+
+// Structs are identified by name: making a struct that already exists
+// returns the existing type.
 TypeInfo *type_make_struct(const char *name, StructField *fields, int field_count) {
-    TypeInfo *t = type_alloc();
+    TypeInfo key = {0};
+    key.base = TYPE_STRUCT;
+    key.struct_name = str_intern(name);
+
+    TypeInfo *t = derived_find(&key);
+    if (t) return t;
+
+    t = type_alloc();
     t->base = TYPE_STRUCT;
-    t->struct_name = strdup(name);
+    t->struct_name = key.struct_name;
 
-    StructInfo *s = calloc(1, sizeof(StructInfo));
-    s->name = strdup(name);
-    s->fields = malloc(sizeof(StructField) * field_count);
+    StructInfo *s = arena_calloc(type_arena, 1, sizeof(StructInfo));
+    s->name = t->struct_name;
+    s->fields = arena_alloc(type_arena, sizeof(StructField) * field_count);
     s->field_count = field_count;
 
     int offset = 0;
     int max_align = 1;
     for (int i = 0; i < field_count; i++) {
-        s->fields[i].name = strdup(fields[i].name);
+        s->fields[i].name = str_intern(fields[i].name);
         s->fields[i].type = fields[i].type;
 
         // Align field
@@ -200,16 +362,27 @@ TypeInfo *type_make_struct(const char *name, StructField *fields, int field_coun
     t->alignment = s->alignment;
     t->reg_class = REGCLASS_NONE;
 
+    derived_insert(t);
     return t;
 }
 
 TypeInfo *type_make_function(TypeInfo *return_type, TypeInfo **params, int param_count) {
-    TypeInfo *t = type_alloc();
+    TypeInfo key = {0};
+    key.base = TYPE_FUNCTION;
+    key.return_type = return_type;
+    key.param_types = params;
+    key.param_count = param_count;
+
+    TypeInfo *t = derived_find(&key);
+    if (t) return t;
+
+    t = type_alloc();
     t->base = TYPE_FUNCTION;
     t->return_type = return_type;
-    t->param_types = malloc(sizeof(TypeInfo*) * param_count);
-    memcpy(t->param_types, params, sizeof(TypeInfo*) * param_count);
+    t->param_types = arena_alloc(type_arena, sizeof(TypeInfo*) * param_count);
+    if (param_count) memcpy(t->param_types, params, sizeof(TypeInfo*) * param_count);
     t->param_count = param_count;
+    derived_insert(t);
     return t;
 }
 
@@ -217,27 +390,9 @@ TypeInfo *type_make_function(TypeInfo *return_type, TypeInfo **params, int param
 // TYPE CHECKING
 // ============================================================================
 
+// Types are canonical, so equal types are the same object
 bool types_equal(TypeInfo *a, TypeInfo *b) {
-    if (a == b) return true;
-    if (!a || !b) return false;
-    if (a->base != b->base) return false;
-
-    switch (a->base) {
-        case TYPE_ARRAY:
-            return a->array_length == b->array_length &&
-                   types_equal(a->element_type, b->element_type);
-        case TYPE_STRUCT:
-            return strcmp(a->struct_name, b->struct_name) == 0;
-        case TYPE_FUNCTION:
-            if (!types_equal(a->return_type, b->return_type)) return false;
-            if (a->param_count != b->param_count) return false;
-            for (int i = 0; i < a->param_count; i++) {
-                if (!types_equal(a->param_types[i], b->param_types[i])) return false;
-            }
-            return true;
-        default:
-            return true;
-    }
+    return a == b;
 }
 
 bool types_compatible(TypeInfo *a, TypeInfo *b) {
@@ -335,6 +490,11 @@ TypeInfo *type_binary_result(const char *op, TypeInfo *left, TypeInfo *right) {
         return TYPE_BOOL_INFO;
     }
 
+    // Arithmetic on equal types keeps the type (fp16 + fp16 is fp16)
+    if (left == right) {
+        return left;
+    }
+
     // Arithmetic: if either is float, result is float
     if (type_is_scalar(left) && type_is_scalar(right)) {
         if (left->base == TYPE_FLOAT || right->base == TYPE_FLOAT) {
@@ -401,32 +561,20 @@ TypeInfo *type_unary_result(const char *op, TypeInfo *operand) {
 TypeInfo *type_get_member(TypeInfo *type, const char *member) {
     if (!type || !member) return NULL;
 
-    // Struct member access
+    // Struct member access (field names and `member` are interned)
     if (type->base == TYPE_STRUCT && type->struct_info) {
         for (int i = 0; i < type->struct_info->field_count; i++) {
-            if (strcmp(type->struct_info->fields[i].name, member) == 0) {
+            if (type->struct_info->fields[i].name == member) {
                 return type->struct_info->fields[i].type;
             }
         }
         return NULL;
     }
 
-    // Vector swizzle
+    // Vector swizzle: .x is a scalar of the lane type, .xy a vector of the
+    // same kind
     if (type_is_vector(type)) {
-        int len = strlen(member);
-        if (len == 1) {
-            // Single component: .x, .y, .z, .w, .r, .g, .b, .a
-            return TYPE_FLOAT_INFO;
-        }
-        if (len == 2) {
-            return TYPE_VEC2_INFO;
-        }
-        if (len == 3) {
-            return TYPE_VEC3_INFO;
-        }
-        if (len == 4) {
-            return TYPE_VEC4_INFO;
-        }
+        return type_make_vector(type_vector_element(type), strlen(member));
     }
 
     return NULL;
@@ -452,7 +600,7 @@ SwizzleInfo *swizzle_parse(const char *pattern, int source_components) {
     int len = strlen(pattern);
     if (len == 0 || len > 4) return NULL;
 
-    SwizzleInfo *s = malloc(sizeof(SwizzleInfo));
+    SwizzleInfo *s = crt_malloc(sizeof(SwizzleInfo));
     s->count = len;
 
     for (int i = 0; i < len; i++) {
@@ -475,6 +623,19 @@ void swizzle_free(SwizzleInfo *s) {
 // TARGET TYPE MAPPING
 // ============================================================================
 
+const char *type_name(TypeInfo *t) {
+    if (!t) return "<unknown>";
+    if (t >= builtin_types && t < builtin_types + BUILTIN_TYPE_COUNT) {
+        return type_mappings[t - builtin_types].name;
+    }
+    switch (t->base) {
+        case TYPE_STRUCT:   return t->struct_name;
+        case TYPE_ARRAY:    return "array";
+        case TYPE_FUNCTION: return "function";
+        default:            return "<unknown>";
+    }
+}
+
 uint8_t type_to_tgq(TypeInfo *t) {
     if (!t) return TGQ_I32;
     return t->tgq_type;
@@ -485,17 +646,77 @@ RegisterClass type_register_class(TypeInfo *t) {
     return t->reg_class;
 }
 
+// IEEE binary16 from binary32, rounding to nearest even. Values past the
+// largest half overflow to infinity, tiny ones become subnormals or zero,
+// and NaNs stay quiet NaNs.
 uint16_t float32_to_fp16(float f) {
-    uint32_t x = *(uint32_t*)&f;
-    uint32_t sign = (x >> 16) & 0x8000;
-    uint32_t exponent = ((x >> 23) & 0xFF) - 127 + 15;
-    uint32_t mantissa = (x >> 13) & 0x3FF;
-
-    if (exponent <= 0) {
-        return sign;
-    } else if (exponent >= 31) {
-        return sign | 0x7C00;
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    uint16_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7FFFFFFF;
+
+    if (abs >= 0x7F800000) {
+        return sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 | ((abs >> 13) & 0x3FF) : 0);
+    }
+
+    uint32_t result, rest, half;
+    if (abs < 0x38800000) {
+        // Below 2^-14: a subnormal, counted in units of 2^-24
+        int shift = 126 - (int)(abs >> 23);
+        if (shift > 24) return sign;
+        uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+        result = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        half = 1u << (shift - 1);
+    } else {
+        result = (abs >> 13) - ((127 - 15) << 10);
+        rest = abs & 0x1FFF;
+        half = 0x1000;
+    }
+    if (rest > half || (rest == half && (result & 1))) result++;
+    if (result >= 0x7C00) result = 0x7C00;
+    return sign | (uint16_t)result;
+}
+
+float fp16_to_float32(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t x;
+
+    if (exponent == 0x1F) {
+        x = sign | 0x7F800000 | (mantissa << 13);
+    } else if (exponent) {
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    } else if (!mantissa) {
+        x = sign;
     } else {
-        return sign | (exponent << 10) | mantissa;
+        // Subnormal: normalize into a binary32 exponent
+        exponent = 127 - 14;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        x = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
     }
-}
\ No newline at end of file
+
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+// bfloat16 is the upper half of a binary32, rounded to nearest even
+uint16_t float32_to_bf16(float f) {
+    uint32_t x;
+    memcpy(&x, &f, 4);
+    if ((x & 0x7FFFFFFF) > 0x7F800000) return (uint16_t)((x >> 16) | 0x40);
+    x += 0x7FFF + ((x >> 16) & 1);
+    return (uint16_t)(x >> 16);
+}
+
+float bf16_to_float32(uint16_t b) {
+    uint32_t x = (uint32_t)b << 16;
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
@@ -70,14 +70,15 @@ typedef enum {
 typedef struct TypeInfo TypeInfo;
 typedef struct StructInfo StructInfo;
 
+// Struct, field and type names are interned strings (see str_intern)
 typedef struct StructField {
-    char *name;
+    const char *name;
     TypeInfo *type;
     int offset;              // Byte offset within struct
 } StructField;
 
 struct StructInfo {
-    char *name;
+    const char *name;
     StructField *fields;
     int field_count;
     int total_size;
@@ -95,7 +96,7 @@ struct TypeInfo {
     int array_length;        // -1 for unsized
 
     // For structs
-    char *struct_name;
+    const char *struct_name;
     StructInfo *struct_info;
 
     // For functions
@@ -125,16 +126,29 @@ typedef struct {
 void types_init(void);
 void types_cleanup(void);
 
-// Get type info from TGQL type name
+// All TypeInfo objects are canonical (one per distinct type) and owned by
+// the type system; equal types are the same pointer.
+
+// Get the builtin type for a TGQL type name (never allocates)
 TypeInfo *type_from_name(const char *name);
 
-// Create array type
+// Get the canonical array type
 TypeInfo *type_make_array(TypeInfo *element, int length);
 
-// Create struct type
+// Get the builtin vector type with `components` lanes of `element` (bool,
+// int or float); the element itself for one component, NULL if none exists
+TypeInfo *type_make_vector(TypeInfo *element, int components);
+
+// Lane type of a vector type
+TypeInfo *type_vector_element(TypeInfo *vector);
+
+// Column type of a matrix type (vecN for matN), NULL for other types
+TypeInfo *type_matrix_column(TypeInfo *matrix);
+
+// Get the canonical struct type (structs are identified by name)
 TypeInfo *type_make_struct(const char *name, StructField *fields, int field_count);
 
-// Create function type
+// Get the canonical function type
 TypeInfo *type_make_function(TypeInfo *return_type, TypeInfo **params, int param_count);
 
 // Type checking
@@ -151,20 +165,28 @@ TypeInfo *type_binary_result(const char *op, TypeInfo *left, TypeInfo *right);
 // Get result type for unary operation
 TypeInfo *type_unary_result(const char *op, TypeInfo *operand);
 
-// Get member type (for struct.field or vec.xy)
+// Get member type (for struct.field or vec.xy); `member` must be interned
 TypeInfo *type_get_member(TypeInfo *type, const char *member);
 
 // Parse swizzle pattern (xyz, rgb, stp)
 SwizzleInfo *swizzle_parse(const char *pattern, int source_components);
 void swizzle_free(SwizzleInfo *s);
 
+// TGQL spelling of a type, for diagnostics
+const char *type_name(TypeInfo *t);
+
 // Get TGQ type for a base type
 uint8_t type_to_tgq(TypeInfo *t);
 
 // Get register class for a type
 RegisterClass type_register_class(TypeInfo *t);
 
+// Bit-exact conversions between binary32 and the 16-bit float formats;
+// narrowing rounds to nearest even
 uint16_t float32_to_fp16(float f);
+float fp16_to_float32(uint16_t h);
+uint16_t float32_to_bf16(float f);
+float bf16_to_float32(uint16_t b);
 
 // Predefined types (initialized in types_init)
 extern TypeInfo *TYPE_VOID_INFO;
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+#
+# Compiler throughput benchmark. Generates synthetic TGQL programs with
+# tools/gen_bench_tgql.py, compiles each with -ftime-report=json and prints
+# per-stage throughput:
+#
+#   lex       tokens/s
+#   parse     tokens/s and AST nodes/s
+#   resolve   AST nodes/s
+#   codegen   AST nodes/s and emitted bytes/s
+#   emit      emitted bytes/s
+#
+#   make bench                               # default shapes and sizes
+#   python3 tools/bench.py ./bench.out --shapes loops,nesting --sizes 100,1000
+#   python3 tools/bench.py ./bench.out --json > results.json
+#
+# Every program is compiled --repeat times and the fastest run per stage is
+# kept, which filters out scheduling noise.
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_bench_tgql  # noqa: E402
+
+STAGES = ["lex", "parse", "resolve", "codegen", "emit"]
+
+# Which counters are meaningful as a rate for each stage
+STAGE_RATES = {
+    "lex": ["tokens"],
+    "parse": ["tokens", "ast_nodes"],
+    "resolve": ["ast_nodes"],
+    "codegen": ["ast_nodes", "emitted_bytes"],
+    "emit": ["emitted_bytes"],
+}
+
+DEFAULT_SIZES = {
+    "functions": [10, 100, 5000],
+    "nesting": [10, 100, 1000],
+    "structs": [16, 1024, 65536],
+    "uniforms": [10, 100, 5000],
+    "loops": [100, 1000, 10000],
+    "mixed": [64, 512, 2048],
+}
+
+
+def run_compiler(compiler, source, workdir):
+    # The AST dump goes to /dev/null; -a keeps the token dump from running.
+    # Codegen writes its output into the working directory.
+    result = subprocess.run(
+        [compiler, source, "-a", "-o", os.devnull, "-ftime-report=json"],
+        cwd=workdir, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+        universal_newlines=True)
+    if result.returncode != 0:
+        raise RuntimeError("%s failed (exit %d):\n%s" %
+                           (source, result.returncode, result.stderr[-2000:]))
+    start = result.stderr.rfind('{"source_bytes"')
+    if start < 0:
+        raise RuntimeError("%s: no time report in output" % source)
+    return json.loads(result.stderr[start:])
+
+
+def best_of(reports):
+    best = dict(reports[0])
+    best["phases"] = []
+    for i, stage in enumerate(STAGES):
+        runs = [r["phases"][i] for r in reports]
+        best["phases"].append(min(runs, key=lambda p: p["wall_ms"]))
+    return best
+
+
+def rates(report):
+    out = {}
+    for phase in report["phases"]:
+        seconds = max(phase["wall_ms"], 1e-6) / 1000.0
+        out[phase["name"]] = {
+            "wall_ms": phase["wall_ms"],
+            "rates": {k: report[k] / seconds for k in STAGE_RATES[phase["name"]]},
+        }
+    return out
+
+
+def human(value):
+    for unit in ["", "K", "M", "G"]:
+        if value < 1000.0:
+            return "%.1f%s" % (value, unit)
+        value /= 1000.0
+    return "%.1fT" % value
+
+
+def collect(args, parser, compiler, workdir, srcdir):
+    results = []
+    for shape in args.shapes.split(","):
+        if shape not in gen_bench_tgql.SHAPES:
+            parser.error("unknown shape '%s'" % shape)
+        sizes = ([int(s) for s in args.sizes.split(",")] if args.sizes
+                 else DEFAULT_SIZES[shape])
+        for size in sizes:
+            path = os.path.join(srcdir, "%s_%d.tgql" % (shape, size))
+            with open(path, "w") as f:
+                f.write(gen_bench_tgql.generate(shape, size, args.seed))
+            reports = [run_compiler(compiler, path, workdir) for _ in range(args.repeat)]
+            report = best_of(reports)
+            results.append({
+                "shape": shape,
+                "size": size,
+                "source_bytes": report["source_bytes"],
+                "tokens": report["tokens"],
+                "ast_nodes": report["ast_nodes"],
+                "emitted_bytes": report["emitted_bytes"],
+                "stages": rates(report),
+            })
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="TGQL compiler throughput benchmark")
+    parser.add_argument("compiler", help="path to the compiler binary")
+    parser.add_argument("--shapes", default=",".join(DEFAULT_SIZES),
+                        help="comma-separated shapes (default: all)")
+    parser.add_argument("--sizes", help="comma-separated sizes for every shape")
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", action="store_true", help="print results as JSON")
+    parser.add_argument("--keep", metavar="DIR", help="keep generated programs in DIR")
+    args = parser.parse_args()
+
+    compiler = os.path.abspath(args.compiler)
+    workdir = tempfile.mkdtemp(prefix="tgq-bench-")
+    srcdir = args.keep or workdir
+    os.makedirs(srcdir, exist_ok=True)
+
+    try:
+        results = collect(args, parser, compiler, workdir, srcdir)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+        return 0
+
+    labels = {"tokens": "tok/s", "ast_nodes": "nodes/s", "emitted_bytes": "B/s"}
+    for r in results:
+        print("%s %d: %d bytes, %d tokens, %d nodes, %d bytes emitted" %
+              (r["shape"], r["size"], r["source_bytes"], r["tokens"],
+               r["ast_nodes"], r["emitted_bytes"]))
+        for stage in STAGES:
+            s = r["stages"][stage]
+            cols = "  ".join("%8s %s" % (human(v), labels[k]) for k, v in s["rates"].items())
+            print("  %-8s %9.3f ms  %s" % (stage, s["wall_ms"], cols))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
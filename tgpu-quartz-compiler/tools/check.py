@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# Regression tests for the backend. Compiles every tests/*.tgql and
+# compares the --dump-ir output and the code section with the files
+# checked in under tests/expected:
+#
+#   <name>.ir     stdout of the compiler with --dump-ir
+#   <name>.code   .code.hex as a hex dump, 16 bytes per line
+#
+# A test runs once per `// run:` line at its top, with the flags after the
+# colon; `// run <label>:` names the run, whose files are then
+# <name>.<label>.ir and <name>.<label>.code. A test without run lines runs
+# once without flags.
+#
+#   make check
+#   python3 tools/check.py ./check.out                # every test
+#   python3 tools/check.py ./check.out phi_swap       # some of them
+#   python3 tools/check.py ./check.out --update       # rewrite expectations
+
+import argparse
+import difflib
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TESTS = os.path.join(ROOT, "tests")
+EXPECTED = os.path.join(TESTS, "expected")
+
+RUN_LINE = re.compile(r"^//\s*run(?:\s+(\w+))?\s*:(.*)$")
+
+
+def test_runs(source):
+    """(label, flags) for every run of a test, label None for the only one."""
+    runs = []
+    with open(source) as f:
+        for line in f:
+            m = RUN_LINE.match(line.strip())
+            if m:
+                runs.append((m.group(1), m.group(2).split()))
+            elif line.strip() and not line.startswith("//"):
+                break
+    return runs or [(None, [])]
+
+
+def hex_dump(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("%04x: %s\n" % (i, data[i:i + 16].hex()))
+    return "".join(lines)
+
+
+def compile_test(compiler, source, flags, workdir):
+    # The AST dump goes to /dev/null; -a keeps the token dump from running.
+    # Codegen writes .code.hex into the working directory.
+    result = subprocess.run(
+        [compiler, source, "-a", "-o", os.devnull, "--dump-ir"] + flags,
+        cwd=workdir, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True)
+    output = result.stdout
+    if result.returncode != 0:
+        output += "exit %d\n" % result.returncode
+    code_path = os.path.join(workdir, ".code.hex")
+    code = ""
+    if os.path.exists(code_path):
+        with open(code_path, "rb") as f:
+            code = hex_dump(f.read())
+        os.remove(code_path)
+    return output, code
+
+
+def check_file(path, actual, update):
+    """True if `path` holds `actual`; with `update`, makes it so."""
+    expected = None
+    if os.path.exists(path):
+        with open(path) as f:
+            expected = f.read()
+    if expected == actual:
+        return True
+    if update:
+        with open(path, "w") as f:
+            f.write(actual)
+        print("updated %s" % os.path.relpath(path, ROOT))
+        return True
+    if expected is None:
+        print("missing %s" % os.path.relpath(path, ROOT))
+        return False
+    name = os.path.relpath(path, ROOT)
+    sys.stdout.writelines(difflib.unified_diff(
+        expected.splitlines(True), actual.splitlines(True),
+        fromfile=name, tofile=name + " (actual)"))
+    return False
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Backend regression tests")
+    parser.add_argument("compiler", help="path to the compiler binary")
+    parser.add_argument("tests", nargs="*", help="test names (default: all)")
+    parser.add_argument("--update", action="store_true",
+                        help="rewrite the expected files from this compiler")
+    args = parser.parse_args()
+
+    compiler = os.path.abspath(args.compiler)
+    names = args.tests or sorted(
+        f[:-5] for f in os.listdir(TESTS) if f.endswith(".tgql"))
+    os.makedirs(EXPECTED, exist_ok=True)
+
+    workdir = tempfile.mkdtemp(prefix="tgq-check-")
+    failed = []
+    try:
+        for name in names:
+            source = os.path.join(TESTS, name + ".tgql")
+            for label, flags in test_runs(source):
+                stem = name if label is None else "%s.%s" % (name, label)
+                ir, code = compile_test(compiler, source, flags, workdir)
+                ok = check_file(os.path.join(EXPECTED, stem + ".ir"), ir, args.update)
+                ok &= check_file(os.path.join(EXPECTED, stem + ".code"), code, args.update)
+                print("%-6s %s" % ("ok" if ok else "FAIL", stem))
+                if not ok:
+                    failed.append(stem)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    if failed:
+        print("%d failed: %s" % (len(failed), " ".join(failed)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
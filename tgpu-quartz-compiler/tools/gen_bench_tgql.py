@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+#
+# Generates synthetic TGQL programs for the compiler benchmark
+# (tools/bench.py). Each shape stresses one part of the compiler and scales
+# linearly with `size`:
+#
+#   functions   `size` small functions with arithmetic bodies
+#   nesting     one function with an expression nested `size` levels deep
+#   structs     struct types and global arrays of structs with `size` elements
+#   uniforms    `size` uniform declarations read by one function
+#   loops       loops whose bodies hold `size` statements in total
+#   mixed       a realistic blend of all of the above
+#
+#   python3 tools/gen_bench_tgql.py functions 500 > functions.tgql
+#
+# The output stays inside what the frontend accepts today (no postfix ++,
+# no struct array fields) and only declares scalar variables, which the
+# backend can allocate. Integer and float values never mix, as the target
+# has no conversion between them.
+
+import random
+import sys
+
+SCALAR_TYPES = ["float", "int"]
+STATEMENTS_PER_LOOP = 1000
+
+
+def literal(ty, rng):
+    if ty == "int":
+        return str(rng.randint(0, 1000))
+    return "%d.%d" % (rng.randint(0, 100), rng.randint(0, 99))
+
+
+def expression(names, depth, rng, ty="float"):
+    """Random arithmetic expression of type `ty` over `names` with the given depth."""
+    if depth == 0 or not names:
+        if names and rng.random() < 0.7:
+            return rng.choice(names)
+        return literal(ty, rng)
+    op = rng.choice(["+", "-", "*", "/"])
+    left = expression(names, depth - 1, rng, ty)
+    right = expression(names, rng.randint(0, depth - 1), rng, ty)
+    if rng.random() < 0.3:
+        return "(%s %s %s)" % (left, op, right)
+    return "%s %s %s" % (left, op, right)
+
+
+def function(name, locals_count, rng, prefix):
+    out = ["float %s(float a, float b) {" % name]
+    names = {"float": ["a", "b"], "int": []}
+    for i in range(locals_count):
+        ty = rng.choice(SCALAR_TYPES)
+        var = "%s_%d" % (prefix, i)
+        out.append("    %s %s = %s;" % (ty, var, literal(ty, rng)))
+        out.append("    %s = %s;" % (var, expression(names[ty], 3, rng, ty)))
+        names[ty].append(var)
+    floats = names["float"]
+    out.append("    if (%s > %s) {" % (floats[-1], floats[0]))
+    out.append("        return %s;" % expression(floats, 2, rng))
+    out.append("    } else {")
+    out.append("        return vec4(%s, 0.0, 0.0, 1.0).x;" % floats[-1])
+    out.append("    }")
+    out.append("}")
+    return out
+
+
+def gen_functions(size, rng):
+    out = ["// %d functions" % size]
+    for f in range(size):
+        out += function("fn%d" % f, 4, rng, "v%d" % f)
+    return out
+
+
+def gen_nesting(size, rng):
+    expr = "x"
+    for i in range(size):
+        op = "+-*/"[i % 4]
+        expr = "(%s %s %s)" % (expr, op, literal("float", rng))
+    return [
+        "// expression nested %d levels deep" % size,
+        "float deep(float x) {",
+        "    float r = 0.0;",
+        "    r = %s;" % expr,
+        "    return r;",
+        "}",
+    ]
+
+
+def gen_structs(size, rng):
+    out = [
+        "struct Light { vec3 position; vec3 color; float intensity; float radius; };",
+        "struct Material { vec4 albedo; float roughness; float metallic; };",
+        "Light lights[%d];" % size,
+        "Material materials[%d];" % size,
+        "float shade(float k) {",
+        "    float total = 0.0;",
+        "    for (int i = 0; i < %d; i += 1) {" % size,
+        "        total += lights[i].intensity * materials[i].roughness * k;",
+        "        total += dot(lights[i].position, lights[i].color) / lights[i].radius;",
+        "    }",
+        "    return total;",
+        "}",
+    ]
+    return out
+
+
+def gen_uniforms(size, rng):
+    out = ["// %d uniforms" % size]
+    names = {"float": [], "int": []}
+    for i in range(size):
+        ty = rng.choice(SCALAR_TYPES)
+        names[ty].append("u%d" % i)
+        out.append("uniform %s u%d;" % (ty, i))
+    out.append("float sum_uniforms(float s) {")
+    out.append("    float acc = s;")
+    out.append("    int iacc = 0;")
+    for acc, ty in (("acc", "float"), ("iacc", "int")):
+        for i in range(0, len(names[ty]), 8):
+            out.append("    %s += %s;" % (acc, " + ".join(names[ty][i:i + 8])))
+    out.append("    if (iacc > 0) {")
+    out.append("        acc += 1.0;")
+    out.append("    }")
+    out.append("    return acc;")
+    out.append("}")
+    return out
+
+
+def gen_loops(size, rng):
+    out = ["// loops with %d statements in total" % size]
+    loops = max(1, (size + STATEMENTS_PER_LOOP - 1) // STATEMENTS_PER_LOOP)
+    per_loop = max(1, size // loops)
+    out.append("float loops(float x) {")
+    out.append("    float acc_l = x;")
+    out.append("    float t = 1.0;")
+    for l in range(loops):
+        out.append("    for (int i%d = 0; i%d < %d; i%d += 1) {" % (l, l, per_loop, l))
+        for _ in range(per_loop):
+            out.append("        acc_l = %s;" % expression(["acc_l", "t", "x"], 2, rng))
+        out.append("    }")
+        out.append("    while (acc_l > 100.0) { acc_l = acc_l / 2.0; }")
+    out.append("    return acc_l;")
+    out.append("}")
+    return out
+
+
+def gen_mixed(size, rng):
+    out = []
+    out += gen_uniforms(max(1, size // 4), rng)
+    out += gen_structs(max(1, size // 2), rng)
+    out += gen_functions(max(1, size // 8), rng)
+    out += gen_loops(max(1, size // 2), rng)
+    out += gen_nesting(max(1, size // 16), rng)
+    return out
+
+
+SHAPES = {
+    "functions": gen_functions,
+    "nesting": gen_nesting,
+    "structs": gen_structs,
+    "uniforms": gen_uniforms,
+    "loops": gen_loops,
+    "mixed": gen_mixed,
+}
+
+
+def generate(shape, size, seed=1):
+    rng = random.Random(seed)
+    return "\n".join(SHAPES[shape](size, rng)) + "\n"
+
+
+def main():
+    if len(sys.argv) < 3 or sys.argv[1] not in SHAPES:
+        sys.stderr.write("usage: %s {%s} <size> [seed]\n" %
+                         (sys.argv[0], "|".join(SHAPES)))
+        return 1
+    seed = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+    sys.stdout.write(generate(sys.argv[1], int(sys.argv[2]), seed))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
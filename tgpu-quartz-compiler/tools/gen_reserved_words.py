@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# Generates reserved_words.h: a collision-free (perfect) hash table over all
+# TGQL keywords and builtin type names, used by the lexer and by
+# type_from_name(). Re-run after changing the word lists:
+#
+#   python3 tools/gen_reserved_words.py > reserved_words.h
+#
+# The hash only looks at the length and the first, next-to-last and last
+# characters, so classifying an identifier costs one table probe and one
+# memcmp.
+
+import itertools
+import sys
+
+KEYWORDS = [
+    "if", "else", "for", "while", "do", "return", "break", "continue",
+    "const", "struct",
+    "uniform", "varying", "attribute",
+    "in", "out", "inout",
+    "precision", "mediump", "highp", "lowp",
+]
+
+TYPES = [
+    "void", "int", "float", "double", "bool", "char",
+    "fp16", "bf16", "bf32",
+    "vec2", "vec3", "vec4", "ivec2", "ivec3", "ivec4",
+    "bvec2", "bvec3", "bvec4",
+    "mat2", "mat3", "mat4",
+    "sampler2D", "sampler3D", "samplerCube",
+]
+
+HASH_SIZES = (64, 128, 256)
+MAX_COEFF = 32
+
+
+def word_hash(word, coeffs, size):
+    a, b, c, d = coeffs
+    h = len(word) * a + ord(word[0]) * b + ord(word[-2]) * c + ord(word[-1]) * d
+    return h & (size - 1)
+
+
+def find_hash(words):
+    for size in HASH_SIZES:
+        for coeffs in itertools.product(range(1, MAX_COEFF), repeat=4):
+            slots = {word_hash(w, coeffs, size) for w in words}
+            if len(slots) == len(words):
+                return size, coeffs
+    sys.exit("gen_reserved_words: no perfect hash found, raise MAX_COEFF")
+
+
+def main():
+    words = [(w, "TOK_KEYWORD", "-1") for w in KEYWORDS]
+    words += [(w, "TOK_TYPE", "BUILTIN_" + w.upper()) for w in TYPES]
+    assert min(len(w) for w, _, _ in words) >= 2
+
+    size, (a, b, c, d) = find_hash([w for w, _, _ in words])
+
+    out = sys.stdout
+    out.write("// Generated by tools/gen_reserved_words.py - do not edit.\n")
+    out.write("#pragma once\n\n")
+    out.write("#define RESERVED_HASH_SIZE %d\n" % size)
+    out.write("#define RESERVED_HASH(len, first, pen, last) \\\n")
+    out.write("    (((len) * %d + (first) * %d + (pen) * %d + (last) * %d) & (RESERVED_HASH_SIZE - 1))\n\n"
+              % (a, b, c, d))
+
+    out.write("static const ReservedWord reserved_words[] = {\n")
+    for word, kind, builtin in words:
+        out.write("    {%-14s %2d, %-11s %s},\n" % ('"%s",' % word, len(word), kind + ",", builtin))
+    out.write("};\n\n")
+
+    out.write("// Hash slot -> index into reserved_words + 1 (0 = empty slot)\n")
+    out.write("static const unsigned char reserved_slots[RESERVED_HASH_SIZE] = {\n")
+    slots = sorted((word_hash(w, (a, b, c, d), size), i) for i, (w, _, _) in enumerate(words))
+    for slot, i in slots:
+        out.write("    [%3d] = %2d,  // %s\n" % (slot, i + 1, words[i][0]))
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()